@@ -52,6 +52,24 @@ static void RomaJsonInputParsingTest(benchmark::State& state) {
   }
 }
 
+// Runs a handler that ignores its small input, so that the time in V8 is
+// mostly per-call overhead: getting a context, looking up the handler and
+// building its arguments.
+static void RomaTrivialHandlerTest(benchmark::State& state) {
+  TestConfiguration test_configuration = {
+      .inputs_type = InputsType::kSimpleString,
+      .input_payload_in_byte = 0,
+      .workers = 1,
+      .queue_size = 100,
+      .request_threads = 1,
+      .batch_size = static_cast<size_t>(state.range(0)),
+      .requests_per_thread = 100'000,
+  };
+  for (auto _ : state) {
+    RomaBenchmarkSuite(test_configuration);
+  }
+}
+
 static void RomaWorkerAndQueueTest(benchmark::State& state) {
   TestConfiguration test_configuration = {
       .inputs_type = InputsType::kSimpleString,
@@ -98,6 +116,7 @@ BENCHMARK(RomaPayloadTest)->RangeMultiplier(10)->Range(1, 1024 * 1024 * 10);
 BENCHMARK(RomaJsonInputParsingTest)->RangeMultiplier(10)->Range(1, 1000);
 BENCHMARK(RomaJsonInputParsingTest)->RangeMultiplier(10)->Range(1, 100'000);
 BENCHMARK(RomaPayloadTest)->DenseRange(0, 1024 * 1024, 1024 * 500);
+BENCHMARK(RomaTrivialHandlerTest)->Arg(1)->Arg(10);
 BENCHMARK(RomaWorkerAndQueueTest)->Apply(CustomArgumentsForWorkerAndQueueTest);
 BENCHMARK(RomaBatchSizeTest)->RangeMultiplier(10)->Range(1, 100);
 
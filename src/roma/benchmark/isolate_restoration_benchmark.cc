@@ -21,6 +21,7 @@
  * --test_output=all 2>&1 | grep -Ev "sandbox.cc|monitor_base.cc|sandbox2.cc"
  */
 
+#include <filesystem>
 #include <fstream>
 #include <memory>
 #include <regex>
@@ -186,6 +187,43 @@ void BM_LoadGlobal(benchmark::State& state) {
   }
 }
 
+// Measures loading code on the workers of a newly started service, which
+// restore the startup snapshot persisted by an earlier service if the startup
+// snapshot cache is enabled.
+void BM_ColdStartLoadGlobal(benchmark::State& state) {
+  auto length = state.range(0);
+  GlobalType type = static_cast<GlobalType>(state.range(1));
+  const bool enable_startup_snapshot_cache = state.range(2) != 0;
+  state.SetLabel(MakeLabel(type, length, state.name()));
+  const std::string code = GetGlobalVariableUdf(length, type);
+  const std::filesystem::path cache_directory =
+      std::filesystem::temp_directory_path() / "isolate_restoration_benchmark";
+  std::filesystem::create_directories(cache_directory);
+  const auto start_service = [&] {
+    typename RomaService<>::Config config;
+    config.number_of_workers = 2;
+    config.enable_startup_snapshot_cache = enable_startup_snapshot_cache;
+    config.startup_snapshot_cache_directory = cache_directory.string();
+    roma_service.reset(new RomaService<>(std::move(config)));
+    CHECK_OK(roma_service->Init());
+  };
+
+  // Persists the snapshot of the code.
+  start_service();
+  LoadCodeObj(code);
+  DoTeardown(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    start_service();
+    state.ResumeTiming();
+    LoadCodeObj(code);
+    state.PauseTiming();
+    DoTeardown(state);
+    state.ResumeTiming();
+  }
+  std::filesystem::remove_all(cache_directory);
+}
+
 void BM_ExecuteGlobal(::benchmark::State& state) {
   auto length = state.range(0);
   GlobalType type = static_cast<GlobalType>(state.range(1));
@@ -242,6 +280,15 @@ BENCHMARK(BM_LoadGlobal)
     ->ArgNames({kArgNames.begin(), kArgNames.end()})
     ->Setup(DoSetup)
     ->Teardown(DoTeardown);
+BENCHMARK(BM_ColdStartLoadGlobal)
+    ->ArgsProduct({benchmark::CreateRange(MIN_LENGTH, MAX_LENGTH, 8),
+                   {
+                       static_cast<int>(GlobalType::Structure),
+                       static_cast<int>(GlobalType::String),
+                   },
+                   {0, 1}})
+    ->ArgNames({"length", "type", "snapshot_cache"})
+    ->Iterations(10);
 BENCHMARK(BM_ExecuteGlobal)
     ->Name("BM_ExecuteGlobalNone")
     ->ArgsProduct({benchmark::CreateRange(1, 1, 2),
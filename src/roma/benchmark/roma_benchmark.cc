@@ -157,6 +157,10 @@ void GetMetricFromResponse(const ResponseObject& resp,
       it != resp.metrics.end()) {
     metrics.handler_calling_elapse = it->second;
   }
+
+  metrics.call_overhead_elapsed = metrics.v8_elapsed -
+                                  metrics.input_parsing_elapsed -
+                                  metrics.handler_calling_elapse;
 }
 }  // namespace
 
@@ -214,6 +218,7 @@ BenchmarkMetrics BenchmarkMetrics::GetMeanMetrics(
     mean_metric.v8_elapsed += metrics[i].v8_elapsed;
     mean_metric.input_parsing_elapsed += metrics[i].input_parsing_elapsed;
     mean_metric.handler_calling_elapse += metrics[i].handler_calling_elapse;
+    mean_metric.call_overhead_elapsed += metrics[i].call_overhead_elapsed;
   }
 
   mean_metric.total_execute_time /= num_metrics;
@@ -221,6 +226,7 @@ BenchmarkMetrics BenchmarkMetrics::GetMeanMetrics(
   mean_metric.v8_elapsed /= num_metrics;
   mean_metric.input_parsing_elapsed /= num_metrics;
   mean_metric.handler_calling_elapse /= num_metrics;
+  mean_metric.call_overhead_elapsed /= num_metrics;
 
   return mean_metric;
 }
@@ -334,6 +340,9 @@ void RomaBenchmark::ConsoleTestMetrics() {
             << " ns" << std::endl;
   std::cout << "\tHandler function calling elapsed: "
             << absl::ToInt64Nanoseconds(average_metric.handler_calling_elapse)
+            << " ns" << std::endl;
+  std::cout << "\tPer-call overhead elapsed: "
+            << absl::ToInt64Nanoseconds(average_metric.call_overhead_elapsed)
             << " ns\n"
             << std::endl;
 
@@ -406,6 +415,20 @@ void RomaBenchmark::ConsoleTestMetrics() {
                 << " ns" << std::endl;
     }
   }
+
+  {
+    std::sort(latency_metrics_.begin(), latency_metrics_.end(),
+              BenchmarkMetrics::CompareByCallOverheadElapsed);
+    std::cout << "Per-call overhead Elapsed: " << std::endl;
+    for (auto& p : kPercentiles) {
+      auto index = latency_metrics_.size() / 100 * p;
+
+      std::cout << "\t" << p << "th percentile: "
+                << absl::ToInt64Nanoseconds(
+                       latency_metrics_.at(index).call_overhead_elapsed)
+                << " ns" << std::endl;
+    }
+  }
 }
 
 void RomaBenchmark::SendRequestBatch() {
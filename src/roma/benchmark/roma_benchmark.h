@@ -95,6 +95,11 @@ struct BenchmarkMetrics {
   /// the request.
   absl::Duration handler_calling_elapse;
 
+  /// @brief The part of the V8 execution time spent neither parsing inputs
+  /// nor in the handler: getting a context, looking up the handler and
+  /// converting its result. Dominant for trivial handlers.
+  absl::Duration call_overhead_elapsed;
+
   static bool CompareByTotalExec(const BenchmarkMetrics& a,
                                  const BenchmarkMetrics& b) {
     return a.total_execute_time < b.total_execute_time;
@@ -120,6 +125,11 @@ struct BenchmarkMetrics {
     return a.handler_calling_elapse < b.handler_calling_elapse;
   }
 
+  static bool CompareByCallOverheadElapsed(const BenchmarkMetrics& a,
+                                           const BenchmarkMetrics& b) {
+    return a.call_overhead_elapsed < b.call_overhead_elapsed;
+  }
+
   static BenchmarkMetrics GetMeanMetrics(
       const std::vector<BenchmarkMetrics>& metrics);
 };
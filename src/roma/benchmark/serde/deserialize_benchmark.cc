@@ -30,6 +30,7 @@
 #include "src/roma/benchmark/serde/benchmark_service.pb.h"
 #include "src/roma/benchmark/serde/serde_utils.h"
 #include "src/roma/benchmark/test_code.h"
+#include "src/roma/value_serializer/value_serializer.h"
 
 namespace google::scp::roma::benchmark::proto {
 
@@ -57,6 +58,16 @@ void DeserializeJsonBenchmark(::benchmark::State& state,
   }
 }
 
+void DeserializeValueSerializerBenchmark(::benchmark::State& state,
+                                         std::string_view path) {
+  const std::string serialized_input =
+      value_serializer::SerializeValue(GetJsValueFromPath(path));
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(
+        value_serializer::DeserializeValue(serialized_input));
+  }
+}
+
 void BM_RomaJsDeserializeSmallProtobuf(::benchmark::State& state) {
   RunRomaJsBenchmark(state,
                      google::scp::roma::benchmark::kCodeDeserializeProtobuf,
@@ -120,6 +131,18 @@ void BM_CppDeserializeLargeJson(::benchmark::State& state) {
   DeserializeJsonBenchmark(state, kLargeJsonPath);
 }
 
+void BM_CppDeserializeSmallValueSerializer(::benchmark::State& state) {
+  DeserializeValueSerializerBenchmark(state, kSmallJsonPath);
+}
+
+void BM_CppDeserializeMediumValueSerializer(::benchmark::State& state) {
+  DeserializeValueSerializerBenchmark(state, kMediumJsonPath);
+}
+
+void BM_CppDeserializeLargeValueSerializer(::benchmark::State& state) {
+  DeserializeValueSerializerBenchmark(state, kLargeJsonPath);
+}
+
 BENCHMARK(BM_RomaJsDeserializeSmallProtobuf);
 BENCHMARK(BM_RomaJsDeserializeMediumProtobuf);
 BENCHMARK(BM_RomaJsDeserializeLargeProtobuf);
@@ -132,6 +155,9 @@ BENCHMARK(BM_CppDeserializeLargeProtobuf);
 BENCHMARK(BM_CppDeserializeSmallJson);
 BENCHMARK(BM_CppDeserializeMediumJson);
 BENCHMARK(BM_CppDeserializeLargeJson);
+BENCHMARK(BM_CppDeserializeSmallValueSerializer);
+BENCHMARK(BM_CppDeserializeMediumValueSerializer);
+BENCHMARK(BM_CppDeserializeLargeValueSerializer);
 
 }  // namespace google::scp::roma::benchmark::proto
 
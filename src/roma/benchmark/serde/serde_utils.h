@@ -19,6 +19,7 @@
 
 #include <fcntl.h>
 
+#include <fstream>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -38,6 +39,7 @@
 #include "src/roma/config/config.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_js_engine.h"
+#include "src/roma/value_serializer/value_serializer.h"
 
 #include "benchmark_service_romav8_app_service.h"
 
@@ -46,6 +48,7 @@ namespace google::scp::roma::benchmark::proto {
 using google::scp::roma::InvocationStrRequest;
 using google::scp::roma::ResponseObject;
 using google::scp::roma::sandbox::js_engine::v8_js_engine::V8JsEngine;
+using google::scp::roma::value_serializer::JsValue;
 using privacy_sandbox::benchmark::BenchmarkRequest;
 using privacy_sandbox::benchmark::V8BenchmarkService;
 
@@ -75,6 +78,42 @@ BenchmarkRequest GetProtoFromPath(std::string_view path) {
   return req;
 }
 
+JsValue JsonToJsValue(const nlohmann::json& json) {
+  switch (json.type()) {
+    case nlohmann::json::value_t::null:
+      return JsValue{nullptr};
+    case nlohmann::json::value_t::boolean:
+      return JsValue{json.get<bool>()};
+    case nlohmann::json::value_t::number_integer:
+    case nlohmann::json::value_t::number_unsigned:
+    case nlohmann::json::value_t::number_float:
+      return JsValue{json.get<double>()};
+    case nlohmann::json::value_t::string:
+      return JsValue{json.get<std::string>()};
+    case nlohmann::json::value_t::array: {
+      JsValue::Array array;
+      for (const nlohmann::json& element : json) {
+        array.push_back(JsonToJsValue(element));
+      }
+      return JsValue{std::move(array)};
+    }
+    case nlohmann::json::value_t::object: {
+      JsValue::Object object;
+      for (auto it = json.begin(); it != json.end(); ++it) {
+        object.emplace_back(it.key(), JsonToJsValue(it.value()));
+      }
+      return JsValue{std::move(object)};
+    }
+    default:
+      return JsValue{JsValue::Undefined{}};
+  }
+}
+
+JsValue GetJsValueFromPath(std::string_view path) {
+  std::ifstream input_file(path.data());
+  return JsonToJsValue(nlohmann::json::parse(input_file));
+}
+
 V8BenchmarkService<> CreateAppService() {
   google::scp::roma::Config config;
   config.number_of_workers = 2;
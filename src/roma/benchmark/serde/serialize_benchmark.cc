@@ -30,6 +30,7 @@
 #include "src/roma/benchmark/serde/benchmark_service.pb.h"
 #include "src/roma/benchmark/serde/serde_utils.h"
 #include "src/roma/benchmark/test_code.h"
+#include "src/roma/value_serializer/value_serializer.h"
 
 namespace google::scp::roma::benchmark::proto {
 
@@ -51,6 +52,14 @@ void SerializeJsonBenchmark(::benchmark::State& state, std::string_view path) {
   }
 }
 
+void SerializeValueSerializerBenchmark(::benchmark::State& state,
+                                       std::string_view path) {
+  const JsValue value = GetJsValueFromPath(path);
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(value_serializer::SerializeValue(value));
+  }
+}
+
 void BM_RomaJsSerializeSmallProtobuf(::benchmark::State& state) {
   RunRomaJsBenchmark(
       state, google::scp::roma::benchmark::kCodeSerializeProtobuf,
@@ -111,6 +120,18 @@ void BM_CppSerializeLargeJson(::benchmark::State& state) {
   SerializeJsonBenchmark(state, kLargeJsonPath);
 }
 
+void BM_CppSerializeSmallValueSerializer(::benchmark::State& state) {
+  SerializeValueSerializerBenchmark(state, kSmallJsonPath);
+}
+
+void BM_CppSerializeMediumValueSerializer(::benchmark::State& state) {
+  SerializeValueSerializerBenchmark(state, kMediumJsonPath);
+}
+
+void BM_CppSerializeLargeValueSerializer(::benchmark::State& state) {
+  SerializeValueSerializerBenchmark(state, kLargeJsonPath);
+}
+
 BENCHMARK(BM_RomaJsSerializeSmallProtobuf);
 BENCHMARK(BM_RomaJsSerializeMediumProtobuf);
 BENCHMARK(BM_RomaJsSerializeLargeProtobuf);
@@ -123,6 +144,9 @@ BENCHMARK(BM_CppSerializeLargeProtobuf);
 BENCHMARK(BM_CppSerializeSmallJson);
 BENCHMARK(BM_CppSerializeMediumJson);
 BENCHMARK(BM_CppSerializeLargeJson);
+BENCHMARK(BM_CppSerializeSmallValueSerializer);
+BENCHMARK(BM_CppSerializeMediumValueSerializer);
+BENCHMARK(BM_CppSerializeLargeValueSerializer);
 
 }  // namespace google::scp::roma::benchmark::proto
 
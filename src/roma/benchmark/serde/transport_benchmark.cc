@@ -0,0 +1,125 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Measures the round trip of a request through a UDF that returns its input,
+ * with the input and output crossing between host and isolate as JSON text or
+ * in the V8 ValueSerializer wire format.
+ *
+ * Example command to run this (the grep is necessary to avoid noisy log
+ * output):
+ *
+ * builders/tools/bazel-debian run \
+ * //src/roma/benchmark/serde:transport_benchmark \
+ * --test_output=all 2>&1 | grep -Ev "sandbox.cc|monitor_base.cc|sandbox2.cc"
+ */
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "absl/synchronization/notification.h"
+#include "src/roma/benchmark/serde/serde_utils.h"
+#include "src/roma/interface/roma.h"
+#include "src/roma/value_serializer/value_serializer.h"
+
+namespace google::scp::roma::benchmark::proto {
+namespace {
+
+constexpr std::string_view kCodeEcho = R"(
+    function EchoFunc(req) {
+      return req;
+    };
+)";
+constexpr std::string_view kHandlerNameEchoFunc = "EchoFunc";
+
+void RunTransportBenchmark(::benchmark::State& state, std::string_view path,
+                           bool use_value_serializer) {
+  V8BenchmarkService<> app_svc = CreateAppService();
+  LoadCodeObj(app_svc, kCodeEcho);
+
+  std::string input;
+  if (use_value_serializer) {
+    input = value_serializer::SerializeValue(GetJsValueFromPath(path));
+  } else {
+    std::ifstream input_file(path.data());
+    input = nlohmann::json::parse(input_file).dump();
+  }
+
+  for (auto _ : state) {
+    absl::Notification execute_finished;
+    auto execution_obj =
+        std::make_unique<InvocationStrRequest<>>(InvocationStrRequest<>{
+            .id = "foo",
+            .version_string = std::string(kCodeVersion),
+            .handler_name = std::string(kHandlerNameEchoFunc),
+            .input = {input},
+            .use_value_serializer = use_value_serializer,
+        });
+    CHECK_OK(app_svc.GetRomaService()->Execute(
+        std::move(execution_obj), [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          // Read the response back, as a caller would.
+          if (use_value_serializer) {
+            ::benchmark::DoNotOptimize(
+                value_serializer::DeserializeValue(resp->resp));
+          } else {
+            ::benchmark::DoNotOptimize(nlohmann::json::parse(resp->resp));
+          }
+          execute_finished.Notify();
+        }));
+    CHECK(execute_finished.WaitForNotificationWithTimeout(kTimeout));
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_TransportSmallJson(::benchmark::State& state) {
+  RunTransportBenchmark(state, kSmallJsonPath, /*use_value_serializer=*/false);
+}
+
+void BM_TransportMediumJson(::benchmark::State& state) {
+  RunTransportBenchmark(state, kMediumJsonPath, /*use_value_serializer=*/false);
+}
+
+void BM_TransportLargeJson(::benchmark::State& state) {
+  RunTransportBenchmark(state, kLargeJsonPath, /*use_value_serializer=*/false);
+}
+
+void BM_TransportSmallValueSerializer(::benchmark::State& state) {
+  RunTransportBenchmark(state, kSmallJsonPath, /*use_value_serializer=*/true);
+}
+
+void BM_TransportMediumValueSerializer(::benchmark::State& state) {
+  RunTransportBenchmark(state, kMediumJsonPath, /*use_value_serializer=*/true);
+}
+
+void BM_TransportLargeValueSerializer(::benchmark::State& state) {
+  RunTransportBenchmark(state, kLargeJsonPath, /*use_value_serializer=*/true);
+}
+
+BENCHMARK(BM_TransportSmallJson);
+BENCHMARK(BM_TransportMediumJson);
+BENCHMARK(BM_TransportLargeJson);
+BENCHMARK(BM_TransportSmallValueSerializer);
+BENCHMARK(BM_TransportMediumValueSerializer);
+BENCHMARK(BM_TransportLargeValueSerializer);
+
+}  // namespace
+}  // namespace google::scp::roma::benchmark::proto
+
+// Run the benchmark
+BENCHMARK_MAIN();
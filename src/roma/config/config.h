@@ -20,6 +20,7 @@
 #include <stddef.h>
 
 #include <cmath>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -29,6 +30,7 @@
 
 #include <grpcpp/impl/service_type.h>
 
+#include "absl/time/time.h"
 #include "src/roma/config/function_binding_object_v2.h"
 #include "src/roma/native_function_grpc_server/interface.h"
 #include "src/roma/native_function_grpc_server/proto/callback_service.grpc.pb.h"
@@ -81,6 +83,23 @@ struct V8CompilerOptions {
   bool enable_turboshaft = true;
 };
 
+/**
+ * @brief The resources used by each invocation that workers can report in its
+ * ResponseObject. Combined as a bitmask in Config::invocation_resource_metrics.
+ */
+enum InvocationResourceMetric : uint32_t {
+  /// The CPU time of the worker thread running the invocation, in metrics.
+  kInvocationCpuTime = 1 << 0,
+  /// The bytes allocated on the V8 heap and the peak size of the heap in use,
+  /// in counters.
+  kInvocationHeapUsage = 1 << 1,
+  /// The number of native function calls, in counters, and the time spent
+  /// waiting for their responses, in metrics.
+  kInvocationNativeFunctionCalls = 1 << 2,
+  /// The total size of the inputs and the size of the output, in counters.
+  kInvocationIoBytes = 1 << 3,
+};
+
 template <typename T = DefaultMetadata>
 class Config {
  public:
@@ -99,10 +118,112 @@ class Config {
    */
   size_t number_of_workers = 0;
 
+  /**
+   * @brief The number of workers that are started at once. Each worker
+   * launches a sandbox and boots a JS engine, so starting them concurrently
+   * shortens startup. If left at zero, as many workers as there are host CPUs
+   * are started at once.
+   *
+   */
+  size_t worker_startup_parallelism = 0;
+
+  /**
+   * @brief Start only min_number_of_workers workers at first, and start more,
+   * one at a time and up to number_of_workers, while invocations wait for a
+   * worker. Each worker started that way loads every code object loaded so
+   * far, and is stopped again once it has had no work for
+   * elastic_worker_idle_stop_delay. The number of running workers is reported
+   * in ResponseObject::counters.
+   *
+   */
+  bool enable_elastic_workers = false;
+
+  /**
+   * @brief The number of workers that are always running. Only used when
+   * enable_elastic_workers is true.
+   *
+   */
+  size_t min_number_of_workers = 1;
+
+  /**
+   * @brief How long a worker started on demand may have no work before it is
+   * stopped. Only used when enable_elastic_workers is true.
+   *
+   */
+  absl::Duration elastic_worker_idle_stop_delay = absl::Seconds(30);
+
+  /**
+   * @brief The maximum number of code versions each worker holds. Zero means
+   * no limit. Once it is exceeded, the least recently invoked versions are
+   * dropped from the workers, and are loaded again by the first invocation of
+   * them on each worker. Dropped versions are not reloaded after a worker
+   * crashes. Use RomaService::UnloadCodeObj to drop a version for good.
+   *
+   */
+  size_t max_loaded_code_versions = 0;
+
+  /**
+   * @brief The maximum total size of the code, WASM modules and startup
+   * snapshots of the code versions each worker holds, evicted as for
+   * max_loaded_code_versions. Zero means no limit.
+   *
+   */
+  size_t max_loaded_code_bytes = 0;
+
   /// @brief The size of worker queue, which caches the requests. Worker could
   /// process the item in the queue one by one. The default queue size is 100.
   size_t worker_queue_max_items = 0;
 
+  /// @brief The worker queue size for urgent and bulk invocation requests,
+  /// which are capped separately from normal ones. Zero means the same as
+  /// worker_queue_max_items.
+  size_t urgent_worker_queue_max_items = 0;
+  size_t bulk_worker_queue_max_items = 0;
+
+  /**
+   * @brief Route each invocation to the worker that most recently ran the same
+   * code version, so that it runs on a warm compilation context. Hit and miss
+   * counts are reported in ResponseObject::counters.
+   *
+   */
+  bool enable_code_version_affinity = false;
+
+  /**
+   * @brief How long an invocation routed by code version affinity may wait for
+   * its preferred worker before any idle worker may take it. Only used when
+   * enable_code_version_affinity is true.
+   *
+   */
+  absl::Duration code_version_affinity_max_delay = absl::Milliseconds(5);
+
+  /**
+   * @brief How long BatchExecute waits for the dispatcher to have room for
+   * the requests of a batch. If the first request cannot be queued in time,
+   * BatchExecute fails with a ResourceExhaustedError whose retry-after hint
+   * can be read with RomaService::GetRetryAfter. If a later request cannot,
+   * it and the rest of the batch get that error as their response.
+   *
+   */
+  absl::Duration batch_execute_admission_timeout = absl::InfiniteDuration();
+
+  /**
+   * @brief Run each BatchExecute batch whose requests all share a code version
+   * and handler name with a single call into the sandbox per worker, instead
+   * of dispatching every request on its own. JavaScript requests of such a
+   * batch run in a single v8 context, so the global object of the code is
+   * shared between them. Large batches are split across the workers.
+   *
+   */
+  bool enable_native_batch_execution = false;
+
+  /**
+   * @brief The smallest number of requests a native batch is split into when
+   * it is spread across the workers. Only used when
+   * enable_native_batch_execution is true.
+   *
+   */
+  size_t native_batch_execution_min_chunk_size = 16;
+
   /**
    * @brief The maximum number of pages that the WASM memory can use. Each page
    * is 64KiB. Will be clamped to 65536 (4GiB) if larger. If left at zero, the
@@ -111,6 +232,83 @@ class Config {
    */
   size_t max_wasm_memory_number_of_pages = 0;
 
+  /**
+   * @brief The number of idle v8 contexts each worker keeps, and pre-warms on
+   * load, per loaded code version. Invocations take a context from the pool
+   * instead of creating a new one, and give it back once they succeed.
+   * Invocations running in a reused context share its global object, so state
+   * a UDF leaves in globals is visible to later invocations. If left at zero,
+   * every invocation runs in a new context.
+   *
+   */
+  size_t js_engine_context_pool_size = 0;
+
+  /**
+   * @brief The number of invocations after which a pooled v8 context is
+   * dropped, so that a new one is created in its place. If left at zero, pooled
+   * contexts are reused without limit.
+   *
+   */
+  size_t js_engine_context_max_uses = 0;
+
+  /**
+   * @brief The resource usage each invocation reports in its ResponseObject,
+   * as a bitmask of InvocationResourceMetric. Usage is only sampled at the
+   * start and the end of each invocation, around native function calls and
+   * whenever V8 collects garbage, so it is cheap enough to leave on. If left
+   * at zero, none is reported.
+   *
+   */
+  uint32_t invocation_resource_metrics = 0;
+
+  /**
+   * @brief Collect the garbage of a worker's isolates while the worker is
+   * idle, instead of leaving it to collections that pause invocations. A
+   * worker that has had no work for js_engine_idle_gc_delay runs a full
+   * collection in each isolate whose heap has grown well beyond the live set
+   * left by the previous one. Isolates created afterwards start with a heap
+   * of the largest such live set, unless the initial heap size is configured.
+   * The time invocations spend paused for garbage collection is reported in
+   * ResponseObject::metrics either way.
+   *
+   */
+  bool enable_js_engine_idle_gc = false;
+
+  /**
+   * @brief How long a worker must have been idle before it collects garbage.
+   * Only used when enable_js_engine_idle_gc is true.
+   *
+   */
+  absl::Duration js_engine_idle_gc_delay = absl::Milliseconds(100);
+
+  /**
+   * @brief Enable a cache of the V8 startup snapshots workers create when
+   * loading JavaScript code, keyed by a hash of the code. Workers loading code
+   * that is in the cache, including workers reloaded after a crash, restore
+   * the snapshot instead of compiling the code again. Ignored when requests
+   * and responses are shared with the Buffer only, since a snapshot may not
+   * fit into it.
+   *
+   */
+  bool enable_startup_snapshot_cache = false;
+
+  /**
+   * @brief The maximum total size in bytes of the startup snapshots held in
+   * memory. The oldest snapshots are evicted first.
+   *
+   */
+  size_t startup_snapshot_cache_max_size_bytes = 256 * 1024 * 1024;
+
+  /**
+   * @brief If not empty, the directory in which startup snapshots are also
+   * persisted, so that restarted services restore them too. Snapshots only
+   * work with the V8 build, V8 flags and function bindings they were created
+   * with, so services only restore the snapshots persisted by services that
+   * match them in all of these.
+   *
+   */
+  std::string startup_snapshot_cache_directory;
+
   /**
    * @brief Enable a memory check that will be performed upon initialization.
    * If not enough memory is available, the service will fail to start.
@@ -145,6 +343,14 @@ class Config {
    */
   bool enable_metadata_storage = true;
 
+  /**
+   * @brief Register the ROMA_EMIT_CHUNK(string) function, through which UDFs
+   * run by RomaService::ExecuteStreaming hand chunks of their output to the
+   * host as they produce them, instead of returning all of it at once.
+   *
+   */
+  bool enable_response_streaming = false;
+
   /**
    * @brief Enable cancellation of callbacks for requests that are currently
    * executing.
@@ -152,6 +358,15 @@ class Config {
    */
   bool skip_callback_for_cancelled = true;
 
+  /**
+   * @brief The number of host threads that run the C++ functions of function
+   * bindings, shared by all workers. A single thread receives the calls of all
+   * workers and queues them for these threads. If zero, one thread per worker
+   * is used.
+   *
+   */
+  size_t function_binding_concurrency = 0;
+
   /**
    * @brief Function that can be set to overwrite the default memory check
    * threshold. If this function returns a value that is equal to or smaller
@@ -182,6 +397,17 @@ class Config {
    */
   size_t sandbox_request_response_shared_buffer_size_mb = 0;
 
+  /**
+   * @brief The number of slots of the sandbox data shared buffer per worker,
+   * each of them of sandbox_request_response_shared_buffer_size_mb. With more
+   * than one slot, a worker pipelines requests: the next request is written
+   * into a free slot while the sandbox runs the current one, at the cost of
+   * one buffer of memory per slot. The sandbox still runs one request at a
+   * time.
+   *
+   */
+  int sandbox_request_response_shared_buffer_slot_count = 1;
+
   /**
    * @brief The flag that allows the sandbox to communicate only with the
    * buffer. Roma performs better when the sandbox communicates with the buffer
@@ -194,6 +420,27 @@ class Config {
    */
   bool enable_sandbox_sharing_request_response_with_buffer_only = false;
 
+  /**
+   * @brief The flag that shares requests and responses with the sandbox as raw
+   * length-prefixed regions of the buffer instead of serialized protobufs. Only
+   * a small control header is serialized, and the sandbox reads the inputs in
+   * place, which saves copying large inputs and responses. Requests that do
+   * not fit into the buffer fall back to sharing by bytes, unless
+   * enable_sandbox_sharing_request_response_with_buffer_only is set.
+   *
+   */
+  bool enable_sandbox_sharing_request_response_with_raw_layout = false;
+
+  /**
+   * @brief Keep a spare sandbox per worker, initialized and started in the
+   * background, so that a worker whose sandbox dies gets the spare swapped in
+   * instead of waiting for a new sandbox and JS engine to start. Code loaded
+   * into the worker is still loaded again afterwards. Doubles the number of
+   * sandbox processes.
+   *
+   */
+  bool enable_spare_worker_sandbox = false;
+
   using FunctionBindingObjectPtr =
       std::shared_ptr<FunctionBindingObjectV2<TMetadata>>;
 
@@ -19,6 +19,7 @@
 
 #include <functional>
 #include <string>
+#include <string_view>
 
 #include "absl/container/flat_hash_map.h"
 #include "src/roma/interface/function_binding_io.pb.h"
@@ -41,6 +42,12 @@ struct FunctionBindingPayload {
    * outside of sandbox.
    */
   const TMetadata& metadata;
+
+  /**
+   * @brief The handle of the invocation request that called the function, as
+   * in its ExecutionToken. Empty if unknown.
+   */
+  std::string_view request_uuid = {};
 };
 
 template <typename TMetadata = DefaultMetadata>
@@ -55,6 +62,14 @@ class FunctionBindingObjectV2 {
    * @brief The function that will be bound to a Javascript function.
    */
   std::function<void(FunctionBindingPayload<TMetadata>&)> function;
+
+  /**
+   * @brief Whether the Javascript function returns a Promise instead of
+   * blocking until the C++ function returns. The C++ function runs on a host
+   * thread pool, so several calls of a UDF can be in flight at once and
+   * complete in any order.
+   */
+  bool is_async = false;
 };
 
 }  // namespace google::scp::roma
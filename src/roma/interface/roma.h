@@ -17,14 +17,17 @@
 #ifndef ROMA_INTERFACE_ROMA_H_
 #define ROMA_INTERFACE_ROMA_H_
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/time/time.h"
 #include "src/roma/config/function_binding_object_v2.h"
@@ -47,6 +50,16 @@ inline constexpr std::string_view kWasmCodeArrayName =
 inline constexpr std::string_view kDefaultRomaRequestId =
     "roma.defaults.request.id";
 
+/// @brief Dispatch priority of an invocation request. Each priority has its
+/// own queue and cap on pending requests, and workers take requests from the
+/// queues in weighted turns that favour the more urgent ones.
+enum class InvocationPriority {
+  kUrgent = 0,
+  kNormal = 1,
+  kBulk = 2,
+};
+inline constexpr int kNumInvocationPriorities = 3;
+
 // The code object containing untrusted code to be loaded into the Worker.
 struct CodeObject {
   // The id of the code object.
@@ -101,12 +114,34 @@ struct InvocationRequest {
   // to allow for byte string inputs to ROMA.
   bool treat_input_as_byte_str = false;
 
+  // Treat the first element in `input` as a value in the V8 ValueSerializer
+  // wire format instead of JSON, and return the result of the handler in that
+  // format in ResponseObject::resp. Input must be of length 1. Numeric arrays
+  // and deeply nested objects cross far more cheaply than as JSON text. See
+  // src/roma/value_serializer for building and reading values without V8.
+  bool use_value_serializer = false;
+
+  // Parse each element of `input` once per worker and hand the parsed value,
+  // deeply frozen, to every invocation that passes the same element. Useful
+  // when many requests share large read-only inputs. Handlers must not mutate
+  // their inputs. The objects and arrays of shared inputs have no prototype,
+  // so array methods are only available on copies such as Array.from(list).
+  bool share_parsed_input = false;
+
   // Minimum logging level for UDF logs associated with this InvocationRequest.
   // All logs with severity < min_log_level will be no-ops in the sandbox,
   // preventing the logging function registered on RomaService from being
   // invoked.
   absl::LogSeverity min_log_level = absl::LogSeverity::kInfo;
 
+  // If the request is still waiting to be dispatched to a worker at this time,
+  // it fails with a DeadlineExceededError instead of running. Otherwise the
+  // execution timeout is capped at the time left until the deadline.
+  absl::Time deadline = absl::InfiniteFuture();
+
+  // The priority with which the request is dispatched to a worker.
+  InvocationPriority priority = InvocationPriority::kNormal;
+
   // Any server-side metadata associated with this code object. This metadata is
   // passed into native functions without entering SAPI Sandbox and v8.
   TMetadata metadata;
@@ -130,6 +165,9 @@ struct ResponseObject {
   std::string profiler_output;
   // Execution metrics. Any key should be checked for existence.
   absl::flat_hash_map<std::string, absl::Duration> metrics;
+  // Execution counters, for metrics that are not durations. Any key should be
+  // checked for existence.
+  absl::flat_hash_map<std::string, int64_t> counters;
 };
 
 using Callback = absl::AnyInvocable<void(absl::StatusOr<ResponseObject>)>;
@@ -138,6 +176,11 @@ using Callback = absl::AnyInvocable<void(absl::StatusOr<ResponseObject>)>;
 // void Callback(vector<ResponseObject>);
 using BatchCallback =
     absl::AnyInvocable<void(std::vector<absl::StatusOr<ResponseObject>>)>;
+
+// Streaming API
+// Receives each chunk of output a UDF emits, in order. Returning an error
+// makes the call that emitted the chunk throw in the UDF.
+using ChunkCallback = absl::AnyInvocable<absl::Status(std::string_view chunk)>;
 }  // namespace google::scp::roma
 
 #endif  // ROMA_INTERFACE_ROMA_H_
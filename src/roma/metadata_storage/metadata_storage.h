@@ -17,31 +17,218 @@
 #ifndef ROMA_METADATA_STORAGE_METADATA_STORAGE_H_
 #define ROMA_METADATA_STORAGE_METADATA_STORAGE_H_
 
-#include <string>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
-#include "src/roma/metadata_storage/thread_safe_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "src/roma/metadata_storage/request_handle.h"
 
 namespace google::scp::roma::metadata_storage {
 
-// MetadataStorage acts as a thin wrapper around ThreadSafeMap, providing a
-// simplified interface for metadata operations.
+template <typename TMetadata>
+class ScopedMetadataReader;
+
+// Stores the metadata of in-flight invocation requests in a slab of slots,
+// each addressed by the RequestHandle returned from Add.
+//
+// Slots are spread over kNumShards shards that each keep their own free list,
+// and a slot is reused once its request is deleted, so in steady state Add and
+// Delete neither allocate nor take a lock shared by all requests. Lookups
+// index straight into the slab and only lock the slot.
 template <typename TMetadata>
 class MetadataStorage {
  public:
-  absl::Status Add(std::string key, TMetadata val) {
-    return metadata_storage_.Add(std::move(key), std::move(val));
+  MetadataStorage() = default;
+
+  MetadataStorage(const MetadataStorage&) = delete;
+  MetadataStorage& operator=(const MetadataStorage&) = delete;
+
+  ~MetadataStorage() {
+    for (Shard& shard : shards_) {
+      for (std::atomic<Chunk*>& chunk : shard.chunks) {
+        delete chunk.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Stores `val` and returns the handle under which it can be read and
+  // deleted.
+  absl::StatusOr<RequestHandle> Add(TMetadata val) {
+    const uint32_t shard_index =
+        next_shard_.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+    Shard& shard = shards_[shard_index];
+    uint32_t position;
+    {
+      absl::MutexLock lock(&shard.mutex);
+      if (!shard.free_positions.empty()) {
+        position = shard.free_positions.back();
+        shard.free_positions.pop_back();
+      } else if (shard.num_positions == kMaxPositionsPerShard) {
+        return absl::ResourceExhaustedError(
+            "Too many invocation requests in flight to store metadata");
+      } else {
+        position = shard.num_positions++;
+        if (position % kSlotsPerChunk == 0) {
+          shard.chunks[position / kSlotsPerChunk].store(
+              new Chunk(), std::memory_order_release);
+        }
+      }
+    }
+    Slot& slot = GetSlot(shard, position);
+    absl::MutexLock lock(&slot.mutex);
+    slot.value.emplace(std::move(val));
+    return RequestHandle(slot.generation, position * kNumShards + shard_index);
+  }
+
+  // Removes the metadata of `handle`, waiting for readers of it to finish.
+  absl::Status Delete(RequestHandle handle) {
+    Slot* slot = FindSlot(handle);
+    if (slot == nullptr) {
+      return absl::NotFoundError("Metadata could not be found");
+    }
+    {
+      absl::MutexLock lock(&slot->mutex);
+      if (!slot->value.has_value() || slot->generation != handle.generation()) {
+        return absl::NotFoundError("Metadata could not be found");
+      }
+      slot->value.reset();
+      ++slot->generation;
+    }
+    Shard& shard = shards_[handle.index() % kNumShards];
+    absl::MutexLock lock(&shard.mutex);
+    shard.free_positions.push_back(handle.index() / kNumShards);
+    return absl::OkStatus();
+  }
+
+ private:
+  friend class ScopedMetadataReader<TMetadata>;
+
+  static constexpr uint32_t kNumShards = 16;
+  static constexpr uint32_t kSlotsPerChunk = 1024;
+  static constexpr uint32_t kMaxChunksPerShard = 1024;
+  static constexpr uint32_t kMaxPositionsPerShard =
+      kSlotsPerChunk * kMaxChunksPerShard;
+
+  struct Slot {
+    absl::Mutex mutex;
+    uint32_t generation ABSL_GUARDED_BY(mutex) = 0;
+    std::optional<TMetadata> value ABSL_GUARDED_BY(mutex);
+  };
+
+  struct Chunk {
+    std::array<Slot, kSlotsPerChunk> slots;
+  };
+
+  // Slot `position` of a shard has index `position * kNumShards + shard`.
+  // Chunks are only ever added, so lookups read `chunks` without the lock.
+  struct alignas(ABSL_CACHELINE_SIZE) Shard {
+    absl::Mutex mutex;
+    std::vector<uint32_t> free_positions ABSL_GUARDED_BY(mutex);
+    uint32_t num_positions ABSL_GUARDED_BY(mutex) = 0;
+    std::array<std::atomic<Chunk*>, kMaxChunksPerShard> chunks{};
+  };
+
+  static Slot& GetSlot(Shard& shard, uint32_t position) {
+    return shard.chunks[position / kSlotsPerChunk]
+        .load(std::memory_order_acquire)
+        ->slots[position % kSlotsPerChunk];
+  }
+
+  // Returns nullptr if the index of `handle` was never handed out.
+  Slot* FindSlot(RequestHandle handle) {
+    Shard& shard = shards_[handle.index() % kNumShards];
+    const uint32_t position = handle.index() / kNumShards;
+    if (position >= kMaxPositionsPerShard) {
+      return nullptr;
+    }
+    Chunk* chunk = shard.chunks[position / kSlotsPerChunk].load(
+        std::memory_order_acquire);
+    if (chunk == nullptr) {
+      return nullptr;
+    }
+    return &chunk->slots[position % kSlotsPerChunk];
+  }
+
+  std::atomic<uint32_t> next_shard_ = 0;
+  std::array<Shard, kNumShards> shards_;
+};
+
+// Holds the lock of a request's metadata slot for as long as it lives, so that
+// the metadata cannot be deleted while it is read.
+template <typename TMetadata>
+class ScopedMetadataReader {
+ public:
+  static absl::StatusOr<ScopedMetadataReader> Create(
+      MetadataStorage<TMetadata>& storage, RequestHandle handle) {
+    auto* slot = storage.FindSlot(handle);
+    if (slot == nullptr) {
+      return absl::NotFoundError("Metadata could not be found");
+    }
+    slot->mutex.Lock();
+    if (!slot->value.has_value() || slot->generation != handle.generation()) {
+      slot->mutex.Unlock();
+      return absl::NotFoundError("Metadata could not be found");
+    }
+    return ScopedMetadataReader(slot);
+  }
+
+  // Looks up the handle rendered by RequestHandle::ToString.
+  static absl::StatusOr<ScopedMetadataReader> Create(
+      MetadataStorage<TMetadata>& storage, std::string_view handle) {
+    if (const auto parsed = RequestHandle::FromString(handle)) {
+      return Create(storage, *parsed);
+    }
+    return absl::NotFoundError("Invalid request handle");
+  }
+
+  absl::StatusOr<TMetadata*> Get() {
+    slot_->mutex.AssertReaderHeld();
+    return &(*slot_->value);
+  }
+
+  // Disable copy semantics.
+  ScopedMetadataReader(const ScopedMetadataReader&) = delete;
+
+  ScopedMetadataReader& operator=(const ScopedMetadataReader&) = delete;
+
+  ScopedMetadataReader(ScopedMetadataReader&& other) : slot_(other.slot_) {
+    other.slot_ = nullptr;
   }
 
-  absl::Status Delete(std::string_view key) {
-    return metadata_storage_.Delete(key);
+  ScopedMetadataReader& operator=(ScopedMetadataReader&& other) {
+    if (this != &other) {
+      Unlock();
+      slot_ = other.slot_;
+      other.slot_ = nullptr;
+    }
+    return *this;
   }
 
-  ThreadSafeMap<TMetadata>& GetMetadataMap() { return metadata_storage_; }
+  ~ScopedMetadataReader() { Unlock(); }
 
  private:
-  ThreadSafeMap<TMetadata> metadata_storage_;
+  using Slot = typename MetadataStorage<TMetadata>::Slot;
+
+  // `slot` must already be locked by the caller.
+  explicit ScopedMetadataReader(Slot* slot) : slot_(slot) {}
+
+  void Unlock() {
+    if (slot_) {
+      slot_->mutex.Unlock();
+    }
+  }
+
+  Slot* slot_;
 };
 
 }  // namespace google::scp::roma::metadata_storage
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Compares the designs for storing request metadata: a single-shard
+ * ThreadSafeMap, which behaves like the former global lock design, the
+ * lock-striped ThreadSafeMap keyed by UUID strings, and the handle-indexed
+ * MetadataStorage slab. Each iteration performs the per-request metadata
+ * lifecycle of RomaService: Add on Execute, one function binding lookup, and
+ * Delete on completion.
+ *
+ * Example command to run this:
+ *
+ * builders/tools/bazel-debian run \
+ * //src/roma/metadata_storage:metadata_storage_benchmark \
+ * --test_output=all
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "src/roma/metadata_storage/metadata_storage.h"
+#include "src/roma/metadata_storage/thread_safe_map.h"
+
+namespace {
+
+using google::scp::roma::metadata_storage::MetadataStorage;
+using google::scp::roma::metadata_storage::RequestHandle;
+using google::scp::roma::metadata_storage::ScopedMetadataReader;
+using google::scp::roma::metadata_storage::ScopedValueReader;
+using google::scp::roma::metadata_storage::ThreadSafeMap;
+
+template <size_t kNumShards>
+void BM_RequestLifecycle(benchmark::State& state) {
+  static ThreadSafeMap<std::string, kNumShards>* map;
+  if (state.thread_index() == 0) {
+    map = new ThreadSafeMap<std::string, kNumShards>();
+  }
+  // Keys look like the UUIDs RomaService generates.
+  const std::string prefix =
+      absl::StrCat("3f2c7a1e-9b4d-4e8a-", state.thread_index(), "-");
+  int64_t i = 0;
+  for (auto _ : state) {
+    std::string key = absl::StrCat(prefix, i++);
+    CHECK_OK(map->Add(key, "metadata"));
+    {
+      auto reader =
+          ScopedValueReader<std::string, kNumShards>::Create(*map, key);
+      CHECK_OK(reader);
+      benchmark::DoNotOptimize(reader->Get());
+    }
+    CHECK_OK(map->Delete(key));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete map;
+  }
+}
+
+void BM_SlabRequestLifecycle(benchmark::State& state) {
+  static MetadataStorage<std::string>* storage;
+  if (state.thread_index() == 0) {
+    storage = new MetadataStorage<std::string>();
+  }
+  for (auto _ : state) {
+    absl::StatusOr<RequestHandle> handle = storage->Add("metadata");
+    CHECK_OK(handle);
+    {
+      auto reader =
+          ScopedMetadataReader<std::string>::Create(*storage, *handle);
+      CHECK_OK(reader);
+      benchmark::DoNotOptimize(reader->Get());
+    }
+    CHECK_OK(storage->Delete(*handle));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete storage;
+  }
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_RequestLifecycle, 1)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_RequestLifecycle, 64)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(BM_SlabRequestLifecycle)->ThreadRange(1, 32)->UseRealTime();
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/metadata_storage/metadata_storage.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/roma/metadata_storage/request_handle.h"
+
+namespace google::scp::roma::metadata_storage::test {
+
+TEST(RequestHandleTest, RoundTripsThroughString) {
+  const RequestHandle handle(/*generation=*/7, /*index=*/42);
+  EXPECT_EQ(handle.generation(), 7);
+  EXPECT_EQ(handle.index(), 42);
+  const auto parsed = RequestHandle::FromString(handle.ToString());
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(*parsed, handle);
+}
+
+TEST(RequestHandleTest, RejectsMalformedString) {
+  EXPECT_FALSE(RequestHandle::FromString("").has_value());
+  EXPECT_FALSE(RequestHandle::FromString("foo").has_value());
+  EXPECT_FALSE(
+      RequestHandle::FromString("3f2c7a1e-9b4d-4e8a-a1b2-c3d4e5f60718")
+          .has_value());
+}
+
+TEST(MetadataStorageTest, AddAndRead) {
+  MetadataStorage<std::string> storage;
+  const auto handle = storage.Add("val1");
+  ASSERT_TRUE(handle.ok());
+
+  auto reader = ScopedMetadataReader<std::string>::Create(storage, *handle);
+  ASSERT_TRUE(reader.ok());
+  auto value = reader->Get();
+  ASSERT_TRUE(value.ok());
+  EXPECT_EQ(**value, "val1");
+}
+
+TEST(MetadataStorageTest, ReadByString) {
+  MetadataStorage<std::string> storage;
+  const auto handle = storage.Add("val1");
+  ASSERT_TRUE(handle.ok());
+
+  auto reader =
+      ScopedMetadataReader<std::string>::Create(storage, handle->ToString());
+  ASSERT_TRUE(reader.ok());
+  EXPECT_EQ(**reader->Get(), "val1");
+  EXPECT_FALSE(ScopedMetadataReader<std::string>::Create(storage, "foo").ok());
+}
+
+TEST(MetadataStorageTest, FreshStorageHandsOutSequentialHandles) {
+  MetadataStorage<int> storage;
+  for (int i = 0; i < 100; ++i) {
+    const auto handle = storage.Add(i);
+    ASSERT_TRUE(handle.ok());
+    EXPECT_EQ(handle->value(), i);
+  }
+}
+
+TEST(MetadataStorageTest, DeleteInvalidatesHandle) {
+  MetadataStorage<std::string> storage;
+  const auto handle = storage.Add("val1");
+  ASSERT_TRUE(handle.ok());
+  EXPECT_TRUE(storage.Delete(*handle).ok());
+  EXPECT_FALSE(storage.Delete(*handle).ok());
+  EXPECT_FALSE(
+      ScopedMetadataReader<std::string>::Create(storage, *handle).ok());
+}
+
+TEST(MetadataStorageTest, StaleHandleDoesNotReadReusedSlot) {
+  MetadataStorage<std::string> storage;
+  std::vector<RequestHandle> handles;
+  for (int i = 0; i < 32; ++i) {
+    const auto handle = storage.Add("old");
+    ASSERT_TRUE(handle.ok());
+    handles.push_back(*handle);
+  }
+  for (const RequestHandle handle : handles) {
+    ASSERT_TRUE(storage.Delete(handle).ok());
+  }
+  for (int i = 0; i < 32; ++i) {
+    const auto handle = storage.Add("new");
+    ASSERT_TRUE(handle.ok());
+    // Slots are reused under a new generation.
+    EXPECT_NE(handle->generation(), 0);
+  }
+  for (const RequestHandle handle : handles) {
+    EXPECT_FALSE(
+        ScopedMetadataReader<std::string>::Create(storage, handle).ok());
+    EXPECT_FALSE(storage.Delete(handle).ok());
+  }
+}
+
+TEST(MetadataStorageTest, UnknownIndexNotFound) {
+  MetadataStorage<std::string> storage;
+  EXPECT_FALSE(storage.Delete(RequestHandle(0, 12345)).ok());
+  EXPECT_FALSE(
+      ScopedMetadataReader<std::string>::Create(storage, RequestHandle(0, 0))
+          .ok());
+}
+
+TEST(MetadataStorageTest, ConcurrentAddReadAndDelete) {
+  MetadataStorage<int> storage;
+  constexpr int num_threads = 10;
+  constexpr int iterations = 1000;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&storage, i] {
+      for (int j = 0; j < iterations; ++j) {
+        const int val = i * iterations + j;
+        const auto handle = storage.Add(val);
+        ASSERT_TRUE(handle.ok());
+        {
+          auto reader = ScopedMetadataReader<int>::Create(storage, *handle);
+          ASSERT_TRUE(reader.ok());
+          EXPECT_EQ(**reader->Get(), val);
+        }
+        EXPECT_TRUE(storage.Delete(*handle).ok());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace google::scp::roma::metadata_storage::test
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_METADATA_STORAGE_REQUEST_HANDLE_H_
+#define ROMA_METADATA_STORAGE_REQUEST_HANDLE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+
+namespace google::scp::roma::metadata_storage {
+
+// Identifies an in-flight invocation request. The low 32 bits are the index of
+// the request's slot in MetadataStorage and the high 32 bits are the
+// generation of that slot, so the handle of a finished request never matches
+// the next request stored in the same slot.
+//
+// Handles cross process boundaries and reach callers as ExecutionToken values
+// in their string form, which is the decimal value.
+class RequestHandle {
+ public:
+  constexpr RequestHandle(uint32_t generation, uint32_t index)
+      : value_((static_cast<uint64_t>(generation) << 32) | index) {}
+
+  static constexpr RequestHandle FromValue(uint64_t value) {
+    return RequestHandle(static_cast<uint32_t>(value >> 32),
+                         static_cast<uint32_t>(value));
+  }
+
+  // Returns std::nullopt if `str` was not produced by ToString.
+  static std::optional<RequestHandle> FromString(std::string_view str) {
+    uint64_t value;
+    if (str.empty() || str.size() > 20 || !absl::SimpleAtoi(str, &value)) {
+      return std::nullopt;
+    }
+    return FromValue(value);
+  }
+
+  constexpr uint64_t value() const { return value_; }
+
+  constexpr uint32_t generation() const {
+    return static_cast<uint32_t>(value_ >> 32);
+  }
+
+  constexpr uint32_t index() const { return static_cast<uint32_t>(value_); }
+
+  std::string ToString() const { return absl::StrCat(value_); }
+
+  friend constexpr bool operator==(RequestHandle a, RequestHandle b) {
+    return a.value_ == b.value_;
+  }
+
+  friend constexpr bool operator!=(RequestHandle a, RequestHandle b) {
+    return a.value_ != b.value_;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, RequestHandle handle) {
+    return H::combine(std::move(h), handle.value_);
+  }
+
+ private:
+  uint64_t value_;
+};
+
+}  // namespace google::scp::roma::metadata_storage
+
+#endif  // ROMA_METADATA_STORAGE_REQUEST_HANDLE_H_
@@ -17,11 +17,15 @@
 #ifndef ROMA_METADATA_STORAGE_THREAD_SAFE_MAP_H_
 #define ROMA_METADATA_STORAGE_THREAD_SAFE_MAP_H_
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <utility>
 
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/container/node_hash_map.h"
+#include "absl/hash/hash.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
@@ -30,89 +34,120 @@
 
 namespace google::scp::roma::metadata_storage {
 
+template <typename V, size_t kNumShards>
+class ScopedValueReader;
+
 // Supports thread safe insertion, deletion, and lookups. Provides client with
 // row-level lock associated for a value to allow for thread-safe reading of
 // values. Lock row-level lock before reading value and unlock after.
-template <typename V>
+//
+// Keys are striped across kNumShards independently locked shards, so requests
+// with different keys rarely contend. Each value is stored in the same node as
+// its row-level lock, which makes Add a single allocation.
+template <typename V, size_t kNumShards = 64>
 class ThreadSafeMap {
  public:
-  absl::Status Add(std::string key, V val)
-      ABSL_LOCKS_EXCLUDED(mutex_map_mutex_) {
-    absl::MutexLock mu_lock(&mutex_map_mutex_);
-    absl::MutexLock lock(&key_value_map_mutex_);
-    auto [it, inserted] =
-        key_value_map_.try_emplace(std::move(key), std::move(val));
-    if (!inserted) {
+  static_assert(kNumShards > 0, "ThreadSafeMap needs at least one shard");
+
+  absl::Status Add(std::string key, V val) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (auto [it, inserted] =
+            shard.map.try_emplace(std::move(key), std::move(val));
+        !inserted) {
       return absl::AlreadyExistsError(
           "UUID for Invocation Request already added to map");
     }
-    mutex_map_.try_emplace(it->first);  // create a mutex for key
     return absl::OkStatus();
   }
 
-  absl::Status Delete(std::string_view key)
-      ABSL_LOCKS_EXCLUDED(mutex_map_mutex_) {
-    absl::MutexLock mu_lock(&mutex_map_mutex_);
-    auto mutex_it = mutex_map_.find(key);
-    if (mutex_it == mutex_map_.end()) {
-      return absl::NotFoundError(
-          "Mutex associated with metadata could not be found");
-    }
+  absl::Status Delete(std::string_view key) {
+    typename absl::node_hash_map<std::string, Entry>::node_type node;
     {
-      absl::MutexLock row_lock(&mutex_it->second);
-      absl::MutexLock lock(&key_value_map_mutex_);
-
-      if (auto it = key_value_map_.find(key); it != key_value_map_.end()) {
-        key_value_map_.erase(it);
-      } else {
+      Shard& shard = GetShard(key);
+      absl::MutexLock lock(&shard.mutex);
+      const auto it = shard.map.find(key);
+      if (it == shard.map.end()) {
         return absl::NotFoundError("Metadata could not be found");
       }
+      node = shard.map.extract(it);
     }
-    mutex_map_.erase(mutex_it);
+    // The row is no longer reachable, but readers that found it earlier may
+    // still hold its lock. Wait for them before the node is destroyed.
+    absl::MutexLock row_lock(&node.mapped().mutex);
     return absl::OkStatus();
   }
 
-  absl::StatusOr<V*> GetValue(std::string_view key)
-      ABSL_LOCKS_EXCLUDED(key_value_map_mutex_) {
-    absl::MutexLock lock(&key_value_map_mutex_);
-    if (const auto it = key_value_map_.find(key); it != key_value_map_.end()) {
-      return &(it->second);
+  // GetValue and GetMutex take the shard lock. Do not call them while holding
+  // a row-level lock; use ScopedValueReader to read a value under its lock.
+  absl::StatusOr<V*> GetValue(std::string_view key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (const auto it = shard.map.find(key); it != shard.map.end()) {
+      return &(it->second.value);
     }
     return absl::NotFoundError(
         absl::StrCat("Value with key: ", key, " could not be found"));
   }
 
-  absl::StatusOr<absl::Mutex*> GetMutex(std::string_view key)
-      ABSL_LOCKS_EXCLUDED(mutex_map_mutex_) {
-    absl::MutexLock lock(&mutex_map_mutex_);
-    if (const auto it = mutex_map_.find(key); it != mutex_map_.end()) {
-      return &(it->second);
+  absl::StatusOr<absl::Mutex*> GetMutex(std::string_view key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (const auto it = shard.map.find(key); it != shard.map.end()) {
+      return &(it->second.mutex);
     }
     return absl::NotFoundError(
         absl::StrCat("Mutex with key: ", key, " could not be found"));
   }
 
  private:
-  absl::node_hash_map<std::string, V> key_value_map_
-      ABSL_GUARDED_BY(key_value_map_mutex_);
-  absl::node_hash_map<std::string_view, absl::Mutex> mutex_map_
-      ABSL_GUARDED_BY(mutex_map_mutex_);
-  absl::Mutex key_value_map_mutex_;
-  absl::Mutex mutex_map_mutex_;
+  friend class ScopedValueReader<V, kNumShards>;
+
+  struct Entry {
+    explicit Entry(V val) : value(std::move(val)) {}
+
+    V value;
+    absl::Mutex mutex;
+  };
+
+  struct alignas(ABSL_CACHELINE_SIZE) Shard {
+    absl::Mutex mutex;
+    absl::node_hash_map<std::string, Entry> map ABSL_GUARDED_BY(mutex);
+  };
+
+  Shard& GetShard(std::string_view key) {
+    return shards_[absl::Hash<std::string_view>{}(key) % kNumShards];
+  }
+
+  // Finds the row for `key` and acquires its lock. The row lock is taken under
+  // the shard lock so that a concurrent Delete cannot free the row in between.
+  absl::StatusOr<Entry*> LockEntry(std::string_view key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    const auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      return absl::NotFoundError(
+          absl::StrCat("Mutex with key: ", key, " could not be found"));
+    }
+    it->second.mutex.Lock();
+    return &(it->second);
+  }
+
+  std::array<Shard, kNumShards> shards_;
 };
 
-template <typename V>
+template <typename V, size_t kNumShards = 64>
 class ScopedValueReader {
  public:
-  static absl::StatusOr<ScopedValueReader<V>> Create(ThreadSafeMap<V>& map,
-                                                     std::string_view key) {
-    PS_ASSIGN_OR_RETURN(auto mutex, map.GetMutex(key));
-    return ScopedValueReader(map, key, mutex);
+  static absl::StatusOr<ScopedValueReader> Create(
+      ThreadSafeMap<V, kNumShards>& map, std::string_view key) {
+    PS_ASSIGN_OR_RETURN(auto entry, map.LockEntry(key));
+    return ScopedValueReader(entry);
   }
 
   absl::StatusOr<V*> Get() {
-    mutex_->AssertReaderHeld();
-    return map_.GetValue(key_);
+    entry_->mutex.AssertReaderHeld();
+    return &(entry_->value);
   }
 
   // Disable copy semantics.
@@ -120,34 +155,34 @@ class ScopedValueReader {
 
   ScopedValueReader& operator=(const ScopedValueReader&) = delete;
 
-  ScopedValueReader(ScopedValueReader&& other)
-      : map_(other.map_), key_(other.key_), mutex_(other.mutex_) {
-    other.mutex_ = nullptr;
+  ScopedValueReader(ScopedValueReader&& other) : entry_(other.entry_) {
+    other.entry_ = nullptr;
   }
 
   ScopedValueReader& operator=(ScopedValueReader&& other) {
-    map_ = other.map_;
-    key_ = other.key_;
-    mutex_ = other.mutex_;
-    other.mutex_ = nullptr;
-  }
-
-  ~ScopedValueReader() {
-    if (mutex_) {
-      mutex_->Unlock();
+    if (this != &other) {
+      Unlock();
+      entry_ = other.entry_;
+      other.entry_ = nullptr;
     }
+    return *this;
   }
 
+  ~ScopedValueReader() { Unlock(); }
+
  private:
-  ScopedValueReader(ThreadSafeMap<V>& map, std::string_view key,
-                    absl::Mutex* mutex)
-      : map_(map), key_(key), mutex_(mutex) {
-    mutex_->Lock();
+  using Entry = typename ThreadSafeMap<V, kNumShards>::Entry;
+
+  // `entry` must already be locked by the caller.
+  explicit ScopedValueReader(Entry* entry) : entry_(entry) {}
+
+  void Unlock() {
+    if (entry_) {
+      entry_->mutex.Unlock();
+    }
   }
 
-  ThreadSafeMap<V>& map_;
-  std::string_view key_;
-  absl::Mutex* mutex_;
+  Entry* entry_;
 };
 
 }  // namespace google::scp::roma::metadata_storage
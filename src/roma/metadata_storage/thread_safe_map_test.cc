@@ -24,6 +24,8 @@
 #include <vector>
 
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 
 namespace google::scp::roma::metadata_storage::test {
 
@@ -59,6 +61,46 @@ TEST(ThreadSafeMapTest, GetMutexNotFound) {
   EXPECT_FALSE(map.GetMutex("key1").ok());
 }
 
+TEST(ThreadSafeMapTest, ScopedValueReaderNotFound) {
+  ThreadSafeMap<std::string> map;
+  EXPECT_FALSE(ScopedValueReader<std::string>::Create(map, "key1").ok());
+}
+
+TEST(ThreadSafeMapTest, DeleteWaitsForScopedValueReader) {
+  ThreadSafeMap<std::string> map;
+  ASSERT_TRUE(map.Add("key1", "val1").ok());
+  absl::Notification deleted;
+  std::thread deleter;
+  {
+    auto reader = ScopedValueReader<std::string>::Create(map, "key1");
+    ASSERT_TRUE(reader.ok());
+    deleter = std::thread([&map, &deleted] {
+      EXPECT_TRUE(map.Delete("key1").ok());
+      deleted.Notify();
+    });
+    EXPECT_FALSE(deleted.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+    auto value = reader->Get();
+    ASSERT_TRUE(value.ok());
+    EXPECT_EQ(**value, "val1");
+  }
+  deleter.join();
+  EXPECT_TRUE(deleted.HasBeenNotified());
+  EXPECT_FALSE(map.GetValue("key1").ok());
+}
+
+TEST(ThreadSafeMapTest, SingleShardMap) {
+  ThreadSafeMap<int, /*kNumShards=*/1> map;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(map.Add(absl::StrCat("key_", i), i).ok());
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto value = map.GetValue(absl::StrCat("key_", i));
+    ASSERT_TRUE(value.ok());
+    EXPECT_EQ(**value, i);
+    EXPECT_TRUE(map.Delete(absl::StrCat("key_", i)).ok());
+  }
+}
+
 TEST(ThreadSafeMapTest, ConcurrentAddAndGet) {
   ThreadSafeMap<int> map;
   constexpr int num_threads = 10;
@@ -29,7 +29,7 @@
 #include "src/roma/metadata_storage/metadata_storage.h"
 
 using google::scp::roma::metadata_storage::MetadataStorage;
-using google::scp::roma::metadata_storage::ScopedValueReader;
+using google::scp::roma::metadata_storage::ScopedMetadataReader;
 
 namespace google::scp::roma::grpc_server {
 inline constexpr std::string_view kUuidTag = "request_uuid";
@@ -153,8 +153,8 @@ class RequestHandlerImpl : public Proceedable, public THandler<TMetadata> {
           it != client_metadata.end() && metadata_storage_ != nullptr) {
         std::string_view uuid =
             std::string_view(it->second.data(), it->second.size());
-        if (auto reader = ScopedValueReader<TMetadata>::Create(
-                metadata_storage_->GetMetadataMap(), uuid);
+        if (auto reader = ScopedMetadataReader<TMetadata>::Create(
+                *metadata_storage_, uuid);
             reader.ok()) {
           if (auto value = reader->Get(); value.ok()) {
             auto response_status_pair = this->ProcessRequest(**value);
@@ -68,13 +68,16 @@ class NativeFunctionGrpcServerTest : public ::testing::Test {
         metadata_storage_.get(), socket_addresses);
   }
 
+  // The client binaries send their id as the request handle, which matches
+  // the handles a fresh storage hands out.
   void PopulateMetadataStorage(int num_processes, int num_iters) {
     for (int iter = 0; iter < num_iters; iter++) {
       for (int i = 0; i < num_processes; i++) {
-        std::string uuid = absl::StrCat((iter * num_processes) + i);
-        std::string metadata = absl::StrCat("metadata_", uuid);
-        ASSERT_TRUE(
-            metadata_storage_->Add(std::move(uuid), std::move(metadata)).ok());
+        const int id = (iter * num_processes) + i;
+        const auto handle =
+            metadata_storage_->Add(absl::StrCat("metadata_", id));
+        ASSERT_TRUE(handle.ok());
+        ASSERT_EQ(handle->ToString(), absl::StrCat(id));
       }
     }
   }
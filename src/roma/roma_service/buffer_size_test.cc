@@ -238,4 +238,78 @@ TEST(BufferSizeTest, ExecutionShouldSucceedIfResponsePayloadOversize) {
   ASSERT_TRUE(roma_service.Stop().ok());
 }
 
+TEST(BufferSizeTest, RawLayoutExecutionShouldSucceedWithLargeAndOversizeData) {
+  Config config;
+  config.number_of_workers = 2;
+  // The buffer size is 1MB.
+  config.sandbox_request_response_shared_buffer_size_mb = 1;
+  config.enable_sandbox_sharing_request_response_with_raw_layout = true;
+
+  RomaService<> roma_service(std::move(config));
+  ASSERT_TRUE(roma_service.Init().ok());
+
+  {
+    absl::Notification load_finished;
+    auto code_obj = std::make_unique<CodeObject>(CodeObject{
+        .id = "foo",
+        .version_string = "v1",
+        // Echoes the input and appends a string of the requested size.
+        .js = R"JS_CODE(
+          function Handler(input, response_size) {
+            return input + 'x'.repeat(response_size);
+          }
+        )JS_CODE",
+    });
+
+    absl::Status response_status;
+    ASSERT_TRUE(roma_service
+                    .LoadCodeObj(std::move(code_obj),
+                                 [&](absl::StatusOr<ResponseObject> resp) {
+                                   response_status = resp.status();
+                                   load_finished.Notify();
+                                 })
+                    .ok());
+    ASSERT_TRUE(
+        load_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+    ASSERT_TRUE(response_status.ok());
+  }
+
+  // Payloads that fit into the Buffer are shared in the raw layout, and
+  // oversize payloads fall back to sharing by bytes.
+  constexpr int kLargePayloadSize = 512 * 1024;
+  for (const int request_size : {kLargePayloadSize,
+                                 static_cast<int>(kOversizedPayloadSize)}) {
+    for (const int response_size :
+         {0, kLargePayloadSize, static_cast<int>(kOversizedPayloadSize)}) {
+      absl::Notification execute_finished;
+      const std::string input(request_size, 'A');
+      auto execution_obj =
+          std::make_unique<InvocationStrRequest<>>(InvocationStrRequest<>{
+              .id = "foo",
+              .version_string = "v1",
+              .handler_name = "Handler",
+              .input = {absl::StrCat("\"", input, "\""),
+                        absl::StrCat(response_size)},
+          });
+
+      absl::StatusOr<ResponseObject> response;
+      ASSERT_TRUE(roma_service
+                      .Execute(std::move(execution_obj),
+                               [&](absl::StatusOr<ResponseObject> resp) {
+                                 response = std::move(resp);
+                                 execute_finished.Notify();
+                               })
+                      .ok());
+      ASSERT_TRUE(
+          execute_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+      ASSERT_TRUE(response.ok()) << response.status();
+      EXPECT_THAT(response->resp,
+                  StrEq(absl::StrCat("\"", input,
+                                     std::string(response_size, 'x'), "\"")));
+    }
+  }
+
+  ASSERT_TRUE(roma_service.Stop().ok());
+}
+
 }  // namespace google::scp::roma::test
@@ -23,6 +23,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/status/status.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
 #include "src/roma/config/config.h"
@@ -33,6 +34,7 @@
 using google::scp::roma::FunctionBindingPayload;
 using google::scp::roma::sandbox::roma_service::RomaService;
 using ::testing::_;
+using ::testing::ElementsAre;
 using ::testing::HasSubstr;
 using ::testing::StrEq;
 
@@ -597,4 +599,90 @@ TEST(FunctionBindingTest, CanRegisterNonGlobalBindingsAndExecuteCode) {
   EXPECT_TRUE(roma_service.Stop().ok());
 }
 
+TEST(FunctionBindingTest, CanStreamResponseChunksToTheHost) {
+  RomaService<>::Config config;
+  config.number_of_workers = 2;
+  config.enable_response_streaming = true;
+
+  RomaService<> roma_service(std::move(config));
+  ASSERT_TRUE(roma_service.Init().ok());
+
+  absl::Notification load_finished;
+  ASSERT_TRUE(roma_service
+                  .LoadCodeObj(std::make_unique<CodeObject>(CodeObject{
+                                   .id = "foo",
+                                   .version_string = "v1",
+                                   .js = R"JS_CODE(
+          function Handler(input) {
+            for (let i = 0; i < 3; i++) {
+              ROMA_EMIT_CHUNK(`${input} ${i}`);
+            }
+            return "done";
+          })JS_CODE",
+                               }),
+                               [&](absl::StatusOr<ResponseObject> resp) {
+                                 EXPECT_TRUE(resp.ok());
+                                 load_finished.Notify();
+                               })
+                  .ok());
+  ASSERT_TRUE(load_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+
+  const auto execution_obj = [] {
+    return std::make_unique<InvocationStrRequest<>>(InvocationStrRequest<>{
+        .id = "foo",
+        .version_string = "v1",
+        .handler_name = "Handler",
+        .input = {R"("chunk")"},
+    });
+  };
+  std::vector<std::string> chunks;
+  std::string result;
+  absl::Notification execute_finished;
+  ASSERT_TRUE(roma_service
+                  .ExecuteStreaming(
+                      execution_obj(),
+                      [&](std::string_view chunk) {
+                        chunks.push_back(std::string(chunk));
+                        return absl::OkStatus();
+                      },
+                      [&](absl::StatusOr<ResponseObject> resp) {
+                        ASSERT_TRUE(resp.ok());
+                        result = std::move(resp->resp);
+                        execute_finished.Notify();
+                      })
+                  .ok());
+  ASSERT_TRUE(
+      execute_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  EXPECT_THAT(chunks, ElementsAre("chunk 0", "chunk 1", "chunk 2"));
+  EXPECT_THAT(result, StrEq(R"("done")"));
+
+  // An error from the chunk callback fails the UDF.
+  absl::Notification abort_finished;
+  ASSERT_TRUE(roma_service
+                  .ExecuteStreaming(
+                      execution_obj(),
+                      [](std::string_view /*chunk*/) {
+                        return absl::CancelledError("enough");
+                      },
+                      [&](absl::StatusOr<ResponseObject> resp) {
+                        EXPECT_FALSE(resp.ok());
+                        abort_finished.Notify();
+                      })
+                  .ok());
+  ASSERT_TRUE(abort_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+
+  // Invocations run by Execute have nowhere to stream to.
+  absl::Notification plain_finished;
+  ASSERT_TRUE(roma_service
+                  .Execute(execution_obj(),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             EXPECT_FALSE(resp.ok());
+                             plain_finished.Notify();
+                           })
+                  .ok());
+  ASSERT_TRUE(plain_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+
+  EXPECT_TRUE(roma_service.Stop().ok());
+}
+
 }  // namespace google::scp::roma::test
@@ -35,6 +35,7 @@
 #include "src/roma/config/config.h"
 #include "src/roma/config/function_binding_object_v2.h"
 #include "src/roma/interface/roma.h"
+#include "src/roma/metadata_storage/request_handle.h"
 #include "src/roma/roma_service/roma_service.h"
 
 using google::scp::roma::FunctionBindingPayload;
@@ -135,6 +136,68 @@ TEST(MetadataTest, InvocationReqMetadataVisibleInNativeFunction) {
   log.StopCapturingLogs();
 }
 
+TEST(MetadataTest, RejectedBatchesDoNotLeakMetadata) {
+  for (const bool native_batch_execution : {false, true}) {
+    Config config;
+    config.number_of_workers = 1;
+    config.enable_native_batch_execution = native_batch_execution;
+    RomaService<> roma_service(std::move(config));
+    ASSERT_TRUE(roma_service.Init().ok());
+
+    absl::Notification load_finished;
+    ASSERT_TRUE(roma_service
+                    .LoadCodeObj(std::make_unique<CodeObject>(CodeObject{
+                                     .id = "foo",
+                                     .version_string = "v1",
+                                     .js = "var Handler = () => 1;",
+                                 }),
+                                 [&](absl::StatusOr<ResponseObject> resp) {
+                                   EXPECT_TRUE(resp.ok());
+                                   load_finished.Notify();
+                                 })
+                    .ok());
+    ASSERT_TRUE(
+        load_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+
+    // Batches whose deadline has passed are rejected before any of their
+    // requests is dispatched.
+    for (int i = 0; i < 100; ++i) {
+      std::vector<InvocationStrRequest<>> batch(
+          4, InvocationStrRequest<>{
+                 .id = "foo",
+                 .version_string = "v1",
+                 .handler_name = "Handler",
+                 .deadline = absl::Now() - absl::Seconds(1),
+             });
+      EXPECT_EQ(roma_service.BatchExecute(batch, [](auto /*unused*/) {}).code(),
+                absl::StatusCode::kDeadlineExceeded);
+    }
+
+    // Metadata slots are reused once freed, and spread over 16 shards. Had
+    // the rejected batches leaked theirs, the next request would get a slot
+    // beyond the first of its shard.
+    absl::Notification execute_finished;
+    const auto token = roma_service.Execute(
+        std::make_unique<InvocationStrRequest<>>(InvocationStrRequest<>{
+            .id = "foo",
+            .version_string = "v1",
+            .handler_name = "Handler",
+        }),
+        [&](absl::StatusOr<ResponseObject> resp) {
+          EXPECT_TRUE(resp.ok());
+          execute_finished.Notify();
+        });
+    ASSERT_TRUE(token.ok());
+    const auto handle =
+        metadata_storage::RequestHandle::FromString(token->value);
+    ASSERT_TRUE(handle.has_value());
+    EXPECT_LT(handle->index(), 16u);
+    ASSERT_TRUE(
+        execute_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+    EXPECT_TRUE(roma_service.Stop().ok());
+  }
+}
+
 void LogMetadataStringFunction(FunctionBindingPayload<std::string>& wrapper) {
   LOG(INFO) << wrapper.metadata;
 }
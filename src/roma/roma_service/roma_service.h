@@ -17,6 +17,9 @@
 #ifndef ROMA_SANDBOX_ROMA_SERVICE_ROMA_SERVICE_H_
 #define ROMA_SANDBOX_ROMA_SERVICE_ROMA_SERVICE_H_
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -33,15 +36,21 @@
 #include "src/roma/native_function_grpc_server/request_handlers.h"
 #include "src/roma/sandbox/constants/constants.h"
 #include "src/roma/sandbox/dispatcher/dispatcher.h"
+#include "src/roma/sandbox/native_function_binding/latency_histogram.h"
 #include "src/roma/sandbox/native_function_binding/native_function_handler.h"
 #include "src/roma/sandbox/native_function_binding/native_function_table.h"
+#include "src/util/duration.h"
 #include "src/util/execution_token.h"
 #include "src/util/status_macro/status_macros.h"
 
 using google::scp::core::os::linux::SystemResourceInfoProviderLinux;
 using google::scp::roma::FunctionBindingObjectV2;
+using google::scp::roma::metadata_storage::RequestHandle;
 using google::scp::roma::sandbox::constants::kRequestUuid;
+using google::scp::roma::sandbox::dispatcher::CodeVersionLimits;
 using google::scp::roma::sandbox::dispatcher::Dispatcher;
+using google::scp::roma::sandbox::dispatcher::ElasticWorkers;
+using google::scp::roma::sandbox::native_function_binding::LatencyHistogram;
 using google::scp::roma::sandbox::native_function_binding::
     NativeFunctionHandler;
 using google::scp::roma::sandbox::native_function_binding::NativeFunctionTable;
@@ -49,6 +58,9 @@ using google::scp::roma::sandbox::native_function_binding::NativeFunctionTable;
 namespace google::scp::roma::sandbox::roma_service {
 constexpr int kWorkerQueueMax = 100;
 
+// The function through which UDFs run by ExecuteStreaming emit output chunks.
+constexpr std::string_view kEmitChunkFunctionName = "ROMA_EMIT_CHUNK";
+
 // This value does not account for runtime memory usage and is only a generic
 // estimate based on the memory needed by roma and the steady-state memory
 // needed by v8.
@@ -96,6 +108,23 @@ class RomaService {
     return dispatcher_->Load(*std::move(code_object), std::move(callback));
   }
 
+  // Drops the code loaded for `version` from the workers. Invocations of it
+  // fail from then on, until it is loaded again.
+  absl::Status UnloadCodeObj(std::string_view version) {
+    return dispatcher_->Unload(version);
+  }
+
+  // Returns the size of the code and startup snapshot of each loaded code
+  // version, and whether the workers hold it. See
+  // Config::max_loaded_code_versions.
+  absl::flat_hash_map<std::string, Dispatcher::CodeVersionStats>
+  GetCodeVersionStats() {
+    if (!dispatcher_) {
+      return {};
+    }
+    return dispatcher_->GetCodeVersionStats();
+  }
+
   // Async API.
   // Execute single invocation request. Can only be called when a valid
   // code object has been loaded.
@@ -110,11 +139,85 @@ class RomaService {
     return ExecuteInternal(std::move(invocation_req), std::move(callback));
   }
 
+  // Like Execute, but the UDF may hand its output to `chunk_callback` in
+  // chunks by calling ROMA_EMIT_CHUNK(string), which requires
+  // Config::enable_response_streaming. Each call blocks the UDF until
+  // `chunk_callback` returns, so a host that consumes chunks slowly throttles
+  // the UDF rather than letting output pile up. `callback` runs once the UDF
+  // returns, with whatever it returned as the response.
+  template <typename InputType>
+  absl::StatusOr<ExecutionToken> ExecuteStreaming(
+      std::unique_ptr<InvocationRequest<InputType, TMetadata>> invocation_req,
+      ChunkCallback chunk_callback, Callback callback) {
+    if (!config_.enable_response_streaming) {
+      return absl::FailedPreconditionError(
+          "Roma ExecuteStreaming requires enable_response_streaming.");
+    }
+    if (invocation_req->id.empty()) {
+      invocation_req->id = kDefaultRomaRequestId;
+    }
+    return ExecuteInternal(std::move(invocation_req), std::move(callback),
+                           std::move(chunk_callback));
+  }
+
   void Cancel(const ExecutionToken& token) {
     native_function_binding_handler_->PreventCallbacks(token);
     dispatcher_->Cancel(token);
   }
 
+  // Cancels every queued invocation request for which `predicate` returns
+  // true, e.g. requests received before some deadline, and returns how many
+  // were cancelled. See `Dispatcher::CancelAll`.
+  size_t CancelAll(
+      absl::FunctionRef<bool(const Dispatcher::QueuedRequest&)> predicate) {
+    return dispatcher_->CancelAll(predicate);
+  }
+
+  // Returns the latency histogram of every function binding called so far,
+  // keyed by function name.
+  absl::flat_hash_map<std::string, LatencyHistogram::Snapshot>
+  GetFunctionBindingLatencyHistograms() const {
+    if (!native_function_binding_handler_) {
+      return {};
+    }
+    return native_function_binding_handler_->GetLatencyHistograms();
+  }
+
+  // Returns how long invocation requests waited to be dispatched to a worker.
+  // Requests shed because their deadline passed are counted by
+  // `GetDeadlineShedCount` instead.
+  LatencyHistogram::Snapshot GetDispatchQueueWaitHistogram() const {
+    if (!dispatcher_) {
+      return {};
+    }
+    return dispatcher_->GetQueueWaitHistogram();
+  }
+
+  // Returns how many invocations failed instead of running because their
+  // deadline passed before they were dispatched.
+  int64_t GetDeadlineShedCount() const {
+    if (!dispatcher_) {
+      return 0;
+    }
+    return dispatcher_->GetDeadlineShedCount();
+  }
+
+  // Returns how many invocations ran on a worker whose last invocation used
+  // the same code version (hits) or a different one (misses). Both are zero
+  // unless code version affinity is enabled.
+  int64_t GetVersionAffinityHits() const {
+    if (!dispatcher_) {
+      return 0;
+    }
+    return dispatcher_->GetVersionAffinityHits();
+  }
+  int64_t GetVersionAffinityMisses() const {
+    if (!dispatcher_) {
+      return 0;
+    }
+    return dispatcher_->GetVersionAffinityMisses();
+  }
+
   // Async & Batch API.
   // Batch execute a batch of invocation requests. Can only be called when a
   // valid code object has been loaded.
@@ -127,6 +230,13 @@ class RomaService {
 
   absl::Status Stop() { return StopInternal(); }
 
+  // Returns how long a caller rejected with a ResourceExhaustedError for lack
+  // of capacity should wait before retrying, if the error says so.
+  static std::optional<absl::Duration> GetRetryAfter(
+      const absl::Status& status) {
+    return Dispatcher::GetRetryAfter(status);
+  }
+
  private:
   absl::Status InitInternal() {
     size_t concurrency = config_.number_of_workers;
@@ -137,8 +247,21 @@ class RomaService {
     if (worker_queue_cap == 0) {
       worker_queue_cap = kWorkerQueueMax;
     }
+    const auto lane_cap = [&](size_t worker_queue_max_items) {
+      return static_cast<int>(
+          concurrency * (worker_queue_max_items == 0 ? worker_queue_cap
+                                                     : worker_queue_max_items));
+    };
+    const std::array<int, kNumInvocationPriorities> max_pending_requests = {
+        lane_cap(config_.urgent_worker_queue_max_items),
+        lane_cap(worker_queue_cap),
+        lane_cap(config_.bulk_worker_queue_max_items),
+    };
 
     RegisterLogBindings();
+    if (config_.enable_response_streaming) {
+      RegisterStreamingBindings();
+    }
 
     if (config_.enable_native_function_grpc_server) {
       SetupNativeFunctionGrpcServer();
@@ -148,10 +271,43 @@ class RomaService {
     PS_RETURN_IF_ERROR(SetupWorkers(native_function_binding_info));
     native_function_binding_handler_->Run();
 
-    // TODO: Make max_pending_requests configurable
-    dispatcher_.emplace(
-        absl::MakeSpan(workers_),
-        concurrency * worker_queue_cap /*max_pending_requests*/);
+    std::optional<absl::Duration> version_affinity_delay;
+    if (config_.enable_code_version_affinity) {
+      version_affinity_delay = config_.code_version_affinity_max_delay;
+    }
+    std::optional<absl::Duration> idle_gc_delay;
+    if (config_.enable_js_engine_idle_gc) {
+      idle_gc_delay = config_.js_engine_idle_gc_delay;
+    }
+    if (config_.enable_startup_snapshot_cache &&
+        !config_.enable_sandbox_sharing_request_response_with_buffer_only) {
+      // All workers are set up alike, so any of them describes the
+      // environment of the snapshots.
+      snapshot_cache_.emplace(config_.startup_snapshot_cache_max_size_bytes,
+                              config_.startup_snapshot_cache_directory,
+                              workers_.front().SnapshotEnvironment());
+    }
+    std::optional<ElasticWorkers> elastic_workers;
+    if (config_.enable_elastic_workers) {
+      elastic_workers = ElasticWorkers{
+          .min_workers = static_cast<int>(NumInitialWorkers()),
+          .idle_stop_delay = config_.elastic_worker_idle_stop_delay,
+      };
+    }
+    std::optional<CodeVersionLimits> code_version_limits;
+    if (config_.max_loaded_code_versions > 0 ||
+        config_.max_loaded_code_bytes > 0) {
+      code_version_limits = CodeVersionLimits{
+          .max_versions = config_.max_loaded_code_versions,
+          .max_bytes = config_.max_loaded_code_bytes,
+      };
+    }
+    dispatcher_.emplace(absl::MakeSpan(workers_), max_pending_requests,
+                        version_affinity_delay,
+                        snapshot_cache_.has_value() ? &*snapshot_cache_
+                                                    : nullptr,
+                        idle_gc_delay, elastic_workers, code_version_limits);
+    dispatcher_->SetWorkerStartupDuration(worker_startup_duration_);
     ROMA_VLOG(1) << "RomaService Init with " << config_.number_of_workers
                  << " workers.";
     return absl::OkStatus();
@@ -188,22 +344,24 @@ class RomaService {
     native_function_server_->Run();
   }
 
-  absl::Status StoreMetadata(std::string uuid, TMetadata metadata) {
-    return metadata_storage_.Add(std::move(uuid), std::move(metadata));
-  }
-
-  void DeleteMetadata(std::string_view uuid) {
-    if (auto deletion_status = metadata_storage_.Delete(uuid);
+  void DeleteMetadata(RequestHandle handle) {
+    if (auto deletion_status = metadata_storage_.Delete(handle);
         !deletion_status.ok()) {
-      ROMA_VLOG(1) << "Failed to delete metadata. UUID: " << uuid
-                   << ", status: " << deletion_status;
+      ROMA_VLOG(1) << "Failed to delete metadata. Handle: "
+                   << handle.ToString() << ", status: " << deletion_status;
     }
   }
 
+  void DeleteChunkCallback(RequestHandle handle) {
+    absl::MutexLock lock(&chunk_callbacks_mu_);
+    chunk_callbacks_.erase(handle);
+  }
+
   struct NativeFunctionBindingSetup {
     std::vector<int> remote_file_descriptors;
     std::vector<int> local_file_descriptors;
     std::vector<std::string> js_function_names;
+    std::vector<std::string> js_async_function_names;
   };
 
   /**
@@ -219,10 +377,14 @@ class RomaService {
 
     std::vector<std::string> function_names;
     function_names.reserve(function_bindings.size());
+    std::vector<std::string> async_function_names;
     for (const auto& binding : function_bindings) {
       PS_RETURN_IF_ERROR(native_function_binding_table_.Register(
           binding->function_name, binding->function));
       function_names.push_back(binding->function_name);
+      if (binding->is_async) {
+        async_function_names.push_back(binding->function_name);
+      }
     }
 
     std::vector<int> local_fds;
@@ -246,12 +408,14 @@ class RomaService {
     }
     native_function_binding_handler_.emplace(
         &native_function_binding_table_, metadata_ptr, local_fds, remote_fds,
-        config_.skip_callback_for_cancelled);
+        config_.skip_callback_for_cancelled,
+        config_.function_binding_concurrency);
 
     NativeFunctionBindingSetup setup{
         .remote_file_descriptors = std::move(remote_fds),
         .local_file_descriptors = std::move(local_fds),
         .js_function_names = std::move(function_names),
+        .js_async_function_names = std::move(async_function_names),
     };
     return setup;
   }
@@ -276,6 +440,39 @@ class RomaService {
     }
   }
 
+  void RegisterStreamingBindings() {
+    auto function_binding_object =
+        std::make_unique<FunctionBindingObjectV2<TMetadata>>();
+    function_binding_object->function_name = kEmitChunkFunctionName;
+    function_binding_object->function =
+        [this](FunctionBindingPayload<TMetadata>& wrapper) {
+          std::shared_ptr<ChunkCallback> chunk_callback;
+          if (const std::optional<RequestHandle> handle =
+                  RequestHandle::FromString(wrapper.request_uuid)) {
+            absl::MutexLock lock(&chunk_callbacks_mu_);
+            if (const auto it = chunk_callbacks_.find(*handle);
+                it != chunk_callbacks_.end()) {
+              chunk_callback = it->second;
+            }
+          }
+          absl::Status status;
+          if (chunk_callback == nullptr) {
+            status = absl::FailedPreconditionError(
+                "ROMA: The invocation was not run by ExecuteStreaming.");
+          } else if (wrapper.io_proto.has_input_bytes()) {
+            status = (*chunk_callback)(wrapper.io_proto.input_bytes());
+          } else {
+            status = (*chunk_callback)(wrapper.io_proto.input_string());
+          }
+          if (!status.ok()) {
+            wrapper.io_proto.mutable_errors()->Add(
+                std::string(status.message()));
+          }
+          wrapper.io_proto.set_output_string("");
+        };
+    config_.RegisterFunctionBinding(std::move(function_binding_object));
+  }
+
   absl::Status SetupWorkers(
       const NativeFunctionBindingSetup& native_binding_setup) {
     const auto& remote_fds = native_binding_setup.remote_file_descriptors;
@@ -295,6 +492,8 @@ class RomaService {
           /*require_preload=*/true,
           /*native_js_function_comms_fd=*/remote_fd,
           /*native_js_function_names=*/function_names,
+          /*native_js_async_function_names=*/
+          native_binding_setup.js_async_function_names,
           /*rpc_method_names=*/rpc_method_names,
           /*server_address=*/server_address,
           /*max_worker_virtual_memory_mb=*/config_.max_worker_virtual_memory_mb,
@@ -304,21 +503,48 @@ class RomaService {
           resource_constraints.maximum_heap_size_in_mb,
           /*js_engine_max_wasm_memory_number_of_pages=*/
           config_.max_wasm_memory_number_of_pages,
+          /*js_engine_context_pool_size=*/config_.js_engine_context_pool_size,
+          /*js_engine_context_max_uses=*/config_.js_engine_context_max_uses,
+          /*invocation_resource_metrics=*/
+          config_.invocation_resource_metrics,
           /*sandbox_request_response_shared_buffer_size_mb=*/
           config_.sandbox_request_response_shared_buffer_size_mb,
+          /*sandbox_request_response_shared_buffer_slot_count=*/
+          config_.sandbox_request_response_shared_buffer_slot_count,
           /*enable_sandbox_sharing_request_response_with_buffer_only=*/
           config_.enable_sandbox_sharing_request_response_with_buffer_only,
+          /*enable_sandbox_sharing_request_response_with_raw_layout=*/
+          config_.enable_sandbox_sharing_request_response_with_raw_layout,
+          /*enable_spare_worker_sandbox=*/config_.enable_spare_worker_sandbox,
           /*v8_flags=*/v8_flags,
           /*enable_profilers=*/config_.enable_profilers,
           /*logging_function_set=*/config_.logging_function_set,
           /*disable_udf_stacktraces_in_response*/
           config_.disable_udf_stacktraces_in_response);
-      PS_RETURN_IF_ERROR(workers_.back().Init());
-      PS_RETURN_IF_ERROR(workers_.back().Run());
     }
+    size_t parallelism = config_.worker_startup_parallelism;
+    if (parallelism == 0) {
+      parallelism = std::thread::hardware_concurrency();
+    }
+    privacy_sandbox::server_common::Stopwatch stopwatch;
+    // With elastic workers, the dispatcher starts the others on demand.
+    PS_RETURN_IF_ERROR(worker_api::StartWorkers(
+        absl::MakeSpan(workers_).subspan(0, NumInitialWorkers()), parallelism));
+    worker_startup_duration_ = stopwatch.GetElapsedTime();
+    ROMA_VLOG(1) << "Started " << NumInitialWorkers() << " workers in "
+                 << worker_startup_duration_;
     return absl::OkStatus();
   }
 
+  // The number of workers started by Init.
+  size_t NumInitialWorkers() const {
+    if (!config_.enable_elastic_workers) {
+      return workers_.size();
+    }
+    return std::clamp<size_t>(config_.min_number_of_workers, 1,
+                              workers_.size());
+  }
+
   template <typename InputType>
   absl::Status AssertInvocationRequestIsValid(
       std::string_view function_name,
@@ -339,86 +565,183 @@ class RomaService {
   template <typename InputType>
   absl::StatusOr<ExecutionToken> ExecuteInternal(
       std::unique_ptr<InvocationRequest<InputType, TMetadata>> invocation_req,
-      Callback callback) {
+      Callback callback, ChunkCallback chunk_callback = nullptr) {
     PS_RETURN_IF_ERROR(
         AssertInvocationRequestIsValid("Execute", *invocation_req));
 
-    auto request_unique_id = google::scp::core::common::Uuid::GenerateUuid();
-    std::string uuid_str =
-        google::scp::core::common::ToString(request_unique_id);
-    invocation_req->tags.insert({std::string(kRequestUuid), uuid_str});
+    PS_ASSIGN_OR_RETURN(
+        const RequestHandle handle,
+        metadata_storage_.Add(std::move(invocation_req->metadata)));
+    std::string handle_str = handle.ToString();
+    invocation_req->tags.insert({std::string(kRequestUuid), handle_str});
 
     invocation_req->tags.insert(
         {std::string(google::scp::roma::sandbox::constants::kMinLogLevel),
          absl::StrCat(invocation_req->min_log_level)});
 
+    const bool streaming = chunk_callback != nullptr;
+    if (streaming) {
+      absl::MutexLock lock(&chunk_callbacks_mu_);
+      chunk_callbacks_[handle] =
+          std::make_shared<ChunkCallback>(std::move(chunk_callback));
+    }
+
     Callback callback_wrapper =
-        [this, uuid_str, callback = std::move(callback)](
+        [this, handle, streaming, callback = std::move(callback)](
             absl::StatusOr<ResponseObject> resp) mutable {
+          if (streaming) {
+            DeleteChunkCallback(handle);
+          }
           callback(std::move(resp));
-          DeleteMetadata(uuid_str);
+          DeleteMetadata(handle);
         };
 
-    PS_RETURN_IF_ERROR(
-        StoreMetadata(uuid_str, std::move(invocation_req->metadata)));
-    PS_RETURN_IF_ERROR(dispatcher_->Invoke(std::move(*invocation_req),
-                                           std::move(callback_wrapper)));
-    return ExecutionToken{std::move(uuid_str)};
+    if (absl::Status status = dispatcher_->Invoke(std::move(*invocation_req),
+                                                  std::move(callback_wrapper));
+        !status.ok()) {
+      if (streaming) {
+        DeleteChunkCallback(handle);
+      }
+      DeleteMetadata(handle);
+      return status;
+    }
+    return ExecutionToken{std::move(handle_str)};
   }
 
   template <typename InputType>
   absl::Status BatchExecuteInternal(
       std::vector<InvocationRequest<InputType, TMetadata>>& batch,
       BatchCallback batch_callback) {
-    std::vector<std::string> uuids;
-    uuids.reserve(batch.size());
-
     for (auto& request : batch) {
       PS_RETURN_IF_ERROR(
           AssertInvocationRequestIsValid("BatchExecute", request));
-      auto request_unique_id = google::scp::core::common::Uuid::GenerateUuid();
-      std::string uuid_str =
-          google::scp::core::common::ToString(request_unique_id);
-      // Save uuids for later removal in callback_wrapper
-      uuids.push_back(uuid_str);
-      auto [it, inserted] =
-          request.tags.insert({std::string(kRequestUuid), uuid_str});
-      if (!inserted) {
-        it->second = uuid_str;
+    }
+    std::vector<RequestHandle> handles;
+    handles.reserve(batch.size());
+    for (auto& request : batch) {
+      auto handle = metadata_storage_.Add(std::move(request.metadata));
+      if (!handle.ok()) {
+        for (const RequestHandle stored : handles) {
+          DeleteMetadata(stored);
+        }
+        return handle.status();
       }
-      PS_RETURN_IF_ERROR(
-          StoreMetadata(std::move(uuid_str), std::move(request.metadata)));
+      // Save handles for later removal in callback_wrapper
+      handles.push_back(*handle);
+      request.tags.insert_or_assign(std::string(kRequestUuid),
+                                    handle->ToString());
     }
     auto batch_callback_ptr = std::make_shared<BatchCallback>(
-        [&, uuids = std::move(uuids),
-         batch_callback = std::move(batch_callback)](
+        [&, handles, batch_callback = std::move(batch_callback)](
             std::vector<absl::StatusOr<ResponseObject>> batch_resp) mutable {
           std::move(batch_callback)(std::move(batch_resp));
-          for (const auto& uuid : uuids) {
-            DeleteMetadata(uuid);
+          for (const RequestHandle handle : handles) {
+            DeleteMetadata(handle);
           }
         });
+    // A batch whose first request or chunk is rejected never runs the batch
+    // callback, so its metadata is deleted here instead.
+    const auto delete_batch_metadata = [&] {
+      for (const RequestHandle handle : handles) {
+        DeleteMetadata(handle);
+      }
+    };
+    if (config_.enable_native_batch_execution &&
+        dispatcher::AssertBatchIsValid(batch).ok()) {
+      absl::Status status =
+          NativeBatchExecuteInternal(batch, std::move(batch_callback_ptr));
+      if (!status.ok()) {
+        delete_batch_metadata();
+      }
+      return status;
+    }
+    const absl::Time admission_deadline =
+        absl::Now() + config_.batch_execute_admission_timeout;
     const auto batch_size = batch.size();
     auto batch_response =
         std::make_shared<std::vector<absl::StatusOr<ResponseObject>>>(
             batch_size, absl::StatusOr<ResponseObject>());
     auto finished_counter = std::make_shared<std::atomic<size_t>>(0);
-    for (size_t index = 0; index < batch_size; ++index) {
-      auto callback = [batch_response, finished_counter, batch_callback_ptr,
-                       index](absl::StatusOr<ResponseObject> obj_response) {
+    const auto make_callback = [&](size_t index) {
+      return [batch_response, finished_counter, batch_callback_ptr,
+              index](absl::StatusOr<ResponseObject> obj_response) {
         (*batch_response)[index] = std::move(obj_response);
         auto finished_value = finished_counter->fetch_add(1);
         if (finished_value + 1 == batch_response->size()) {
           (*batch_callback_ptr)(std::move(*batch_response));
         }
       };
-      absl::Status result;
-      while (!(result = dispatcher_->Invoke(batch[index], callback)).ok()) {
-        // If the first request from the batch got a failure, return failure
-        // without waiting.
+    };
+    for (size_t index = 0; index < batch_size; ++index) {
+      if (absl::Status result = dispatcher_->Invoke(
+              batch[index], make_callback(index), admission_deadline);
+          !result.ok()) {
+        // If the first request from the batch got a failure, return failure.
         if (index == 0) {
+          delete_batch_metadata();
+          return result;
+        }
+        // The requests dispatched so far still run, so the rest of the batch
+        // fails through the batch callback.
+        for (; index < batch_size; ++index) {
+          make_callback(index)(result);
+        }
+        break;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Splits `batch` into chunks that each run with a single call into the
+  // sandbox of one worker.
+  template <typename InputType>
+  absl::Status NativeBatchExecuteInternal(
+      const std::vector<InvocationRequest<InputType, TMetadata>>& batch,
+      std::shared_ptr<BatchCallback> batch_callback_ptr) {
+    const size_t batch_size = batch.size();
+    // Spread the batch over the workers, as long as each chunk stays large
+    // enough to be worth a call into the sandbox of its own.
+    const size_t min_chunk_size =
+        std::max<size_t>(config_.native_batch_execution_min_chunk_size, 1);
+    const size_t num_chunks =
+        std::clamp<size_t>(batch_size / min_chunk_size, 1, workers_.size());
+    const size_t chunk_size = (batch_size + num_chunks - 1) / num_chunks;
+
+    const absl::Time admission_deadline =
+        absl::Now() + config_.batch_execute_admission_timeout;
+    auto batch_response =
+        std::make_shared<std::vector<absl::StatusOr<ResponseObject>>>(
+            batch_size, absl::StatusOr<ResponseObject>());
+    auto finished_counter = std::make_shared<std::atomic<size_t>>(0);
+    const auto make_callback = [&](size_t begin) {
+      return [batch_response, finished_counter, batch_callback_ptr, begin](
+                 std::vector<absl::StatusOr<ResponseObject>> chunk_response) {
+        const size_t count = chunk_response.size();
+        std::move(chunk_response.begin(), chunk_response.end(),
+                  batch_response->begin() + begin);
+        auto finished_value = finished_counter->fetch_add(count);
+        if (finished_value + count == batch_response->size()) {
+          (*batch_callback_ptr)(std::move(*batch_response));
+        }
+      };
+    };
+    for (size_t begin = 0; begin < batch_size; begin += chunk_size) {
+      const size_t end = std::min(begin + chunk_size, batch_size);
+      if (absl::Status result = dispatcher_->InvokeBatch(
+              std::vector<InvocationRequest<InputType, TMetadata>>(
+                  batch.begin() + begin, batch.begin() + end),
+              make_callback(begin), admission_deadline);
+          !result.ok()) {
+        // If the first chunk of the batch got a failure, return failure. The
+        // caller deletes the metadata of the batch.
+        if (begin == 0) {
           return result;
         }
+        // The chunks dispatched so far still run, so the rest of the batch
+        // fails through the batch callback.
+        make_callback(begin)(std::vector<absl::StatusOr<ResponseObject>>(
+            batch_size - begin, result));
+        break;
       }
     }
     return absl::OkStatus();
@@ -476,12 +799,20 @@ class RomaService {
 
   Config config_;
   std::vector<worker_api::WorkerSandboxApi> workers_;
+  // How long Init took to start the workers.
+  absl::Duration worker_startup_duration_;
   native_function_binding::NativeFunctionTable<TMetadata>
       native_function_binding_table_;
-  // Map of invocation request uuid to associated metadata.
+  // Metadata of in-flight invocation requests, by request handle.
   MetadataStorage<TMetadata> metadata_storage_;
   std::optional<NativeFunctionHandler<TMetadata>>
       native_function_binding_handler_;
+  // Chunk callbacks of in-flight ExecuteStreaming requests, by request handle.
+  absl::Mutex chunk_callbacks_mu_;
+  absl::flat_hash_map<RequestHandle, std::shared_ptr<ChunkCallback>>
+      chunk_callbacks_ ABSL_GUARDED_BY(chunk_callbacks_mu_);
+  // Outlives `dispatcher_`, which refers to it.
+  std::optional<dispatcher::SnapshotCache> snapshot_cache_;
   std::optional<dispatcher::Dispatcher> dispatcher_;
   std::vector<std::string> native_function_server_addresses_;
   std::optional<grpc_server::NativeFunctionGrpcServer<TMetadata>>
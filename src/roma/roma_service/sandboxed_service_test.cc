@@ -1160,6 +1160,75 @@ TEST(SandboxedServiceTest, BatchExecute) {
   ASSERT_TRUE(roma_service.Stop().ok());
 }
 
+TEST(SandboxedServiceTest, NativeBatchExecuteKeepsResponsesInOrder) {
+  Config config;
+  config.number_of_workers = 2;
+  config.enable_native_batch_execution = true;
+  config.native_batch_execution_min_chunk_size = 4;
+  RomaService<> roma_service(std::move(config));
+  ASSERT_TRUE(roma_service.Init().ok());
+
+  std::vector<absl::StatusOr<ResponseObject>> batch_responses;
+  constexpr size_t kBatchSize = 20;
+  absl::Notification load_finished;
+  absl::Notification execute_finished;
+  {
+    auto code_obj = std::make_unique<CodeObject>(CodeObject{
+        .id = "foo",
+        .version_string = "v1",
+        .js = R"JS_CODE(
+    function Handler(input) { return "Hello world! " + JSON.stringify(input);
+    }
+  )JS_CODE",
+    });
+
+    absl::Status response_status;
+    ASSERT_TRUE(roma_service
+                    .LoadCodeObj(std::move(code_obj),
+                                 [&](absl::StatusOr<ResponseObject> resp) {
+                                   response_status = resp.status();
+                                   load_finished.Notify();
+                                 })
+                    .ok());
+    ASSERT_TRUE(
+        load_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+    ASSERT_TRUE(response_status.ok());
+  }
+
+  {
+    std::vector<InvocationStrRequest<>> batch;
+    for (size_t i = 0; i < kBatchSize; ++i) {
+      batch.push_back(InvocationStrRequest<>{
+          .id = absl::StrCat("foo", i),
+          .version_string = "v1",
+          .handler_name = "Handler",
+          .input = {absl::StrCat(i)},
+      });
+    }
+    ASSERT_TRUE(
+        roma_service
+            .BatchExecute(batch,
+                          [&](const std::vector<absl::StatusOr<ResponseObject>>&
+                                  batch_resp) {
+                            batch_responses = batch_resp;
+                            execute_finished.Notify();
+                          })
+            .ok());
+    ASSERT_TRUE(
+        execute_finished.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  }
+
+  ASSERT_EQ(batch_responses.size(), kBatchSize);
+  for (size_t i = 0; i < kBatchSize; ++i) {
+    ASSERT_TRUE(batch_responses[i].ok());
+    EXPECT_EQ(batch_responses[i]->id, absl::StrCat("foo", i));
+    EXPECT_EQ(batch_responses[i]->resp,
+              absl::StrCat("\"Hello world! ", i, "\""));
+  }
+
+  ASSERT_TRUE(roma_service.Stop().ok());
+}
+
 void CallbackFunc(FunctionBindingPayload<>& wrapper) {
   wrapper.io_proto.set_output_string("Hello world!");
 }
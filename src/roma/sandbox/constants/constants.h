@@ -29,6 +29,17 @@ inline constexpr std::string_view kHandlerName = "HandlerName";
 
 inline constexpr std::string_view kInputType = "InputType";
 inline constexpr std::string_view kInputTypeBytes = "InputTypeBytes";
+// The input is, and the output is returned as, a value in the V8
+// ValueSerializer wire format.
+inline constexpr std::string_view kInputTypeSerializedValue =
+    "InputTypeSerializedValue";
+// Present if the inputs of an invocation are parsed through the shared input
+// cache of the worker.
+inline constexpr std::string_view kShareInput = "ShareInput";
+
+// Unix time, in nanoseconds, by which every invocation of a batch must have
+// started. Set in the metadata shared by the batch.
+inline constexpr std::string_view kBatchDeadline = "BatchDeadline";
 
 inline constexpr std::string_view kMinLogLevel = "MinLogLevel";
 inline constexpr std::string_view kRequestUuid = "RequestUuid";
@@ -36,6 +47,18 @@ inline constexpr std::string_view kCodeVersion = "CodeVersion";
 inline constexpr std::string_view kRequestAction = "RequestAction";
 inline constexpr std::string_view kRequestActionLoad = "Load";
 inline constexpr std::string_view kRequestActionExecute = "Execute";
+// Collects the garbage of the idle isolates of a worker. Needs no code version.
+inline constexpr std::string_view kRequestActionCollectGarbage =
+    "CollectGarbage";
+// Drops a loaded code version from the worker.
+inline constexpr std::string_view kRequestActionUnload = "Unload";
+// Asks the worker handling a load to return the V8 startup snapshot it creates
+// for the code.
+inline constexpr std::string_view kReturnStartupSnapshot =
+    "ReturnStartupSnapshot";
+// Key under which the worker hands a startup snapshot received with a load to
+// the JS engine. Only used in the metadata passed to the JS engine.
+inline constexpr std::string_view kStartupSnapshot = "StartupSnapshot";
 inline constexpr std::string_view kJsEngineOneTimeSetupWasmPagesKey =
     "MaxWasmNumberOfPages";
 inline constexpr std::string_view kJsEngineOneTimeSetupV8FlagsKey = "V8Flags";
@@ -71,6 +94,85 @@ inline constexpr std::string_view kInputParsingMetricJsEngineDuration =
 inline constexpr std::string_view kHandlerCallMetricJsEngineDuration =
     "roma.metric.js_engine_handler_call_duration";
 
+// Label for time the JS engine spent paused for garbage collection while
+// parsing the input and calling the handler function. In absl::Duration or
+// nanoseconds.
+inline constexpr std::string_view kGcPauseMetricJsEngineDuration =
+    "roma.metric.js_engine_gc_pause_duration";
+
+// Labels for the resources used by an invocation, each only reported when
+// selected by Config::invocation_resource_metrics. The CPU time of the worker
+// thread running the invocation, in absl::Duration or nanoseconds.
+inline constexpr std::string_view kExecutionMetricJsEngineCpuDuration =
+    "roma.metric.js_engine_cpu_duration";
+// The bytes allocated on the V8 heap, and the peak size of the V8 heap in use,
+// while the invocation ran.
+inline constexpr std::string_view kExecutionCounterJsEngineHeapAllocatedBytes =
+    "roma.counter.js_engine_heap_allocated_bytes";
+inline constexpr std::string_view kExecutionCounterJsEngineHeapPeakBytes =
+    "roma.counter.js_engine_heap_peak_bytes";
+// The number of native functions the invocation called, and the time it spent
+// waiting for their responses, in absl::Duration or nanoseconds.
+inline constexpr std::string_view kExecutionCounterNativeFunctionCalls =
+    "roma.counter.native_function_calls";
+inline constexpr std::string_view kExecutionMetricNativeFunctionCallDuration =
+    "roma.metric.native_function_call_duration";
+// The total size in bytes of the inputs of the invocation, and the size of its
+// output.
+inline constexpr std::string_view kExecutionCounterInputBytes =
+    "roma.counter.input_bytes";
+inline constexpr std::string_view kExecutionCounterOutputBytes =
+    "roma.counter.output_bytes";
+
+// Label for time an invocation waited between being handed to the dispatcher
+// and starting to run on a worker, including any wait for dispatcher capacity.
+// In absl::Duration or nanoseconds.
+inline constexpr std::string_view kExecutionMetricDispatchQueueWaitDuration =
+    "roma.metric.dispatch_queue_wait_duration";
+
+// Label for whether the dispatcher ran an invocation on a worker whose last
+// invocation used the same code version. Either 0 or 1 per invocation, and
+// only reported when code version affinity is enabled.
+inline constexpr std::string_view kDispatchCounterVersionAffinityHit =
+    "roma.counter.code_version_affinity_hit";
+
+// Label for how long the most recent worker startup took: that of all of the
+// workers started by RomaService::Init, or that of a single worker started on
+// demand when elastic workers are enabled. In absl::Duration or nanoseconds.
+inline constexpr std::string_view kDispatchMetricWorkerStartupDuration =
+    "roma.metric.worker_startup_duration";
+
+// Label for the number of workers running when a request finished. Only
+// reported when elastic workers are enabled.
+inline constexpr std::string_view kDispatchCounterRunningWorkers =
+    "roma.counter.running_workers";
+
+// Labels for whether an invocation ran in a newly created v8 context (created)
+// or in one reused from the context pool of its code version (reused). Each is
+// either 0 or 1 per invocation.
+inline constexpr std::string_view kExecutionCounterJsEngineContextsCreated =
+    "roma.counter.js_engine_contexts_created";
+inline constexpr std::string_view kExecutionCounterJsEngineContextsReused =
+    "roma.counter.js_engine_contexts_reused";
+
+// Label for whether a load was handed a cached startup snapshot to restore
+// instead of compiling the code. Either 0 or 1 per worker the code is loaded
+// on, and only reported when the startup snapshot cache is enabled.
+inline constexpr std::string_view kLoadCounterStartupSnapshotCacheHit =
+    "roma.counter.startup_snapshot_cache_hit";
+
+// Label for the number of inputs of an invocation that were taken, already
+// parsed, from the shared input cache of the worker. Only reported for
+// invocations that share their input.
+inline constexpr std::string_view kInputCounterSharedInputCacheHits =
+    "roma.counter.shared_input_cache_hits";
+
+// Type URL of the absl::Status payload holding how long a caller rejected for
+// lack of dispatcher capacity should wait before retrying, formatted with
+// absl::FormatDuration.
+inline constexpr std::string_view kRetryAfterStatusPayloadUrl =
+    "roma.status.retry_after";
+
 // Invalid file descriptor value.
 inline constexpr int kBadFd = -1;
 }  // namespace google::scp::roma::sandbox::constants
@@ -16,20 +16,27 @@
 
 #include "dispatcher.h"
 
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/logging/logging.h"
 #include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/sandbox/worker_api/sapi/error_codes.h"
 #include "src/roma/sandbox/worker_api/sapi/utils.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
 #include "src/util/duration.h"
@@ -38,26 +45,61 @@
 #include "src/util/status_macro/status_macros.h"
 
 namespace google::scp::roma::sandbox::dispatcher {
+using google::scp::roma::metadata_storage::RequestHandle;
+using google::scp::roma::sandbox::constants::kBatchDeadline;
+using google::scp::roma::sandbox::constants::kCodeVersion;
+using google::scp::roma::sandbox::constants::kDispatchCounterVersionAffinityHit;
+using google::scp::roma::sandbox::constants::
+    kExecutionMetricDispatchQueueWaitDuration;
+using google::scp::roma::sandbox::constants::
+    kLoadCounterStartupSnapshotCacheHit;
+using google::scp::roma::sandbox::constants::kRequestAction;
+using google::scp::roma::sandbox::constants::kRequestActionCollectGarbage;
+using google::scp::roma::sandbox::constants::kRequestActionExecute;
+using google::scp::roma::sandbox::constants::kRequestActionLoad;
+using google::scp::roma::sandbox::constants::kRequestActionUnload;
 using google::scp::roma::sandbox::constants::kRequestId;
 using google::scp::roma::sandbox::constants::kRequestUuid;
+using google::scp::roma::sandbox::constants::kRetryAfterStatusPayloadUrl;
+using google::scp::roma::sandbox::constants::kReturnStartupSnapshot;
 using google::scp::roma::sandbox::worker_api::RetryStatus;
 
+namespace {
+// Upper bound on the number of requests a consumer moves from the shared
+// queue into its local queue at once.
+constexpr size_t kMaxClaimBatchSize = 8;
+
+// Sleeping consumers re-check the queues at least this often.
+constexpr absl::Duration kIdleWaitTimeout = absl::Milliseconds(100);
+
+// Lower bound on the retry-after hint given to callers rejected for lack of
+// capacity.
+constexpr absl::Duration kMinRetryAfter = absl::Milliseconds(1);
+
+// The lane whose turn each dequeue is, out of a cycle in which urgent, normal
+// and bulk requests get 8, 4 and 1 turns respectively, spread out evenly.
+constexpr int kLaneTurns[] = {0, 1, 0, 0, 1, 0, 2, 0, 1, 0, 0, 1, 0};
+
+// Weight of the newest sample in the moving average of run durations, as a
+// power of two.
+constexpr int kRunDurationAverageShift = 3;
+}  // namespace
+
 Dispatcher::~Dispatcher() {
-  // Wait for per-worker queues to empty to ensure cleanup runs.
+  // Wait for per-worker load queues to empty to ensure cleanup runs.
   auto fn = [&] {
-    mu_.AssertReaderHeld();
-    for (const auto& queue : per_worker_requests_) {
-      if (!queue.empty()) {
+    for (const WorkerQueue& queue : worker_queues_) {
+      if (queue.num_loads > 0) {
         return false;
       }
     }
     return true;
   };
   {
-    absl::MutexLock lock(&mu_);
-    mu_.Await(absl::Condition(&fn));
-    requests_ = {};
+    absl::MutexLock lock(&idle_mu_);
+    idle_mu_.Await(absl::Condition(&fn));
     kill_consumers_ = true;
+    idle_cv_.SignalAll();
   }
   for (std::thread& consumer : consumers_) {
     consumer.join();
@@ -68,26 +110,89 @@ absl::Status Dispatcher::Load(
     CodeObject code_object,
     absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback) {
   PS_RETURN_IF_ERROR(AssertRequestIsValid(code_object));
+  std::string version = code_object.version_string;
   ::worker_api::WorkerParamsProto param =
       RequestToProto(std::move(code_object));
-  const int n_workers = workers_.size();
+  // Workers that are not running load the code once they start.
+  absl::MutexLock params_lock(&params_mu_);
+  QueueForRunningWorkers(param, std::move(callback));
+  code_versions_[version] = CodeVersion{
+      .load = std::move(param),
+      .last_used = std::make_shared<std::atomic<uint64_t>>(
+          ++code_version_clock_),
+  };
+  if (code_version_limits_.has_value()) {
+    EvictCodeVersions(version);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Dispatcher::Unload(std::string_view code_version) {
+  absl::MutexLock params_lock(&params_mu_);
+  if (code_versions_.erase(code_version) == 0) {
+    return absl::NotFoundError(
+        absl::StrCat("No code is loaded for version ", code_version));
+  }
+  // Invocations which find the version loaded skip `code_versions_`.
+  if (code_version_limits_.has_value()) {
+    for (WorkerQueue& queue : worker_queues_) {
+      absl::MutexLock lock(&queue.mu);
+      queue.loaded_versions.erase(code_version);
+    }
+  }
+  ::worker_api::WorkerParamsProto param;
+  (*param.mutable_metadata())[std::string(kCodeVersion)] = code_version;
+  (*param.mutable_metadata())[std::string(kRequestAction)] =
+      kRequestActionUnload;
+  QueueForRunningWorkers(param, [](auto) {});
+  return absl::OkStatus();
+}
+
+absl::flat_hash_map<std::string, Dispatcher::CodeVersionStats>
+Dispatcher::GetCodeVersionStats() {
+  absl::MutexLock lock(&params_mu_);
+  absl::flat_hash_map<std::string, CodeVersionStats> stats;
+  stats.reserve(code_versions_.size());
+  for (const auto& [version, code_version] : code_versions_) {
+    stats[version] = CodeVersionStats{
+        .size_bytes = code_version.SizeBytes(),
+        .snapshot_bytes = code_version.snapshot_bytes,
+        .resident = code_version.resident,
+    };
+  }
+  return stats;
+}
+
+void Dispatcher::QueueForRunningWorkers(
+    const ::worker_api::WorkerParamsProto& param,
+    absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback) {
+  std::vector<WorkerQueue*> running;
+  running.reserve(worker_queues_.size());
+  for (WorkerQueue& queue : worker_queues_) {
+    if (queue.state == WorkerState::kRunning) {
+      running.push_back(&queue);
+    }
+  }
+  const int n_workers = running.size();
   if (n_workers == 1) {
-    absl::MutexLock lock(&mu_);
-    per_worker_requests_.front().push(Request{
+    WorkerQueue& queue = *running.front();
+    absl::MutexLock lock(&queue.mu);
+    queue.loads.push(Request{
         .param = param,
         .callback =
             [callback = std::move(callback)](auto response) mutable {
               std::move(callback)(std::move(response));
             },
     });
-    params_.push_back(std::move(param));
+    queue.num_loads.fetch_add(1);
   } else {
     auto* const mu = new absl::Mutex;
     auto* const counter = new int(0);
     auto* const shared_callback = new decltype(callback)(std::move(callback));
-    absl::MutexLock lock(&mu_);
-    for (auto& queue : per_worker_requests_) {
-      queue.push(Request{
+    for (WorkerQueue* const queue_ptr : running) {
+      WorkerQueue& queue = *queue_ptr;
+      absl::MutexLock lock(&queue.mu);
+      queue.loads.push(Request{
           .param = param,
           .callback =
               [=](auto response) {
@@ -108,104 +213,1024 @@ absl::Status Dispatcher::Load(
                 }
               },
       });
+      queue.num_loads.fetch_add(1);
+    }
+  }
+  {
+    // Every consumer has a new load to run.
+    absl::MutexLock lock(&idle_mu_);
+    idle_cv_.SignalAll();
+  }
+}
+
+std::vector<::worker_api::WorkerParamsProto> Dispatcher::ResidentLoads() {
+  std::vector<::worker_api::WorkerParamsProto> loads;
+  loads.reserve(code_versions_.size());
+  for (const auto& [_, code_version] : code_versions_) {
+    if (code_version.resident) {
+      loads.push_back(code_version.load);
+    }
+  }
+  return loads;
+}
+
+void Dispatcher::EvictCodeVersions(std::string_view keep) {
+  size_t num_resident = 0;
+  size_t resident_bytes = 0;
+  for (const auto& [_, code_version] : code_versions_) {
+    if (code_version.resident) {
+      ++num_resident;
+      resident_bytes += code_version.SizeBytes();
+    }
+  }
+  const auto exceeds_limits = [&] {
+    return (code_version_limits_->max_versions > 0 &&
+            num_resident > code_version_limits_->max_versions) ||
+           (code_version_limits_->max_bytes > 0 &&
+            resident_bytes > code_version_limits_->max_bytes);
+  };
+  while (exceeds_limits()) {
+    std::string_view lru_version;
+    CodeVersion* lru = nullptr;
+    for (auto& [version, code_version] : code_versions_) {
+      if (code_version.resident && version != keep &&
+          (lru == nullptr || *code_version.last_used < *lru->last_used)) {
+        lru_version = version;
+        lru = &code_version;
+      }
+    }
+    if (lru == nullptr) {
+      // Only `keep` is left, which stays however large it is.
+      return;
+    }
+    ROMA_VLOG(1) << "Dropping code version " << lru_version
+                 << " from the workers";
+    lru->resident = false;
+    --num_resident;
+    resident_bytes -= lru->SizeBytes();
+    ::worker_api::WorkerParamsProto param;
+    (*param.mutable_metadata())[std::string(kCodeVersion)] = lru_version;
+    (*param.mutable_metadata())[std::string(kRequestAction)] =
+        kRequestActionUnload;
+    QueueForRunningWorkers(param, [](auto) {});
+  }
+}
+
+absl::Status Dispatcher::EnsureCodeVersionLoaded(int i,
+                                                 const Request& request) {
+  const auto& metadata = request.param.metadata();
+  const auto action = metadata.find(std::string(kRequestAction));
+  const auto version = metadata.find(std::string(kCodeVersion));
+  if (action == metadata.end() || action->second != kRequestActionExecute ||
+      version == metadata.end()) {
+    return absl::OkStatus();
+  }
+  WorkerQueue& queue = worker_queues_[i];
+  {
+    absl::MutexLock lock(&queue.mu);
+    const auto not_reloading = [&]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(queue.mu) {
+      return !queue.reloading_versions.contains(version->second);
+    };
+    queue.mu.Await(absl::Condition(&not_reloading));
+    if (const auto it = queue.loaded_versions.find(version->second);
+        it != queue.loaded_versions.end()) {
+      it->second->store(++code_version_clock_);
+      return absl::OkStatus();
+    }
+    queue.reloading_versions.insert(version->second);
+  }
+  absl::Cleanup reloaded = [&] {
+    absl::MutexLock lock(&queue.mu);
+    queue.reloading_versions.erase(version->second);
+  };
+  ::worker_api::WorkerParamsProto load;
+  {
+    absl::MutexLock lock(&params_mu_);
+    const auto it = code_versions_.find(version->second);
+    if (it == code_versions_.end()) {
+      return absl::NotFoundError(
+          "Could not find a stored context for the execution request.");
+    }
+    it->second.last_used->store(++code_version_clock_);
+    if (!it->second.resident) {
+      it->second.resident = true;
+      EvictCodeVersions(version->second);
+    }
+    load = it->second.load;
+  }
+  ROMA_VLOG(1) << "Loading the dropped code version " << version->second
+               << " into the worker " << i;
+  const std::optional<SnapshotLoad> snapshot_load = AttachStartupSnapshot(load);
+  size_t snapshot_bytes = load.startup_snapshot().size();
+  auto [status, _] = workers_[i].RunCode(load);
+  snapshot_bytes = std::max(snapshot_bytes, load.startup_snapshot().size());
+  if (snapshot_load.has_value()) {
+    StoreStartupSnapshot(*snapshot_load, load);
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "Loading the code version " << version->second
+               << " into the worker " << i << " failed with " << status;
+    return status;
+  }
+  TrackLoadedVersion(i, load, snapshot_bytes);
+  return absl::OkStatus();
+}
+
+void Dispatcher::TrackLoadedVersion(
+    int i, const ::worker_api::WorkerParamsProto& param,
+    size_t snapshot_bytes) {
+  const auto& metadata = param.metadata();
+  const auto action = metadata.find(std::string(kRequestAction));
+  const auto version = metadata.find(std::string(kCodeVersion));
+  if (action == metadata.end() || version == metadata.end()) {
+    return;
+  }
+  WorkerQueue& queue = worker_queues_[i];
+  if (action->second == kRequestActionLoad) {
+    std::shared_ptr<std::atomic<uint64_t>> last_used;
+    if (snapshot_bytes > 0 || code_version_limits_.has_value()) {
+      absl::MutexLock lock(&params_mu_);
+      if (const auto it = code_versions_.find(version->second);
+          it != code_versions_.end()) {
+        last_used = it->second.last_used;
+        if (snapshot_bytes > 0 && it->second.snapshot_bytes != snapshot_bytes) {
+          it->second.snapshot_bytes = snapshot_bytes;
+          if (code_version_limits_.has_value() && it->second.resident) {
+            EvictCodeVersions(version->second);
+          }
+        }
+      }
+    }
+    // A version unloaded in the meantime is not tracked, so that invocations
+    // of it fail rather than run on a worker which still holds it.
+    if (code_version_limits_.has_value() && last_used != nullptr) {
+      absl::MutexLock lock(&queue.mu);
+      queue.loaded_versions[version->second] = std::move(last_used);
+    }
+  } else if (action->second == kRequestActionUnload &&
+             code_version_limits_.has_value()) {
+    absl::MutexLock lock(&queue.mu);
+    queue.loaded_versions.erase(version->second);
+  }
+}
+
+absl::Status Dispatcher::Enqueue(Request request,
+                                 absl::Time admission_deadline) {
+  request.received_at = absl::Now();
+  if (request.deadline <= request.received_at) {
+    num_deadline_shed_.fetch_add(1);
+    return absl::DeadlineExceededError(
+        "Dispatch is disallowed since the request deadline has passed.");
+  }
+  // Reserve a slot before touching the queue so that a lane can never hold
+  // more than its maximum number of pending requests. There is no point in
+  // waiting for one past the request deadline.
+  Lane& lane = GetLane(request.priority);
+  if (!AcquirePendingSlot(lane,
+                          std::min(admission_deadline, request.deadline))) {
+    return CapacityExhaustedError(
+        "Dispatch is disallowed since the number of unfinished requests is "
+        "at capacity.");
+  }
+  IndexForCancellation(request);
+  if (version_affinity_delay_.has_value() && PushToAffineWorker(request)) {
+    return absl::OkStatus();
+  }
+  if (!lane.requests.TryPush(request)) {
+    ReleasePendingSlot(lane);
+    if (!ClaimFromCancelIndex(request)) {
+      // Cancelled before it could be queued, so its callback already ran.
+      return absl::OkStatus();
     }
-    params_.push_back(std::move(param));
+    return CapacityExhaustedError(
+        "Dispatch is disallowed since the request queue is full.");
   }
+  WakeIdleConsumer();
   return absl::OkStatus();
 }
 
+bool Dispatcher::AcquirePendingSlot(Lane& lane, absl::Time deadline) {
+  const auto try_acquire = [&lane] {
+    int pending = lane.num_pending;
+    while (pending < lane.max_pending) {
+      if (lane.num_pending.compare_exchange_weak(pending, pending + 1)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  if (try_acquire()) {
+    return true;
+  }
+  if (deadline <= absl::Now()) {
+    return false;
+  }
+  absl::MutexLock lock(&admission_mu_);
+  // Consumers read `num_admission_waiters` after releasing a slot, so either
+  // they see this caller waiting and signal it, or `try_acquire` sees the
+  // released slot.
+  lane.num_admission_waiters.fetch_add(1);
+  bool acquired = try_acquire();
+  while (!acquired) {
+    const bool timed_out =
+        lane.admission_cv.WaitWithDeadline(&admission_mu_, deadline);
+    acquired = try_acquire();
+    if (timed_out) {
+      break;
+    }
+  }
+  lane.num_admission_waiters.fetch_sub(1);
+  return acquired;
+}
+
+void Dispatcher::ReleasePendingSlot(Lane& lane) {
+  lane.num_pending.fetch_sub(1);
+  if (lane.num_admission_waiters > 0) {
+    absl::MutexLock lock(&admission_mu_);
+    lane.admission_cv.Signal();
+  }
+}
+
+absl::Status Dispatcher::CapacityExhaustedError(
+    std::string_view message) const {
+  // A pending request starts to run as soon as any consumer finishes the
+  // request it is running.
+  const absl::Duration retry_after =
+      std::max(absl::Nanoseconds(avg_run_duration_nanos_.load()) /
+                   std::max(num_consumers_, 1),
+               kMinRetryAfter);
+  absl::Status status = absl::ResourceExhaustedError(absl::StrCat(
+      message, " Retry after ", absl::FormatDuration(retry_after), "."));
+  status.SetPayload(kRetryAfterStatusPayloadUrl,
+                    absl::Cord(absl::FormatDuration(retry_after)));
+  return status;
+}
+
+std::optional<absl::Duration> Dispatcher::GetRetryAfter(
+    const absl::Status& status) {
+  std::optional<absl::Cord> payload =
+      status.GetPayload(kRetryAfterStatusPayloadUrl);
+  absl::Duration retry_after;
+  if (!payload.has_value() ||
+      !absl::ParseDuration(std::string(*payload), &retry_after)) {
+    return std::nullopt;
+  }
+  return retry_after;
+}
+
 void Dispatcher::ConsumerImpl(int i) {
-  while (true) {
-    Request request;
+  while (!kill_consumers_) {
+    if (worker_queues_[i].num_loads > 0) {
+      RunNextLoad(i);
+    } else if (worker_queues_[i].state != WorkerState::kRunning) {
+      WaitToStart(i);
+    } else if (!RunNextInvocation(i)) {
+      WaitForWork(i);
+    }
+  }
+}
+
+void Dispatcher::RunNextLoad(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  {
+    // Waits for the invocations in flight on this worker to finish.
+    absl::MutexLock run_lock(&queue.run_mu);
+    std::optional<Request> load;
     {
-      auto fn = [&] {
-        mu_.AssertReaderHeld();
-        return kill_consumers_ || !per_worker_requests_[i].empty() ||
-               !requests_.empty();
-      };
-      absl::MutexLock lock(&mu_);
-      mu_.Await(absl::Condition(&fn));
-      if (kill_consumers_) {
-        break;
+      absl::MutexLock lock(&queue.mu);
+      if (queue.loads.empty()) {
+        // Another consumer of this worker ran it.
+        return;
       }
+      load = std::move(queue.loads.front());
+      queue.loads.pop();
+      queue.num_loads.fetch_sub(1);
+    }
+    RunRequest(i, *std::move(load));
+  }
+  // Releasing `idle_mu_` lets the destructor re-evaluate whether every load
+  // has been run.
+  absl::MutexLock lock(&idle_mu_);
+}
+
+bool Dispatcher::RunNextInvocation(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  absl::ReaderMutexLock run_lock(&queue.run_mu);
+  // Prioritize loading over executing.
+  if (queue.num_loads > 0) {
+    return true;
+  }
+  // The worker may have been stopped since the consumer last looked.
+  if (queue.state != WorkerState::kRunning) {
+    return false;
+  }
+  std::optional<Request> request = TryNextInvocation(i);
+  if (!request.has_value()) {
+    return false;
+  }
+  ReleasePendingSlot(GetLane(request->priority));
+  // A cancelled request is left in the queues as a tombstone.
+  if (ClaimFromCancelIndex(*request) && !ShedIfExpired(*request)) {
+    if (version_affinity_delay_.has_value()) {
+      RecordVersionAffinity(i, *request);
+    }
+    RunRequest(i, *std::move(request));
+  }
+  return true;
+}
+
+std::optional<Dispatcher::Request> Dispatcher::TryNextInvocation(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  if (queue.num_local > 0) {
+    absl::MutexLock lock(&queue.mu);
+    if (!queue.local.empty()) {
+      return TakeLocal(queue, queue.local.begin());
+    }
+  }
+  if (std::optional<Request> request = ClaimFromSharedQueue(i)) {
+    return request;
+  }
+  return StealFrom(i);
+}
 
-      // Prioritize loading over executing.
-      if (!per_worker_requests_[i].empty()) {
-        request = std::move(per_worker_requests_[i].front());
-        per_worker_requests_[i].pop();
-      } else {
-        request = std::move(requests_.front());
-        requests_.pop();
+void Dispatcher::WaitForWork(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  bool collect_garbage = false;
+  bool stop_worker = false;
+  {
+    absl::MutexLock lock(&idle_mu_);
+    // Producers read `num_idle_` after publishing a request, so either they
+    // see this consumer as idle and signal it, or `HasWork` sees the request.
+    num_idle_.fetch_add(1);
+    queue.num_idle.fetch_add(1);
+    absl::Duration timeout =
+        version_affinity_delay_.has_value()
+            ? std::min(*version_affinity_delay_, kIdleWaitTimeout)
+            : kIdleWaitTimeout;
+    if (idle_gc_delay_.has_value()) {
+      timeout = std::min(timeout, *idle_gc_delay_);
+    }
+    const bool may_stop = elastic_workers_.has_value() &&
+                          i >= elastic_workers_->min_workers;
+    if (may_stop) {
+      timeout = std::min(timeout, elastic_workers_->idle_stop_delay);
+    }
+    const absl::Time idle_since = absl::Now();
+    while (!kill_consumers_ && !HasWork(i)) {
+      // Pinned requests become stealable without any signal, so recheck them
+      // whenever the wait times out.
+      if (!idle_cv_.WaitWithTimeout(&idle_mu_, timeout)) {
+        continue;
+      }
+      if (HasPinnedWork(i)) {
+        break;
+      }
+      // Only one consumer of the worker collects its garbage, and only while
+      // none of the others has a request in flight that would wait for it.
+      if (idle_gc_delay_.has_value() &&
+          absl::Now() - idle_since >= *idle_gc_delay_ &&
+          queue.num_idle == workers_[i].SlotCount() &&
+          queue.needs_gc.exchange(false)) {
+        collect_garbage = true;
+        break;
+      }
+      if (may_stop &&
+          absl::Now() - idle_since >= elastic_workers_->idle_stop_delay) {
+        stop_worker = true;
+        break;
       }
     }
-    privacy_sandbox::server_common::Stopwatch stopwatch;
-    if (auto [error, retry_status] = workers_[i].RunCode(request.param);
-        !error.ok()) {
-      LOG(ERROR) << "The worker " << i << " execute the request failed due to "
-                 << error;
-      if (retry_status == RetryStatus::kRetry) {
-        // This means that the worker crashed and the request could be retried,
-        // however, we need to reload the worker with the cached code.
-        std::vector<::worker_api::WorkerParamsProto> params;
-        {
-          absl::MutexLock lock(&mu_);
-          params = params_;
-        }
-        for (::worker_api::WorkerParamsProto& param : params) {
-          if (auto [status, _] = workers_[i].RunCode(param); !status.ok()) {
-            LOG(ERROR) << "Reloading the worker cache failed with " << status;
-            break;
-          }
+    queue.num_idle.fetch_sub(1);
+    num_idle_.fetch_sub(1);
+  }
+  if (collect_garbage) {
+    CollectGarbage(i);
+  } else if (stop_worker) {
+    StopWorker(i);
+  }
+}
+
+void Dispatcher::WaitToStart(int i) {
+  {
+    absl::MutexLock lock(&idle_mu_);
+    if (!kill_consumers_) {
+      idle_cv_.WaitWithTimeout(&idle_mu_, kIdleWaitTimeout);
+    }
+  }
+  if (kill_consumers_ || !NeedsMoreWorkers()) {
+    return;
+  }
+  WorkerQueue& queue = worker_queues_[i];
+  WorkerState stopped = WorkerState::kStopped;
+  if (!queue.state.compare_exchange_strong(stopped, WorkerState::kStarting)) {
+    // Another consumer of the worker is starting or stopping it.
+    return;
+  }
+  if (worker_starting_.exchange(true)) {
+    queue.state = WorkerState::kStopped;
+    return;
+  }
+  StartWorker(i);
+  worker_starting_ = false;
+}
+
+bool Dispatcher::NeedsMoreWorkers() const {
+  if (num_idle_ > 0) {
+    return false;
+  }
+  for (const std::unique_ptr<Lane>& lane : lanes_) {
+    if (!lane->requests.EmptyApprox()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Dispatcher::StartWorker(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  absl::Status status = workers_[i].Init();
+  if (status.ok()) {
+    status = workers_[i].Run();
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "Starting the worker " << i << " failed with " << status;
+    (void)workers_[i].Stop();
+    queue.state = WorkerState::kStopped;
+    return;
+  }
+  // Keeps the consumers of the worker from running invocations until the code
+  // is loaded.
+  absl::MutexLock run_lock(&queue.run_mu);
+  std::vector<::worker_api::WorkerParamsProto> params;
+  {
+    absl::MutexLock lock(&params_mu_);
+    params = ResidentLoads();
+    queue.state = WorkerState::kRunning;
+  }
+  LoadCachedCode(i, std::move(params));
+  num_running_workers_.fetch_add(1);
+  const absl::Duration startup_duration = stopwatch.GetElapsedTime();
+  worker_startup_nanos_ = absl::ToInt64Nanoseconds(startup_duration);
+  ROMA_VLOG(1) << "Started the worker " << i << " in " << startup_duration;
+}
+
+void Dispatcher::StopWorker(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  {
+    absl::MutexLock lock(&params_mu_);
+    // A load queued in the meantime must run on the worker.
+    WorkerState running = WorkerState::kRunning;
+    if (queue.num_loads > 0 ||
+        !queue.state.compare_exchange_strong(running, WorkerState::kStopping)) {
+      return;
+    }
+  }
+  num_running_workers_.fetch_sub(1);
+  if (version_affinity_delay_.has_value()) {
+    absl::MutexLock lock(&affinity_mu_);
+    absl::erase_if(version_owners_,
+                   [i](const auto& owner) { return owner.second == i; });
+  }
+  // Waits for the invocations in flight on the worker to finish.
+  absl::MutexLock run_lock(&queue.run_mu);
+  // Stopping the worker also ends its sandbox.
+  (void)workers_[i].Stop();
+  queue.needs_gc = false;
+  if (code_version_limits_.has_value()) {
+    absl::MutexLock lock(&queue.mu);
+    queue.loaded_versions.clear();
+  }
+  queue.state = WorkerState::kStopped;
+  ROMA_VLOG(1) << "Stopped the idle worker " << i;
+}
+
+void Dispatcher::CollectGarbage(int i) {
+  WorkerQueue& queue = worker_queues_[i];
+  // Loads must not run at the same time.
+  absl::ReaderMutexLock run_lock(&queue.run_mu);
+  // Work that arrived since the worker went idle must not wait behind the
+  // collection, so leave that to the next time the worker is idle.
+  if (HasWork(i) || queue.num_idle < workers_[i].SlotCount() - 1) {
+    queue.needs_gc = true;
+    return;
+  }
+  num_idle_garbage_collections_.fetch_add(1);
+  ::worker_api::WorkerParamsProto param;
+  (*param.mutable_metadata())[std::string(kRequestAction)] =
+      kRequestActionCollectGarbage;
+  if (auto [status, retry_status] = workers_[i].RunCode(param); !status.ok()) {
+    LOG(ERROR) << "The worker " << i << " failed to collect garbage due to "
+               << status;
+    if (retry_status == RetryStatus::kRetry) {
+      ReloadWorker(i);
+    }
+  }
+}
+
+std::optional<Dispatcher::Request> Dispatcher::ClaimFromSharedQueue(int i) {
+  const uint64_t n = lane_turn_.fetch_add(1, std::memory_order_relaxed);
+  const int turn = kLaneTurns[n % std::size(kLaneTurns)];
+  int lane_index = turn;
+  std::optional<Request> request = lanes_[turn]->requests.TryPop();
+  for (int j = 0; !request.has_value() && j < lanes_.size(); ++j) {
+    if (j != turn) {
+      request = lanes_[j]->requests.TryPop();
+      lane_index = j;
+    }
+  }
+  if (!request.has_value()) {
+    return std::nullopt;
+  }
+  Lane& lane = *lanes_[lane_index];
+  // Only claim extra requests when there is a backlog large enough for every
+  // consumer to get a share, so that claiming never holds back a request an
+  // idle consumer could have started. Claimed requests stay stealable. Nor
+  // claim any while more urgent requests wait, since those would then wait
+  // behind the claimed ones.
+  size_t share =
+      std::min(lane.requests.SizeApprox() / num_consumers_, kMaxClaimBatchSize);
+  for (int j = 0; share > 0 && j < lane_index; ++j) {
+    if (!lanes_[j]->requests.EmptyApprox()) {
+      share = 0;
+    }
+  }
+  if (share > 0) {
+    WorkerQueue& queue = worker_queues_[i];
+    {
+      absl::MutexLock lock(&queue.mu);
+      for (size_t n = 0; n < share; ++n) {
+        std::optional<Request> claimed = lane.requests.TryPop();
+        if (!claimed.has_value()) {
+          break;
         }
-        ROMA_VLOG(1)
-            << "Successfully reload all cached code objects to the worker"
-            << index;
+        queue.local.push_back(*std::move(claimed));
+        queue.num_local.fetch_add(1);
       }
-      std::move(request).callback(std::move(error));
-    } else {
-      absl::Duration run_code_duration = stopwatch.GetElapsedTime();
-      ResponseObject response;
-      response.metrics.reserve(1 + request.param.metrics_size());
-      response.metrics[roma::sandbox::constants::
-                           kExecutionMetricSandboxedJsEngineCallDuration] =
-          std::move(run_code_duration);
-      absl::Status status = [&] {
-        for (auto& [key, proto_duration] : *request.param.mutable_metrics()) {
-          PS_ASSIGN_OR_RETURN(
-              response.metrics[std::move(key)],
-              privacy_sandbox::server_common::DecodeGoogleApiProto(
-                  proto_duration));
-        }
-        return absl::OkStatus();
-      }();
-      if (!status.ok()) {
-        std::move(request).callback(std::move(status));
-      } else {
-        response.id =
-            std::move((*request.param.mutable_metadata())[kRequestId]);
-        response.resp = std::move(*request.param.mutable_response());
-        response.profiler_output =
-            std::move(*request.param.mutable_profiler_output());
-        std::move(request).callback(std::move(response));
+    }
+    WakeIdleConsumer();
+  }
+  return request;
+}
+
+std::optional<Dispatcher::Request> Dispatcher::StealFrom(int i) {
+  const int n_workers = workers_.size();
+  const absl::Time now = version_affinity_delay_.has_value()
+                             ? absl::Now()
+                             : absl::InfinitePast();
+  for (int offset = 1; offset < n_workers; ++offset) {
+    WorkerQueue& victim = worker_queues_[(i + offset) % n_workers];
+    if (victim.num_local == 0) {
+      continue;
+    }
+    absl::MutexLock lock(&victim.mu);
+    for (auto it = victim.local.begin(); it != victim.local.end(); ++it) {
+      if (it->stealable_after <= now) {
+        return TakeLocal(victim, it);
       }
     }
   }
+  return std::nullopt;
 }
 
-void Dispatcher::Cancel(const ExecutionToken& token) {
-  absl::MutexLock lock(&mu_);
+Dispatcher::Request Dispatcher::TakeLocal(WorkerQueue& queue,
+                                          std::deque<Request>::iterator it) {
+  Request request = std::move(*it);
+  queue.local.erase(it);
+  queue.num_local.fetch_sub(1);
+  if (request.stealable_after != absl::InfinitePast()) {
+    queue.num_pinned.fetch_sub(1);
+  }
+  return request;
+}
+
+bool Dispatcher::HasWork(int i) const {
+  const WorkerQueue& own = worker_queues_[i];
+  if (own.num_loads > 0 || own.num_local > 0) {
+    return true;
+  }
+  for (const std::unique_ptr<Lane>& lane : lanes_) {
+    if (!lane->requests.EmptyApprox()) {
+      return true;
+    }
+  }
+  for (const WorkerQueue& queue : worker_queues_) {
+    if (queue.num_local > queue.num_pinned) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Dispatcher::HasPinnedWork(int i) const {
+  for (int j = 0; j < worker_queues_.size(); ++j) {
+    if (j != i && worker_queues_[j].num_pinned > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Dispatcher::PushToAffineWorker(Request& request) {
+  const auto& metadata = request.param.metadata();
+  const auto version_it = metadata.find(kCodeVersion);
+  if (version_it == metadata.end()) {
+    return false;
+  }
+  int owner;
+  {
+    absl::MutexLock lock(&affinity_mu_);
+    const auto it = version_owners_.find(version_it->second);
+    if (it == version_owners_.end()) {
+      return false;
+    }
+    owner = it->second;
+  }
+  request.stealable_after = absl::Now() + *version_affinity_delay_;
+  {
+    WorkerQueue& queue = worker_queues_[owner];
+    absl::MutexLock lock(&queue.mu);
+    queue.local.push_back(std::move(request));
+    queue.num_local.fetch_add(1);
+    queue.num_pinned.fetch_add(1);
+  }
+  // Any idle consumer may be the owner, so wake all of them. The others go
+  // back to sleep since pinned requests do not count as work for them.
+  if (num_idle_ > 0) {
+    absl::MutexLock lock(&idle_mu_);
+    idle_cv_.SignalAll();
+  }
+  return true;
+}
+
+void Dispatcher::RecordVersionAffinity(int i, Request& request) {
+  const auto& metadata = request.param.metadata();
+  const auto version_it = metadata.find(kCodeVersion);
+  if (version_it == metadata.end()) {
+    return;
+  }
+  {
+    WorkerQueue& queue = worker_queues_[i];
+    absl::MutexLock lock(&queue.mu);
+    request.version_affinity_hit = queue.last_version == version_it->second;
+    if (*request.version_affinity_hit) {
+      version_affinity_hits_.fetch_add(1);
+      return;
+    }
+    queue.last_version = version_it->second;
+  }
+  version_affinity_misses_.fetch_add(1);
+  absl::MutexLock lock(&affinity_mu_);
+  version_owners_[version_it->second] = i;
+}
 
-  size_t num_queued_requests = requests_.size();
-  for (int i = 0; i < num_queued_requests; i++) {
-    Request item = std::move(requests_.front());
-    requests_.pop();
+void Dispatcher::WakeIdleConsumer() {
+  if (num_idle_ == 0) {
+    return;
+  }
+  absl::MutexLock lock(&idle_mu_);
+  idle_cv_.Signal();
+}
+
+bool Dispatcher::ShedIfExpired(Request& request) {
+  if (request.deadline == absl::InfiniteFuture()) {
+    return false;
+  }
+  const absl::Duration remaining = request.deadline - absl::Now();
+  if (remaining <= absl::ZeroDuration()) {
+    num_deadline_shed_.fetch_add(1);
+    FailRequest(std::move(request),
+                absl::DeadlineExceededError(
+                    "Request deadline passed before it was dispatched."));
+    return true;
+  }
+  const auto cap_timeout = [remaining](::worker_api::WorkerParamsProto& param) {
+    auto& metadata = *param.mutable_metadata();
+    absl::Duration timeout = kDefaultExecutionTimeout;
+    if (const auto it = metadata.find(std::string(kTimeoutDurationTag));
+        it != metadata.end() && !absl::ParseDuration(it->second, &timeout)) {
+      // Leave unparseable timeouts for the worker to report.
+      return;
+    }
+    if (remaining < timeout) {
+      metadata[std::string(kTimeoutDurationTag)] =
+          absl::FormatDuration(remaining);
+    }
+  };
+  if (request.param.batch().empty()) {
+    cap_timeout(request.param);
+    return false;
+  }
+  // Batch elements run one after the other, so the remaining time cannot be
+  // handed to each of them. The worker instead fails the elements which start
+  // after the deadline, and caps the timeout of the others to it.
+  (*request.param.mutable_metadata())[std::string(kBatchDeadline)] =
+      absl::StrCat(absl::ToUnixNanos(request.deadline));
+  return false;
+}
 
-    if (item.param.metadata().at(kRequestUuid) != token.value) {
-      requests_.push(std::move(item));
-    } else {
-      std::move(item).callback(
-          absl::CancelledError("Request has been cancelled."));
+void Dispatcher::ReloadWorker(int i) {
+  std::vector<::worker_api::WorkerParamsProto> params;
+  {
+    absl::MutexLock lock(&params_mu_);
+    params = ResidentLoads();
+  }
+  LoadCachedCode(i, std::move(params));
+}
+
+void Dispatcher::LoadCachedCode(
+    int i, std::vector<::worker_api::WorkerParamsProto> params) {
+  if (code_version_limits_.has_value()) {
+    absl::MutexLock lock(&worker_queues_[i].mu);
+    worker_queues_[i].loaded_versions.clear();
+  }
+  for (::worker_api::WorkerParamsProto& param : params) {
+    const std::optional<SnapshotLoad> snapshot_load =
+        AttachStartupSnapshot(param);
+    size_t snapshot_bytes = param.startup_snapshot().size();
+    auto [status, _] = workers_[i].RunCode(param);
+    snapshot_bytes = std::max(snapshot_bytes, param.startup_snapshot().size());
+    if (snapshot_load.has_value()) {
+      StoreStartupSnapshot(*snapshot_load, param);
+    }
+    if (!status.ok()) {
+      LOG(ERROR) << "Reloading the worker cache failed with " << status;
+      return;
+    }
+    TrackLoadedVersion(i, param, snapshot_bytes);
+  }
+  ROMA_VLOG(1) << "Successfully reload all cached code objects to the worker "
+               << i;
+}
+
+void Dispatcher::RunRequest(int i, Request request) {
+  if (idle_gc_delay_.has_value()) {
+    worker_queues_[i].needs_gc = true;
+  }
+  // Loads are not handed to the dispatcher through `Enqueue`.
+  std::optional<absl::Duration> queue_wait;
+  if (request.received_at != absl::InfinitePast()) {
+    queue_wait = absl::Now() - request.received_at;
+    queue_wait_histogram_.Record(*queue_wait);
+  }
+  if (code_version_limits_.has_value()) {
+    if (absl::Status status = EnsureCodeVersionLoaded(i, request);
+        !status.ok()) {
+      FailRequest(std::move(request), std::move(status));
+      return;
+    }
+  }
+  const std::optional<SnapshotLoad> snapshot_load =
+      AttachStartupSnapshot(request.param);
+  const bool snapshot_cache_hit = request.param.has_startup_snapshot();
+  size_t snapshot_bytes = request.param.startup_snapshot().size();
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  auto [error, retry_status] = workers_[i].RunCode(request.param);
+  const absl::Duration run_code_duration = stopwatch.GetElapsedTime();
+  snapshot_bytes =
+      std::max(snapshot_bytes, request.param.startup_snapshot().size());
+  if (snapshot_load.has_value()) {
+    StoreStartupSnapshot(*snapshot_load, request.param);
+  }
+  if (!error.ok()) {
+    LOG(ERROR) << "The worker " << i << " execute the request failed due to "
+               << error;
+    if (retry_status == RetryStatus::kRetry) {
+      // This means that the worker crashed and the request could be retried,
+      // however, we need to reload the worker with the cached code.
+      ReloadWorker(i);
+    }
+    FailRequest(std::move(request), error);
+    return;
+  }
+  TrackLoadedVersion(i, request.param, snapshot_bytes);
+  if (snapshot_load.has_value()) {
+    (*request.param.mutable_counters())[kLoadCounterStartupSnapshotCacheHit] =
+        snapshot_cache_hit ? 1 : 0;
+  }
+  if (request.version_affinity_hit.has_value()) {
+    (*request.param.mutable_counters())[kDispatchCounterVersionAffinityHit] =
+        *request.version_affinity_hit ? 1 : 0;
+  }
+  if (queue_wait.has_value()) {
+    // Consumers finish concurrently, so retry until no other update of the
+    // average has happened in between.
+    const int64_t run_nanos = absl::ToInt64Nanoseconds(run_code_duration);
+    int64_t avg = avg_run_duration_nanos_.load();
+    while (!avg_run_duration_nanos_.compare_exchange_weak(
+        avg, avg + ((run_nanos - avg) >> kRunDurationAverageShift))) {
+    }
+  }
+  if (!request.batch_callback) {
+    std::move(request).callback(
+        ToResponse(request.param, run_code_duration, queue_wait));
+    return;
+  }
+  std::vector<absl::StatusOr<ResponseObject>> responses;
+  responses.reserve(request.param.batch_size());
+  for (::worker_api::WorkerParamsProto& element :
+       *request.param.mutable_batch()) {
+    if (element.has_error_message()) {
+      responses.push_back(SapiStatusCodeToAbslStatus(
+          static_cast<int>(SapiStatusCode::kExecutionFailed),
+          element.error_message()));
+      continue;
+    }
+    // Metrics and counters of the batch as a whole, such as the duration of
+    // the call into the JS engine, apply to each of its requests.
+    element.mutable_metrics()->insert(request.param.metrics().begin(),
+                                      request.param.metrics().end());
+    element.mutable_counters()->insert(request.param.counters().begin(),
+                                       request.param.counters().end());
+    responses.push_back(ToResponse(element, run_code_duration, queue_wait));
+  }
+  std::move(request).batch_callback(std::move(responses));
+}
+
+std::optional<Dispatcher::SnapshotLoad> Dispatcher::AttachStartupSnapshot(
+    ::worker_api::WorkerParamsProto& param) {
+  if (snapshot_cache_ == nullptr) {
+    return std::nullopt;
+  }
+  if (const auto action = param.metadata().find(std::string(kRequestAction));
+      action == param.metadata().end() ||
+      action->second != kRequestActionLoad) {
+    return std::nullopt;
+  }
+  SnapshotLoad snapshot_load{.key = snapshot_cache_->Key(param)};
+  auto& metadata = *param.mutable_metadata();
+  if (std::shared_ptr<const std::string> snapshot =
+          snapshot_cache_->GetOrBuild(snapshot_load.key, snapshot_load.build);
+      snapshot != nullptr) {
+    param.set_startup_snapshot(*snapshot);
+    metadata.erase(std::string(kReturnStartupSnapshot));
+  } else {
+    metadata[std::string(kReturnStartupSnapshot)] = "true";
+  }
+  return snapshot_load;
+}
+
+void Dispatcher::StoreStartupSnapshot(const SnapshotLoad& snapshot_load,
+                                      ::worker_api::WorkerParamsProto& param) {
+  if (param.has_startup_snapshot()) {
+    snapshot_cache_->Put(snapshot_load.key,
+                         std::move(*param.mutable_startup_snapshot()));
+    param.clear_startup_snapshot();
+  }
+  if (snapshot_load.build) {
+    snapshot_cache_->EndBuild(snapshot_load.key);
+  }
+}
+
+absl::StatusOr<ResponseObject> Dispatcher::ToResponse(
+    ::worker_api::WorkerParamsProto& param, absl::Duration run_code_duration,
+    std::optional<absl::Duration> queue_wait) {
+  ResponseObject response;
+  if (elastic_workers_.has_value()) {
+    response.counters[roma::sandbox::constants::
+                          kDispatchCounterRunningWorkers] =
+        num_running_workers_;
+  }
+  if (const int64_t startup_nanos = worker_startup_nanos_; startup_nanos > 0) {
+    response.metrics[roma::sandbox::constants::
+                         kDispatchMetricWorkerStartupDuration] =
+        absl::Nanoseconds(startup_nanos);
+  }
+  response.metrics.reserve(3 + param.metrics_size());
+  response.metrics[roma::sandbox::constants::
+                       kExecutionMetricSandboxedJsEngineCallDuration] =
+      run_code_duration;
+  if (queue_wait.has_value()) {
+    response.metrics[kExecutionMetricDispatchQueueWaitDuration] = *queue_wait;
+  }
+  for (auto& [key, proto_duration] : *param.mutable_metrics()) {
+    PS_ASSIGN_OR_RETURN(
+        response.metrics[std::move(key)],
+        privacy_sandbox::server_common::DecodeGoogleApiProto(proto_duration));
+  }
+  response.counters.insert(param.counters().begin(), param.counters().end());
+  response.id = std::move((*param.mutable_metadata())[kRequestId]);
+  response.resp = std::move(*param.mutable_response());
+  response.profiler_output = std::move(*param.mutable_profiler_output());
+  return response;
+}
+
+void Dispatcher::FailRequest(Request request, const absl::Status& status) {
+  if (!request.batch_callback) {
+    std::move(request).callback(status);
+    return;
+  }
+  std::move(request).batch_callback(
+      std::vector<absl::StatusOr<ResponseObject>>(request.batch_size, status));
+}
+
+void Dispatcher::IndexForCancellation(Request& request) {
+  if (request.batch_callback) {
+    return;
+  }
+  const auto& metadata = request.param.metadata();
+  const auto uuid_it = metadata.find(kRequestUuid);
+  if (uuid_it == metadata.end()) {
+    return;
+  }
+  const std::optional<RequestHandle> handle =
+      RequestHandle::FromString(uuid_it->second);
+  if (!handle.has_value()) {
+    return;
+  }
+  auto ticket = std::make_shared<CancelTicket>();
+  ticket->info = QueuedRequest{
+      .handle = *handle,
+      .received_at = request.received_at,
+  };
+  CancelIndexShard& shard = GetCancelIndexShard(*handle);
+  {
+    absl::MutexLock lock(&shard.mu);
+    // Leave a request that reuses the handle of a queued one uncancellable
+    // rather than lose track of either.
+    if (!shard.tickets.try_emplace(*handle, ticket).second) {
+      return;
+    }
+    ticket->callback = std::move(request.callback);
+  }
+  request.ticket = std::move(ticket);
+}
+
+bool Dispatcher::ClaimFromCancelIndex(Request& request) {
+  if (request.ticket == nullptr) {
+    return true;
+  }
+  std::shared_ptr<CancelTicket> ticket = std::move(request.ticket);
+  if (ticket->claimed.exchange(true)) {
+    return false;
+  }
+  {
+    CancelIndexShard& shard = GetCancelIndexShard(ticket->info.handle);
+    absl::MutexLock lock(&shard.mu);
+    shard.tickets.erase(ticket->info.handle);
+  }
+  request.callback = std::move(ticket->callback);
+  return true;
+}
+
+Dispatcher::CancelIndexShard& Dispatcher::GetCancelIndexShard(
+    RequestHandle handle) {
+  return cancel_index_[handle.index() % cancel_index_.size()];
+}
+
+bool Dispatcher::CancelTicketIfUnclaimed(CancelTicket& ticket) {
+  if (ticket.claimed.exchange(true)) {
+    return false;
+  }
+  std::move(ticket.callback)(
+      absl::CancelledError("Request has been cancelled."));
+  return true;
+}
+
+void Dispatcher::Cancel(const ExecutionToken& token) {
+  const std::optional<RequestHandle> handle =
+      RequestHandle::FromString(token.value);
+  if (!handle.has_value()) {
+    return;
+  }
+  std::shared_ptr<CancelTicket> ticket;
+  {
+    CancelIndexShard& shard = GetCancelIndexShard(*handle);
+    absl::MutexLock lock(&shard.mu);
+    const auto it = shard.tickets.find(*handle);
+    if (it == shard.tickets.end()) {
+      return;
+    }
+    ticket = std::move(it->second);
+    shard.tickets.erase(it);
+  }
+  CancelTicketIfUnclaimed(*ticket);
+}
+
+size_t Dispatcher::CancelAll(
+    absl::FunctionRef<bool(const QueuedRequest&)> predicate) {
+  size_t num_cancelled = 0;
+  std::vector<std::shared_ptr<CancelTicket>> tickets;
+  for (CancelIndexShard& shard : cancel_index_) {
+    {
+      absl::MutexLock lock(&shard.mu);
+      for (auto it = shard.tickets.begin(); it != shard.tickets.end();) {
+        if (predicate(it->second->info)) {
+          tickets.push_back(std::move(it->second));
+          shard.tickets.erase(it++);
+        } else {
+          ++it;
+        }
+      }
+    }
+    // Run callbacks between shards so none runs under a shard lock.
+    for (std::shared_ptr<CancelTicket>& ticket : tickets) {
+      if (CancelTicketIfUnclaimed(*ticket)) {
+        ++num_cancelled;
+      }
     }
+    tickets.clear();
   }
+  return num_cancelled;
 }
 }  // namespace google::scp::roma::sandbox::dispatcher
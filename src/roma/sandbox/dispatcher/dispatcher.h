@@ -17,43 +17,135 @@
 #ifndef ROMA_SANDBOX_DISPATCHER_DISPATCHER_H_
 #define ROMA_SANDBOX_DISPATCHER_DISPATCHER_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
 #include <queue>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/functional/any_invocable.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "src/roma/interface/roma.h"
+#include "src/roma/metadata_storage/request_handle.h"
+#include "src/roma/sandbox/native_function_binding/latency_histogram.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_sandbox_api.h"
 #include "src/util/execution_token.h"
 #include "src/util/status_macro/status_macros.h"
 
+#include "mpmc_queue.h"
 #include "request_converter.h"
 #include "request_validator.h"
+#include "snapshot_cache.h"
 
 namespace google::scp::roma::sandbox::dispatcher {
+// Lets the dispatcher start and stop workers with the load.
+struct ElasticWorkers {
+  // Workers [0, min_workers) are running when the dispatcher is created and
+  // are never stopped. The others are not started until invocations have to
+  // wait for a worker.
+  int min_workers = 1;
+  // A worker beyond the first `min_workers` is stopped once it has had no
+  // work for this long.
+  absl::Duration idle_stop_delay = absl::Seconds(30);
+};
+
+// Bounds the code versions held by each worker. Zero means no bound. Once a
+// bound is exceeded, the least recently invoked versions are dropped from the
+// workers, and a worker loads a dropped version again the next time it has to
+// run it.
+struct CodeVersionLimits {
+  size_t max_versions = 0;
+  // Bounds the total size of the code, WASM modules and startup snapshots of
+  // the versions.
+  size_t max_bytes = 0;
+};
+
 class Dispatcher final {
  public:
-  // Starts a thread for each worker.
+  // Starts a thread for each slot of each worker, so that a worker with more
+  // than one slot gets its requests pipelined. If `version_affinity_delay` is
+  // set, invocations are routed to the worker that most recently ran the same
+  // code version, and any other worker may take them once they have waited for
+  // `version_affinity_delay`. If `snapshot_cache` is set, it must outlive the
+  // dispatcher, and loads restore startup snapshots from it. Up to
+  // `max_pending_requests[p]` invocations of priority `p` may be pending at
+  // once. If `idle_gc_delay` is set, a worker that has run requests and then
+  // had no work for `idle_gc_delay` is asked to collect its garbage. Without
+  // `elastic_workers`, every worker must be running. `code_version_limits`
+  // bound the code versions each worker holds.
   Dispatcher(absl::Span<worker_api::WorkerSandboxApi> workers,
-             int max_pending_requests)
-      : max_pending_requests_(max_pending_requests),
+             const std::array<int, kNumInvocationPriorities>&
+                 max_pending_requests,
+             std::optional<absl::Duration> version_affinity_delay = std::nullopt,
+             SnapshotCache* snapshot_cache = nullptr,
+             std::optional<absl::Duration> idle_gc_delay = std::nullopt,
+             std::optional<ElasticWorkers> elastic_workers = std::nullopt,
+             std::optional<CodeVersionLimits> code_version_limits =
+                 std::nullopt)
+      : version_affinity_delay_(version_affinity_delay),
+        idle_gc_delay_(idle_gc_delay),
+        elastic_workers_(elastic_workers),
+        code_version_limits_(code_version_limits),
+        snapshot_cache_(snapshot_cache),
         workers_(workers),
-        per_worker_requests_(workers_.size()) {
+        worker_queues_(workers_.size()) {
     CHECK(!workers_.empty());
-    consumers_.reserve(workers_.size());
+    num_running_workers_ = workers_.size();
+    if (elastic_workers_.has_value()) {
+      CHECK_GT(elastic_workers_->min_workers, 0);
+      for (int i = elastic_workers_->min_workers; i < workers_.size(); ++i) {
+        worker_queues_[i].state = WorkerState::kStopped;
+        --num_running_workers_;
+      }
+    }
+    lanes_.reserve(kNumInvocationPriorities);
+    for (const int max_pending : max_pending_requests) {
+      lanes_.push_back(std::make_unique<Lane>(max_pending));
+    }
+    for (const worker_api::WorkerSandboxApi& worker : workers_) {
+      num_consumers_ += worker.SlotCount();
+    }
+    consumers_.reserve(num_consumers_);
     for (int i = 0; i < workers_.size(); ++i) {
-      consumers_.emplace_back(&Dispatcher::ConsumerImpl, this, i);
+      for (int slot = 0; slot < workers_[i].SlotCount(); ++slot) {
+        consumers_.emplace_back(&Dispatcher::ConsumerImpl, this, i);
+      }
     }
   }
 
+  // Caps pending invocations of each priority at `max_pending_requests`.
+  Dispatcher(absl::Span<worker_api::WorkerSandboxApi> workers,
+             int max_pending_requests,
+             std::optional<absl::Duration> version_affinity_delay = std::nullopt,
+             SnapshotCache* snapshot_cache = nullptr,
+             std::optional<absl::Duration> idle_gc_delay = std::nullopt,
+             std::optional<ElasticWorkers> elastic_workers = std::nullopt,
+             std::optional<CodeVersionLimits> code_version_limits =
+                 std::nullopt)
+      : Dispatcher(workers,
+                   {max_pending_requests, max_pending_requests,
+                    max_pending_requests},
+                   version_affinity_delay, snapshot_cache, idle_gc_delay,
+                   elastic_workers, code_version_limits) {}
+
   // Clears queue and kills threads.
   ~Dispatcher();
 
@@ -61,58 +153,522 @@ class Dispatcher final {
   absl::Status Load(
       CodeObject code_object,
       absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback)
-      ABSL_LOCKS_EXCLUDED(mu_);
+      ABSL_LOCKS_EXCLUDED(params_mu_, idle_mu_);
+
+  // Queues `code_version` to be dropped from all workers. Invocations of it
+  // fail from then on, until it is loaded again.
+  absl::Status Unload(std::string_view code_version)
+      ABSL_LOCKS_EXCLUDED(params_mu_, idle_mu_);
+
+  struct CodeVersionStats {
+    // The size of the code, WASM module and startup snapshot of the version.
+    size_t size_bytes = 0;
+    // The size of the startup snapshot each worker restores the version from.
+    size_t snapshot_bytes = 0;
+    // Whether the workers hold the version, rather than having dropped it to
+    // stay within the code version limits.
+    bool resident = true;
+  };
 
-  // Queues a CodeObject or InvocationRequest to be invoked by a worker.
+  // Returns the stats of every loaded code version, keyed by version.
+  absl::flat_hash_map<std::string, CodeVersionStats> GetCodeVersionStats()
+      ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Queues a CodeObject or InvocationRequest to be invoked by a worker. If
+  // the maximum number of requests of its priority are pending, waits for one
+  // of them to start running until `admission_deadline`, and then fails with a
+  // ResourceExhaustedError that carries a retry-after hint. A request whose
+  // deadline passes before it reaches a worker fails with a
+  // DeadlineExceededError instead of running.
   template <typename RequestT>
   absl::Status Invoke(
       RequestT request,
-      absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback)
-      ABSL_LOCKS_EXCLUDED(mu_) {
+      absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback,
+      absl::Time admission_deadline = absl::InfinitePast())
+      ABSL_LOCKS_EXCLUDED(idle_mu_, admission_mu_) {
     PS_RETURN_IF_ERROR(AssertRequestIsValid(request));
-    ::worker_api::WorkerParamsProto param = RequestToProto(std::move(request));
-    absl::MutexLock lock(&mu_);
-    if (requests_.size() == max_pending_requests_) {
-      return absl::ResourceExhaustedError(
-          "Dispatch is disallowed since the number of unfinished requests is "
-          "at capacity.");
+    const absl::Time deadline = GetDeadline(request);
+    const InvocationPriority priority = GetPriority(request);
+    return Enqueue(
+        Request{
+            .param = RequestToProto(std::move(request)),
+            .callback = std::move(callback),
+            .deadline = deadline,
+            .priority = priority,
+        },
+        admission_deadline);
+  }
+
+  // Queues a batch of InvocationRequests, which must all run the same handler
+  // of the same code version, to be invoked together by a single worker. The
+  // batch takes up a single pending request. `callback` receives the response
+  // of each request of the batch in order. Admission works as for `Invoke`,
+  // and the whole batch is shed once the earliest deadline of its requests
+  // passes. The batch is dispatched with the most urgent priority of its
+  // requests.
+  template <typename RequestT>
+  absl::Status InvokeBatch(
+      std::vector<RequestT> batch,
+      absl::AnyInvocable<
+          void(std::vector<absl::StatusOr<ResponseObject>>) &&>
+          callback,
+      absl::Time admission_deadline = absl::InfinitePast())
+      ABSL_LOCKS_EXCLUDED(idle_mu_, admission_mu_) {
+    PS_RETURN_IF_ERROR(AssertBatchIsValid(batch));
+    const size_t batch_size = batch.size();
+    absl::Time deadline = absl::InfiniteFuture();
+    InvocationPriority priority = InvocationPriority::kBulk;
+    for (const RequestT& request : batch) {
+      deadline = std::min(deadline, GetDeadline(request));
+      priority = std::min(priority, GetPriority(request));
     }
-    requests_.push(Request{
-        .param = std::move(param),
-        .callback = std::move(callback),
-    });
-    return absl::OkStatus();
+    return Enqueue(
+        Request{
+            .param = BatchToProto(std::move(batch)),
+            .batch_callback = std::move(callback),
+            .batch_size = batch_size,
+            .deadline = deadline,
+            .priority = priority,
+        },
+        admission_deadline);
   }
 
+  // Returns the retry-after hint of a ResourceExhaustedError returned by
+  // `Invoke` or `InvokeBatch`, if it has one.
+  static std::optional<absl::Duration> GetRetryAfter(
+      const absl::Status& status);
+
+  // Describes a queued invocation request to the predicate of `CancelAll`.
+  struct QueuedRequest {
+    metadata_storage::RequestHandle handle;
+    // When the request was handed to the dispatcher.
+    absl::Time received_at;
+  };
+
+  // Cancels the invocation request of `token` if it is still queued, running
+  // its callback with a CancelledError on the calling thread. Does nothing
+  // once the request has started to run.
   void Cancel(const ExecutionToken& token);
 
+  // Cancels every queued invocation request for which `predicate` returns
+  // true, as `Cancel` does, and returns how many were cancelled. `predicate`
+  // runs under a lock that `Cancel` and consumers also take, so it must be
+  // cheap and must not call back into the dispatcher.
+  size_t CancelAll(absl::FunctionRef<bool(const QueuedRequest&)> predicate);
+
+  // Returns how long invocation requests waited between being handed to the
+  // dispatcher and starting to run on a worker.
+  native_function_binding::LatencyHistogram::Snapshot
+  GetQueueWaitHistogram() const {
+    return queue_wait_histogram_.GetSnapshot();
+  }
+
+  // Returns how many invocations ran on a worker whose last invocation used
+  // the same code version. Zero unless code version affinity is enabled.
+  int64_t GetVersionAffinityHits() const { return version_affinity_hits_; }
+
+  // Returns how many invocations ran on a worker whose last invocation used
+  // a different code version. Zero unless code version affinity is enabled.
+  int64_t GetVersionAffinityMisses() const { return version_affinity_misses_; }
+
+  // Returns how many invocations failed instead of running because their
+  // deadline passed before they were dispatched.
+  int64_t GetDeadlineShedCount() const { return num_deadline_shed_; }
+
+  // Returns how many times an idle worker was asked to collect its garbage.
+  int64_t GetIdleGarbageCollectionCount() const {
+    return num_idle_garbage_collections_;
+  }
+
+  // Records how long the workers took to start before the dispatcher was
+  // created, to be reported until the dispatcher starts a worker itself.
+  void SetWorkerStartupDuration(absl::Duration duration) {
+    worker_startup_nanos_ = absl::ToInt64Nanoseconds(duration);
+  }
+
  private:
+  // Lets a queued request be cancelled without finding it in the queues. A
+  // request that has a ticket keeps its callback in the ticket. Whoever first
+  // sets `claimed`, the consumer that dequeues the request or a canceller,
+  // takes the callback; a consumer that loses skips the request as a
+  // tombstone.
+  struct CancelTicket {
+    QueuedRequest info;
+    std::atomic<bool> claimed = false;
+    absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback;
+  };
+
+  // Tickets of queued requests, striped by request handle.
+  struct alignas(ABSL_CACHELINE_SIZE) CancelIndexShard {
+    absl::Mutex mu;
+    absl::flat_hash_map<metadata_storage::RequestHandle,
+                        std::shared_ptr<CancelTicket>>
+        tickets ABSL_GUARDED_BY(mu);
+  };
+
   struct Request {
     ::worker_api::WorkerParamsProto param;
     absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback;
+
+    // Set instead of `callback` for requests queued by `InvokeBatch`.
+    absl::AnyInvocable<void(std::vector<absl::StatusOr<ResponseObject>>) &&>
+        batch_callback;
+    size_t batch_size = 0;
+
+    // The request fails instead of running if it is not dispatched by then.
+    absl::Time deadline = absl::InfiniteFuture();
+
+    // Selects the lane in which the request waits to be dispatched.
+    InvocationPriority priority = InvocationPriority::kNormal;
+
+    // When the request was handed to the dispatcher.
+    absl::Time received_at = absl::InfinitePast();
+
+    // Whether the worker running the request last ran its code version. Only
+    // set when code version affinity is enabled.
+    std::optional<bool> version_affinity_hit;
+
+    // Consumers other than the one whose local queue holds the request may
+    // only steal it from this point on.
+    absl::Time stealable_after = absl::InfinitePast();
+
+    // Set, instead of `callback`, while the request is in the cancel index.
+    std::shared_ptr<CancelTicket> ticket;
   };
 
+  // Invocation requests of a single priority waiting to be dispatched.
+  struct Lane {
+    explicit Lane(int max_pending)
+        : max_pending(max_pending), requests(std::max(max_pending, 1)) {}
+
+    const int max_pending;
+
+    // Count of requests accepted by `Invoke` that have not yet been handed to
+    // a worker. Enforces `max_pending`.
+    std::atomic<int> num_pending = 0;
+
+    BoundedMpmcQueue<Request> requests;
+
+    // Callers waiting for `num_pending` to drop sleep on `admission_cv`,
+    // under `admission_mu_`. `num_admission_waiters` lets consumers skip
+    // taking `admission_mu_` when nobody waits.
+    absl::CondVar admission_cv;
+    std::atomic<int> num_admission_waiters = 0;
+  };
+
+  enum class WorkerState {
+    kStopped,
+    kStarting,
+    kRunning,
+    kStopping,
+  };
+
+  // Queues owned by the consumer threads of a single worker. Other consumers
+  // only take the lock to steal from `local` once they run out of work of
+  // their own.
+  struct WorkerQueue {
+    absl::Mutex mu;
+
+    // Held shared by the worker's consumers while they run an invocation and
+    // exclusively while they run a load, so that no invocation taken after a
+    // load was queued can overtake the load.
+    absl::Mutex run_mu;
+
+    // `loads` holds code objects to load. These take priority over
+    // invocations.
+    std::queue<Request> loads ABSL_GUARDED_BY(mu);
+
+    // `local` holds invocation requests claimed from a lane in a batch.
+    std::deque<Request> local ABSL_GUARDED_BY(mu);
+
+    // Mirrors of the container sizes so that idle checks need not lock.
+    // `num_pinned` counts the requests in `local` that were routed here by
+    // code version affinity and cannot be stolen yet.
+    std::atomic<size_t> num_loads = 0;
+    std::atomic<size_t> num_local = 0;
+    std::atomic<size_t> num_pinned = 0;
+
+    // Code version of the last invocation run by this worker.
+    std::string last_version ABSL_GUARDED_BY(mu);
+
+    // Whether the worker has run a request since it last collected garbage.
+    std::atomic<bool> needs_gc = false;
+
+    // The number of the worker's consumers waiting for work. The worker only
+    // collects garbage once all of them are.
+    std::atomic<int> num_idle = 0;
+
+    // Code versions loaded into the worker, with the clock of their last use.
+    // Only tracked with code version limits.
+    absl::flat_hash_map<std::string, std::shared_ptr<std::atomic<uint64_t>>>
+        loaded_versions ABSL_GUARDED_BY(mu);
+
+    // Code versions being reloaded into the worker by one of its consumers,
+    // which its other consumers wait for rather than reload them as well.
+    absl::flat_hash_set<std::string> reloading_versions ABSL_GUARDED_BY(mu);
+
+    // Only running workers take loads and invocations. Changes to and from
+    // kRunning are made under `params_mu_`, so that every load is either
+    // queued for the worker or replayed when it starts.
+    std::atomic<WorkerState> state = WorkerState::kRunning;
+  };
+
+  // Queues an invocation request once fewer than the maximum number of
+  // requests of its priority are pending, waiting for that until
+  // `admission_deadline`.
+  absl::Status Enqueue(Request request, absl::Time admission_deadline)
+      ABSL_LOCKS_EXCLUDED(idle_mu_, admission_mu_);
+
+  // Counts a new pending request in `lane`, waiting until `deadline` for the
+  // number of its pending requests to drop below its maximum. Returns whether
+  // the request was counted.
+  bool AcquirePendingSlot(Lane& lane, absl::Time deadline)
+      ABSL_LOCKS_EXCLUDED(admission_mu_);
+
+  // Counts a pending request of `lane` as no longer pending and lets a caller
+  // waiting in `AcquirePendingSlot` take its place.
+  void ReleasePendingSlot(Lane& lane) ABSL_LOCKS_EXCLUDED(admission_mu_);
+
+  Lane& GetLane(InvocationPriority priority) {
+    return *lanes_[static_cast<int>(priority)];
+  }
+
+  // Returns a ResourceExhaustedError with `message` and a hint of how long to
+  // wait before retrying.
+  absl::Status CapacityExhaustedError(std::string_view message) const;
+
   // While-loop pulls requests off queue and processes them with a
   // fixed worker.
   void ConsumerImpl(int i);
 
-  int max_pending_requests_;
+  // Runs the next load queued for worker `i`, if any.
+  void RunNextLoad(int i) ABSL_LOCKS_EXCLUDED(idle_mu_);
+
+  // Runs the next invocation found for worker `i`. Returns false if there was
+  // nothing to run.
+  bool RunNextInvocation(int i);
+
+  // Returns the next invocation for worker `i` without blocking.
+  std::optional<Request> TryNextInvocation(int i);
+
+  // Blocks until worker `i` may have work or the dispatcher is shutting down.
+  // Collects the garbage of the worker once it has been idle for
+  // `idle_gc_delay_`.
+  void WaitForWork(int i) ABSL_LOCKS_EXCLUDED(idle_mu_);
+
+  // Blocks a consumer of stopped worker `i` for a while, and starts the worker
+  // if invocations are waiting for one and no other worker is starting.
+  void WaitToStart(int i) ABSL_LOCKS_EXCLUDED(idle_mu_, params_mu_);
+
+  // Whether invocations are waiting while no consumer is idle.
+  bool NeedsMoreWorkers() const;
+
+  // Starts stopped worker `i` and loads the cached code objects into it.
+  void StartWorker(int i) ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Stops idle worker `i` unless a load is queued for it.
+  void StopWorker(int i) ABSL_LOCKS_EXCLUDED(params_mu_, affinity_mu_);
+
+  // Asks worker `i` to collect the garbage of its isolates.
+  void CollectGarbage(int i) ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Loads the cached code objects into worker `i` after its sandbox crashed.
+  void ReloadWorker(int i) ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Loads `params` into worker `i`.
+  void LoadCachedCode(int i,
+                      std::vector<::worker_api::WorkerParamsProto> params);
+
+  // Returns the loads of the code versions the workers hold.
+  std::vector<::worker_api::WorkerParamsProto> ResidentLoads()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(params_mu_);
+
+  // Queues `param`, a load or unload, for every running worker. `callback`
+  // runs once, with the response of the first worker to run it.
+  void QueueForRunningWorkers(
+      const ::worker_api::WorkerParamsProto& param,
+      absl::AnyInvocable<void(absl::StatusOr<ResponseObject>) &&> callback)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(params_mu_);
+
+  // Drops the least recently invoked versions other than `keep` from the
+  // workers until the code version limits are met.
+  void EvictCodeVersions(std::string_view keep)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(params_mu_);
+
+  // If `request` is an invocation, loads the code version it invokes into
+  // worker `i` unless the worker holds it, and counts the version as used.
+  // Returns an error if the version is not loaded at all or failed to load.
+  absl::Status EnsureCodeVersionLoaded(int i, const Request& request)
+      ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Updates the versions worker `i` holds after it ran load or unload `param`.
+  void TrackLoadedVersion(int i, const ::worker_api::WorkerParamsProto& param,
+                          size_t snapshot_bytes)
+      ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // Takes a request from the lane whose weighted turn it is, or from the most
+  // urgent non-empty lane if that one is empty. Moves up to a fair share of
+  // the backlog of that lane into the local queue of consumer `i` as well,
+  // and returns the first request.
+  std::optional<Request> ClaimFromSharedQueue(int i);
+
+  // Takes the oldest stealable request out of another consumer's local
+  // queue.
+  std::optional<Request> StealFrom(int i);
+
+  // Removes `it` from `queue.local`, keeping the size mirrors in sync.
+  static Request TakeLocal(WorkerQueue& queue,
+                           std::deque<Request>::iterator it)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(queue.mu);
+
+  // Whether consumer `i` would find a request in any of the queues.
+  bool HasWork(int i) const;
+
+  // Whether any consumer other than `i` holds requests pinned by code version
+  // affinity. These become stealable over time rather than on a signal.
+  bool HasPinnedWork(int i) const;
+
+  // Queues `request` on the worker that most recently ran its code version.
+  // Returns false, leaving `request` untouched, if no worker has run it yet.
+  bool PushToAffineWorker(Request& request)
+      ABSL_LOCKS_EXCLUDED(affinity_mu_, idle_mu_);
+
+  // Records on `request` whether worker `i` last ran the same code version and
+  // makes it the preferred worker for that version.
+  void RecordVersionAffinity(int i, Request& request)
+      ABSL_LOCKS_EXCLUDED(affinity_mu_);
+
+  // Wakes a single sleeping consumer, if any.
+  void WakeIdleConsumer() ABSL_LOCKS_EXCLUDED(idle_mu_);
+
+  // Adds `request` to the cancel index if it is an invocation with a request
+  // handle, moving its callback into a new ticket.
+  void IndexForCancellation(Request& request);
+
+  // Removes a dequeued `request` from the cancel index and moves its callback
+  // back out of its ticket. Returns false if the request was cancelled, in
+  // which case the canceller has run the callback.
+  bool ClaimFromCancelIndex(Request& request);
+
+  CancelIndexShard& GetCancelIndexShard(metadata_storage::RequestHandle handle);
+
+  // Runs the callback of a ticket taken out of the cancel index, unless a
+  // consumer claimed the request first. Returns whether it did.
+  static bool CancelTicketIfUnclaimed(CancelTicket& ticket);
+
+  // Fails `request` if its deadline has passed, and otherwise caps its
+  // execution timeout at the time left. Returns whether it failed.
+  bool ShedIfExpired(Request& request);
+
+  // Runs `request` on worker `i`, reloading the worker's code cache first if
+  // the sandbox crashed, and runs the request callback.
+  void RunRequest(int i, Request request) ABSL_LOCKS_EXCLUDED(params_mu_);
+
+  // The startup snapshot of the code of a load.
+  struct SnapshotLoad {
+    std::string key;
+    // Whether the load builds the snapshot other loads of the code wait for.
+    bool build = false;
+  };
+
+  // If there is a snapshot cache and `param` is a load, hands the cached
+  // startup snapshot of its code to the worker, or asks the worker to return
+  // the snapshot it creates if none is cached. Waits for the snapshot if
+  // another worker is creating it.
+  std::optional<SnapshotLoad> AttachStartupSnapshot(
+      ::worker_api::WorkerParamsProto& param);
+
+  // Moves the startup snapshot returned by a load, if any, into the cache.
+  // Must be called whether or not the load succeeded.
+  void StoreStartupSnapshot(const SnapshotLoad& snapshot_load,
+                            ::worker_api::WorkerParamsProto& param);
+
+  // Converts the output of a successful run of `param` into a response.
+  absl::StatusOr<ResponseObject> ToResponse(
+      ::worker_api::WorkerParamsProto& param, absl::Duration run_code_duration,
+      std::optional<absl::Duration> queue_wait);
+
+  // Runs the callback of `request` with `status`, once for each request of a
+  // batch.
+  static void FailRequest(Request request, const absl::Status& status);
+
+  const std::optional<absl::Duration> version_affinity_delay_;
+  const std::optional<absl::Duration> idle_gc_delay_;
+  const std::optional<ElasticWorkers> elastic_workers_;
+  const std::optional<CodeVersionLimits> code_version_limits_;
+  SnapshotCache* const snapshot_cache_;
   absl::Span<worker_api::WorkerSandboxApi> workers_;
+  int num_consumers_ = 0;
   std::vector<std::thread> consumers_;
-  absl::Mutex mu_;
 
-  // Consumers break out of while-loop when true.
-  bool kill_consumers_ ABSL_GUARDED_BY(mu_) = false;
+  // Indexed by `InvocationPriority`.
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  // Counts dequeues from the lanes, to take turns between them.
+  std::atomic<uint64_t> lane_turn_ = 0;
+
+  absl::Mutex admission_mu_;
+
+  // Moving average of how long a worker takes to run an invocation request,
+  // from which retry-after hints are derived.
+  std::atomic<int64_t> avg_run_duration_nanos_ = 0;
+
+  // Invocation requests failed because their deadline passed while queued.
+  std::atomic<int64_t> num_deadline_shed_ = 0;
+  native_function_binding::LatencyHistogram queue_wait_histogram_;
+  std::atomic<int64_t> num_idle_garbage_collections_ = 0;
+
+  // How long the most recent worker startup took, or zero if unknown.
+  std::atomic<int64_t> worker_startup_nanos_ = 0;
+  std::atomic<int> num_running_workers_ = 0;
+  // Set while a consumer starts a worker, so that workers start one by one.
+  std::atomic<bool> worker_starting_ = false;
+
+  // `worker_queues_[i]` holds code objects to load on worker `i` and the
+  // invocation requests it has claimed.
+  std::vector<WorkerQueue> worker_queues_;
+
+  // Consumers with nothing to do sleep on `idle_cv_`. `num_idle_` lets
+  // producers skip taking `idle_mu_` while every consumer is busy.
+  absl::Mutex idle_mu_;
+  absl::CondVar idle_cv_;
+  std::atomic<int> num_idle_ = 0;
+
+  // Consumers break out of while-loop when true. Only set while holding
+  // `idle_mu_` so that sleeping consumers cannot miss it.
+  std::atomic<bool> kill_consumers_ = false;
+
+  absl::Mutex params_mu_;
+
+  struct CodeVersion {
+    ::worker_api::WorkerParamsProto load;
+    size_t snapshot_bytes = 0;
+    bool resident = true;
+    // The value of `code_version_clock_` when the version was last used.
+    // Shared with `WorkerQueue::loaded_versions`, so that invocations of a
+    // loaded version count it as used without taking `params_mu_`.
+    std::shared_ptr<std::atomic<uint64_t>> last_used =
+        std::make_shared<std::atomic<uint64_t>>(0);
+
+    size_t SizeBytes() const {
+      return load.code().size() + load.wasm().size() + snapshot_bytes;
+    }
+  };
 
-  // `params_` contains code to reload onto failed workers.
-  std::vector<::worker_api::WorkerParamsProto> params_ ABSL_GUARDED_BY(mu_);
+  // The latest load of each code version. The resident ones are reloaded onto
+  // failed and newly started workers.
+  absl::flat_hash_map<std::string, CodeVersion> code_versions_
+      ABSL_GUARDED_BY(params_mu_);
+  std::atomic<uint64_t> code_version_clock_ = 0;
 
-  // `requests_` holds invocation requests.
-  // TODO(b/325486969): Replace `std::queue` with bounded queue implementation.
-  std::queue<Request> requests_ ABSL_GUARDED_BY(mu_);
+  std::array<CancelIndexShard, 16> cancel_index_;
 
-  // `per_worker_requests_[i]` holds code objects to load.
-  std::vector<std::queue<Request>> per_worker_requests_ ABSL_GUARDED_BY(mu_);
+  // Maps each code version to the worker that most recently ran it. Only used
+  // when `version_affinity_delay_` is set.
+  absl::Mutex affinity_mu_;
+  absl::flat_hash_map<std::string, int> version_owners_
+      ABSL_GUARDED_BY(affinity_mu_);
+  std::atomic<int64_t> version_affinity_hits_ = 0;
+  std::atomic<int64_t> version_affinity_misses_ = 0;
 };
 }  // namespace google::scp::roma::sandbox::dispatcher
 
@@ -39,7 +39,7 @@ using google::scp::roma::ResponseObject;
 using google::scp::roma::sandbox::dispatcher::Dispatcher;
 using google::scp::roma::sandbox::worker_api::WorkerSandboxApi;
 
-std::vector<WorkerSandboxApi> Workers(int num_workers) {
+std::vector<WorkerSandboxApi> Workers(int num_workers, int slot_count = 1) {
   std::vector<WorkerSandboxApi> workers;
   workers.reserve(num_workers);
   for (int i = 0; i < num_workers; ++i) {
@@ -47,14 +47,21 @@ std::vector<WorkerSandboxApi> Workers(int num_workers) {
         /*require_preload=*/true,
         /*native_js_function_comms_fd=*/-1,
         /*native_js_function_names=*/std::vector<std::string>(),
+        /*native_js_async_function_names=*/std::vector<std::string>(),
         /*rpc_method_names=*/std::vector<std::string>(),
         /*server_address=*/"",
         /*max_worker_virtual_memory_mb=*/0,
         /*js_engine_initial_heap_size_mb=*/0,
         /*js_engine_maximum_heap_size_mb=*/0,
         /*js_engine_max_wasm_memory_number_of_pages=*/0,
+        /*js_engine_context_pool_size=*/0,
+        /*js_engine_context_max_uses=*/0,
+        /*invocation_resource_metrics=*/0,
         /*sandbox_request_response_shared_buffer_size_mb=*/0,
+        /*sandbox_request_response_shared_buffer_slot_count=*/slot_count,
         /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+        /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+        /*enable_spare_worker_sandbox=*/false,
         /*v8_flags=*/std::vector<std::string>(),
         /*enable_profilers=*/false,
         /*logging_function_set=*/false,
@@ -98,9 +105,47 @@ void BM_Dispatch(benchmark::State& state) {
   }
 }
 
+void BM_DispatchScaling(benchmark::State& state) {
+  const int number_of_workers = state.range(0);
+  const int slot_count = state.range(1);
+  constexpr int kNumberOfCalls = 1000;
+  std::vector<WorkerSandboxApi> workers =
+      Workers(number_of_workers, slot_count);
+  absl::Cleanup cleanup = [&] {
+    for (WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers),
+                        /*max_pending_requests=*/kNumberOfCalls);
+
+  for (auto _ : state) {
+    absl::BlockingCounter is_running(kNumberOfCalls);
+    for (int i = 0; i < kNumberOfCalls; ++i) {
+      CodeObject request{
+          .id = "id",
+          .version_string = "v1",
+          .js = R"(function test() { return 'Hello World'; })",
+      };
+      CHECK_OK(dispatcher.Invoke(
+          std::move(request),
+          [&is_running](absl::StatusOr<ResponseObject> resp) {
+            CHECK_OK(resp);
+            is_running.DecrementCount();
+          }));
+    }
+    is_running.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * kNumberOfCalls);
+}
+
 }  // namespace
 
 BENCHMARK(BM_Dispatch)->RangeMultiplier(10)->Range(1, 1000);
+BENCHMARK(BM_DispatchScaling)
+    ->ArgsProduct({{1, 2, 4, 8, 16}, {1, 2, 4}})
+    ->ArgNames({"workers", "slots"})
+    ->UseRealTime();
 
 // Run the benchmark
 BENCHMARK_MAIN();
@@ -45,14 +45,21 @@ std::vector<worker_api::WorkerSandboxApi> Workers(int num_workers) {
         /*require_preload=*/true,
         /*native_js_function_comms_fd=*/-1,
         /*native_js_function_names=*/std::vector<std::string>(),
+        /*native_js_async_function_names=*/std::vector<std::string>(),
         /*rpc_method_names=*/std::vector<std::string>(),
         /*server_address*/ "",
         /*max_worker_virtual_memory_mb=*/0,
         /*js_engine_initial_heap_size_mb=*/0,
         /*js_engine_maximum_heap_size_mb=*/0,
         /*js_engine_max_wasm_memory_number_of_pages=*/0,
+        /*js_engine_context_pool_size=*/0,
+        /*js_engine_context_max_uses=*/0,
+        /*invocation_resource_metrics=*/0,
         /*sandbox_request_response_shared_buffer_size_mb=*/0,
+        /*sandbox_request_response_shared_buffer_slot_count=*/1,
         /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+        /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+        /*enable_spare_worker_sandbox=*/false,
         /*v8_flags=*/std::vector<std::string>(),
         /*enable_profilers=*/false,
         /*logging_function_set=*/false,
@@ -19,8 +19,13 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <memory>
+#include <optional>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
@@ -30,15 +35,26 @@
 #include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "src/roma/interface/roma.h"
+#include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/sandbox/dispatcher/snapshot_cache.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_sandbox_api.h"
+#include "src/util/execution_token.h"
 
+using ::testing::AnyOf;
+using ::testing::HasSubstr;
+using ::testing::SizeIs;
 using ::testing::StrEq;
 
 namespace google::scp::roma::sandbox::dispatcher::test {
 namespace {
-std::vector<worker_api::WorkerSandboxApi> Workers(int num_workers) {
+// Only the first `num_started_workers` workers are started, if given.
+std::vector<worker_api::WorkerSandboxApi> Workers(
+    int num_workers, int slot_count = 1,
+    std::optional<int> num_started_workers = std::nullopt) {
   std::vector<worker_api::WorkerSandboxApi> workers;
   workers.reserve(num_workers);
   for (int i = 0; i < num_workers; ++i) {
@@ -46,23 +62,45 @@ std::vector<worker_api::WorkerSandboxApi> Workers(int num_workers) {
         /*require_preload=*/true,
         /*native_js_function_comms_fd=*/-1,
         /*native_js_function_names=*/std::vector<std::string>(),
+        /*native_js_async_function_names=*/std::vector<std::string>(),
         /*rpc_method_names=*/std::vector<std::string>(),
         /*server_address*/ "",
         /*max_worker_virtual_memory_mb=*/0,
         /*js_engine_initial_heap_size_mb=*/0,
         /*js_engine_maximum_heap_size_mb=*/0,
         /*js_engine_max_wasm_memory_number_of_pages=*/0,
+        /*js_engine_context_pool_size=*/0,
+        /*js_engine_context_max_uses=*/0,
+        /*invocation_resource_metrics=*/0,
         /*sandbox_request_response_shared_buffer_size_mb=*/0,
+        /*sandbox_request_response_shared_buffer_slot_count=*/slot_count,
         /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+        /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+        /*enable_spare_worker_sandbox=*/false,
         /*v8_flags=*/std::vector<std::string>(),
         /*enable_profilers=*/false,
         /*logging_function_set=*/false,
         /*disable_udf_stacktraces_in_response=*/false);
-    CHECK_OK(workers.back().Init());
-    CHECK_OK(workers.back().Run());
+    if (!num_started_workers.has_value() || i < *num_started_workers) {
+      CHECK_OK(workers.back().Init());
+      CHECK_OK(workers.back().Run());
+    }
   }
   return workers;
 }
+
+// Code for version `version` whose loads from `change_at` on take
+// `load_duration` and then throw if `fail` is set.
+std::string CodeChangingAt(std::string_view version, absl::Time change_at,
+                           absl::Duration load_duration, bool fail) {
+  return absl::StrCat(
+      "if (Date.now() >= ", absl::ToUnixMillis(change_at), ") {",
+      "  const start = Date.now();",
+      "  while (Date.now() - start < ",
+      absl::ToInt64Milliseconds(load_duration), ") {}",
+      fail ? "  throw new Error('reload failed');" : "", "}",
+      "function Handler() { return \"", version, "\"; }");
+}
 }  // namespace
 
 TEST(DispatcherTest, CanRunCode) {
@@ -318,6 +356,195 @@ TEST(DispatcherTest, BroadcastShouldExitGracefullyIfThereAreErrorsWithTheCode) {
   done_loading.WaitForNotification();
 }
 
+TEST(DispatcherTest, CanRunCodeWithVersionAffinity) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/3);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  // Long enough that no other worker steals an invocation from the idle
+  // worker it is routed to.
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/100,
+                        /*version_affinity_delay=*/absl::Seconds(1));
+
+  for (const std::string_view version : {"v1", "v2"}) {
+    CodeObject load_request{
+        .id = "some_id",
+        .version_string = std::string(version),
+        .js = absl::StrCat("function test(input) { return input + \" ",
+                           version, "\"; }"),
+    };
+    absl::Notification done_loading;
+    CHECK_OK(dispatcher.Load(std::move(load_request),
+                             [&](absl::StatusOr<ResponseObject> resp) {
+                               CHECK_OK(resp);
+                               done_loading.Notify();
+                             }));
+    done_loading.WaitForNotification();
+  }
+
+  // Run the invocations of each version one after the other, so that only
+  // the first invocation of a version misses: every later one is routed to the
+  // worker that ran the version last, which is idle.
+  constexpr int kRequestsPerVersion = 10;
+  int64_t hits = 0;
+  for (const std::string_view version : {"v1", "v2"}) {
+    for (int i = 0; i < kRequestsPerVersion; ++i) {
+      InvocationStrRequest<> execute_request{
+          .id = absl::StrCat("some_id_", i),
+          .version_string = std::string(version),
+          .handler_name = "test",
+          .input = {R"("Hello")"},
+      };
+      absl::Notification done;
+      CHECK_OK(dispatcher.Invoke(
+          std::move(execute_request),
+          [&, version](absl::StatusOr<ResponseObject> resp) {
+            CHECK_OK(resp);
+            EXPECT_THAT(resp->resp, StrEq(absl::StrCat(R"("Hello )", version,
+                                                       R"(")")));
+            const int64_t hit = resp->counters.at(
+                constants::kDispatchCounterVersionAffinityHit);
+            EXPECT_THAT(hit, AnyOf(0, 1));
+            hits += hit;
+            done.Notify();
+          }));
+      done.WaitForNotification();
+    }
+  }
+  EXPECT_GE(hits, 2 * kRequestsPerVersion - 2);
+  EXPECT_EQ(dispatcher.GetVersionAffinityHits(), hits);
+  EXPECT_EQ(dispatcher.GetVersionAffinityHits() +
+                dispatcher.GetVersionAffinityMisses(),
+            2 * kRequestsPerVersion);
+}
+
+TEST(DispatcherTest, CanPipelineRequestsThroughBufferSlots) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/2, /*slot_count=*/3);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/100);
+
+  constexpr int kRequestsPerVersion = 30;
+  absl::BlockingCounter counter(2 * kRequestsPerVersion);
+  for (const std::string_view version : {"v1", "v2"}) {
+    // Invocations are queued right after the load without waiting for it, so
+    // every worker must run the load before any of them.
+    CodeObject load_request{
+        .id = "some_id",
+        .version_string = std::string(version),
+        .js = absl::StrCat("function test(input) { return input + \" ",
+                           version, "\"; }"),
+    };
+    CHECK_OK(dispatcher.Load(
+        std::move(load_request),
+        [](absl::StatusOr<ResponseObject> resp) { CHECK_OK(resp); }));
+    for (int i = 0; i < kRequestsPerVersion; ++i) {
+      InvocationStrRequest<> execute_request{
+          .id = absl::StrCat("some_id_", i),
+          .version_string = std::string(version),
+          .handler_name = "test",
+          .input = {absl::StrCat("\"Hello", i, "\"")},
+      };
+      CHECK_OK(dispatcher.Invoke(
+          std::move(execute_request),
+          [&, i, version](absl::StatusOr<ResponseObject> resp) {
+            EXPECT_TRUE(resp.ok()) << resp.status();
+            if (resp.ok()) {
+              EXPECT_THAT(resp->resp,
+                          StrEq(absl::StrCat("\"Hello", i, " ", version,
+                                             "\"")));
+            }
+            counter.DecrementCount();
+          }));
+    }
+  }
+  counter.Wait();
+}
+
+TEST(DispatcherTest, CanRunBatchOfInvocations) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/1);
+
+  CodeObject load_request{
+      .id = "some_id",
+      .version_string = "v1",
+      .js = R"(function test(input) { return input + " Some string"; })",
+  };
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(std::move(load_request),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             CHECK_OK(resp);
+                             done_loading.Notify();
+                           }));
+  done_loading.WaitForNotification();
+
+  std::vector<InvocationStrRequest<>> batch;
+  for (int i = 0; i < 5; ++i) {
+    batch.push_back(InvocationStrRequest<>{
+        .id = absl::StrCat("id", i),
+        .version_string = "v1",
+        .handler_name = "test",
+        .input = {absl::StrCat("\"Hello", i, "\"")},
+    });
+  }
+  // The bad input only fails its own request.
+  batch[3].input = {"not json"};
+
+  // The whole batch takes up a single pending request.
+  absl::Notification done_executing;
+  CHECK_OK(dispatcher.InvokeBatch(
+      std::move(batch),
+      [&](std::vector<absl::StatusOr<ResponseObject>> responses) {
+        ASSERT_EQ(responses.size(), 5);
+        for (int i = 0; i < 5; ++i) {
+          if (i == 3) {
+            EXPECT_FALSE(responses[i].ok());
+            continue;
+          }
+          ASSERT_TRUE(responses[i].ok());
+          EXPECT_EQ(responses[i]->id, absl::StrCat("id", i));
+          EXPECT_EQ(responses[i]->resp,
+                    absl::StrCat("\"Hello", i, " Some string\""));
+        }
+        done_executing.Notify();
+      }));
+  done_executing.WaitForNotification();
+}
+
+TEST(DispatcherTest, InvokeBatchShouldFailForMixedHandlers) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10);
+
+  std::vector<InvocationStrRequest<>> batch = {
+      {.id = "id0", .version_string = "v1", .handler_name = "test"},
+      {.id = "id1", .version_string = "v1", .handler_name = "other"},
+  };
+  EXPECT_EQ(dispatcher
+                .InvokeBatch(std::move(batch),
+                             [](std::vector<absl::StatusOr<ResponseObject>>) {})
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 TEST(DispatcherTest, DispatchBatchShouldFailIfQueuesAreFull) {
   // One worker with a one-item queue so that the queue takes long to empty out
   std::vector<worker_api::WorkerSandboxApi> workers =
@@ -380,6 +607,789 @@ TEST(DispatcherTest, DispatchBatchShouldFailIfQueuesAreFull) {
   finished_batch.WaitForNotification();
 }
 
+TEST(DispatcherTest, LoadRestoresCachedStartupSnapshot) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  SnapshotCache snapshot_cache(/*max_size_bytes=*/64 * 1024 * 1024);
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        &snapshot_cache);
+
+  std::vector<int64_t> cache_hits;
+  for (std::string_view version : {"v1", "v2"}) {
+    absl::Notification done_loading;
+    CHECK_OK(dispatcher.Load(
+        CodeObject{
+            .id = "some_id",
+            .version_string = std::string(version),
+            .js = R"(function Handler() { return "Hello"; })",
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          cache_hits.push_back(resp->counters.at(
+              constants::kLoadCounterStartupSnapshotCacheHit));
+          done_loading.Notify();
+        }));
+    done_loading.WaitForNotification();
+  }
+  // The second version has the same code, so it restores the snapshot of the
+  // first.
+  EXPECT_THAT(cache_hits, ::testing::ElementsAre(0, 1));
+
+  absl::Notification done;
+  CHECK_OK(dispatcher.Invoke(
+      InvocationStrRequest<>{
+          .id = "some_id",
+          .version_string = "v2",
+          .handler_name = "Handler",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        EXPECT_THAT(resp->resp, StrEq(R"("Hello")"));
+        done.Notify();
+      }));
+  done.WaitForNotification();
+}
+
+TEST(DispatcherTest, CanRunCodeAfterIdleGarbageCollection) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/absl::Milliseconds(1));
+
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(
+      CodeObject{
+          .id = "some_id",
+          .version_string = "v1",
+          .js = R"(function Handler() {
+            new Array(100000).fill({});
+            return "Hello";
+          })",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        done_loading.Notify();
+      }));
+  done_loading.WaitForNotification();
+
+  for (int i = 0; i < 2; ++i) {
+    // Give the worker time to collect garbage while it is idle.
+    absl::SleepFor(absl::Milliseconds(200));
+    absl::Notification done;
+    CHECK_OK(dispatcher.Invoke(
+        InvocationStrRequest<>{
+            .id = "some_id",
+            .version_string = "v1",
+            .handler_name = "Handler",
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          EXPECT_THAT(resp->resp, StrEq(R"("Hello")"));
+          EXPECT_TRUE(resp->metrics.contains(
+              constants::kGcPauseMetricJsEngineDuration));
+          done.Notify();
+        }));
+    done.WaitForNotification();
+  }
+}
+
+TEST(DispatcherTest, CollectsGarbageOnlyOnceEveryConsumerIsIdle) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1, /*slot_count=*/3);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/absl::Milliseconds(1));
+
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(
+      CodeObject{
+          .id = "some_id",
+          .version_string = "v1",
+          .js = R"(function Handler() {
+            const start = Date.now();
+            while (Date.now() - start < 500) {}
+            return "Hello";
+          })",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        done_loading.Notify();
+      }));
+  done_loading.WaitForNotification();
+  // Lets the worker collect the garbage of the load.
+  absl::SleepFor(absl::Milliseconds(200));
+  const int64_t collections = dispatcher.GetIdleGarbageCollectionCount();
+
+  absl::Notification done;
+  CHECK_OK(dispatcher.Invoke(
+      InvocationStrRequest<>{
+          .id = "some_id",
+          .version_string = "v1",
+          .handler_name = "Handler",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        done.Notify();
+      }));
+  // The other consumers of the worker are idle, but the worker is not.
+  absl::SleepFor(absl::Milliseconds(300));
+  EXPECT_EQ(dispatcher.GetIdleGarbageCollectionCount(), collections);
+  done.WaitForNotification();
+  absl::SleepFor(absl::Milliseconds(200));
+  EXPECT_EQ(dispatcher.GetIdleGarbageCollectionCount(), collections + 1);
+}
+
+TEST(DispatcherTest, ReloadsEvictedCodeVersionsOnInvocation) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/2);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/std::nullopt,
+                        /*elastic_workers=*/std::nullopt,
+                        CodeVersionLimits{.max_versions = 1});
+
+  const auto load = [&](std::string version) {
+    absl::Notification done;
+    CHECK_OK(dispatcher.Load(
+        CodeObject{
+            .id = "some_id",
+            .version_string = version,
+            .js = absl::StrCat("function Handler() { return \"", version,
+                               "\"; }"),
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          done.Notify();
+        }));
+    done.WaitForNotification();
+  };
+  const auto invoke = [&](std::string version) {
+    absl::Notification done;
+    absl::StatusOr<ResponseObject> response;
+    CHECK_OK(dispatcher.Invoke(
+        InvocationStrRequest<>{
+            .id = "some_id",
+            .version_string = version,
+            .handler_name = "Handler",
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          response = std::move(resp);
+          done.Notify();
+        }));
+    done.WaitForNotification();
+    return response;
+  };
+
+  load("v1");
+  load("v2");
+  auto stats = dispatcher.GetCodeVersionStats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_FALSE(stats["v1"].resident);
+  EXPECT_TRUE(stats["v2"].resident);
+
+  // Each invocation of the version that was dropped loads it again, dropping
+  // the other one.
+  for (int i = 0; i < 4; ++i) {
+    const std::string version = i % 2 == 0 ? "v1" : "v2";
+    const absl::StatusOr<ResponseObject> response = invoke(version);
+    ASSERT_TRUE(response.ok()) << response.status();
+    EXPECT_THAT(response->resp, StrEq(absl::StrCat("\"", version, "\"")));
+  }
+
+  ASSERT_TRUE(dispatcher.Unload("v2").ok());
+  EXPECT_FALSE(invoke("v2").ok());
+  EXPECT_EQ(dispatcher.Unload("v2").code(), absl::StatusCode::kNotFound);
+  EXPECT_THAT(dispatcher.GetCodeVersionStats(), SizeIs(1));
+}
+
+TEST(DispatcherTest, ReloadsEvictedCodeVersionsOncePerWorker) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1, /*slot_count=*/3);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/std::nullopt,
+                        /*elastic_workers=*/std::nullopt,
+                        CodeVersionLimits{.max_versions = 1});
+
+  // Reloads of v1 take a while, unlike its first load.
+  const absl::Time slow_from = absl::Now() + absl::Seconds(1);
+  constexpr absl::Duration kReloadDuration = absl::Milliseconds(500);
+  for (const std::string_view version : {"v1", "v2"}) {
+    absl::Notification done;
+    CHECK_OK(dispatcher.Load(
+        CodeObject{
+            .id = "some_id",
+            .version_string = std::string(version),
+            .js = CodeChangingAt(version, slow_from, kReloadDuration,
+                                 /*fail=*/false),
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          done.Notify();
+        }));
+    done.WaitForNotification();
+  }
+  absl::SleepFor(slow_from - absl::Now());
+
+  // Every consumer of the worker takes one of the invocations of the dropped
+  // v1, and all but one of them wait for the reload of the other.
+  constexpr int kInvocations = 3;
+  const absl::Time start = absl::Now();
+  absl::BlockingCounter counter(kInvocations);
+  for (int i = 0; i < kInvocations; ++i) {
+    CHECK_OK(dispatcher.Invoke(
+        InvocationStrRequest<>{
+            .id = "some_id",
+            .version_string = "v1",
+            .handler_name = "Handler",
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          EXPECT_TRUE(resp.ok()) << resp.status();
+          counter.DecrementCount();
+        }));
+  }
+  counter.Wait();
+  EXPECT_LT(absl::Now() - start, 2 * kReloadDuration);
+}
+
+TEST(DispatcherTest, FailsInvocationsWithTheErrorOfTheirReload) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/std::nullopt,
+                        /*elastic_workers=*/std::nullopt,
+                        CodeVersionLimits{.max_versions = 1});
+
+  // Reloads of v1 fail, unlike its first load.
+  const absl::Time fail_from = absl::Now() + absl::Seconds(1);
+  for (const std::string_view version : {"v1", "v2"}) {
+    absl::Notification done;
+    CHECK_OK(dispatcher.Load(
+        CodeObject{
+            .id = "some_id",
+            .version_string = std::string(version),
+            .js = CodeChangingAt(version, fail_from, absl::ZeroDuration(),
+                                 /*fail=*/version == "v1"),
+        },
+        [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          done.Notify();
+        }));
+    done.WaitForNotification();
+  }
+  absl::SleepFor(fail_from - absl::Now());
+
+  absl::Notification done;
+  CHECK_OK(dispatcher.Invoke(
+      InvocationStrRequest<>{
+          .id = "some_id",
+          .version_string = "v1",
+          .handler_name = "Handler",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        EXPECT_FALSE(resp.ok());
+        EXPECT_THAT(resp.status().message(), HasSubstr("reload failed"));
+        done.Notify();
+      }));
+  done.WaitForNotification();
+}
+
+TEST(DispatcherTest, InvokeWaitsForCapacityUntilAdmissionDeadline) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/1);
+
+  CodeObject load_request{
+      .id = "some_id",
+      .version_string = "v1",
+      .js = R"""(
+    function sleep(milliseconds) {
+      const date = Date.now();
+      let currentDate = null;
+      do {
+        currentDate = Date.now();
+      } while (currentDate - date < milliseconds);
+    }
+
+    function takes_long() {
+      sleep(500);
+      return "hello";
+    }
+  )""",
+  };
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(std::move(load_request),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             CHECK_OK(resp);
+                             done_loading.Notify();
+                           }));
+  done_loading.WaitForNotification();
+
+  InvocationStrRequest<> execute_request = {
+      .id = "some_id",
+      .version_string = "v1",
+      .handler_name = "takes_long",
+  };
+  absl::BlockingCounter is_running(3);
+  const auto callback = [&is_running](absl::StatusOr<ResponseObject> resp) {
+    CHECK_OK(resp);
+    EXPECT_TRUE(resp->metrics.contains(
+        constants::kExecutionMetricDispatchQueueWaitDuration));
+    is_running.DecrementCount();
+  };
+  // Fill the worker and the single pending slot.
+  CHECK_OK(dispatcher.Invoke(execute_request, callback,
+                             absl::Now() + absl::Seconds(10)));
+  CHECK_OK(dispatcher.Invoke(execute_request, callback,
+                             absl::Now() + absl::Seconds(10)));
+
+  // Without waiting, the request is rejected with a retry-after hint.
+  const absl::Status rejected =
+      dispatcher.Invoke(execute_request, [](auto /*unused*/) {});
+  EXPECT_EQ(rejected.code(), absl::StatusCode::kResourceExhausted);
+  EXPECT_TRUE(Dispatcher::GetRetryAfter(rejected).has_value());
+
+  // Waiting long enough admits the request once the worker frees up.
+  EXPECT_TRUE(dispatcher
+                  .Invoke(execute_request, callback,
+                          absl::Now() + absl::Seconds(10))
+                  .ok());
+  is_running.Wait();
+}
+
+TEST(DispatcherTest, StartsAndStopsElasticWorkersWithTheLoad) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/2);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  // The dispatcher starts the second worker when it is needed.
+  CHECK_OK(workers[1].Stop());
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/std::nullopt,
+                        ElasticWorkers{
+                            .min_workers = 1,
+                            .idle_stop_delay = absl::Milliseconds(500),
+                        });
+  dispatcher.SetWorkerStartupDuration(absl::Milliseconds(1));
+
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(
+      CodeObject{
+          .id = "some_id",
+          .version_string = "v1",
+          .js = R"""(
+            function takes_long() {
+              const start = Date.now();
+              while (Date.now() - start < 300) {}
+              return "hello";
+            }
+          )""",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        done_loading.Notify();
+      }));
+  done_loading.WaitForNotification();
+
+  const InvocationStrRequest<> execute_request = {
+      .id = "some_id",
+      .version_string = "v1",
+      .handler_name = "takes_long",
+  };
+  absl::Mutex mu;
+  int64_t max_running_workers = 0;
+  absl::BlockingCounter is_running(8);
+  for (int i = 0; i < 8; ++i) {
+    CHECK_OK(dispatcher.Invoke(
+        execute_request, [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          EXPECT_THAT(resp->resp, StrEq(R"("hello")"));
+          EXPECT_TRUE(resp->metrics.contains(
+              constants::kDispatchMetricWorkerStartupDuration));
+          absl::MutexLock lock(&mu);
+          max_running_workers = std::max(
+              max_running_workers,
+              resp->counters.at(constants::kDispatchCounterRunningWorkers));
+          is_running.DecrementCount();
+        }));
+  }
+  is_running.Wait();
+  // The backlog started the second worker, which loaded the code.
+  EXPECT_EQ(max_running_workers, 2);
+
+  // Once idle, the second worker is stopped again.
+  absl::SleepFor(absl::Seconds(1));
+  absl::Notification done;
+  CHECK_OK(dispatcher.Invoke(
+      execute_request, [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        EXPECT_EQ(resp->counters.at(constants::kDispatchCounterRunningWorkers),
+                  1);
+        done.Notify();
+      }));
+  done.WaitForNotification();
+}
+
+TEST(DispatcherTest, PipelinesRequestsThroughElasticWorkersStartedLater) {
+  // The second worker is never started before the dispatcher starts it.
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/2, /*slot_count=*/3, /*num_started_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/100,
+                        /*version_affinity_delay=*/std::nullopt,
+                        /*snapshot_cache=*/nullptr,
+                        /*idle_gc_delay=*/std::nullopt,
+                        ElasticWorkers{
+                            .min_workers = 1,
+                            .idle_stop_delay = absl::Seconds(10),
+                        });
+  dispatcher.SetWorkerStartupDuration(absl::Milliseconds(1));
+
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(
+      CodeObject{
+          .id = "some_id",
+          .version_string = "v1",
+          .js = R"""(
+            function takes_long() {
+              const start = Date.now();
+              while (Date.now() - start < 50) {}
+              return "hello";
+            }
+          )""",
+      },
+      [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        done_loading.Notify();
+      }));
+  done_loading.WaitForNotification();
+
+  const InvocationStrRequest<> execute_request = {
+      .id = "some_id",
+      .version_string = "v1",
+      .handler_name = "takes_long",
+  };
+  // Callbacks run on the consumer which ran the request, and every slot of a
+  // worker has a consumer of its own.
+  absl::Mutex mu;
+  std::set<std::thread::id> consumers;
+  int64_t max_running_workers = 0;
+  constexpr int kRequests = 60;
+  absl::BlockingCounter is_running(kRequests);
+  for (int i = 0; i < kRequests; ++i) {
+    CHECK_OK(dispatcher.Invoke(
+        execute_request, [&](absl::StatusOr<ResponseObject> resp) {
+          CHECK_OK(resp);
+          absl::MutexLock lock(&mu);
+          consumers.insert(std::this_thread::get_id());
+          max_running_workers = std::max(
+              max_running_workers,
+              resp->counters.at(constants::kDispatchCounterRunningWorkers));
+          is_running.DecrementCount();
+        }));
+  }
+  is_running.Wait();
+  EXPECT_EQ(max_running_workers, 2);
+  // The first worker has three consumers, so the second one, started by the
+  // backlog, ran requests on more than one.
+  EXPECT_GT(consumers.size(), 4u);
+}
+
+TEST(DispatcherTest, CancelsQueuedInvocations) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10);
+
+  CodeObject load_request{
+      .id = "some_id",
+      .version_string = "v1",
+      .js = R"""(
+    function sleep(milliseconds) {
+      const date = Date.now();
+      let currentDate = null;
+      do {
+        currentDate = Date.now();
+      } while (currentDate - date < milliseconds);
+    }
+
+    function takes_long() {
+      sleep(200);
+      return "hello";
+    }
+  )""",
+  };
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(std::move(load_request),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             CHECK_OK(resp);
+                             done_loading.Notify();
+                           }));
+  done_loading.WaitForNotification();
+
+  const auto execute_request = [](std::string_view handle) {
+    return InvocationStrRequest<>{
+        .id = "some_id",
+        .version_string = "v1",
+        .handler_name = "takes_long",
+        .tags = {{std::string(constants::kRequestUuid), std::string(handle)}},
+    };
+  };
+  absl::BlockingCounter done(4);
+  std::vector<absl::StatusCode> codes(4);
+  const auto callback = [&](int i) {
+    return [&, i](absl::StatusOr<ResponseObject> resp) {
+      codes[i] = resp.status().code();
+      done.DecrementCount();
+    };
+  };
+  // The first request keeps the only worker busy while the others queue.
+  for (int i = 0; i < 4; ++i) {
+    CHECK_OK(dispatcher.Invoke(execute_request(absl::StrCat(i)), callback(i)));
+  }
+
+  // Cancelling runs the callback right away.
+  dispatcher.Cancel(ExecutionToken{"2"});
+  EXPECT_EQ(codes[2], absl::StatusCode::kCancelled);
+  // Tokens of requests that are not queued are ignored.
+  dispatcher.Cancel(ExecutionToken{"2"});
+  dispatcher.Cancel(ExecutionToken{"42"});
+  dispatcher.Cancel(ExecutionToken{"not a handle"});
+
+  EXPECT_EQ(dispatcher.CancelAll([](const Dispatcher::QueuedRequest& request) {
+    return request.handle.index() == 3;
+  }),
+            1);
+  EXPECT_EQ(codes[3], absl::StatusCode::kCancelled);
+
+  done.Wait();
+  EXPECT_EQ(codes[0], absl::StatusCode::kOk);
+  EXPECT_EQ(codes[1], absl::StatusCode::kOk);
+}
+
+TEST(DispatcherTest, ShedsInvocationsPastTheirDeadline) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers), /*max_pending_reqs=*/10);
+
+  CodeObject load_request{
+      .id = "some_id",
+      .version_string = "v1",
+      .js = R"""(
+    function sleep(milliseconds) {
+      const date = Date.now();
+      let currentDate = null;
+      do {
+        currentDate = Date.now();
+      } while (currentDate - date < milliseconds);
+    }
+
+    function takes_long() {
+      sleep(300);
+      return "hello";
+    }
+  )""",
+  };
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(std::move(load_request),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             CHECK_OK(resp);
+                             done_loading.Notify();
+                           }));
+  done_loading.WaitForNotification();
+
+  InvocationStrRequest<> execute_request = {
+      .id = "some_id",
+      .version_string = "v1",
+      .handler_name = "takes_long",
+  };
+  absl::Notification first_done;
+  absl::Notification second_done;
+  CHECK_OK(dispatcher.Invoke(execute_request,
+                             [&](absl::StatusOr<ResponseObject> resp) {
+                               CHECK_OK(resp);
+                               first_done.Notify();
+                             }));
+  // Expires while the first request keeps the only worker busy.
+  execute_request.deadline = absl::Now() + absl::Milliseconds(50);
+  CHECK_OK(dispatcher.Invoke(execute_request,
+                             [&](absl::StatusOr<ResponseObject> resp) {
+                               EXPECT_EQ(resp.status().code(),
+                                         absl::StatusCode::kDeadlineExceeded);
+                               second_done.Notify();
+                             }));
+  // Already expired, so never queued.
+  execute_request.deadline = absl::Now() - absl::Milliseconds(1);
+  EXPECT_EQ(dispatcher.Invoke(execute_request, [](auto /*unused*/) {}).code(),
+            absl::StatusCode::kDeadlineExceeded);
+  first_done.WaitForNotification();
+  second_done.WaitForNotification();
+
+  // Enough time left to run, so the request runs with a capped timeout.
+  absl::Notification third_done;
+  execute_request.deadline = absl::Now() + absl::Seconds(10);
+  CHECK_OK(dispatcher.Invoke(
+      execute_request, [&](absl::StatusOr<ResponseObject> resp) {
+        CHECK_OK(resp);
+        third_done.Notify();
+      }));
+  third_done.WaitForNotification();
+  EXPECT_EQ(dispatcher.GetDeadlineShedCount(), 2);
+  EXPECT_EQ(dispatcher.GetQueueWaitHistogram().count, 2);
+}
+
+TEST(DispatcherTest, DispatchesUrgentInvocationsFirstWithinLaneCaps) {
+  std::vector<worker_api::WorkerSandboxApi> workers =
+      Workers(/*num_workers=*/1);
+  absl::Cleanup cleanup = [&] {
+    for (worker_api::WorkerSandboxApi& worker : workers) {
+      CHECK_OK(worker.Stop());
+    }
+  };
+  Dispatcher dispatcher(absl::MakeSpan(workers),
+                        /*max_pending_requests=*/{10, 10, 3});
+
+  CodeObject load_request{
+      .id = "some_id",
+      .version_string = "v1",
+      .js = R"""(
+    function sleep(milliseconds) {
+      const date = Date.now();
+      let currentDate = null;
+      do {
+        currentDate = Date.now();
+      } while (currentDate - date < milliseconds);
+    }
+
+    function takes_long() {
+      sleep(200);
+      return "hello";
+    }
+
+    function Handler() { return "hello"; }
+  )""",
+  };
+  absl::Notification done_loading;
+  CHECK_OK(dispatcher.Load(std::move(load_request),
+                           [&](absl::StatusOr<ResponseObject> resp) {
+                             CHECK_OK(resp);
+                             done_loading.Notify();
+                           }));
+  done_loading.WaitForNotification();
+
+  absl::Mutex order_mu;
+  std::vector<std::string> order;
+  absl::BlockingCounter done(7);
+  const auto callback = [&](absl::StatusOr<ResponseObject> resp) {
+    CHECK_OK(resp);
+    {
+      absl::MutexLock lock(&order_mu);
+      order.push_back(resp->id);
+    }
+    done.DecrementCount();
+  };
+  // Keeps the only worker busy while the others queue.
+  CHECK_OK(dispatcher.Invoke(
+      InvocationStrRequest<>{
+          .id = "blocker",
+          .version_string = "v1",
+          .handler_name = "takes_long",
+      },
+      callback));
+  absl::SleepFor(absl::Milliseconds(50));
+  const auto execute_request = [](InvocationPriority priority) {
+    return InvocationStrRequest<>{
+        .id = priority == InvocationPriority::kBulk ? "bulk" : "urgent",
+        .version_string = "v1",
+        .handler_name = "Handler",
+        .priority = priority,
+    };
+  };
+  for (int i = 0; i < 3; ++i) {
+    CHECK_OK(dispatcher.Invoke(execute_request(InvocationPriority::kBulk),
+                               callback));
+  }
+  // The bulk lane is full, which does not keep urgent requests out.
+  EXPECT_EQ(
+      dispatcher
+          .Invoke(execute_request(InvocationPriority::kBulk), [](auto) {})
+          .code(),
+      absl::StatusCode::kResourceExhausted);
+  for (int i = 0; i < 3; ++i) {
+    CHECK_OK(dispatcher.Invoke(execute_request(InvocationPriority::kUrgent),
+                               callback));
+  }
+  done.Wait();
+
+  // Bulk requests get one turn in every 13, so at most one of them can run
+  // before the last urgent one.
+  absl::MutexLock lock(&order_mu);
+  ASSERT_EQ(order.size(), 7);
+  EXPECT_EQ(order[0], "blocker");
+  EXPECT_GE(std::count(order.begin() + 1, order.begin() + 5, "urgent"), 3);
+}
+
 TEST(DispatcherTest, CanRunCodeWithTreatInputAsByteStr) {
   std::vector<worker_api::WorkerSandboxApi> workers =
       Workers(/*num_workers=*/1);
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_SANDBOX_DISPATCHER_MPMC_QUEUE_H_
+#define ROMA_SANDBOX_DISPATCHER_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "absl/log/check.h"
+
+namespace google::scp::roma::sandbox::dispatcher {
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer queue.
+ *
+ * Each cell carries a sequence number which tells producers and consumers
+ * whether the cell is free for the current lap of the ring, so neither side
+ * ever needs a lock. The capacity is rounded up to the next power of two, and
+ * is at least two since a single cell cannot tell a full lap from an empty one.
+ * https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+template <typename T>
+class BoundedMpmcQueue {
+ public:
+  explicit BoundedMpmcQueue(size_t min_capacity)
+      : mask_(RoundUpToPowerOfTwo(min_capacity) - 1),
+        cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~BoundedMpmcQueue() {
+    while (TryPop().has_value()) {
+    }
+  }
+
+  // Not copyable or movable.
+  BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+  BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+  /**
+   * @brief Enqueues `value` unless the queue is full. `value` is left
+   * untouched on failure.
+   */
+  bool TryPush(T& value) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Dequeues the oldest element, or returns std::nullopt if the queue
+   * is empty.
+   */
+  std::optional<T> TryPop() {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return std::nullopt;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* element = std::launder(reinterpret_cast<T*>(&cell->storage));
+    std::optional<T> value(std::move(*element));
+    element->~T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return value;
+  }
+
+  /**
+   * @brief Number of elements in the queue. Only exact when no push or pop is
+   * in progress.
+   */
+  size_t SizeApprox() const {
+    const size_t dequeue_pos = dequeue_pos_.load();
+    const size_t enqueue_pos = enqueue_pos_.load();
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  bool EmptyApprox() const { return SizeApprox() == 0; }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  // Keep the producer and consumer cursors on separate cache lines so that
+  // `Invoke` callers and consumer threads do not false-share.
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    CHECK_GT(n, 0);
+    size_t capacity = 2;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_{0};
+  alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_{0};
+};
+}  // namespace google::scp::roma::sandbox::dispatcher
+
+#endif  // ROMA_SANDBOX_DISPATCHER_MPMC_QUEUE_H_
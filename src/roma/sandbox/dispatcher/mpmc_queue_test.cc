@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/sandbox/dispatcher/mpmc_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace google::scp::roma::sandbox::dispatcher::test {
+
+TEST(BoundedMpmcQueueTest, CapacityIsRoundedUpToPowerOfTwo) {
+  EXPECT_EQ(BoundedMpmcQueue<int>(1).Capacity(), 2);
+  EXPECT_EQ(BoundedMpmcQueue<int>(3).Capacity(), 4);
+  EXPECT_EQ(BoundedMpmcQueue<int>(100).Capacity(), 128);
+}
+
+TEST(BoundedMpmcQueueTest, PopsInFifoOrder) {
+  BoundedMpmcQueue<int> queue(4);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.TryPush(i));
+  }
+  EXPECT_EQ(queue.SizeApprox(), 4);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(queue.TryPop(), i);
+  }
+  EXPECT_TRUE(queue.EmptyApprox());
+}
+
+TEST(BoundedMpmcQueueTest, PushFailsWhenFullAndKeepsValue) {
+  BoundedMpmcQueue<std::unique_ptr<int>> queue(2);
+  auto zeroth = std::make_unique<int>(0);
+  auto first = std::make_unique<int>(1);
+  auto second = std::make_unique<int>(2);
+  EXPECT_TRUE(queue.TryPush(zeroth));
+  EXPECT_TRUE(queue.TryPush(first));
+  EXPECT_FALSE(queue.TryPush(second));
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(*second, 2);
+
+  std::optional<std::unique_ptr<int>> popped = queue.TryPop();
+  ASSERT_TRUE(popped.has_value());
+  EXPECT_EQ(**popped, 0);
+  EXPECT_TRUE(queue.TryPush(second));
+}
+
+TEST(BoundedMpmcQueueTest, PopFailsWhenEmpty) {
+  BoundedMpmcQueue<int> queue(2);
+  EXPECT_FALSE(queue.TryPop().has_value());
+  int value = 1;
+  EXPECT_TRUE(queue.TryPush(value));
+  EXPECT_TRUE(queue.TryPop().has_value());
+  EXPECT_FALSE(queue.TryPop().has_value());
+}
+
+TEST(BoundedMpmcQueueTest, ConcurrentProducersAndConsumersSeeEveryItem) {
+  constexpr int kNumThreads = 4;
+  constexpr int kItemsPerProducer = 10000;
+  BoundedMpmcQueue<int> queue(64);
+  std::atomic<int> num_popped = 0;
+  std::atomic<long> sum = 0;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&queue] {
+      for (int i = 1; i <= kItemsPerProducer; ++i) {
+        int value = i;
+        while (!queue.TryPush(value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    threads.emplace_back([&] {
+      while (num_popped < kNumThreads * kItemsPerProducer) {
+        if (std::optional<int> value = queue.TryPop()) {
+          sum += *value;
+          ++num_popped;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_popped, kNumThreads * kItemsPerProducer);
+  EXPECT_EQ(sum, static_cast<long>(kNumThreads) * kItemsPerProducer *
+                     (kItemsPerProducer + 1) / 2);
+  EXPECT_TRUE(queue.EmptyApprox());
+}
+
+}  // namespace google::scp::roma::sandbox::dispatcher::test
@@ -20,8 +20,10 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/sandbox/constants/constants.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
@@ -36,6 +38,33 @@ void AddMetadata(std::string version_string, std::string id,
                  ::worker_api::WorkerParamsProto& params);
 }  // namespace internal::request_converter
 
+/**
+ * @brief Returns the time by which a request must be dispatched to a worker.
+ * Code objects have no deadline.
+ */
+inline absl::Time GetDeadline(const CodeObject& /*request*/) {
+  return absl::InfiniteFuture();
+}
+
+template <typename InputType, typename TMetadata>
+absl::Time GetDeadline(const InvocationRequest<InputType, TMetadata>& request) {
+  return request.deadline;
+}
+
+/**
+ * @brief Returns the dispatch priority of a request. Code objects queued as
+ * invocations have normal priority.
+ */
+inline InvocationPriority GetPriority(const CodeObject& /*request*/) {
+  return InvocationPriority::kNormal;
+}
+
+template <typename InputType, typename TMetadata>
+InvocationPriority GetPriority(
+    const InvocationRequest<InputType, TMetadata>& request) {
+  return request.priority;
+}
+
 /**
  * @brief This converts a CodeObject into a WorkerParamsProto.
  */
@@ -59,9 +88,15 @@ template <typename InputType, typename TMetadata>
       std::move(request.handler_name);
 
   // Add inputs.
-  if (request.treat_input_as_byte_str) {
+  if (request.share_parsed_input && !request.treat_input_as_byte_str &&
+      !request.use_value_serializer) {
+    metadata[google::scp::roma::sandbox::constants::kShareInput] = "true";
+  }
+  if (request.treat_input_as_byte_str || request.use_value_serializer) {
     metadata[google::scp::roma::sandbox::constants::kInputType] =
-        google::scp::roma::sandbox::constants::kInputTypeBytes;
+        request.treat_input_as_byte_str
+            ? google::scp::roma::sandbox::constants::kInputTypeBytes
+            : google::scp::roma::sandbox::constants::kInputTypeSerializedValue;
     if (request.input.size() != 1) {
       return params;
     }
@@ -89,6 +124,33 @@ template <typename InputType, typename TMetadata>
   }
   return params;
 }
+
+/**
+ * @brief This converts a batch of InvocationRequests, which must all run the
+ * same handler of the same code version, into a single WorkerParamsProto
+ * holding one element per request.
+ */
+template <typename InputType, typename TMetadata>
+::worker_api::WorkerParamsProto BatchToProto(
+    std::vector<InvocationRequest<InputType, TMetadata>> batch) {
+  ::worker_api::WorkerParamsProto params;
+  if (batch.empty()) {
+    return params;
+  }
+  auto& metadata = *params.mutable_metadata();
+  metadata[google::scp::roma::sandbox::constants::kCodeVersion] =
+      batch.front().version_string;
+  metadata[google::scp::roma::sandbox::constants::kRequestAction] =
+      google::scp::roma::sandbox::constants::kRequestActionExecute;
+  metadata[google::scp::roma::sandbox::constants::kHandlerName] =
+      batch.front().handler_name;
+
+  params.mutable_batch()->Reserve(batch.size());
+  for (InvocationRequest<InputType, TMetadata>& request : batch) {
+    *params.add_batch() = RequestToProto(std::move(request));
+  }
+  return params;
+}
 }  // namespace google::scp::roma::sandbox
 
 #endif  // ROMA_SANDBOX_DISPATCHER_REQUEST_CONVERTER_H_
@@ -18,6 +18,7 @@
 #define ROMA_SANDBOX_DISPATCHER_REQUEST_VALIDATOR_H_
 
 #include <memory>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "src/roma/interface/roma.h"
@@ -39,6 +40,41 @@ absl::Status AssertRequestIsValid(
         "Dispatch is disallowed since the number of inputs does not equal one "
         "and InvocationRequest.treat_input_as_byte_str is true.");
   }
+  if (request.use_value_serializer && request.input.size() != 1) {
+    return absl::InvalidArgumentError(
+        "Dispatch is disallowed since the number of inputs does not equal one "
+        "and InvocationRequest.use_value_serializer is true.");
+  }
+  if (request.use_value_serializer && request.treat_input_as_byte_str) {
+    return absl::InvalidArgumentError(
+        "Dispatch is disallowed since InvocationRequest.use_value_serializer "
+        "and InvocationRequest.treat_input_as_byte_str are both true.");
+  }
+  return absl::OkStatus();
+}
+
+/**
+ * @brief Validates a batch of invocation requests to be run together, which
+ * requires every request to run the same handler of the same code version.
+ */
+template <typename InputType, typename TMetadata>
+absl::Status AssertBatchIsValid(
+    const std::vector<InvocationRequest<InputType, TMetadata>>& batch) {
+  if (batch.empty()) {
+    return absl::InvalidArgumentError(
+        "Dispatch is disallowed since the batch is empty.");
+  }
+  for (const InvocationRequest<InputType, TMetadata>& request : batch) {
+    if (absl::Status status = AssertRequestIsValid(request); !status.ok()) {
+      return status;
+    }
+    if (request.version_string != batch.front().version_string ||
+        request.handler_name != batch.front().handler_name) {
+      return absl::InvalidArgumentError(
+          "Dispatch is disallowed since the requests of the batch do not all "
+          "run the same handler of the same code version.");
+    }
+  }
   return absl::OkStatus();
 }
 }  // namespace google::scp::roma::sandbox::dispatcher
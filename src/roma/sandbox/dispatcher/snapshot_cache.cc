@@ -0,0 +1,192 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "snapshot_cache.h"
+
+#include <openssl/sha.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/log/log.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "src/roma/sandbox/constants/constants.h"
+
+using google::scp::roma::sandbox::constants::kRequestType;
+
+namespace google::scp::roma::sandbox::dispatcher {
+namespace {
+constexpr std::string_view kSnapshotFileExtension = ".snapshot";
+
+void Update(SHA256_CTX& ctx, std::string_view data) {
+  // Length-prefixed, so that the fields cannot run into each other.
+  const uint64_t size = data.size();
+  SHA256_Update(&ctx, &size, sizeof(size));
+  SHA256_Update(&ctx, data.data(), data.size());
+}
+}  // namespace
+
+SnapshotCache::SnapshotCache(size_t max_size_bytes, std::string directory,
+                             std::string environment)
+    : max_size_bytes_(max_size_bytes),
+      directory_(std::move(directory)),
+      environment_(std::move(environment)) {}
+
+std::string SnapshotCache::Key(
+    const ::worker_api::WorkerParamsProto& load) const {
+  SHA256_CTX ctx;
+  SHA256_Init(&ctx);
+  Update(ctx, environment_);
+  const auto request_type = load.metadata().find(std::string(kRequestType));
+  Update(ctx, request_type == load.metadata().end()
+                  ? std::string_view()
+                  : std::string_view(request_type->second));
+  Update(ctx, load.code());
+  Update(ctx, load.wasm());
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &ctx);
+  return absl::BytesToHexString(std::string_view(
+      reinterpret_cast<const char*>(digest), SHA256_DIGEST_LENGTH));
+}
+
+std::shared_ptr<const std::string> SnapshotCache::Get(const std::string& key) {
+  {
+    absl::MutexLock lock(&mu_);
+    if (const auto it = entries_.find(key); it != entries_.end()) {
+      return it->second;
+    }
+  }
+  if (directory_.empty()) {
+    return nullptr;
+  }
+  std::ifstream file(PathOf(key), std::ios::binary);
+  if (!file) {
+    return nullptr;
+  }
+  auto snapshot = std::make_shared<const std::string>(
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  if (snapshot->empty()) {
+    return nullptr;
+  }
+  absl::MutexLock lock(&mu_);
+  Insert(key, snapshot);
+  return snapshot;
+}
+
+void SnapshotCache::Put(const std::string& key, std::string snapshot) {
+  auto shared_snapshot =
+      std::make_shared<const std::string>(std::move(snapshot));
+  {
+    absl::MutexLock lock(&mu_);
+    if (entries_.contains(key)) {
+      return;
+    }
+    Insert(key, shared_snapshot);
+  }
+  if (directory_.empty()) {
+    return;
+  }
+  // Write to a temporary file first, so that readers never see a partially
+  // written snapshot.
+  const std::string path = PathOf(key);
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.write(shared_snapshot->data(), shared_snapshot->size())) {
+      LOG(WARNING) << "Failed to write startup snapshot to " << tmp_path;
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  if (error) {
+    LOG(WARNING) << "Failed to persist startup snapshot to " << path << ": "
+                 << error.message();
+    std::remove(tmp_path.c_str());
+  }
+}
+
+std::shared_ptr<const std::string> SnapshotCache::GetOrBuild(
+    const std::string& key, bool& build) {
+  build = false;
+  auto build_done = [this, &key]() ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return !builds_.contains(key);
+  };
+  bool waited = false;
+  {
+    absl::MutexLock lock(&mu_);
+    if (builds_.contains(key)) {
+      waited = true;
+      mu_.Await(absl::Condition(&build_done));
+    }
+  }
+  if (std::shared_ptr<const std::string> snapshot = Get(key);
+      snapshot != nullptr || waited) {
+    // If the build ended without a snapshot, the callers that waited for it
+    // compile the code themselves rather than take turns building it.
+    return snapshot;
+  }
+  absl::MutexLock lock(&mu_);
+  if (const auto it = entries_.find(key); it != entries_.end()) {
+    // Built since the lookup.
+    return it->second;
+  }
+  if (builds_.insert(key).second) {
+    build = true;
+    return nullptr;
+  }
+  // Another caller started building it since the lookup.
+  mu_.Await(absl::Condition(&build_done));
+  const auto it = entries_.find(key);
+  return it == entries_.end() ? nullptr : it->second;
+}
+
+void SnapshotCache::EndBuild(const std::string& key) {
+  absl::MutexLock lock(&mu_);
+  builds_.erase(key);
+}
+
+void SnapshotCache::Insert(const std::string& key,
+                           std::shared_ptr<const std::string> snapshot) {
+  if (snapshot->size() > max_size_bytes_ || entries_.contains(key)) {
+    return;
+  }
+  while (size_bytes_ + snapshot->size() > max_size_bytes_) {
+    const auto oldest = entries_.find(insertion_order_.front());
+    size_bytes_ -= oldest->second->size();
+    entries_.erase(oldest);
+    insertion_order_.pop_front();
+  }
+  size_bytes_ += snapshot->size();
+  insertion_order_.push_back(key);
+  entries_.emplace(key, std::move(snapshot));
+}
+
+std::string SnapshotCache::PathOf(std::string_view key) const {
+  return (std::filesystem::path(directory_) /
+          absl::StrCat(key, kSnapshotFileExtension))
+      .string();
+}
+
+}  // namespace google::scp::roma::sandbox::dispatcher
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_SANDBOX_DISPATCHER_SNAPSHOT_CACHE_H_
+#define ROMA_SANDBOX_DISPATCHER_SNAPSHOT_CACHE_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
+
+namespace google::scp::roma::sandbox::dispatcher {
+
+/**
+ * @brief Host-side cache of the V8 startup snapshots created by workers when
+ * loading code, keyed by a hash of the loaded code. Loads of code that is in
+ * the cache hand its snapshot to the worker, which restores it instead of
+ * compiling the code again.
+ *
+ * The first load of code that is not in the cache builds its snapshot, and
+ * concurrent loads of the same code, such as those of the other workers, wait
+ * for it, so that the code is compiled once rather than once per worker.
+ *
+ * Snapshots are only valid for the V8 build and the native function bindings
+ * they were created with, so these are folded into the keys as the
+ * environment of the cache. Services with a different environment never
+ * restore each other's snapshots, even if they share a directory.
+ */
+class SnapshotCache {
+ public:
+  /**
+   * @param max_size_bytes The maximum total size of the snapshots held in
+   * memory. The oldest snapshots are evicted first.
+   * @param directory If not empty, snapshots are also written to and looked up
+   * in this directory, so that they outlive the process.
+   * @param environment What the snapshots depend on besides the loaded code,
+   * as described by WorkerSandboxApi::SnapshotEnvironment.
+   */
+  explicit SnapshotCache(size_t max_size_bytes, std::string directory = "",
+                         std::string environment = "");
+
+  // Returns the key of the code loaded by `load` in the environment of the
+  // cache.
+  std::string Key(const ::worker_api::WorkerParamsProto& load) const;
+
+  // Returns the snapshot stored under `key`, or nullptr if there is none.
+  std::shared_ptr<const std::string> Get(const std::string& key)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  void Put(const std::string& key, std::string snapshot)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  /**
+   * @brief Returns the snapshot stored under `key`, first waiting for it if
+   * another caller is building it. If there is none, `build` is set to whether
+   * the caller is now the one building it, and must then call EndBuild once
+   * it has stored the snapshot or failed to create one.
+   */
+  std::shared_ptr<const std::string> GetOrBuild(const std::string& key,
+                                                bool& build)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Lets the callers waiting for the snapshot built under `key` proceed.
+  void EndBuild(const std::string& key) ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  void Insert(const std::string& key,
+              std::shared_ptr<const std::string> snapshot)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  std::string PathOf(std::string_view key) const;
+
+  const size_t max_size_bytes_;
+  const std::string directory_;
+  const std::string environment_;
+
+  absl::Mutex mu_;
+  absl::flat_hash_map<std::string, std::shared_ptr<const std::string>> entries_
+      ABSL_GUARDED_BY(mu_);
+  // Keys of `entries_`, oldest first.
+  std::deque<std::string> insertion_order_ ABSL_GUARDED_BY(mu_);
+  size_t size_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  // Keys of the snapshots being built.
+  absl::flat_hash_set<std::string> builds_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace google::scp::roma::sandbox::dispatcher
+
+#endif  // ROMA_SANDBOX_DISPATCHER_SNAPSHOT_CACHE_H_
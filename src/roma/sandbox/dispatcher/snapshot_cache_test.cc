@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/sandbox/dispatcher/snapshot_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
+
+namespace google::scp::roma::sandbox::dispatcher::test {
+namespace {
+::worker_api::WorkerParamsProto Load(std::string code) {
+  ::worker_api::WorkerParamsProto load;
+  load.set_code(std::move(code));
+  return load;
+}
+}  // namespace
+
+TEST(SnapshotCacheTest, KeyOnlyDependsOnContentAndEnvironment) {
+  const SnapshotCache cache(/*max_size_bytes=*/1024);
+  ::worker_api::WorkerParamsProto load = Load("function f() {}");
+  ::worker_api::WorkerParamsProto same_code = load;
+  (*same_code.mutable_metadata())["CodeVersion"] = "v2";
+  EXPECT_EQ(cache.Key(load), cache.Key(same_code));
+  EXPECT_NE(cache.Key(load), cache.Key(Load("function g() {}")));
+  const SnapshotCache other_environment(/*max_size_bytes=*/1024,
+                                        /*directory=*/"", "bindings");
+  EXPECT_NE(cache.Key(load), other_environment.Key(load));
+}
+
+TEST(SnapshotCacheTest, ReturnsStoredSnapshot) {
+  SnapshotCache cache(/*max_size_bytes=*/1024);
+  EXPECT_EQ(cache.Get("key"), nullptr);
+  cache.Put("key", "snapshot");
+  ASSERT_NE(cache.Get("key"), nullptr);
+  EXPECT_EQ(*cache.Get("key"), "snapshot");
+}
+
+TEST(SnapshotCacheTest, EvictsOldestSnapshotsFirst) {
+  SnapshotCache cache(/*max_size_bytes=*/8);
+  cache.Put("a", "1234");
+  cache.Put("b", "1234");
+  cache.Put("c", "1234");
+  EXPECT_EQ(cache.Get("a"), nullptr);
+  EXPECT_NE(cache.Get("b"), nullptr);
+  EXPECT_NE(cache.Get("c"), nullptr);
+  // A snapshot larger than the cache is not stored.
+  cache.Put("d", "123456789");
+  EXPECT_EQ(cache.Get("d"), nullptr);
+}
+
+TEST(SnapshotCacheTest, WaitsForSnapshotBeingBuilt) {
+  SnapshotCache cache(/*max_size_bytes=*/1024);
+  bool build = false;
+  EXPECT_EQ(cache.GetOrBuild("key", build), nullptr);
+  ASSERT_TRUE(build);
+
+  std::shared_ptr<const std::string> waited;
+  bool waiter_builds = true;
+  std::thread waiter(
+      [&] { waited = cache.GetOrBuild("key", waiter_builds); });
+  cache.Put("key", "snapshot");
+  cache.EndBuild("key");
+  waiter.join();
+  ASSERT_NE(waited, nullptr);
+  EXPECT_EQ(*waited, "snapshot");
+  EXPECT_FALSE(waiter_builds);
+}
+
+TEST(SnapshotCacheTest, BuildsAgainAfterFailedBuild) {
+  SnapshotCache cache(/*max_size_bytes=*/1024);
+  bool build = false;
+  EXPECT_EQ(cache.GetOrBuild("key", build), nullptr);
+  ASSERT_TRUE(build);
+  cache.EndBuild("key");
+
+  EXPECT_EQ(cache.GetOrBuild("key", build), nullptr);
+  EXPECT_TRUE(build);
+  cache.EndBuild("key");
+}
+
+TEST(SnapshotCacheTest, PersistsSnapshotsToDirectory) {
+  const std::filesystem::path directory =
+      std::filesystem::path(::testing::TempDir()) / "snapshot_cache_test";
+  std::filesystem::create_directories(directory);
+  SnapshotCache(/*max_size_bytes=*/1024, directory.string())
+      .Put("key", "snapshot");
+
+  SnapshotCache restarted(/*max_size_bytes=*/1024, directory.string());
+  ASSERT_NE(restarted.Get("key"), nullptr);
+  EXPECT_EQ(*restarted.Get("key"), "snapshot");
+  std::filesystem::remove_all(directory);
+}
+
+TEST(SnapshotCacheTest, MissesSnapshotsPersistedInAnotherEnvironment) {
+  const std::filesystem::path directory =
+      std::filesystem::path(::testing::TempDir()) /
+      "snapshot_cache_environment_test";
+  std::filesystem::create_directories(directory);
+  const ::worker_api::WorkerParamsProto load = Load("function f() {}");
+  {
+    SnapshotCache cache(/*max_size_bytes=*/1024, directory.string(),
+                        "functions:1\n4:log");
+    cache.Put(cache.Key(load), "snapshot");
+  }
+
+  SnapshotCache same_bindings(/*max_size_bytes=*/1024, directory.string(),
+                              "functions:1\n4:log");
+  EXPECT_NE(same_bindings.Get(same_bindings.Key(load)), nullptr);
+  SnapshotCache other_bindings(/*max_size_bytes=*/1024, directory.string(),
+                               "functions:2\n4:log\n5:fetch");
+  EXPECT_EQ(other_bindings.Get(other_bindings.Key(load)), nullptr);
+  std::filesystem::remove_all(directory);
+}
+
+}  // namespace google::scp::roma::sandbox::dispatcher::test
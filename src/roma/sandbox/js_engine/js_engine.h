@@ -17,13 +17,16 @@
 #ifndef ROMA_SANDBOX_JS_ENGINE_JS_ENGINE_H_
 #define ROMA_SANDBOX_JS_ENGINE_JS_ENGINE_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 
@@ -47,6 +50,12 @@ struct ExecutionResponse {
 
   /// the metrics for handler function execution.
   absl::flat_hash_map<std::string, absl::Duration> metrics;
+
+  /// the counters for handler function execution.
+  absl::flat_hash_map<std::string, int64_t> counters;
+
+  /// the startup snapshot created by a load, if it was asked for.
+  std::string startup_snapshot;
 };
 
 /**
@@ -65,6 +74,18 @@ struct JsEngineExecutionResponse {
   ExecutionResponse execution_response;
 };
 
+/**
+ * @brief A single invocation of a batch run by the JS engine.
+ *
+ */
+struct BatchInvocation {
+  /// The input to pass to the handler.
+  std::vector<std::string_view> input;
+
+  /// The metadata associated with this invocation.
+  absl::flat_hash_map<std::string_view, std::string_view> metadata;
+};
+
 /**
  * @brief Interface for a JS engine.
  *
@@ -146,6 +167,51 @@ class JsEngine {
       const std::vector<std::string_view>& input,
       const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
       const RomaJsEngineCompilationContext& context) = 0;
+
+  /**
+   * @brief Runs the JS handler once for each invocation of `batch` using a
+   * previously built compilation context. Engines which can share setup work
+   * between the invocations of a batch should override this; by default every
+   * invocation is run on its own.
+   * @param function_name The name of the JS function to invoke
+   * @param batch The inputs and metadata of each invocation
+   * @param context A context returned by an earlier compilation of the code
+   * @param deadline Invocations which would start after it fail with
+   * DeadlineExceeded instead.
+   * @return The response, or the error, of each invocation in `batch` order.
+   */
+  virtual std::vector<absl::StatusOr<ExecutionResponse>> RunJsBatch(
+      std::string_view function_name, absl::Span<const BatchInvocation> batch,
+      const RomaJsEngineCompilationContext& context,
+      absl::Time deadline = absl::InfiniteFuture()) {
+    std::vector<absl::StatusOr<ExecutionResponse>> responses;
+    responses.reserve(batch.size());
+    for (const BatchInvocation& invocation : batch) {
+      if (absl::Now() >= deadline) {
+        responses.push_back(absl::DeadlineExceededError(
+            "Batch deadline passed before the invocation started."));
+        continue;
+      }
+      auto response_or =
+          CompileAndRunJs(/*code=*/"", function_name, invocation.input,
+                          invocation.metadata, context);
+      if (response_or.ok()) {
+        responses.push_back(std::move(response_or)->execution_response);
+      } else {
+        responses.push_back(std::move(response_or).status());
+      }
+    }
+    return responses;
+  }
+
+  /**
+   * @brief Collects garbage in the engine state of `context` while no
+   * invocation runs. Meant to be called when the worker is idle, so that the
+   * collection does not pause an invocation. Engines that leave garbage
+   * collection to the JS runtime need not override this.
+   * @param context A context returned by an earlier compilation of the code
+   */
+  virtual void CollectGarbage(const RomaJsEngineCompilationContext& context) {}
 };
 }  // namespace google::scp::roma::sandbox::js_engine
 
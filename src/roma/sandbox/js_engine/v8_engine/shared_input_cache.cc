@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shared_input_cache.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+
+namespace google::scp::roma::sandbox::js_engine::v8_js_engine {
+namespace {
+// Freezes `value` and everything reachable through its own properties, and
+// drops the prototypes of its objects and arrays. JSON values form a tree, so
+// there are no cycles to guard against. Walks the tree with a worklist rather
+// than recursion, since JSON can nest deeper than the native stack allows.
+bool Harden(v8::Isolate* isolate, v8::Local<v8::Context> context,
+            v8::Local<v8::Value> value) {
+  std::vector<v8::Local<v8::Object>> worklist;
+  if (value->IsObject()) {
+    worklist.push_back(value.As<v8::Object>());
+  }
+  while (!worklist.empty()) {
+    const v8::Local<v8::Object> object = worklist.back();
+    worklist.pop_back();
+    v8::Local<v8::Array> keys;
+    if (!object->GetOwnPropertyNames(context).ToLocal(&keys)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < keys->Length(); ++i) {
+      v8::Local<v8::Value> key;
+      v8::Local<v8::Value> property;
+      if (!keys->Get(context, i).ToLocal(&key) ||
+          !object->Get(context, key).ToLocal(&property)) {
+        return false;
+      }
+      if (property->IsObject()) {
+        worklist.push_back(property.As<v8::Object>());
+      }
+    }
+    if (!object->SetPrototype(context, v8::Null(isolate)).FromMaybe(false) ||
+        !object->SetIntegrityLevel(context, v8::IntegrityLevel::kFrozen)
+             .FromMaybe(false)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+v8::MaybeLocal<v8::Value> SharedInputCache::GetOrParse(v8::Isolate* isolate,
+                                                       std::string_view json,
+                                                       bool& hit) {
+  const size_t hash = absl::HashOf(json);
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->hash == hash && it->json == json) {
+      hit = true;
+      v8::Local<v8::Value> value = it->value.Get(isolate);
+      std::rotate(it, it + 1, entries_.end());
+      return value;
+    }
+  }
+  hit = false;
+  v8::Local<v8::Value> value = v8::Undefined(isolate);
+  if (!json.empty()) {
+    if (parse_context_.IsEmpty()) {
+      parse_context_.Reset(isolate, v8::Context::New(isolate));
+    }
+    const v8::Local<v8::Context> context = parse_context_.Get(isolate);
+    v8::Context::Scope context_scope(context);
+    v8::Local<v8::String> json_str;
+    if (!v8::String::NewFromUtf8(isolate, json.data(),
+                                 v8::NewStringType::kNormal, json.size())
+             .ToLocal(&json_str) ||
+        !v8::JSON::Parse(context, json_str).ToLocal(&value) ||
+        !Harden(isolate, context, value)) {
+      return {};
+    }
+  }
+  if (max_entries_ == 0) {
+    return value;
+  }
+  if (entries_.size() >= max_entries_) {
+    entries_.erase(entries_.begin());
+  }
+  entries_.push_back(Entry{
+      .hash = hash,
+      .json = std::string(json),
+      .value = v8::Global<v8::Value>(isolate, value),
+  });
+  return value;
+}
+
+}  // namespace google::scp::roma::sandbox::js_engine::v8_js_engine
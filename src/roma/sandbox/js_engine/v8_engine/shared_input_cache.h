@@ -0,0 +1,83 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_SHARED_INPUT_CACHE_H_
+#define ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_SHARED_INPUT_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace google::scp::roma::sandbox::js_engine::v8_js_engine {
+
+/**
+ * @brief Parsed JSON inputs that the invocations run in the contexts of a
+ * single isolate share, keyed by their content.
+ *
+ * Values are deeply frozen and their objects and arrays have no prototype, so
+ * no invocation can see changes made by another, not even through the
+ * prototypes the values would otherwise share. They are parsed in a context of
+ * their own rather than in that of the first invocation to use them, which
+ * would keep that context alive.
+ */
+class SharedInputCache {
+ public:
+  static constexpr size_t kDefaultMaxEntries = 8;
+
+  explicit SharedInputCache(size_t max_entries = kDefaultMaxEntries)
+      : max_entries_(max_entries) {}
+
+  // Not copyable or movable.
+  SharedInputCache(const SharedInputCache&) = delete;
+  SharedInputCache& operator=(const SharedInputCache&) = delete;
+
+  /**
+   * @brief Returns the frozen value of `json`, parsing it unless it is
+   * cached. Evicts the least recently used value if the cache is full.
+   *
+   * @param json The input to parse. An empty input is undefined.
+   * @param hit Set to whether the value was cached.
+   * @return v8::MaybeLocal<v8::Value> Empty if `json` could not be parsed.
+   */
+  v8::MaybeLocal<v8::Value> GetOrParse(v8::Isolate* isolate,
+                                       std::string_view json, bool& hit);
+
+  void Clear() {
+    entries_.clear();
+    parse_context_.Reset();
+  }
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::string json;
+    v8::Global<v8::Value> value;
+  };
+
+  const size_t max_entries_;
+  // The most recently used entry is last.
+  std::vector<Entry> entries_;
+  // Created on the first parse.
+  v8::Global<v8::Context> parse_context_;
+};
+
+}  // namespace google::scp::roma::sandbox::js_engine::v8_js_engine
+
+#endif  // ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_SHARED_INPUT_CACHE_H_
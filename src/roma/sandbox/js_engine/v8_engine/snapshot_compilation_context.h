@@ -21,8 +21,10 @@
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "include/v8.h"
 #include "src/roma/sandbox/js_engine/js_engine.h"
+#include "src/roma/sandbox/js_engine/v8_engine/shared_input_cache.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_wrapper.h"
 
 namespace google::scp::roma::sandbox::js_engine::v8_js_engine {
@@ -30,6 +32,19 @@ namespace google::scp::roma::sandbox::js_engine::v8_js_engine {
 /// JavaScript Mixed with WASM.
 enum class CacheType { kUnknown, kSnapshot, kUnboundScript };
 
+/// Handler functions of a v8 context, by the name they were looked up with.
+using HandlerCache =
+    absl::flat_hash_map<std::string, v8::Global<v8::Function>>;
+
+/// An idle v8 context of a compilation context, ready to run invocations.
+struct PooledContext {
+  v8::Global<v8::Context> context;
+  /// The number of invocations that have run in the context so far.
+  size_t uses = 0;
+  /// The handlers invocations have run in the context so far.
+  HandlerCache handlers;
+};
+
 /**
  * @brief A snapshot of V8 isolate with a compilation context.
  *
@@ -39,6 +54,8 @@ class SnapshotCompilationContext {
   SnapshotCompilationContext() {}
 
   ~SnapshotCompilationContext() {
+    shared_inputs.Clear();
+    context_pool.clear();
     unbound_script.Reset();
 
     // If there's any previous data, deallocate it.
@@ -63,6 +80,18 @@ class SnapshotCompilationContext {
 
   /// An instance of UnboundScript used to cache compiled code in isolate.
   v8::Global<v8::UnboundScript> unbound_script;
+
+  /// Contexts, with the compiled code available in them, which are kept to
+  /// be reused by later invocations. The most recently used one is last.
+  std::vector<PooledContext> context_pool;
+
+  /// Inputs of invocations that asked to share them, parsed once for all of
+  /// the contexts of the isolate.
+  SharedInputCache shared_inputs;
+
+  /// The heap in use after the last garbage collection run between
+  /// invocations, or zero if there has been none yet.
+  size_t steady_heap_size_bytes = 0;
 };
 }  // namespace google::scp::roma::sandbox::js_engine::v8_js_engine
 
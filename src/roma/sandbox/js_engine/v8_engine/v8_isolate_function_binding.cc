@@ -19,9 +19,11 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_split.h"
 #include "include/v8.h"
 #include "src/roma/config/type_converter.h"
@@ -32,6 +34,7 @@
 #include "src/roma/sandbox/js_engine/v8_engine/performance_now.h"
 #include "src/roma/sandbox/native_function_binding/rpc_wrapper.pb.h"
 #include "src/util/duration.h"
+#include "src/util/status_macro/status_macros.h"
 
 using google::scp::roma::proto::FunctionBindingIoProto;
 using google::scp::roma::proto::RpcWrapper;
@@ -155,13 +158,18 @@ V8IsolateFunctionBinding::V8IsolateFunctionBinding(
     const std::vector<std::string>& rpc_method_names,
     std::unique_ptr<native_function_binding::NativeFunctionInvoker>
         function_invoker,
-    std::string_view server_address)
+    std::string_view server_address,
+    const std::vector<std::string>& async_function_names)
     : function_invoker_(std::move(function_invoker)) {
+  const absl::flat_hash_set<std::string_view> async_functions(
+      async_function_names.begin(), async_function_names.end());
   for (const auto& function_name : function_names) {
     binding_references_.emplace_back(Binding{
         .function_name = function_name,
         .instance = this,
-        .callback = &GlobalV8FunctionCallback,
+        .callback = async_functions.contains(function_name)
+                        ? &GlobalV8AsyncFunctionCallback
+                        : &GlobalV8FunctionCallback,
     });
   }
   for (const auto& rpc_method_name : rpc_method_names) {
@@ -227,7 +235,11 @@ void V8IsolateFunctionBinding::GlobalV8FunctionCallback(
     return;
   }
 
-  const auto result = binding->instance->function_invoker_->Invoke(rpc_proto);
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  const auto result = binding->instance->InvokeRpc(rpc_proto);
+  CallStats& call_stats = binding->instance->call_stats_;
+  ++call_stats.calls;
+  call_stats.wait_duration += stopwatch.GetElapsedTime();
   if (!result.ok()) {
     isolate->ThrowError(kCouldNotRunFunctionBinding);
     ROMA_VLOG(1) << kCouldNotRunFunctionBinding;
@@ -242,6 +254,55 @@ void V8IsolateFunctionBinding::GlobalV8FunctionCallback(
   info.GetReturnValue().Set(returned_value);
 }
 
+void V8IsolateFunctionBinding::GlobalV8AsyncFunctionCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  ROMA_VLOG(9) << "Calling V8 async function callback";
+  auto isolate = info.GetIsolate();
+  v8::Isolate::Scope isolate_scope(isolate);
+  v8::HandleScope handle_scope(isolate);
+  auto data = info.Data();
+  if (data.IsEmpty()) {
+    isolate->ThrowError(kUnexpectedDataInBindingCallback);
+    ROMA_VLOG(1) << kUnexpectedDataInBindingCallback;
+    return;
+  }
+  auto binding_external = v8::Local<v8::External>::Cast(data);
+  auto binding = reinterpret_cast<Binding*>(binding_external->Value());
+  FunctionBindingIoProto function_invocation_proto;
+  if (!V8TypesToProto(info, function_invocation_proto)) {
+    isolate->ThrowError(kCouldNotConvertJsFunctionInputToNative);
+    ROMA_VLOG(1) << kCouldNotConvertJsFunctionInputToNative;
+    return;
+  }
+
+  RpcWrapper rpc_proto;
+  if (!NativeFieldsToProto(*binding, function_invocation_proto, rpc_proto)) {
+    isolate->ThrowError(kCouldNotRunFunctionBinding);
+    ROMA_VLOG(1) << kCouldNotRunFunctionBinding;
+    return;
+  }
+
+  v8::Local<v8::Promise::Resolver> resolver;
+  if (!v8::Promise::Resolver::New(isolate->GetCurrentContext())
+           .ToLocal(&resolver)) {
+    return;
+  }
+  V8IsolateFunctionBinding& instance = *binding->instance;
+  const uint64_t call_id = ++instance.last_call_id_;
+  rpc_proto.set_call_id(call_id);
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  const absl::Status sent = instance.function_invoker_->Send(rpc_proto);
+  ++instance.call_stats_.calls;
+  instance.call_stats_.wait_duration += stopwatch.GetElapsedTime();
+  if (!sent.ok()) {
+    isolate->ThrowError(kCouldNotRunFunctionBinding);
+    ROMA_VLOG(1) << kCouldNotRunFunctionBinding;
+    return;
+  }
+  instance.pending_calls_.try_emplace(call_id, isolate, resolver);
+  info.GetReturnValue().Set(resolver->GetPromise());
+}
+
 void V8IsolateFunctionBinding::GrpcServerCallback(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
   ROMA_VLOG(9) << "Calling V8 gRPC Server callback";
@@ -283,8 +344,11 @@ void V8IsolateFunctionBinding::GrpcServerCallback(
   context.AddMetadata(std::string(google::scp::roma::grpc_server::kUuidTag),
                       uuid);
 
+  privacy_sandbox::server_common::Stopwatch stopwatch;
   const grpc::Status status =
       stub->InvokeCallback(&context, request, &response);
+  ++binding->instance->call_stats_.calls;
+  binding->instance->call_stats_.wait_duration += stopwatch.GetElapsedTime();
 
   if (status.ok()) {
     info.GetReturnValue().Set(
@@ -371,13 +435,95 @@ void V8IsolateFunctionBinding::AddExternalReferences(
   }
   external_references.push_back(
       reinterpret_cast<intptr_t>(&GlobalV8FunctionCallback));
+  external_references.push_back(
+      reinterpret_cast<intptr_t>(&GlobalV8AsyncFunctionCallback));
   external_references.push_back(
       reinterpret_cast<intptr_t>(&GrpcServerCallback));
   external_references.push_back(reinterpret_cast<intptr_t>(&PerformanceNow));
 }
 
 absl::Status V8IsolateFunctionBinding::InvokeRpc(RpcWrapper& rpc_proto) {
-  return function_invoker_->Invoke(rpc_proto);
+  if (pending_calls_.empty()) {
+    return function_invoker_->Invoke(rpc_proto);
+  }
+  // Responses of asynchronous calls may arrive before the response of this
+  // call, so keep them for CompletePendingCall.
+  PS_RETURN_IF_ERROR(function_invoker_->Send(rpc_proto));
+  while (true) {
+    RpcWrapper response;
+    PS_RETURN_IF_ERROR(function_invoker_->Receive(response));
+    if (response.call_id() == 0) {
+      rpc_proto = std::move(response);
+      return absl::OkStatus();
+    }
+    completed_calls_.push_back(std::move(response));
+  }
+}
+
+absl::Status V8IsolateFunctionBinding::CompletePendingCall(
+    absl::Nonnull<v8::Isolate*> isolate) {
+  if (pending_calls_.empty()) {
+    return absl::OkStatus();
+  }
+  RpcWrapper response;
+  if (completed_calls_.empty()) {
+    privacy_sandbox::server_common::Stopwatch stopwatch;
+    const absl::Status received = function_invoker_->Receive(response);
+    call_stats_.wait_duration += stopwatch.GetElapsedTime();
+    PS_RETURN_IF_ERROR(received);
+  } else {
+    response = std::move(completed_calls_.front());
+    completed_calls_.pop_front();
+  }
+  const auto it = pending_calls_.find(response.call_id());
+  if (it == pending_calls_.end()) {
+    // The response of a call discarded by DiscardPendingCalls.
+    return absl::OkStatus();
+  }
+  v8::HandleScope handle_scope(isolate);
+  const v8::Local<v8::Promise::Resolver> resolver = it->second.Get(isolate);
+  pending_calls_.erase(it);
+  const v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  v8::Maybe<bool> settled = v8::Nothing<bool>();
+  if (!response.io_proto().errors().empty()) {
+    ROMA_VLOG(1) << kErrorInFunctionBindingInvocation;
+    const auto error = v8::Exception::Error(
+        TypeConverter<std::string>::ToV8(isolate,
+                                         kErrorInFunctionBindingInvocation)
+            .As<v8::String>());
+    settled = resolver->Reject(context, error);
+  } else {
+    settled = resolver->Resolve(context,
+                                ProtoToV8Type(isolate, response.io_proto()));
+  }
+  if (settled.IsNothing()) {
+    return absl::InternalError(
+        "Could not settle the promise of an asynchronous call.");
+  }
+  return absl::OkStatus();
+}
+
+void V8IsolateFunctionBinding::SettlePendingCalls(
+    absl::Nonnull<v8::Isolate*> isolate) {
+  while (!pending_calls_.empty()) {
+    if (const auto status = CompletePendingCall(isolate); !status.ok()) {
+      ROMA_VLOG(1) << "Failed to complete asynchronous call: " << status;
+      DiscardPendingCalls();
+      return;
+    }
+    isolate->PerformMicrotaskCheckpoint();
+  }
+}
+
+void V8IsolateFunctionBinding::DiscardPendingCalls() {
+  size_t outstanding = pending_calls_.size() - completed_calls_.size();
+  pending_calls_.clear();
+  completed_calls_.clear();
+  for (; outstanding > 0; --outstanding) {
+    if (RpcWrapper response; !function_invoker_->Receive(response).ok()) {
+      return;
+    }
+  }
 }
 
 void V8IsolateFunctionBinding::SetMinLogLevel(absl::LogSeverity severity) {
@@ -17,6 +17,8 @@
 #ifndef ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_V8_ISOLATE_FUNCTION_BINDING_H_
 #define ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_V8_ISOLATE_FUNCTION_BINDING_H_
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
 #include <utility>
@@ -25,6 +27,9 @@
 #include <grpcpp/grpcpp.h>
 
 #include "absl/base/nullability.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
 #include "include/v8.h"
 #include "src/roma/native_function_grpc_server/proto/callback_service.grpc.pb.h"
 #include "src/roma/native_function_grpc_server/proto/callback_service.pb.h"
@@ -37,13 +42,16 @@ class V8IsolateFunctionBinding {
    * @brief Create a V8IsolateFunctionBinding instance
    * @param function_names is a list of the names of the functions that can be
    * registered in the v8 context.
+   * @param async_function_names is the subset of function_names whose
+   * functions return a Promise instead of blocking on the native function.
    */
   V8IsolateFunctionBinding(
       const std::vector<std::string>& function_names,
       const std::vector<std::string>& rpc_method_names,
       std::unique_ptr<native_function_binding::NativeFunctionInvoker>
           function_invoker,
-      std::string_view server_address);
+      std::string_view server_address,
+      const std::vector<std::string>& async_function_names = {});
 
   // Not copyable or movable
   V8IsolateFunctionBinding(const V8IsolateFunctionBinding&) = delete;
@@ -61,6 +69,32 @@ class V8IsolateFunctionBinding {
 
   absl::Status InvokeRpc(google::scp::roma::proto::RpcWrapper& rpc_proto);
 
+  // Blocks until one outstanding asynchronous call completes and settles its
+  // promise. Returns immediately if no calls are outstanding.
+  absl::Status CompletePendingCall(absl::Nonnull<v8::Isolate*> isolate);
+
+  // Completes all outstanding asynchronous calls, running the microtasks that
+  // their promises trigger, which may make further calls.
+  void SettlePendingCalls(absl::Nonnull<v8::Isolate*> isolate);
+
+  // Waits for the responses of the asynchronous calls left outstanding by a
+  // failed invocation and drops their promises without running any JS.
+  void DiscardPendingCalls();
+
+  struct CallStats {
+    // The number of native function calls made.
+    int64_t calls = 0;
+    // The time spent blocked on native function calls, sending them and
+    // waiting for their responses. Asynchronous calls only count for as long
+    // as their caller waits for them.
+    absl::Duration wait_duration = absl::ZeroDuration();
+  };
+
+  // The native function calls made since the last ResetCallStats.
+  const CallStats& call_stats() const { return call_stats_; }
+
+  void ResetCallStats() { call_stats_ = CallStats(); }
+
  private:
   struct Binding {
     std::string function_name;
@@ -70,6 +104,9 @@ class V8IsolateFunctionBinding {
   static void GlobalV8FunctionCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
 
+  static void GlobalV8AsyncFunctionCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+
   static void GrpcServerCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
 
@@ -92,6 +129,14 @@ class V8IsolateFunctionBinding {
   const std::vector<std::string> function_names_;
   std::unique_ptr<native_function_binding::NativeFunctionInvoker>
       function_invoker_;
+  uint64_t last_call_id_ = 0;
+  // Promises of the asynchronous calls that are in flight, by call id.
+  absl::flat_hash_map<uint64_t, v8::Global<v8::Promise::Resolver>>
+      pending_calls_;
+  // Responses of asynchronous calls received while waiting for the response
+  // of a synchronous call.
+  std::deque<google::scp::roma::proto::RpcWrapper> completed_calls_;
+  CallStats call_stats_;
   std::shared_ptr<grpc::Channel> grpc_channel_;
   std::unique_ptr<privacy_sandbox::server_common::JSCallbackService::Stub>
       stub_;
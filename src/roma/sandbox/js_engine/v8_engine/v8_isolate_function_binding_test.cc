@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "include/v8.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_js_engine.h"
 #include "src/roma/sandbox/native_function_binding/native_function_invoker.h"
@@ -54,6 +55,8 @@ class NativeFunctionInvokerMock
     : public native_function_binding::NativeFunctionInvoker {
  public:
   MOCK_METHOD(absl::Status, Invoke, (RpcWrapper&), (override));
+  MOCK_METHOD(absl::Status, Send, (const RpcWrapper&), (override));
+  MOCK_METHOD(absl::Status, Receive, (RpcWrapper&), (override));
 
   virtual ~NativeFunctionInvokerMock() = default;
 };
@@ -102,4 +105,47 @@ TEST_F(V8IsolateFunctionBindingTest, PerformanceNowDeclaredInJs) {
   js_engine.Stop();
 }
 
+TEST_F(V8IsolateFunctionBindingTest, AsyncFunctionReturnsPromise) {
+  auto function_invoker = std::make_unique<NativeFunctionInvokerMock>();
+  std::vector<RpcWrapper> sent_calls;
+  EXPECT_CALL(*function_invoker, Send(_))
+      .Times(2)
+      .WillRepeatedly([&sent_calls](const RpcWrapper& rpc_proto) {
+        sent_calls.push_back(rpc_proto);
+        return absl::OkStatus();
+      });
+  // Answer the most recent call first.
+  EXPECT_CALL(*function_invoker, Receive(_))
+      .Times(2)
+      .WillRepeatedly([&sent_calls](RpcWrapper& rpc_proto) {
+        rpc_proto = std::move(sent_calls.back());
+        sent_calls.pop_back();
+        rpc_proto.mutable_io_proto()->set_output_string(
+            absl::StrCat(rpc_proto.io_proto().input_string(), "!"));
+        return absl::OkStatus();
+      });
+
+  std::vector<std::string> function_names = {"cool_func"};
+  auto visitor = std::make_unique<v8_js_engine::V8IsolateFunctionBinding>(
+      function_names, /*rpc_method_names=*/std::vector<std::string>(),
+      std::move(function_invoker), /*server_address=*/"",
+      /*async_function_names=*/function_names);
+
+  static constexpr bool skip_v8_cleanup = true;
+  js_engine::v8_js_engine::V8JsEngine js_engine(std::move(visitor),
+                                                skip_v8_cleanup);
+  js_engine.Run();
+
+  auto result_or = js_engine.CompileAndRunJs(
+      R"(async function func() {
+        const [a, b] = await Promise.all([cool_func("a"), cool_func("b")]);
+        return a + b;
+      })",
+      "func", {}, {});
+  ASSERT_TRUE(result_or.ok());
+  const auto& response_string = result_or->execution_response.response;
+  EXPECT_THAT(response_string, StrEq(R"("a!b!")"));
+  js_engine.Stop();
+}
+
 }  // namespace google::scp::roma::sandbox::js_engine::test
@@ -21,13 +21,16 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/log/check.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_join.h"
@@ -55,7 +58,25 @@ using google::scp::roma::TypeConverter;
 using google::scp::roma::logging::LogOptions;
 using google::scp::roma::proto::FunctionBindingIoProto;
 using google::scp::roma::proto::RpcWrapper;
+using google::scp::roma::sandbox::constants::
+    kExecutionCounterJsEngineContextsCreated;
+using google::scp::roma::sandbox::constants::
+    kExecutionCounterJsEngineContextsReused;
+using google::scp::roma::sandbox::constants::
+    kExecutionCounterJsEngineHeapAllocatedBytes;
+using google::scp::roma::sandbox::constants::
+    kExecutionCounterJsEngineHeapPeakBytes;
+using google::scp::roma::sandbox::constants::kExecutionCounterInputBytes;
+using google::scp::roma::sandbox::constants::
+    kExecutionCounterNativeFunctionCalls;
+using google::scp::roma::sandbox::constants::kExecutionCounterOutputBytes;
+using google::scp::roma::sandbox::constants::
+    kExecutionMetricJsEngineCpuDuration;
+using google::scp::roma::sandbox::constants::
+    kExecutionMetricNativeFunctionCallDuration;
+using google::scp::roma::sandbox::constants::kGcPauseMetricJsEngineDuration;
 using google::scp::roma::sandbox::constants::kHandlerCallMetricJsEngineDuration;
+using google::scp::roma::sandbox::constants::kInputCounterSharedInputCacheHits;
 using google::scp::roma::sandbox::constants::
     kInputParsingMetricJsEngineDuration;
 using google::scp::roma::sandbox::constants::kJsEngineOneTimeSetupV8FlagsKey;
@@ -63,7 +84,10 @@ using google::scp::roma::sandbox::constants::kJsEngineOneTimeSetupWasmPagesKey;
 using google::scp::roma::sandbox::constants::kMaxNumberOfWasm32BitMemPages;
 using google::scp::roma::sandbox::constants::kMinLogLevel;
 using google::scp::roma::sandbox::constants::kRequestId;
+using google::scp::roma::sandbox::constants::kShareInput;
 using google::scp::roma::sandbox::constants::kRequestUuid;
+using google::scp::roma::sandbox::constants::kReturnStartupSnapshot;
+using google::scp::roma::sandbox::constants::kStartupSnapshot;
 using google::scp::roma::sandbox::constants::kWasmMemPagesV8PlatformFlag;
 using google::scp::roma::sandbox::js_engine::JsEngineExecutionResponse;
 using google::scp::roma::sandbox::js_engine::RomaJsEngineCompilationContext;
@@ -203,6 +227,10 @@ std::string_view GetGCCallbackFlagsName(v8::GCCallbackFlags flags) {
     return "UNKNOWN_GC_CALLBACK_FLAG";
   }
 }
+
+// An idle isolate is only collected once its heap has grown by this much
+// beyond its steady state, or by a quarter of it if that is more.
+constexpr size_t kMinIdleHeapGrowthBytes = 1 << 20;
 }  // namespace
 
 namespace google::scp::roma::sandbox::js_engine::v8_js_engine {
@@ -212,7 +240,9 @@ V8JsEngine::V8JsEngine(
     const bool skip_v8_cleanup, const bool enable_profilers,
     const JsEngineResourceConstraints& v8_resource_constraints,
     const bool logging_function_set,
-    const bool disable_udf_stacktraces_in_response)
+    const bool disable_udf_stacktraces_in_response,
+    const size_t context_pool_size, const size_t context_max_uses,
+    const uint32_t invocation_resource_metrics)
     : isolate_function_binding_(std::move(isolate_function_binding)),
       v8_resource_constraints_(v8_resource_constraints),
       execution_watchdog_(std::make_unique<roma::worker::ExecutionWatchDog>()),
@@ -220,7 +250,10 @@ V8JsEngine::V8JsEngine(
       enable_profilers_(enable_profilers),
       logging_function_set_(logging_function_set),
       disable_udf_stacktraces_in_response_(
-          disable_udf_stacktraces_in_response) {
+          disable_udf_stacktraces_in_response),
+      context_pool_size_(context_pool_size),
+      context_max_uses_(context_max_uses),
+      invocation_resource_metrics_(invocation_resource_metrics) {
   if (isolate_function_binding_) {
     isolate_function_binding_->AddExternalReferences(external_references_);
   }
@@ -339,6 +372,22 @@ absl::Status V8JsEngine::CreateSnapshot(v8::StartupData& startup_data,
   return absl::OkStatus();
 }
 
+bool V8JsEngine::RestoreSnapshot(v8::StartupData& startup_data,
+                                 std::string_view snapshot) {
+  char* data = new char[snapshot.size()];
+  std::copy(snapshot.begin(), snapshot.end(), data);
+  startup_data = {data, static_cast<int>(snapshot.size())};
+  // A snapshot created by a different V8 build must not be restored.
+  if (!startup_data.IsValid()) {
+    LOG(WARNING) << "Ignoring a startup snapshot that is not valid for this "
+                    "V8 build.";
+    delete[] startup_data.data;
+    startup_data = {nullptr, 0};
+    return false;
+  }
+  return true;
+}
+
 absl::Status V8JsEngine::CreateSnapshotWithGlobals(
     v8::StartupData& startup_data, absl::Span<const uint8_t> wasm,
     const absl::flat_hash_map<std::string_view, std::string_view>& metadata) {
@@ -404,8 +453,32 @@ void LogHeapStatistics(v8::Isolate* isolate) {
                << "\n  heap_size_limit: " << heap_stats.heap_size_limit();
 }
 
+// Garbage collection pauses happen on the thread that runs the isolate, so
+// they are timed per thread. `gc_pause_duration` is reset by each invocation.
+thread_local absl::Time gc_pause_started_at;
+thread_local absl::Duration gc_pause_duration;
+
+// While an invocation accounting for its heap usage runs on the thread, each
+// collection records the heap in use before it, the largest the heap gets
+// between collections, and the bytes it frees.
+thread_local bool gc_heap_accounting = false;
+thread_local size_t gc_heap_used_before = 0;
+thread_local size_t gc_heap_peak_bytes = 0;
+thread_local size_t gc_heap_freed_bytes = 0;
+
+size_t UsedHeapSize(v8::Isolate* isolate) {
+  v8::HeapStatistics heap_stats;
+  isolate->GetHeapStatistics(&heap_stats);
+  return heap_stats.used_heap_size();
+}
+
 void GCPrologueCallback(v8::Isolate* isolate, v8::GCType type,
                         v8::GCCallbackFlags flags) {
+  gc_pause_started_at = absl::Now();
+  if (gc_heap_accounting) {
+    gc_heap_used_before = UsedHeapSize(isolate);
+    gc_heap_peak_bytes = std::max(gc_heap_peak_bytes, gc_heap_used_before);
+  }
   ROMA_VLOG(9) << "Garbage Collection event started. Type: "
                << GetGCTypeName(type)
                << ", Flags: " << GetGCCallbackFlagsName(flags);
@@ -418,8 +491,84 @@ void GCEpilogueCallback(v8::Isolate* isolate, v8::GCType type,
                << GetGCTypeName(type)
                << ", Flags: " << GetGCCallbackFlagsName(flags);
   LogHeapStatistics(isolate);
+  if (gc_heap_accounting) {
+    if (const size_t used_after = UsedHeapSize(isolate);
+        used_after < gc_heap_used_before) {
+      gc_heap_freed_bytes += gc_heap_used_before - used_after;
+    }
+  }
+  gc_pause_duration += absl::Now() - gc_pause_started_at;
 }
 
+// Measures the resources an invocation uses, as selected by a bitmask of
+// InvocationResourceMetric, from its construction until Report.
+class InvocationResourceAccounting {
+ public:
+  InvocationResourceAccounting(uint32_t metrics, v8::Isolate* isolate,
+                               V8IsolateFunctionBinding* function_binding)
+      : metrics_(metrics),
+        isolate_(isolate),
+        function_binding_(function_binding) {
+    if (metrics_ & kInvocationHeapUsage) {
+      heap_used_at_start_ = UsedHeapSize(isolate_);
+      gc_heap_accounting = true;
+      gc_heap_peak_bytes = heap_used_at_start_;
+      gc_heap_freed_bytes = 0;
+    }
+    if (function_binding_) {
+      function_binding_->ResetCallStats();
+    }
+  }
+
+  ~InvocationResourceAccounting() { gc_heap_accounting = false; }
+
+  void Report(const std::vector<std::string_view>& input,
+              ExecutionResponse& response) const {
+    if (metrics_ & kInvocationCpuTime) {
+      response.metrics[kExecutionMetricJsEngineCpuDuration] =
+          cpu_stopwatch_.GetElapsedTime();
+    }
+    if (metrics_ & kInvocationHeapUsage) {
+      const size_t used_at_end = UsedHeapSize(isolate_);
+      // What is in use at the end was either in use at the start or
+      // allocated, as was what collections freed.
+      const size_t in_use_or_freed = used_at_end + gc_heap_freed_bytes;
+      response.counters[kExecutionCounterJsEngineHeapAllocatedBytes] =
+          in_use_or_freed > heap_used_at_start_
+              ? in_use_or_freed - heap_used_at_start_
+              : 0;
+      response.counters[kExecutionCounterJsEngineHeapPeakBytes] =
+          std::max(gc_heap_peak_bytes, used_at_end);
+    }
+    if (metrics_ & kInvocationNativeFunctionCalls) {
+      V8IsolateFunctionBinding::CallStats call_stats;
+      if (function_binding_) {
+        call_stats = function_binding_->call_stats();
+      }
+      response.counters[kExecutionCounterNativeFunctionCalls] =
+          call_stats.calls;
+      response.metrics[kExecutionMetricNativeFunctionCallDuration] =
+          call_stats.wait_duration;
+    }
+    if (metrics_ & kInvocationIoBytes) {
+      int64_t input_bytes = 0;
+      for (const std::string_view arg : input) {
+        input_bytes += arg.size();
+      }
+      response.counters[kExecutionCounterInputBytes] = input_bytes;
+      response.counters[kExecutionCounterOutputBytes] =
+          response.response.size();
+    }
+  }
+
+ private:
+  const uint32_t metrics_;
+  v8::Isolate* const isolate_;
+  V8IsolateFunctionBinding* const function_binding_;
+  privacy_sandbox::server_common::CpuThreadTimeStopwatch cpu_stopwatch_;
+  size_t heap_used_at_start_ = 0;
+};
+
 std::unique_ptr<V8IsolateWrapper> V8JsEngine::CreateIsolate(
     const v8::StartupData& startup_data) {
   v8::Isolate::CreateParams params;
@@ -432,6 +581,15 @@ std::unique_ptr<V8IsolateWrapper> V8JsEngine::CreateIsolate(
         v8_resource_constraints_.initial_heap_size_in_mb * kMB,
         v8_resource_constraints_.maximum_heap_size_in_mb * kMB);
   }
+  // Unless configured, start with a heap that fits the live set collections
+  // between invocations have left in the isolates so far, so that the heap
+  // need not grow through collections during invocations.
+  if (const size_t steady_heap_size = steady_heap_size_bytes_;
+      v8_resource_constraints_.initial_heap_size_in_mb == 0 &&
+      steady_heap_size > 0) {
+    params.constraints.set_initial_old_generation_size_in_bytes(
+        steady_heap_size);
+  }
 
   std::unique_ptr<v8::ArrayBuffer::Allocator> allocator(
       v8::ArrayBuffer::Allocator::NewDefaultAllocator());
@@ -468,7 +626,8 @@ V8Console* V8JsEngine::console() ABSL_LOCKS_EXCLUDED(console_mutex_) {
 
 void V8JsEngine::StartWatchdogTimer(
     v8::Isolate* isolate,
-    const absl::flat_hash_map<std::string_view, std::string_view>& metadata) {
+    const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+    absl::Time deadline) {
   // Get the timeout value from metadata. If no timeout tag is set, the
   // default value kDefaultExecutionTimeout will be used.
   auto timeout_ms = kDefaultExecutionTimeout;
@@ -482,6 +641,9 @@ void V8JsEngine::StartWatchdogTimer(
                     "tag to absl::Duration.  ";
     }
   }
+  if (deadline != absl::InfiniteFuture()) {
+    timeout_ms = std::min(timeout_ms, deadline - absl::Now());
+  }
   ROMA_VLOG(1) << "StartWatchdogTimer timeout set to " << timeout_ms << " ms";
   execution_watchdog_->StartTimer(isolate, timeout_ms);
 }
@@ -502,10 +664,19 @@ V8JsEngine::CreateCompilationContext(
   // created. Otherwise, a normal snapshot containing compiled JS code will be
   // created.
   const bool js_with_wasm = !wasm.empty();
-  absl::Status snapshot_status =
-      js_with_wasm ? CreateSnapshotWithGlobals(snapshot_context->startup_data,
-                                               wasm, metadata)
-                   : CreateSnapshot(snapshot_context->startup_data, code);
+  // A snapshot handed over with the load is restored instead of created.
+  bool restored = false;
+  if (const auto it = metadata.find(kStartupSnapshot);
+      it != metadata.end() && !js_with_wasm) {
+    restored = RestoreSnapshot(snapshot_context->startup_data, it->second);
+  }
+  absl::Status snapshot_status;
+  if (!restored) {
+    snapshot_status =
+        js_with_wasm ? CreateSnapshotWithGlobals(snapshot_context->startup_data,
+                                                 wasm, metadata)
+                     : CreateSnapshot(snapshot_context->startup_data, code);
+  }
   std::unique_ptr<V8IsolateWrapper> isolate_or;
   if (snapshot_status.ok()) {
     isolate_or = CreateIsolate(snapshot_context->startup_data);
@@ -559,6 +730,7 @@ V8JsEngine::CreateCompilationContext(
   // Snapshot the isolate with compilation context and also initialize a
   // execution watchdog inside the isolate.
   snapshot_context->isolate = std::move(isolate_or);
+  PS_RETURN_IF_ERROR(PrewarmContextPool(snapshot_context));
   return RomaJsEngineCompilationContext{
       .context = snapshot_context,
   };
@@ -592,8 +764,6 @@ absl::StatusOr<ExecutionResponse> V8JsEngine::ExecuteJs(
         current_compilation_context,
     std::string_view function_name, const std::vector<std::string_view>& input,
     const absl::flat_hash_map<std::string_view, std::string_view>& metadata) {
-  LogOptions log_options = GetLogOptions(metadata);
-
   v8::Isolate* v8_isolate = current_compilation_context->isolate->isolate();
   v8::Isolate::Scope isolate_scope(v8_isolate);
   // Create a handle scope to keep the temporary object references.
@@ -603,112 +773,386 @@ absl::StatusOr<ExecutionResponse> V8JsEngine::ExecuteJs(
 
   // Create a context scope, which has essential side-effects for compilation
   v8::Local<v8::Context> v8_context;
-  if (current_compilation_context->cache_type == CacheType::kUnboundScript) {
-    // If cached JS contained global WebAssembly, the context associated with
-    // the isolate created in CreateCompilationContext() will not include the
-    // bound callbacks. Recreate the context and rebind the callbacks to ensure
-    // they can still be called with global WASM.
-    PS_RETURN_IF_ERROR(CreateV8Context(v8_isolate, v8_context));
-  } else {
-    v8_context = v8::Context::New(v8_isolate);
+  size_t uses = 0;
+  HandlerCache handlers;
+  bool created = false;
+  PS_RETURN_IF_ERROR(AcquireExecutionContext(
+      current_compilation_context, v8_context, uses, handlers, created));
+  v8::Context::Scope context_scope(v8_context);
+
+  v8::Local<v8::Function> handler;
+  PS_RETURN_IF_ERROR(
+      GetCachedJsHandler(v8_isolate, function_name, handlers, handler));
+  auto response_or = InvokeJsHandler(
+      v8_isolate, v8_context, handler, input, metadata, try_catch,
+      current_compilation_context->shared_inputs);
+  if (!response_or.ok()) {
+    // The state of a context the invocation failed in, for instance because
+    // it was terminated, is unknown, so it is not reused.
+    return response_or;
   }
+  response_or->counters[kExecutionCounterJsEngineContextsCreated] =
+      created ? 1 : 0;
+  response_or->counters[kExecutionCounterJsEngineContextsReused] =
+      created ? 0 : 1;
+  ReleaseExecutionContext(current_compilation_context, v8_context, uses + 1,
+                          std::move(handlers));
+  return response_or;
+}
 
-  v8::Context::Scope context_scope(v8_context);
+absl::Status V8JsEngine::AcquireExecutionContext(
+    const std::shared_ptr<SnapshotCompilationContext>&
+        current_compilation_context,
+    v8::Local<v8::Context>& v8_context, size_t& uses, HandlerCache& handlers,
+    bool& created) {
+  std::vector<PooledContext>& pool = current_compilation_context->context_pool;
+  created = pool.empty();
+  if (created) {
+    uses = 0;
+    handlers.clear();
+    return CreateExecutionContext(current_compilation_context, v8_context);
+  }
+  v8::Isolate* v8_isolate = current_compilation_context->isolate->isolate();
+  v8_context = v8::Local<v8::Context>::New(v8_isolate, pool.back().context);
+  uses = pool.back().uses;
+  handlers = std::move(pool.back().handlers);
+  pool.pop_back();
+  return absl::OkStatus();
+}
 
-  // Binding UnboundScript to current context when the compilation context is
-  // kUnboundScript.
-  if (current_compilation_context->cache_type == CacheType::kUnboundScript) {
-    if (auto status = ExecutionUtils::BindUnboundScript(
-            current_compilation_context->unbound_script);
-        !status.ok()) {
-      LOG(ERROR)
-          << "BindUnboundScript failed with: Failed to bind unbound script.";
-      DLOG(ERROR) << "BindUnboundScript failed with debug errors "
-                  << status.message();
-      return status;
-    }
+void V8JsEngine::ReleaseExecutionContext(
+    const std::shared_ptr<SnapshotCompilationContext>&
+        current_compilation_context,
+    v8::Local<v8::Context> v8_context, size_t uses, HandlerCache handlers) {
+  std::vector<PooledContext>& pool = current_compilation_context->context_pool;
+  if (pool.size() >= context_pool_size_ ||
+      (context_max_uses_ > 0 && uses >= context_max_uses_)) {
+    return;
   }
+  v8::Isolate* v8_isolate = current_compilation_context->isolate->isolate();
+  pool.push_back(PooledContext{
+      .context = v8::Global<v8::Context>(v8_isolate, v8_context),
+      .uses = uses,
+      .handlers = std::move(handlers),
+  });
+}
 
-  v8::Local<v8::Value> handler;
-  if (const auto status = ExecutionUtils::GetJsHandler(function_name, handler);
+absl::Status V8JsEngine::GetCachedJsHandler(v8::Isolate* v8_isolate,
+                                            std::string_view function_name,
+                                            HandlerCache& handlers,
+                                            v8::Local<v8::Function>& handler) {
+  if (const auto it = handlers.find(function_name); it != handlers.end()) {
+    handler = it->second.Get(v8_isolate);
+    return absl::OkStatus();
+  }
+  v8::Local<v8::Value> value;
+  if (const auto status = ExecutionUtils::GetJsHandler(function_name, value);
       !status.ok()) {
     DLOG(ERROR) << "GetJsHandler failed with " << status.message();
     return status;
   }
+  handler = value.As<v8::Function>();
+  // Without a context pool, the context and its handlers are dropped after
+  // the invocation.
+  if (context_pool_size_ > 0) {
+    handlers.emplace(function_name,
+                     v8::Global<v8::Function>(v8_isolate, handler));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status V8JsEngine::PrewarmContextPool(
+    const std::shared_ptr<SnapshotCompilationContext>&
+        current_compilation_context) {
+  if (context_pool_size_ == 0) {
+    return absl::OkStatus();
+  }
+  v8::Isolate* v8_isolate = current_compilation_context->isolate->isolate();
+  v8::Isolate::Scope isolate_scope(v8_isolate);
+  v8::HandleScope handle_scope(v8_isolate);
+  current_compilation_context->context_pool.reserve(context_pool_size_);
+  while (current_compilation_context->context_pool.size() <
+         context_pool_size_) {
+    v8::Local<v8::Context> v8_context;
+    PS_RETURN_IF_ERROR(
+        CreateExecutionContext(current_compilation_context, v8_context));
+    ReleaseExecutionContext(current_compilation_context, v8_context,
+                            /*uses=*/0, /*handlers=*/{});
+  }
+  return absl::OkStatus();
+}
+
+absl::Status V8JsEngine::CreateExecutionContext(
+    const std::shared_ptr<SnapshotCompilationContext>&
+        current_compilation_context,
+    v8::Local<v8::Context>& v8_context) {
+  v8::Isolate* v8_isolate = current_compilation_context->isolate->isolate();
+  if (current_compilation_context->cache_type != CacheType::kUnboundScript) {
+    v8_context = v8::Context::New(v8_isolate);
+    return absl::OkStatus();
+  }
+  // If cached JS contained global WebAssembly, the context associated with
+  // the isolate created in CreateCompilationContext() will not include the
+  // bound callbacks. Recreate the context and rebind the callbacks to ensure
+  // they can still be called with global WASM.
+  PS_RETURN_IF_ERROR(CreateV8Context(v8_isolate, v8_context));
+
+  // Binding UnboundScript to current context when the compilation context is
+  // kUnboundScript.
+  v8::Context::Scope context_scope(v8_context);
+  if (auto status = ExecutionUtils::BindUnboundScript(
+          current_compilation_context->unbound_script);
+      !status.ok()) {
+    LOG(ERROR)
+        << "BindUnboundScript failed with: Failed to bind unbound script.";
+    DLOG(ERROR) << "BindUnboundScript failed with debug errors "
+                << status.message();
+    return status;
+  }
+  return absl::OkStatus();
+}
 
+absl::StatusOr<ExecutionResponse> V8JsEngine::InvokeJsHandler(
+    v8::Isolate* v8_isolate, v8::Local<v8::Context> v8_context,
+    v8::Local<v8::Function> handler_func,
+    const std::vector<std::string_view>& input,
+    const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+    v8::TryCatch& try_catch, SharedInputCache& shared_inputs) {
+  LogOptions log_options = GetLogOptions(metadata);
+  // Asynchronous native function calls still outstanding when the handler
+  // fails must not leave their responses for the next invocation to read.
+  absl::Cleanup discard_pending_calls = [this] {
+    if (isolate_function_binding_) {
+      isolate_function_binding_->DiscardPendingCalls();
+    }
+  };
   ExecutionResponse execution_response;
+  gc_pause_duration = absl::ZeroDuration();
+  const InvocationResourceAccounting resource_accounting(
+      invocation_resource_metrics_, v8_isolate,
+      isolate_function_binding_.get());
   privacy_sandbox::server_common::Stopwatch stopwatch;
-  {
-    v8::Local<v8::Function> handler_func = handler.As<v8::Function>();
-    stopwatch.Reset();
-
-    const auto input_type =
-        metadata.find(google::scp::roma::sandbox::constants::kInputType);
-    const bool uses_input_type = (input_type != metadata.end());
-    const bool uses_input_type_bytes =
-        (uses_input_type &&
-         input_type->second ==
-             google::scp::roma::sandbox::constants::kInputTypeBytes);
-
-    v8::Local<v8::Array> argv_array =
-        ExecutionUtils::ParseAsJsInput(input, uses_input_type_bytes);
-    const size_t argc = input.size();
-    // If argv_array size doesn't match with input. Input conversion failed.
-    if (argv_array.IsEmpty() || argv_array->Length() != argc) {
-      LOG(ERROR) << "Could not parse the inputs";
-      return FormatAndLogError(v8_isolate, try_catch, v8_context,
-                               "Error parsing input as valid JSON.",
-                               std::move(log_options));
-    }
-    v8::Local<v8::Value> argv[argc];
+  const auto input_type =
+      metadata.find(google::scp::roma::sandbox::constants::kInputType);
+  const bool uses_input_type = (input_type != metadata.end());
+  const bool uses_input_type_bytes =
+      (uses_input_type &&
+       input_type->second ==
+           google::scp::roma::sandbox::constants::kInputTypeBytes);
+  const bool uses_input_type_serialized_value =
+      (uses_input_type &&
+       input_type->second == google::scp::roma::sandbox::constants::
+                                 kInputTypeSerializedValue);
+
+  const size_t argc = input.size();
+  v8::Local<v8::Value> argv[argc];
+  if (uses_input_type_serialized_value) {
     for (size_t i = 0; i < argc; ++i) {
-      argv[i] = argv_array->Get(v8_context, i).ToLocalChecked();
-    }
-    execution_response.metrics[kInputParsingMetricJsEngineDuration] =
-        stopwatch.GetElapsedTime();
-    stopwatch.Reset();
-    v8::Local<v8::Value> result;
-    if (!handler_func->Call(v8_context, v8_context->Global(), argc, argv)
-             .ToLocal(&result)) {
-      LOG(ERROR) << "Handler function calling failed";
-      return FormatAndLogError(v8_isolate, try_catch, v8_context,
-                               "Error when invoking the handler.",
-                               std::move(log_options));
-    }
-    if (result->IsPromise()) {
-      std::string error_msg;
-      if (auto status = ExecutionUtils::V8PromiseHandler(v8_isolate, result);
-          !status.ok()) {
-        DLOG(ERROR) << "V8 Promise execution failed" << status;
+      v8::ValueDeserializer deserializer(
+          v8_isolate, reinterpret_cast<const uint8_t*>(input[i].data()),
+          input[i].size());
+      if (!deserializer.ReadHeader(v8_context).FromMaybe(false) ||
+          !deserializer.ReadValue(v8_context).ToLocal(&argv[i])) {
+        LOG(ERROR) << "Could not deserialize the inputs";
         return FormatAndLogError(v8_isolate, try_catch, v8_context,
-                                 status.message(), std::move(log_options));
+                                 "Error deserializing input.",
+                                 std::move(log_options));
       }
     }
-    execution_response.metrics[kHandlerCallMetricJsEngineDuration] =
-        stopwatch.GetElapsedTime();
-    // Treat as JSON escaped string if there is no input_type in the metadata or
-    // the metadata of input type is not for a byte string.
-    if (!(uses_input_type && uses_input_type_bytes)) {
-      v8::Local<v8::String> result_string;
-      if (auto result_json_maybe = v8::JSON::Stringify(v8_context, result);
-          !result_json_maybe.ToLocal(&result)) {
-        LOG(ERROR) << "Failed to convert the V8 JSON result to Local string";
+  } else if (!uses_input_type && metadata.contains(kShareInput)) {
+    int64_t hits = 0;
+    for (size_t i = 0; i < argc; ++i) {
+      bool hit = false;
+      if (!shared_inputs.GetOrParse(v8_isolate, input[i], hit)
+               .ToLocal(&argv[i])) {
+        LOG(ERROR) << "Could not parse the inputs";
         return FormatAndLogError(v8_isolate, try_catch, v8_context,
-                                 "Error converting output to JSON.",
+                                 "Error parsing input as valid JSON.",
                                  std::move(log_options));
       }
+      hits += hit ? 1 : 0;
+    }
+    execution_response.counters[kInputCounterSharedInputCacheHits] = hits;
+  } else if (!ExecutionUtils::ParseAsJsArgs(v8_isolate, v8_context, input,
+                                            uses_input_type_bytes,
+                                            absl::MakeSpan(argv, argc))) {
+    LOG(ERROR) << "Could not parse the inputs";
+    return FormatAndLogError(v8_isolate, try_catch, v8_context,
+                             "Error parsing input as valid JSON.",
+                             std::move(log_options));
+  }
+  execution_response.metrics[kInputParsingMetricJsEngineDuration] =
+      stopwatch.GetElapsedTime();
+  stopwatch.Reset();
+  v8::Local<v8::Value> result;
+  if (!handler_func->Call(v8_context, v8_context->Global(), argc, argv)
+           .ToLocal(&result)) {
+    LOG(ERROR) << "Handler function calling failed";
+    return FormatAndLogError(v8_isolate, try_catch, v8_context,
+                             "Error when invoking the handler.",
+                             std::move(log_options));
+  }
+  if (result->IsPromise()) {
+    std::string error_msg;
+    absl::AnyInvocable<absl::Status()> complete_pending_call;
+    if (isolate_function_binding_) {
+      complete_pending_call = [this, v8_isolate] {
+        return isolate_function_binding_->CompletePendingCall(v8_isolate);
+      };
+    }
+    if (auto status = ExecutionUtils::V8PromiseHandler(
+            v8_isolate, result, std::move(complete_pending_call));
+        !status.ok()) {
+      DLOG(ERROR) << "V8 Promise execution failed" << status;
+      return FormatAndLogError(v8_isolate, try_catch, v8_context,
+                               status.message(), std::move(log_options));
     }
-    if (!TypeConverter<std::string>::FromV8(v8_isolate, result,
-                                            &execution_response.response)) {
-      LOG(ERROR) << "Failed to convert V8 string to std::string";
+  }
+  if (isolate_function_binding_) {
+    // Settle the calls whose promises the handler did not wait for.
+    isolate_function_binding_->SettlePendingCalls(v8_isolate);
+  }
+  execution_response.metrics[kHandlerCallMetricJsEngineDuration] =
+      stopwatch.GetElapsedTime();
+  execution_response.metrics[kGcPauseMetricJsEngineDuration] =
+      gc_pause_duration;
+  if (uses_input_type_serialized_value) {
+    v8::ValueSerializer serializer(v8_isolate);
+    serializer.WriteHeader();
+    if (!serializer.WriteValue(v8_context, result).FromMaybe(false)) {
+      LOG(ERROR) << "Failed to serialize the result";
       return FormatAndLogError(v8_isolate, try_catch, v8_context,
-                               "Error converting V8 string to std::string",
+                               "Error serializing output.",
                                std::move(log_options));
     }
+    // Allocated with realloc by the default delegate.
+    const auto [buffer, size] = serializer.Release();
+    execution_response.response.assign(reinterpret_cast<const char*>(buffer),
+                                       size);
+    std::free(buffer);
+    resource_accounting.Report(input, execution_response);
+    return execution_response;
   }
+  // Treat as JSON escaped string if there is no input_type in the metadata or
+  // the metadata of input type is not for a byte string.
+  if (!(uses_input_type && uses_input_type_bytes)) {
+    v8::Local<v8::String> result_string;
+    if (auto result_json_maybe = v8::JSON::Stringify(v8_context, result);
+        !result_json_maybe.ToLocal(&result)) {
+      LOG(ERROR) << "Failed to convert the V8 JSON result to Local string";
+      return FormatAndLogError(v8_isolate, try_catch, v8_context,
+                               "Error converting output to JSON.",
+                               std::move(log_options));
+    }
+  }
+  if (!TypeConverter<std::string>::FromV8(v8_isolate, result,
+                                          &execution_response.response)) {
+    LOG(ERROR) << "Failed to convert V8 string to std::string";
+    return FormatAndLogError(v8_isolate, try_catch, v8_context,
+                             "Error converting V8 string to std::string",
+                             std::move(log_options));
+  }
+  resource_accounting.Report(input, execution_response);
   return execution_response;
 }
 
+std::vector<absl::StatusOr<ExecutionResponse>> V8JsEngine::RunJsBatch(
+    std::string_view function_name, absl::Span<const BatchInvocation> batch,
+    const RomaJsEngineCompilationContext& context, absl::Time deadline) {
+  std::vector<absl::StatusOr<ExecutionResponse>> responses;
+  responses.reserve(batch.size());
+  const auto fail_all = [&](absl::Status status) {
+    responses.assign(batch.size(), std::move(status));
+    return std::move(responses);
+  };
+  if (batch.empty()) {
+    return responses;
+  }
+  if (!context) {
+    return fail_all(absl::FailedPreconditionError(
+        "A batch can only run with an existing compilation context."));
+  }
+  const auto curr_comp_ctx =
+      std::static_pointer_cast<SnapshotCompilationContext>(context.context);
+  v8::Isolate* v8_isolate = curr_comp_ctx->isolate->isolate();
+  if (v8_isolate == nullptr) {
+    return fail_all(absl::FailedPreconditionError(
+        "The v8 isolate has not been initialized. The module has not "
+        "been initialized."));
+  }
+
+  v8::Isolate::Scope isolate_scope(v8_isolate);
+  v8::HandleScope handle_scope(v8_isolate);
+
+  // The context is created, and the handler looked up, once for the whole
+  // batch, under the timeout of the first invocation. Invocations therefore
+  // share the global object of the context.
+  v8::Local<v8::Context> v8_context;
+  size_t uses = 0;
+  HandlerCache handlers;
+  bool created = false;
+  StartWatchdogTimer(v8_isolate, batch.front().metadata, deadline);
+  absl::Status context_status = AcquireExecutionContext(
+      curr_comp_ctx, v8_context, uses, handlers, created);
+  StopWatchdogTimer();
+  if (!context_status.ok()) {
+    return fail_all(std::move(context_status));
+  }
+  v8::Context::Scope context_scope(v8_context);
+
+  v8::Local<v8::Function> handler_func;
+  if (absl::Status status = GetCachedJsHandler(v8_isolate, function_name,
+                                               handlers, handler_func);
+      !status.ok()) {
+    return fail_all(std::move(status));
+  }
+
+  bool context_failed = false;
+  for (const BatchInvocation& invocation : batch) {
+    if (absl::Now() >= deadline) {
+      responses.push_back(absl::DeadlineExceededError(
+          "Batch deadline passed before the invocation started."));
+      continue;
+    }
+    // Release the temporary object references of each invocation.
+    v8::HandleScope invocation_handle_scope(v8_isolate);
+    v8::TryCatch try_catch(v8_isolate);
+    if (isolate_function_binding_) {
+      auto [uuid, id, min_log_level] = GetLogOptions(invocation.metadata);
+      isolate_function_binding_->SetMinLogLevel(min_log_level);
+      isolate_function_binding_->AddIds(uuid, id);
+    }
+    StartWatchdogTimer(v8_isolate, invocation.metadata, deadline);
+    auto response_or =
+        InvokeJsHandler(v8_isolate, v8_context, handler_func, invocation.input,
+                        invocation.metadata, try_catch,
+                        curr_comp_ctx->shared_inputs);
+    // End execution_watchdog_ in case it terminate the standby isolate.
+    StopWatchdogTimer();
+    if (!response_or.ok() && execution_watchdog_->IsTerminateCalled()) {
+      response_or = absl::ResourceExhaustedError(
+          "V8 execution terminated due to timeout.");
+    }
+    if (response_or.ok()) {
+      response_or->counters[kExecutionCounterJsEngineContextsCreated] =
+          created ? 1 : 0;
+      response_or->counters[kExecutionCounterJsEngineContextsReused] =
+          created ? 0 : 1;
+    } else {
+      context_failed = true;
+    }
+    // Only the first invocation of the batch may run in a new context.
+    created = false;
+    ++uses;
+    responses.push_back(std::move(response_or));
+  }
+  if (!context_failed) {
+    ReleaseExecutionContext(curr_comp_ctx, v8_context, uses,
+                            std::move(handlers));
+  }
+  return responses;
+}
+
 absl::StatusOr<JsEngineExecutionResponse> V8JsEngine::CompileAndRunJs(
     std::string_view code, std::string_view function_name,
     const std::vector<std::string_view>& input,
@@ -850,6 +1294,12 @@ absl::StatusOr<JsEngineExecutionResponse> V8JsEngine::CompileAndRunJsWithWasm(
     execution_response.compilation_context = comp_context;
     curr_comp_ctx = std::static_pointer_cast<SnapshotCompilationContext>(
         comp_context.context);
+    if (metadata.contains(kReturnStartupSnapshot) &&
+        curr_comp_ctx->cache_type == CacheType::kSnapshot) {
+      const v8::StartupData& startup_data = curr_comp_ctx->startup_data;
+      execution_response.execution_response.startup_snapshot.assign(
+          startup_data.data, startup_data.raw_size);
+    }
 
   } else {
     curr_comp_ctx =
@@ -894,6 +1344,37 @@ absl::StatusOr<JsEngineExecutionResponse> V8JsEngine::CompileAndRunJsWithWasm(
   return status_or_response.status();
 }
 
+void V8JsEngine::CollectGarbage(const RomaJsEngineCompilationContext& context) {
+  if (!context) {
+    return;
+  }
+  const auto curr_comp_ctx =
+      std::static_pointer_cast<SnapshotCompilationContext>(context.context);
+  v8::Isolate* v8_isolate = curr_comp_ctx->isolate->isolate();
+  if (v8_isolate == nullptr) {
+    return;
+  }
+  v8::Isolate::Scope isolate_scope(v8_isolate);
+  v8::HeapStatistics heap_stats;
+  v8_isolate->GetHeapStatistics(&heap_stats);
+  const size_t steady_heap_size = curr_comp_ctx->steady_heap_size_bytes;
+  if (steady_heap_size > 0 &&
+      heap_stats.used_heap_size() <=
+          steady_heap_size +
+              std::max(steady_heap_size / 4, kMinIdleHeapGrowthBytes)) {
+    return;
+  }
+  v8_isolate->LowMemoryNotification();
+  v8_isolate->GetHeapStatistics(&heap_stats);
+  // What is left after a full collection is the live set of the code version.
+  curr_comp_ctx->steady_heap_size_bytes = heap_stats.used_heap_size();
+  ROMA_VLOG(2) << "Idle garbage collection left "
+               << curr_comp_ctx->steady_heap_size_bytes << " bytes in use";
+  if (curr_comp_ctx->steady_heap_size_bytes > steady_heap_size_bytes_) {
+    steady_heap_size_bytes_ = curr_comp_ctx->steady_heap_size_bytes;
+  }
+}
+
 absl::Status V8JsEngine::CreateV8Context(v8::Isolate* isolate,
                                          v8::Local<v8::Context>& context) {
   v8::Local<v8::ObjectTemplate> global_object_template =
@@ -17,6 +17,8 @@
 #ifndef ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_V8_JS_ENGINE_H_
 #define ROMA_SANDBOX_JS_ENGINE_V8_ENGINE_V8_JS_ENGINE_H_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -24,11 +26,13 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
 #include "include/libplatform/libplatform.h"
 #include "include/v8.h"
 #include "src/roma/config/config.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/sandbox/js_engine/js_engine.h"
+#include "src/roma/sandbox/js_engine/v8_engine/shared_input_cache.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_function_binding.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_wrapper.h"
 #include "src/roma/worker/execution_utils.h"
@@ -50,7 +54,9 @@ class V8JsEngine : public JsEngine {
              const JsEngineResourceConstraints& v8_resource_constraints =
                  JsEngineResourceConstraints(),
              bool logging_function_set = false,
-             bool disable_udf_stacktraces_in_response = false);
+             bool disable_udf_stacktraces_in_response = false,
+             size_t context_pool_size = 0, size_t context_max_uses = 0,
+             uint32_t invocation_resource_metrics = 0);
 
   ~V8JsEngine() override;
 
@@ -85,6 +91,20 @@ class V8JsEngine : public JsEngine {
       const js_engine::RomaJsEngineCompilationContext& context =
           RomaJsEngineCompilationContext()) override;
 
+  // Runs every invocation of `batch` in a single v8 context created from
+  // `context`, so the global object is shared between the invocations. No
+  // invocation starts, or runs, past `deadline`.
+  std::vector<absl::StatusOr<js_engine::ExecutionResponse>> RunJsBatch(
+      std::string_view function_name,
+      absl::Span<const js_engine::BatchInvocation> batch,
+      const js_engine::RomaJsEngineCompilationContext& context,
+      absl::Time deadline = absl::InfiniteFuture()) override;
+
+  // Runs a full garbage collection in the isolate of `context` if its heap has
+  // grown well beyond the steady state left by the previous one.
+  void CollectGarbage(
+      const js_engine::RomaJsEngineCompilationContext& context) override;
+
  private:
   /**
    * @brief Create a context in given isolate with isolate_function_binding
@@ -106,6 +126,18 @@ class V8JsEngine : public JsEngine {
    */
   absl::Status CreateSnapshot(v8::StartupData& startup_data,
                               std::string_view js_code);
+  /**
+   * @brief Restore a snapshot created by an earlier CreateSnapshot call into
+   * startup_data. Returns false, leaving startup_data empty, if the snapshot
+   * cannot be used by this V8 build.
+   *
+   * @param startup_data
+   * @param snapshot
+   * @return bool
+   */
+  bool RestoreSnapshot(v8::StartupData& startup_data,
+                       std::string_view snapshot);
+
   /**
    * @brief Create a Snapshot object with start up data containing global
    * objects that can be directly referenced in the JS code.
@@ -145,10 +177,13 @@ class V8JsEngine : public JsEngine {
    * kTimeoutDurationTag with the timeout value. If there is no
    * kTimeoutDurationTag, the default timeout value kDefaultExecutionTimeout
    * will be used.
+   * @param deadline the timeout is shortened so that the execution is
+   * terminated by this time.
    */
   void StartWatchdogTimer(
       v8::Isolate* isolate,
-      const absl::flat_hash_map<std::string_view, std::string_view>& metadata);
+      const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+      absl::Time deadline = absl::InfiniteFuture());
   /**
    * @brief Stop the timer for the execution in isolate. Call this function
    * after execution is complete to avoid watchdog termination of standby
@@ -173,6 +208,100 @@ class V8JsEngine : public JsEngine {
       const std::vector<std::string_view>& input,
       const absl::flat_hash_map<std::string_view, std::string_view>& metadata);
 
+  /**
+   * @brief Create the v8 context in which invocation requests of the current
+   * compilation context run, binding the cached script to it if needed.
+   *
+   * @param current_compilation_context
+   * @param v8_context
+   * @return absl::Status
+   */
+  absl::Status CreateExecutionContext(
+      const std::shared_ptr<SnapshotCompilationContext>&
+          current_compilation_context,
+      v8::Local<v8::Context>& v8_context);
+
+  /**
+   * @brief Take an idle context from the pool of the compilation context, or
+   * create a new execution context if the pool is empty.
+   *
+   * @param current_compilation_context
+   * @param v8_context
+   * @param uses set to the number of invocations that have already run in
+   * `v8_context`.
+   * @param handlers set to the handlers already looked up in `v8_context`.
+   * @param created set to whether `v8_context` was newly created.
+   * @return absl::Status
+   */
+  absl::Status AcquireExecutionContext(
+      const std::shared_ptr<SnapshotCompilationContext>&
+          current_compilation_context,
+      v8::Local<v8::Context>& v8_context, size_t& uses,
+      HandlerCache& handlers, bool& created);
+
+  /**
+   * @brief Return a context, in which `uses` invocations have run, to the pool
+   * of the compilation context. The context is dropped instead if the pool is
+   * full or the context has reached context_max_uses_.
+   *
+   * @param current_compilation_context
+   * @param v8_context
+   * @param uses
+   * @param handlers the handlers looked up in `v8_context`, kept with it.
+   */
+  void ReleaseExecutionContext(
+      const std::shared_ptr<SnapshotCompilationContext>&
+          current_compilation_context,
+      v8::Local<v8::Context> v8_context, size_t uses, HandlerCache handlers);
+
+  /**
+   * @brief Get the handler function named `function_name` in the current
+   * context, looking it up only if it is not in `handlers` yet. The first
+   * lookup in a context is kept for the life of the context, so reassigning
+   * the handler name from JS does not change which function is called.
+   *
+   * @param v8_isolate
+   * @param function_name
+   * @param handlers the handlers of the current context.
+   * @param handler
+   * @return absl::Status
+   */
+  absl::Status GetCachedJsHandler(v8::Isolate* v8_isolate,
+                                  std::string_view function_name,
+                                  HandlerCache& handlers,
+                                  v8::Local<v8::Function>& handler);
+
+  /**
+   * @brief Fill the context pool of a newly created compilation context.
+   *
+   * @param current_compilation_context
+   * @return absl::Status
+   */
+  absl::Status PrewarmContextPool(
+      const std::shared_ptr<SnapshotCompilationContext>&
+          current_compilation_context);
+
+  /**
+   * @brief Call the JS handler with `input` in the current context and
+   * convert its result into an ExecutionResponse.
+   *
+   * @param v8_isolate
+   * @param v8_context
+   * @param handler_func
+   * @param input
+   * @param metadata
+   * @param try_catch
+   * @param shared_inputs Parsed inputs of the isolate, used instead of parsing
+   * `input` if the invocation shares its input.
+   * @return absl::StatusOr<ExecutionResponse>
+   */
+  absl::StatusOr<ExecutionResponse> InvokeJsHandler(
+      v8::Isolate* v8_isolate, v8::Local<v8::Context> v8_context,
+      v8::Local<v8::Function> handler_func,
+      const std::vector<std::string_view>& input,
+      const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+      v8::TryCatch& try_catch, SharedInputCache& shared_inputs);
+
   /**
    * @brief Compile the wasm code array as a wasm module.
    *
@@ -232,6 +361,19 @@ class V8JsEngine : public JsEngine {
   const bool enable_profilers_;
   const bool logging_function_set_;
   const bool disable_udf_stacktraces_in_response_;
+  /// The number of idle contexts kept per compilation context. Zero disables
+  /// the pool, so that every invocation runs in a new context.
+  const size_t context_pool_size_;
+  /// The number of invocations after which a pooled context is replaced by a
+  /// new one. Zero means pooled contexts are reused without limit.
+  const size_t context_max_uses_;
+  /// The resource usage each invocation reports, as a bitmask of
+  /// InvocationResourceMetric.
+  const uint32_t invocation_resource_metrics_;
+  /// The largest heap in use left by a garbage collection between invocations
+  /// in any isolate. New isolates start with a heap of this size unless the
+  /// initial heap size is configured.
+  std::atomic<size_t> steady_heap_size_bytes_ = 0;
 };
 }  // namespace google::scp::roma::sandbox::js_engine::v8_js_engine
 
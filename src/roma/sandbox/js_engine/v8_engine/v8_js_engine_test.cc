@@ -25,6 +25,11 @@
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/value_serializer/value_serializer.h"
 #include "src/roma/wasm/testing_utils.h"
 
 using google::scp::roma::kDefaultExecutionTimeout;
@@ -32,6 +37,9 @@ using google::scp::roma::kTimeoutDurationTag;
 using google::scp::roma::kWasmCodeArrayName;
 
 using google::scp::roma::sandbox::js_engine::v8_js_engine::V8JsEngine;
+using google::scp::roma::value_serializer::DeserializeValue;
+using google::scp::roma::value_serializer::JsValue;
+using google::scp::roma::value_serializer::SerializeValue;
 using google::scp::roma::wasm::testing::WasmTestingUtils;
 using ::testing::HasSubstr;
 using ::testing::IsEmpty;
@@ -213,6 +221,38 @@ TEST_F(V8JsEngineTest, CanRunCodeRequestWithJsonInput) {
   engine.Stop();
 }
 
+TEST_F(V8JsEngineTest, CanRunCodeRequestWithSerializedValueInput) {
+  V8JsEngine engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code =
+      R"(
+        function Handler(req) {
+          return {
+            sum: req.values.reduce((a, b) => a + b, 0),
+            doubled: req.values.map((v) => v * 2),
+          };
+        }
+      )";
+  const std::string input = SerializeValue(JsValue{JsValue::Object{
+      {"values", JsValue{JsValue::Float64Array{{1.5, 2.5}}}},
+  }});
+  const absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {constants::kInputType, constants::kInputTypeSerializedValue}};
+  const auto response_or =
+      engine.CompileAndRunJs(js_code, "Handler", {input}, metadata);
+  ASSERT_TRUE(response_or.ok());
+
+  const auto output =
+      DeserializeValue(response_or->execution_response.response);
+  ASSERT_TRUE(output.ok()) << output.status();
+  EXPECT_EQ(*output, (JsValue{JsValue::Object{
+                         {"sum", JsValue{4.0}},
+                         {"doubled", JsValue{JsValue::Float64Array{{3, 5}}}},
+                     }}));
+  engine.Stop();
+}
+
 TEST_F(V8JsEngineTest, ShouldFailIfInputIsBadJsonInput) {
   V8JsEngine engine = CreateEngine();
   engine.Run();
@@ -447,6 +487,336 @@ TEST_F(V8JsEngineTest, CanTimeoutExecutionWithCustomTimeoutTag) {
   engine.Stop();
 }
 
+TEST_F(V8JsEngineTest, CanRunBatchInSingleContext) {
+  V8JsEngine engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    var calls = 0;
+    function Handler(input) {
+      calls++;
+      return calls + ":" + input;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  const std::vector<BatchInvocation> batch = {
+      {.input = {R"("a")"}},
+      {.input = {"not json"}},
+      {.input = {R"("b")"}},
+  };
+  const auto responses =
+      engine.RunJsBatch("Handler", batch, load_or->compilation_context);
+  ASSERT_EQ(responses.size(), 3);
+  ASSERT_TRUE(responses[0].ok());
+  EXPECT_THAT(responses[0]->response, StrEq(R"("1:a")"));
+  EXPECT_FALSE(responses[1].ok());
+  // The handler sees the state left behind by the earlier invocations.
+  ASSERT_TRUE(responses[2].ok());
+  EXPECT_THAT(responses[2]->response, StrEq(R"("2:b")"));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, FailsBatchInvocationsPastTheBatchDeadline) {
+  V8JsEngine engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Handler() {
+      const start = Date.now();
+      while (Date.now() - start < 200) {}
+      return "done";
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  // Each invocation would get the whole default timeout on its own, but the
+  // batch as a whole has to finish within the deadline.
+  const std::vector<BatchInvocation> batch(5);
+  const absl::Time start = absl::Now();
+  const auto responses =
+      engine.RunJsBatch("Handler", batch, load_or->compilation_context,
+                        /*deadline=*/start + absl::Milliseconds(500));
+  EXPECT_LT(absl::Now() - start, absl::Milliseconds(800));
+  ASSERT_EQ(responses.size(), 5);
+  ASSERT_TRUE(responses[0].ok());
+  EXPECT_THAT(responses[0]->response, StrEq(R"("done")"));
+  EXPECT_EQ(responses[4].status().code(), absl::StatusCode::kDeadlineExceeded);
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, ReusesPooledContextsUpToMaxUses) {
+  static constexpr bool skip_v8_cleanup = true;
+  V8JsEngine engine(nullptr, skip_v8_cleanup, /*enable_profilers=*/false,
+                    JsEngineResourceConstraints(),
+                    /*logging_function_set=*/false,
+                    /*disable_udf_stacktraces_in_response=*/false,
+                    /*context_pool_size=*/1, /*context_max_uses=*/2);
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    var calls = 0;
+    function Handler() {
+      calls++;
+      return calls;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  std::vector<std::string> responses;
+  std::vector<int64_t> created;
+  for (int i = 0; i < 3; ++i) {
+    const auto response_or =
+        engine.CompileAndRunJs(/*code=*/"", "Handler", /*input=*/{},
+                               /*metadata=*/{}, load_or->compilation_context);
+    ASSERT_TRUE(response_or.ok());
+    responses.push_back(response_or->execution_response.response);
+    created.push_back(response_or->execution_response.counters.at(
+        constants::kExecutionCounterJsEngineContextsCreated));
+  }
+  // The pre-warmed context serves two invocations before being replaced.
+  EXPECT_THAT(responses, ::testing::ElementsAre("1", "2", "1"));
+  EXPECT_THAT(created, ::testing::ElementsAre(0, 0, 1));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, LooksUpHandlerOncePerPooledContext) {
+  static constexpr bool skip_v8_cleanup = true;
+  V8JsEngine engine(nullptr, skip_v8_cleanup, /*enable_profilers=*/false,
+                    JsEngineResourceConstraints(),
+                    /*logging_function_set=*/false,
+                    /*disable_udf_stacktraces_in_response=*/false,
+                    /*context_pool_size=*/1, /*context_max_uses=*/0);
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Handler() {
+      Handler = () => "replaced";
+      return "original";
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  std::vector<std::string> responses;
+  for (int i = 0; i < 2; ++i) {
+    const auto response_or =
+        engine.CompileAndRunJs(/*code=*/"", "Handler", /*input=*/{},
+                               /*metadata=*/{}, load_or->compilation_context);
+    ASSERT_TRUE(response_or.ok());
+    responses.push_back(response_or->execution_response.response);
+  }
+  // The second invocation reuses the context, and with it the function the
+  // first invocation looked up.
+  EXPECT_THAT(responses,
+              ::testing::ElementsAre(R"("original")", R"("original")"));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, CollectsGarbageBetweenInvocationsAndReportsGcPauses) {
+  static constexpr bool skip_v8_cleanup = true;
+  V8JsEngine engine(nullptr, skip_v8_cleanup, /*enable_profilers=*/false,
+                    JsEngineResourceConstraints(),
+                    /*logging_function_set=*/false,
+                    /*disable_udf_stacktraces_in_response=*/false,
+                    /*context_pool_size=*/1, /*context_max_uses=*/0);
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    let calls = 0;
+    function Handler() {
+      for (let i = 0; i < 100; ++i) {
+        new Array(10000).fill({calls});
+      }
+      return ++calls;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+  // Nothing to collect in an engine state that does not exist.
+  engine.CollectGarbage(RomaJsEngineCompilationContext());
+
+  std::vector<std::string> responses;
+  for (int i = 0; i < 2; ++i) {
+    const auto response_or =
+        engine.CompileAndRunJs(/*code=*/"", "Handler", /*input=*/{},
+                               /*metadata=*/{}, load_or->compilation_context);
+    ASSERT_TRUE(response_or.ok());
+    responses.push_back(response_or->execution_response.response);
+    EXPECT_TRUE(response_or->execution_response.metrics.contains(
+        constants::kGcPauseMetricJsEngineDuration));
+    // The first collection always runs, to learn the steady state. The second
+    // only runs if the heap has grown beyond it.
+    engine.CollectGarbage(load_or->compilation_context);
+    engine.CollectGarbage(load_or->compilation_context);
+  }
+  // The state of the pooled context survives the collections.
+  EXPECT_THAT(responses, ::testing::ElementsAre("1", "2"));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, ReportsSelectedInvocationResourceUsage) {
+  static constexpr bool skip_v8_cleanup = true;
+  V8JsEngine engine(nullptr, skip_v8_cleanup, /*enable_profilers=*/false,
+                    JsEngineResourceConstraints(),
+                    /*logging_function_set=*/false,
+                    /*disable_udf_stacktraces_in_response=*/false,
+                    /*context_pool_size=*/0, /*context_max_uses=*/0,
+                    kInvocationCpuTime | kInvocationHeapUsage |
+                        kInvocationIoBytes);
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Handler(input) {
+      const arrays = [];
+      for (let i = 0; i < 100; ++i) {
+        arrays.push(new Array(10000).fill(input));
+      }
+      return arrays.length;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  const std::vector<std::string_view> input = {R"("abc")"};
+  const auto response_or =
+      engine.CompileAndRunJs(/*code=*/"", "Handler", input, /*metadata=*/{},
+                             load_or->compilation_context);
+  ASSERT_TRUE(response_or.ok());
+  const ExecutionResponse& response = response_or->execution_response;
+  EXPECT_THAT(response.response, StrEq("100"));
+  EXPECT_GT(response.metrics.at(constants::kExecutionMetricJsEngineCpuDuration),
+            absl::ZeroDuration());
+  // At least the elements of the arrays, each of which takes 4 bytes or more.
+  EXPECT_GT(response.counters.at(
+                constants::kExecutionCounterJsEngineHeapAllocatedBytes),
+            100 * 10000 * 4);
+  EXPECT_GT(
+      response.counters.at(constants::kExecutionCounterJsEngineHeapPeakBytes),
+      0);
+  EXPECT_EQ(response.counters.at(constants::kExecutionCounterInputBytes), 5);
+  EXPECT_EQ(response.counters.at(constants::kExecutionCounterOutputBytes), 3);
+  // Native function calls were not selected.
+  EXPECT_FALSE(response.counters.contains(
+      constants::kExecutionCounterNativeFunctionCalls));
+  EXPECT_FALSE(response.metrics.contains(
+      constants::kExecutionMetricNativeFunctionCallDuration));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, SharesFrozenParsedInputAcrossInvocations) {
+  auto engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Handler(input) {
+      input.a = 2;
+      input.nested.b = 3;
+      return input.a + input.nested.b;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  const std::vector<std::string_view> input = {R"({"a":1,"nested":{"b":1}})"};
+  const absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {constants::kShareInput, "true"}};
+  std::vector<int64_t> hits;
+  for (int i = 0; i < 2; ++i) {
+    const auto response_or = engine.CompileAndRunJs(
+        /*code=*/"", "Handler", input, metadata, load_or->compilation_context);
+    ASSERT_TRUE(response_or.ok());
+    // Writes to the frozen input are ignored outside of strict mode.
+    EXPECT_THAT(response_or->execution_response.response, StrEq("2"));
+    hits.push_back(response_or->execution_response.counters.at(
+        constants::kInputCounterSharedInputCacheHits));
+  }
+  EXPECT_THAT(hits, ::testing::ElementsAre(0, 1));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, SharedInputsDoNotLeakThroughPrototypes) {
+  auto engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Pollute(input) {
+      for (const value of [input, input.list]) {
+        const prototype = Object.getPrototypeOf(value);
+        if (prototype !== null) {
+          prototype.leaked = "secret";
+        }
+      }
+      return Array.from(input.list).map((x) => x * 2);
+    }
+    function Read(input) {
+      return [input.leaked, input.list.leaked, Array.isArray(input.list)];
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  const std::vector<std::string_view> input = {R"({"list":[1,2]})"};
+  const absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {constants::kShareInput, "true"}};
+  const auto polluted_or = engine.CompileAndRunJs(
+      /*code=*/"", "Pollute", input, metadata, load_or->compilation_context);
+  ASSERT_TRUE(polluted_or.ok());
+  EXPECT_THAT(polluted_or->execution_response.response, StrEq("[2,4]"));
+  // Runs in another context, with the cached input.
+  const auto read_or = engine.CompileAndRunJs(
+      /*code=*/"", "Read", input, metadata, load_or->compilation_context);
+  ASSERT_TRUE(read_or.ok());
+  EXPECT_EQ(read_or->execution_response.counters.at(
+                constants::kInputCounterSharedInputCacheHits),
+            1);
+  EXPECT_THAT(read_or->execution_response.response,
+              StrEq("[null,null,true]"));
+  engine.Stop();
+}
+
+TEST_F(V8JsEngineTest, SharesInputsNestedDeeperThanTheNativeStack) {
+  auto engine = CreateEngine();
+  engine.Run();
+
+  constexpr std::string_view js_code = R"JS_CODE(
+    function Depth(input) {
+      let depth = 0;
+      for (; Array.isArray(input); input = input[0]) {
+        depth++;
+      }
+      return depth;
+    }
+  )JS_CODE";
+  const auto load_or = engine.CompileAndRunJs(js_code, /*function_name=*/"",
+                                              /*input=*/{}, /*metadata=*/{});
+  ASSERT_TRUE(load_or.ok());
+
+  constexpr int kDepth = 100'000;
+  const std::string json =
+      absl::StrCat(std::string(kDepth, '['), std::string(kDepth, ']'));
+  const std::vector<std::string_view> input = {json};
+  const absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {constants::kShareInput, "true"}};
+  const auto response_or = engine.CompileAndRunJs(
+      /*code=*/"", "Depth", input, metadata, load_or->compilation_context);
+  ASSERT_TRUE(response_or.ok()) << response_or.status();
+  EXPECT_THAT(response_or->execution_response.response,
+              StrEq(absl::StrCat(kDepth)));
+  engine.Stop();
+}
+
 TEST_F(V8JsEngineTest, JsMixedGlobalWasmCompileRunExecute) {
   V8JsEngine engine = CreateEngine();
   engine.Run();
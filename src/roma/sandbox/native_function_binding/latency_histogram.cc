@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latency_histogram.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace google::scp::roma::sandbox::native_function_binding {
+namespace {
+constexpr absl::Duration kFirstBucketUpperBound = absl::Microseconds(50);
+
+absl::Duration UpperBound(int bucket) {
+  return kFirstBucketUpperBound * (int64_t{1} << bucket);
+}
+}  // namespace
+
+void LatencyHistogram::Record(absl::Duration latency) {
+  int bucket = 0;
+  while (bucket < kNumBuckets - 1 && latency > UpperBound(bucket)) {
+    ++bucket;
+  }
+  bucket_counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_nanos_.fetch_add(absl::ToInt64Nanoseconds(latency),
+                       std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+  Snapshot snapshot;
+  snapshot.bucket_upper_bounds.reserve(kNumBuckets - 1);
+  snapshot.bucket_counts.reserve(kNumBuckets);
+  for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+    if (bucket < kNumBuckets - 1) {
+      snapshot.bucket_upper_bounds.push_back(UpperBound(bucket));
+    }
+    snapshot.bucket_counts.push_back(
+        bucket_counts_[bucket].load(std::memory_order_relaxed));
+  }
+  snapshot.count = count_.load(std::memory_order_relaxed);
+  snapshot.sum = absl::Nanoseconds(sum_nanos_.load(std::memory_order_relaxed));
+  return snapshot;
+}
+
+void LatencyHistogramMap::Record(std::string_view name,
+                                 absl::Duration latency) {
+  LatencyHistogram* histogram = nullptr;
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    if (const auto it = histograms_.find(name); it != histograms_.end()) {
+      histogram = it->second.get();
+    }
+  }
+  if (histogram == nullptr) {
+    absl::MutexLock lock(&mu_);
+    auto& entry = histograms_[name];
+    if (entry == nullptr) {
+      entry = std::make_unique<LatencyHistogram>();
+    }
+    histogram = entry.get();
+  }
+  // Histograms are never removed, so recording outside of the lock is safe.
+  histogram->Record(latency);
+}
+
+absl::flat_hash_map<std::string, LatencyHistogram::Snapshot>
+LatencyHistogramMap::GetSnapshots() const {
+  absl::flat_hash_map<std::string, LatencyHistogram::Snapshot> snapshots;
+  absl::ReaderMutexLock lock(&mu_);
+  snapshots.reserve(histograms_.size());
+  for (const auto& [name, histogram] : histograms_) {
+    snapshots.emplace(name, histogram->GetSnapshot());
+  }
+  return snapshots;
+}
+
+}  // namespace google::scp::roma::sandbox::native_function_binding
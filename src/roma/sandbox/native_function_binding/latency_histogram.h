@@ -0,0 +1,79 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_SANDBOX_NATIVE_FUNCTION_BINDING_LATENCY_HISTOGRAM_H_
+#define ROMA_SANDBOX_NATIVE_FUNCTION_BINDING_LATENCY_HISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace google::scp::roma::sandbox::native_function_binding {
+
+/**
+ * @brief Lock-free histogram of latencies, with exponential buckets from 50us
+ * up to about 26s and an overflow bucket above that.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int kNumBuckets = 21;
+
+  struct Snapshot {
+    // The inclusive upper bound of each bucket but the last one, which holds
+    // everything above the bound of the one before it.
+    std::vector<absl::Duration> bucket_upper_bounds;
+    std::vector<uint64_t> bucket_counts;
+    uint64_t count = 0;
+    absl::Duration sum;
+  };
+
+  void Record(absl::Duration latency);
+
+  Snapshot GetSnapshot() const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> bucket_counts_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<int64_t> sum_nanos_ = 0;
+};
+
+// Latency histograms keyed by name, created on first use.
+class LatencyHistogramMap {
+ public:
+  void Record(std::string_view name, absl::Duration latency)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  absl::flat_hash_map<std::string, LatencyHistogram::Snapshot> GetSnapshots()
+      const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, std::unique_ptr<LatencyHistogram>>
+      histograms_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace google::scp::roma::sandbox::native_function_binding
+
+#endif  // ROMA_SANDBOX_NATIVE_FUNCTION_BINDING_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/sandbox/native_function_binding/latency_histogram.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "absl/time/time.h"
+
+using ::testing::SizeIs;
+
+namespace google::scp::roma::sandbox::native_function_binding::test {
+namespace {
+
+TEST(LatencyHistogramTest, RecordsIntoExponentialBuckets) {
+  LatencyHistogram histogram;
+  histogram.Record(absl::Microseconds(10));
+  histogram.Record(absl::Microseconds(50));
+  histogram.Record(absl::Microseconds(51));
+  histogram.Record(absl::Hours(1));
+
+  const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+  ASSERT_THAT(snapshot.bucket_counts, SizeIs(LatencyHistogram::kNumBuckets));
+  ASSERT_THAT(snapshot.bucket_upper_bounds,
+              SizeIs(LatencyHistogram::kNumBuckets - 1));
+  EXPECT_EQ(snapshot.bucket_upper_bounds[0], absl::Microseconds(50));
+  EXPECT_EQ(snapshot.bucket_upper_bounds[1], absl::Microseconds(100));
+  EXPECT_EQ(snapshot.bucket_counts[0], 2);
+  EXPECT_EQ(snapshot.bucket_counts[1], 1);
+  EXPECT_EQ(snapshot.bucket_counts.back(), 1);
+  EXPECT_EQ(snapshot.count, 4);
+  EXPECT_EQ(snapshot.sum, absl::Hours(1) + absl::Microseconds(111));
+}
+
+TEST(LatencyHistogramMapTest, KeepsOneHistogramPerName) {
+  LatencyHistogramMap histograms;
+  histograms.Record("foo", absl::Milliseconds(1));
+  histograms.Record("foo", absl::Milliseconds(2));
+  histograms.Record("bar", absl::Milliseconds(3));
+
+  const auto snapshots = histograms.GetSnapshots();
+  ASSERT_THAT(snapshots, SizeIs(2));
+  EXPECT_EQ(snapshots.at("foo").count, 2);
+  EXPECT_EQ(snapshots.at("foo").sum, absl::Milliseconds(3));
+  EXPECT_EQ(snapshots.at("bar").count, 1);
+}
+
+}  // namespace
+}  // namespace google::scp::roma::sandbox::native_function_binding::test
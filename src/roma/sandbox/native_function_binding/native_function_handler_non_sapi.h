@@ -19,6 +19,7 @@
 
 #include <unistd.h>
 
+#include <optional>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -27,15 +28,21 @@
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/logging/logging.h"
 #include "src/roma/metadata_storage/metadata_storage.h"
 #include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/sandbox/native_function_binding/latency_histogram.h"
 #include "src/roma/sandbox/native_function_binding/native_function_table.h"
 #include "src/roma/sandbox/native_function_binding/rpc_wrapper.pb.h"
 #include "src/util/execution_token.h"
 
+using google::scp::roma::metadata_storage::RequestHandle;
+using google::scp::roma::metadata_storage::ScopedMetadataReader;
 using google::scp::roma::sandbox::constants::kRequestId;
 using google::scp::roma::sandbox::constants::kRequestUuid;
 
@@ -53,12 +60,15 @@ class NativeFunctionHandlerNonSapi {
    * function calls.
    * @param remote_fds The remote file descriptors. These are what the remote
    * process uses to send requests to this process.
+   * @param callback_concurrency Unused. Each local file descriptor has a
+   * thread that runs the C++ functions called through it, in order.
    */
   NativeFunctionHandlerNonSapi(NativeFunctionTable<TMetadata>* function_table,
                                MetadataStorage<TMetadata>* metadata_storage,
                                const std::vector<int>& local_fds,
                                std::vector<int> remote_fds,
-                               bool skip_callback_for_cancelled = true)
+                               bool skip_callback_for_cancelled = true,
+                               size_t callback_concurrency = 0)
       : stop_(false),
         function_table_(function_table),
         metadata_storage_(metadata_storage),
@@ -91,10 +101,11 @@ class NativeFunctionHandlerNonSapi {
           }
 
           auto io_proto = wrapper_proto.mutable_io_proto();
-          const auto& invocation_req_uuid = wrapper_proto.request_uuid();
-          {
+          const std::optional<RequestHandle> handle =
+              RequestHandle::FromString(wrapper_proto.request_uuid());
+          if (handle.has_value()) {
             absl::MutexLock lock(&canceled_requests_mu_);
-            if (const auto it = canceled_requests_.find(invocation_req_uuid);
+            if (const auto it = canceled_requests_.find(*handle);
                 it != canceled_requests_.end()) {
               // TODO(b/353555061): Avoid execution errors that relate to
               // cancellation.
@@ -117,6 +128,7 @@ class NativeFunctionHandlerNonSapi {
             }
           }
 
+          const absl::Time start = absl::Now();
           // Get function name
           if (const auto function_name = wrapper_proto.function_name();
               !function_name.empty()) {
@@ -125,6 +137,7 @@ class NativeFunctionHandlerNonSapi {
               if (FunctionBindingPayload<TMetadata> wrapper{
                       *io_proto,
                       dummy_metadata,
+                      wrapper_proto.request_uuid(),
                   };
                   !function_table_->Call(function_name, wrapper).ok()) {
                 // If execution failed, add errors to the proto to return
@@ -132,9 +145,8 @@ class NativeFunctionHandlerNonSapi {
                     std::string(kFailedNativeHandlerExecution));
                 ROMA_VLOG(1) << kFailedNativeHandlerExecution;
               }
-            } else if (auto reader = ScopedValueReader<TMetadata>::Create(
-                           metadata_storage_->GetMetadataMap(),
-                           invocation_req_uuid);
+            } else if (auto reader = ScopedMetadataReader<TMetadata>::Create(
+                           *metadata_storage_, wrapper_proto.request_uuid());
                        !reader.ok()) {
               // If mutex can't be found, add errors to the proto to return
               io_proto->mutable_errors()->Add(std::string(kCouldNotFindMutex));
@@ -147,6 +159,7 @@ class NativeFunctionHandlerNonSapi {
             } else if (FunctionBindingPayload<TMetadata> wrapper{
                            *io_proto,
                            **value,
+                           wrapper_proto.request_uuid(),
                        };
                        !function_table_->Call(function_name, wrapper).ok()) {
               // If execution failed, add errors to the proto to return
@@ -160,6 +173,8 @@ class NativeFunctionHandlerNonSapi {
                 std::string(kCouldNotFindFunctionName));
             ROMA_VLOG(1) << kCouldNotFindFunctionName;
           }
+          latency_histograms_.Record(wrapper_proto.function_name(),
+                                     absl::Now() - start);
 
           std::string serialized_wrapper = wrapper_proto.SerializeAsString();
           ssize_t sentBytes = write(local_fd, serialized_wrapper.c_str(),
@@ -204,10 +219,21 @@ class NativeFunctionHandlerNonSapi {
     }
   }
 
+  /**
+   * @brief Returns the latency histogram of every C++ function called so far,
+   * keyed by function name.
+   */
+  absl::flat_hash_map<std::string, LatencyHistogram::Snapshot>
+  GetLatencyHistograms() const {
+    return latency_histograms_.GetSnapshots();
+  }
+
   void PreventCallbacks(ExecutionToken token)
       ABSL_LOCKS_EXCLUDED(canceled_requests_mu_) {
-    absl::MutexLock lock(&canceled_requests_mu_);
-    canceled_requests_.insert(std::move(token).value);
+    if (const auto handle = RequestHandle::FromString(token.value)) {
+      absl::MutexLock lock(&canceled_requests_mu_);
+      canceled_requests_.insert(*handle);
+    }
   }
 
  private:
@@ -226,16 +252,17 @@ class NativeFunctionHandlerNonSapi {
   absl::Mutex stop_mutex_;
 
   NativeFunctionTable<TMetadata>* function_table_;
-  // Map of invocation request uuid to associated metadata.
+  // Metadata of in-flight invocation requests, by request handle.
   MetadataStorage<TMetadata>* metadata_storage_;
   std::vector<std::thread> function_handler_threads_;
-  absl::flat_hash_set<std::string> canceled_requests_
+  absl::flat_hash_set<RequestHandle> canceled_requests_
       ABSL_GUARDED_BY(canceled_requests_mu_);
   absl::Mutex canceled_requests_mu_;
   // We need the remote file descriptors to unblock the local ones when stopping
   std::vector<int> remote_fds_;
   std::vector<int> local_fds_;
   bool skip_callback_for_cancelled_;
+  LatencyHistogramMap latency_histograms_;
 };
 
 template <typename T>
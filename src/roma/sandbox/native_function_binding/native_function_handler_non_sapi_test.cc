@@ -39,8 +39,6 @@ using ::testing::StrEq;
 
 namespace google::scp::roma::sandbox::native_function_binding::test {
 namespace {
-constexpr std::string_view kRequestUuid = "foo";
-
 TEST(NativeFunctionHandlerNonSapiTest, IninRunStop) {
   int fd_pair[2];
   EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fd_pair), 0);
@@ -74,13 +72,14 @@ TEST(NativeFunctionHandlerNonSapiTest, ShouldCallFunctionWhenRegistered) {
   NativeFunctionHandlerNonSapi handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(std::string{kRequestUuid}, {}).IgnoreError();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
   g_called_registered_function = false;
 
   auto remote_fd = remote_fds.at(0);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name");
-  rpc_proto.set_request_uuid(std::string{kRequestUuid});
+  rpc_proto.set_request_uuid(handle->ToString());
   std::string serialized_proto = rpc_proto.SerializeAsString();
 
   // Send the request over so that it's handled and the registered function
@@ -112,14 +111,15 @@ TEST(NativeFunctionHandlerNonSapiTest,
   NativeFunctionHandlerNonSapi handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(std::string{kRequestUuid}, {}).IgnoreError();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
 
   g_called_registered_function = false;
 
   auto remote_fd = remote_fds.at(0);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name");
-  rpc_proto.set_request_uuid(std::string{kRequestUuid});
+  rpc_proto.set_request_uuid(handle->ToString());
   std::string serialized_proto = rpc_proto.SerializeAsString();
   // Send the request over so that it's handled and the registered function
   // can be called
@@ -208,7 +208,8 @@ TEST(NativeFunctionHandlerNonSapiTest, ShouldBeAbleToCallMultipleFunctions) {
   NativeFunctionHandlerNonSapi handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(absl::StrCat(kRequestUuid, 1), {}).IgnoreError();
+  const auto handle_one = metadata_storage.Add({});
+  ASSERT_TRUE(handle_one.ok());
 
   g_called_registered_function_one = false;
   g_called_registered_function_two = false;
@@ -216,7 +217,7 @@ TEST(NativeFunctionHandlerNonSapiTest, ShouldBeAbleToCallMultipleFunctions) {
   auto remote_fd = remote_fds.at(0);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name_one");
-  rpc_proto.set_request_uuid(absl::StrCat(kRequestUuid, 1));
+  rpc_proto.set_request_uuid(handle_one->ToString());
   std::string serialized_proto = rpc_proto.SerializeAsString();
   // Send the request over so that it's handled and the registered function
   // can be called
@@ -235,8 +236,9 @@ TEST(NativeFunctionHandlerNonSapiTest, ShouldBeAbleToCallMultipleFunctions) {
 
   rpc_proto.Clear();
   rpc_proto.set_function_name("cool_function_name_two");
-  rpc_proto.set_request_uuid(absl::StrCat(kRequestUuid, 2));
-  metadata_storage.Add(absl::StrCat(kRequestUuid, 2), {}).IgnoreError();
+  const auto handle_two = metadata_storage.Add({});
+  ASSERT_TRUE(handle_two.ok());
+  rpc_proto.set_request_uuid(handle_two->ToString());
   serialized_proto = rpc_proto.SerializeAsString();
   // Send the request over so that it's handled and the registered function
   // can be called
@@ -17,9 +17,17 @@
 #ifndef ROMA_SANDBOX_NATIVE_FUNCTION_BINDING_NATIVE_FUNCTION_HANDLER_SAPI_IPC_H_
 #define ROMA_SANDBOX_NATIVE_FUNCTION_BINDING_NATIVE_FUNCTION_HANDLER_SAPI_IPC_H_
 
+#include <sys/epoll.h>
+#include <unistd.h>
+
 #include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -28,7 +36,12 @@
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "src/roma/interface/roma.h"
 #include "src/roma/logging/logging.h"
@@ -37,8 +50,11 @@
 #include "src/roma/sandbox/native_function_binding/rpc_wrapper.pb.h"
 #include "src/util/execution_token.h"
 
+#include "latency_histogram.h"
 #include "native_function_table.h"
 
+using google::scp::roma::metadata_storage::RequestHandle;
+using google::scp::roma::metadata_storage::ScopedMetadataReader;
 using google::scp::roma::sandbox::constants::kRequestId;
 using google::scp::roma::sandbox::constants::kRequestUuid;
 
@@ -67,119 +83,90 @@ class NativeFunctionHandlerSapiIpc {
    * function calls.
    * @param remote_fds The remote file descriptors. These are what the remote
    * process uses to send requests to this process.
+   * @param callback_concurrency The number of threads that run the C++
+   * functions. If zero, one thread per local file descriptor is used.
    */
   NativeFunctionHandlerSapiIpc(NativeFunctionTable<TMetadata>* function_table,
                                MetadataStorage<TMetadata>* metadata_storage,
                                const std::vector<int>& local_fds,
                                std::vector<int> remote_fds,
-                               bool skip_callback_for_cancelled = true)
+                               bool skip_callback_for_cancelled = true,
+                               size_t callback_concurrency = 0)
       : stop_(false),
         function_table_(function_table),
         metadata_storage_(metadata_storage),
         remote_fds_(std::move(remote_fds)),
-        skip_callback_for_cancelled_(skip_callback_for_cancelled) {
+        skip_callback_for_cancelled_(skip_callback_for_cancelled),
+        callback_concurrency_(callback_concurrency > 0 ? callback_concurrency
+                                                       : local_fds.size()) {
     ipc_comms_.reserve(local_fds.size());
     for (const int local_fd : local_fds) {
       ipc_comms_.emplace_back(local_fd);
     }
   }
 
-  void Run() ABSL_LOCKS_EXCLUDED(canceled_requests_mu_) {
+  /**
+   * @brief Start receiving calls. A single thread waits for calls on all of
+   * the local file descriptors and queues them for the callback threads, so a
+   * slow C++ function does not hold up the calls of other workers, or the
+   * other asynchronous calls of the same worker.
+   */
+  void Run() ABSL_LOCKS_EXCLUDED(canceled_requests_mu_, calls_mu_) {
     ROMA_VLOG(9) << "Calling native function handler";
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+      LOG(ERROR) << "Failed to create epoll instance: " << strerror(errno);
+      return;
+    }
     for (int i = 0; i < ipc_comms_.size(); i++) {
-      function_handler_threads_.emplace_back([this, i] {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u64 = i;
+      if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD,
+                      ipc_comms_[i].GetConnectionFD(), &event) == -1) {
+        LOG(ERROR) << "Failed to watch native function comms: "
+                   << strerror(errno);
+      }
+    }
+    function_handler_threads_.emplace_back([this] { ReceiveCalls(); });
+    for (int i = 0; i < callback_concurrency_; i++) {
+      function_handler_threads_.emplace_back([this] {
         while (true) {
-          sandbox2::Comms& comms = ipc_comms_.at(i);
-          proto::RpcWrapper wrapper_proto;
-
-          // This unblocks once a call is issued from the other side
-          const bool received = comms.RecvProtoBuf(&wrapper_proto);
-          if (absl::MutexLock lock(&stop_mutex_); stop_) {
-            break;
-          }
-          if (!received) {
-            continue;
-          }
-
-          auto io_proto = wrapper_proto.mutable_io_proto();
-          const auto& invocation_req_uuid = wrapper_proto.request_uuid();
-          if (skip_callback_for_cancelled_) {
-            absl::MutexLock lock(&canceled_requests_mu_);
-            if (const auto it = canceled_requests_.find(invocation_req_uuid);
-                it != canceled_requests_.end()) {
-              // TODO(b/353555061): Avoid execution errors that relate to
-              // cancellation.
-              io_proto->mutable_errors()->Add(std::string(kRequestCanceled));
-              ROMA_VLOG(1) << kRequestCanceled;
-              comms.SendProtoBuf(wrapper_proto);
-              // Remove the canceled request's execution token from
-              // canceled_requests_ to prevent bloat.
-              canceled_requests_.erase(it);
-              continue;
+          Call call;
+          {
+            absl::MutexLock lock(&calls_mu_);
+            calls_mu_.Await(absl::Condition(
+                this, &NativeFunctionHandlerSapiIpc::CallReadyOrStopped));
+            if (calls_stopped_) {
+              break;
             }
+            call = std::move(calls_.front());
+            calls_.pop_front();
           }
-
-          // Get function name
-          if (const auto function_name = wrapper_proto.function_name();
-              !function_name.empty()) {
-            if (metadata_storage_ == nullptr) {
-              if constexpr (std::is_default_constructible<TMetadata>::value) {
-                TMetadata dummy_metadata;
-                if (FunctionBindingPayload<TMetadata> wrapper{
-                        *io_proto,
-                        dummy_metadata,
-                    };
-                    !function_table_->Call(function_name, wrapper).ok()) {
-                  // If execution failed, add errors to the proto to return
-                  io_proto->mutable_errors()->Add(
-                      std::string(kFailedNativeHandlerExecution));
-                  ROMA_VLOG(1) << kFailedNativeHandlerExecution;
-                }
-              }
-            } else if (auto reader = ScopedValueReader<TMetadata>::Create(
-                           metadata_storage_->GetMetadataMap(),
-                           invocation_req_uuid);
-                       !reader.ok()) {
-              // If mutex can't be found, add errors to the proto to return
-              io_proto->mutable_errors()->Add(std::string(kCouldNotFindMutex));
-              ROMA_VLOG(1) << kCouldNotFindMutex;
-            } else if (auto value = reader->Get(); !value.ok()) {
-              // If metadata can't be found, add errors to the proto to return
-              io_proto->mutable_errors()->Add(
-                  std::string(kCouldNotFindMetadata));
-              ROMA_VLOG(1) << kCouldNotFindMetadata;
-            } else if (FunctionBindingPayload<TMetadata> wrapper{
-                           *io_proto,
-                           **value,
-                       };
-                       !function_table_->Call(function_name, wrapper).ok()) {
-              // If execution failed, add errors to the proto to return
-              io_proto->mutable_errors()->Add(
-                  std::string(kFailedNativeHandlerExecution));
-              ROMA_VLOG(1) << kFailedNativeHandlerExecution;
-            }
-          } else {
-            // If we can't find the function, add errors to the proto to return
-            io_proto->mutable_errors()->Add(
-                std::string(kCouldNotFindFunctionName));
-            ROMA_VLOG(1) << kCouldNotFindFunctionName;
-          }
-          if (!comms.SendProtoBuf(wrapper_proto)) {
-            continue;
-          }
+          const absl::Time start = absl::Now();
+          HandleCall(call.wrapper_proto);
+          latency_histograms_.Record(call.wrapper_proto.function_name(),
+                                     absl::Now() - start);
+          // Comms serializes concurrent sends, and asynchronous calls carry
+          // their call id, so calls may be answered in any order.
+          ipc_comms_.at(call.comms_index).SendProtoBuf(call.wrapper_proto);
         }
       });
     }
   }
 
-  void Stop() {
+  void Stop() ABSL_LOCKS_EXCLUDED(calls_mu_) {
     {
       absl::MutexLock lock(&stop_mutex_);
       stop_ = true;
     }
+    {
+      absl::MutexLock lock(&calls_mu_);
+      calls_stopped_ = true;
+    }
 
-    // We write to the comms object so that we can unblock the function binding
-    // threads waiting on it.
+    // We write to the comms object so that we can unblock the receiving
+    // thread waiting on it.
     for (const int fd : remote_fds_) {
       sandbox2::Comms remote_comms(fd);
       proto::FunctionBindingIoProto io_proto;
@@ -192,32 +179,165 @@ class NativeFunctionHandlerSapiIpc {
         t.join();
       }
     }
+    if (epoll_fd_ != -1) {
+      ::close(epoll_fd_);
+      epoll_fd_ = -1;
+    }
     for (sandbox2::Comms& c : ipc_comms_) {
       c.Terminate();
     }
   }
 
+  /**
+   * @brief Returns the latency histogram of every C++ function called so far,
+   * keyed by function name.
+   */
+  absl::flat_hash_map<std::string, LatencyHistogram::Snapshot>
+  GetLatencyHistograms() const {
+    return latency_histograms_.GetSnapshots();
+  }
+
   void PreventCallbacks(ExecutionToken token)
       ABSL_LOCKS_EXCLUDED(canceled_requests_mu_) {
-    absl::MutexLock lock(&canceled_requests_mu_);
-    canceled_requests_.insert(std::move(token).value);
+    if (const auto handle = RequestHandle::FromString(token.value)) {
+      absl::MutexLock lock(&canceled_requests_mu_);
+      canceled_requests_.insert(*handle);
+    }
   }
 
  private:
+  struct Call {
+    int comms_index;
+    proto::RpcWrapper wrapper_proto;
+  };
+
+  bool CallReadyOrStopped() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(calls_mu_) {
+    return calls_stopped_ || !calls_.empty();
+  }
+
+  void ReceiveCalls() ABSL_LOCKS_EXCLUDED(calls_mu_) {
+    constexpr int kMaxEvents = 64;
+    epoll_event events[kMaxEvents];
+    while (true) {
+      const int num_events = ::epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+      if (num_events == -1 && errno != EINTR) {
+        LOG(ERROR) << "Failed to wait for native function calls: "
+                   << strerror(errno);
+        return;
+      }
+      for (int e = 0; e < num_events; e++) {
+        const int i = static_cast<int>(events[e].data.u64);
+        sandbox2::Comms& comms = ipc_comms_.at(i);
+        if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+          // The other side is gone, stop watching it rather than spinning.
+          ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, comms.GetConnectionFD(),
+                      nullptr);
+          continue;
+        }
+        proto::RpcWrapper wrapper_proto;
+        const bool received = comms.RecvProtoBuf(&wrapper_proto);
+        if (absl::MutexLock lock(&stop_mutex_); stop_) {
+          return;
+        }
+        if (!received) {
+          continue;
+        }
+        absl::MutexLock lock(&calls_mu_);
+        calls_.push_back(Call{
+            .comms_index = i,
+            .wrapper_proto = std::move(wrapper_proto),
+        });
+      }
+    }
+  }
+
+  void HandleCall(proto::RpcWrapper& wrapper_proto)
+      ABSL_LOCKS_EXCLUDED(canceled_requests_mu_) {
+    auto io_proto = wrapper_proto.mutable_io_proto();
+    const std::optional<RequestHandle> handle =
+        RequestHandle::FromString(wrapper_proto.request_uuid());
+    if (skip_callback_for_cancelled_ && handle.has_value()) {
+      absl::MutexLock lock(&canceled_requests_mu_);
+      if (const auto it = canceled_requests_.find(*handle);
+          it != canceled_requests_.end()) {
+        // TODO(b/353555061): Avoid execution errors that relate to
+        // cancellation.
+        io_proto->mutable_errors()->Add(std::string(kRequestCanceled));
+        ROMA_VLOG(1) << kRequestCanceled;
+        // Remove the canceled request's execution token from
+        // canceled_requests_ to prevent bloat.
+        canceled_requests_.erase(it);
+        return;
+      }
+    }
+
+    // Get function name
+    if (const auto function_name = wrapper_proto.function_name();
+        !function_name.empty()) {
+      if (metadata_storage_ == nullptr) {
+        if constexpr (std::is_default_constructible<TMetadata>::value) {
+          TMetadata dummy_metadata;
+          if (FunctionBindingPayload<TMetadata> wrapper{
+                  *io_proto,
+                  dummy_metadata,
+                  wrapper_proto.request_uuid(),
+              };
+              !function_table_->Call(function_name, wrapper).ok()) {
+            // If execution failed, add errors to the proto to return
+            io_proto->mutable_errors()->Add(
+                std::string(kFailedNativeHandlerExecution));
+            ROMA_VLOG(1) << kFailedNativeHandlerExecution;
+          }
+        }
+      } else if (auto reader = ScopedMetadataReader<TMetadata>::Create(
+                     *metadata_storage_, wrapper_proto.request_uuid());
+                 !reader.ok()) {
+        // If mutex can't be found, add errors to the proto to return
+        io_proto->mutable_errors()->Add(std::string(kCouldNotFindMutex));
+        ROMA_VLOG(1) << kCouldNotFindMutex;
+      } else if (auto value = reader->Get(); !value.ok()) {
+        // If metadata can't be found, add errors to the proto to return
+        io_proto->mutable_errors()->Add(std::string(kCouldNotFindMetadata));
+        ROMA_VLOG(1) << kCouldNotFindMetadata;
+      } else if (FunctionBindingPayload<TMetadata> wrapper{
+                     *io_proto,
+                     **value,
+                     wrapper_proto.request_uuid(),
+                 };
+                 !function_table_->Call(function_name, wrapper).ok()) {
+        // If execution failed, add errors to the proto to return
+        io_proto->mutable_errors()->Add(
+            std::string(kFailedNativeHandlerExecution));
+        ROMA_VLOG(1) << kFailedNativeHandlerExecution;
+      }
+    } else {
+      // If we can't find the function, add errors to the proto to return
+      io_proto->mutable_errors()->Add(std::string(kCouldNotFindFunctionName));
+      ROMA_VLOG(1) << kCouldNotFindFunctionName;
+    }
+  }
+
   bool stop_ ABSL_GUARDED_BY(stop_mutex_);
   absl::Mutex stop_mutex_;
 
   NativeFunctionTable<TMetadata>* function_table_;
-  // Map of invocation request uuid to associated metadata.
+  // Metadata of in-flight invocation requests, by request handle.
   MetadataStorage<TMetadata>* metadata_storage_;
   std::vector<std::thread> function_handler_threads_;
   std::vector<sandbox2::Comms> ipc_comms_;
-  absl::flat_hash_set<std::string> canceled_requests_
+  absl::flat_hash_set<RequestHandle> canceled_requests_
       ABSL_GUARDED_BY(canceled_requests_mu_);
   absl::Mutex canceled_requests_mu_;
   // We need the remote file descriptors to unblock the local ones when stopping
   std::vector<int> remote_fds_;
   bool skip_callback_for_cancelled_;
+  const size_t callback_concurrency_;
+  int epoll_fd_ = -1;
+  // Received calls waiting for a callback thread.
+  std::deque<Call> calls_ ABSL_GUARDED_BY(calls_mu_);
+  bool calls_stopped_ ABSL_GUARDED_BY(calls_mu_) = false;
+  absl::Mutex calls_mu_;
+  LatencyHistogramMap latency_histograms_;
 };
 
 template <typename T>
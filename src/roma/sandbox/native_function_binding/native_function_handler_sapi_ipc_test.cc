@@ -26,6 +26,7 @@
 #include <thread>
 #include <vector>
 
+#include "absl/synchronization/notification.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "src/roma/metadata_storage/metadata_storage.h"
 #include "src/roma/sandbox/native_function_binding/native_function_table.h"
@@ -40,8 +41,6 @@ using ::testing::StrEq;
 
 namespace google::scp::roma::sandbox::native_function_binding::test {
 namespace {
-constexpr std::string_view kRequestUuid = "foo";
-
 TEST(NativeFunctionHandlerSapiIpcTest, IninRunStop) {
   int fd_pair[2];
   EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fd_pair), 0);
@@ -75,14 +74,15 @@ TEST(NativeFunctionHandlerSapiIpcTest, ShouldCallFunctionWhenRegistered) {
   NativeFunctionHandlerSapiIpc handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(std::string{kRequestUuid}, {}).IgnoreError();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
   g_called_registered_function = false;
 
   auto remote_fd = remote_fds.at(0);
   sandbox2::Comms comms(remote_fd);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name");
-  rpc_proto.set_request_uuid(std::string{kRequestUuid});
+  rpc_proto.set_request_uuid(handle->ToString());
   // Send the request over so that it's handled and the registered function
   // can be called
   EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
@@ -107,7 +107,8 @@ TEST(NativeFunctionHandlerSapiIpcTest,
   NativeFunctionHandlerSapiIpc handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(std::string{kRequestUuid}, {}).IgnoreError();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
 
   g_called_registered_function = false;
 
@@ -115,7 +116,7 @@ TEST(NativeFunctionHandlerSapiIpcTest,
   sandbox2::Comms comms(remote_fd);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name");
-  rpc_proto.set_request_uuid(std::string{kRequestUuid});
+  rpc_proto.set_request_uuid(handle->ToString());
   // Send the request over so that it's handled and the registered function
   // can be called
   EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
@@ -191,7 +192,8 @@ TEST(NativeFunctionHandlerSapiIpcTest, ShouldBeAbleToCallMultipleFunctions) {
   NativeFunctionHandlerSapiIpc handler(&function_table, &metadata_storage,
                                        local_fds, remote_fds);
   handler.Run();
-  metadata_storage.Add(absl::StrCat(kRequestUuid, 1), {}).IgnoreError();
+  const auto handle_one = metadata_storage.Add({});
+  ASSERT_TRUE(handle_one.ok());
 
   g_called_registered_function_one = false;
   g_called_registered_function_two = false;
@@ -200,7 +202,7 @@ TEST(NativeFunctionHandlerSapiIpcTest, ShouldBeAbleToCallMultipleFunctions) {
   sandbox2::Comms comms(remote_fd);
   proto::RpcWrapper rpc_proto;
   rpc_proto.set_function_name("cool_function_name_one");
-  rpc_proto.set_request_uuid(absl::StrCat(kRequestUuid, 1));
+  rpc_proto.set_request_uuid(handle_one->ToString());
   // Send the request over so that it's handled and the registered function
   // can be called
   EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
@@ -213,8 +215,9 @@ TEST(NativeFunctionHandlerSapiIpcTest, ShouldBeAbleToCallMultipleFunctions) {
 
   rpc_proto.Clear();
   rpc_proto.set_function_name("cool_function_name_two");
-  rpc_proto.set_request_uuid(absl::StrCat(kRequestUuid, 2));
-  metadata_storage.Add(absl::StrCat(kRequestUuid, 2), {}).IgnoreError();
+  const auto handle_two = metadata_storage.Add({});
+  ASSERT_TRUE(handle_two.ok());
+  rpc_proto.set_request_uuid(handle_two->ToString());
   // Send the request over so that it's handled and the registered function
   // can be called
   EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
@@ -226,5 +229,111 @@ TEST(NativeFunctionHandlerSapiIpcTest, ShouldBeAbleToCallMultipleFunctions) {
   EXPECT_THAT(rpc_proto.io_proto().output_string(), StrEq("From function two"));
   handler.Stop();
 }
+
+TEST(NativeFunctionHandlerSapiIpcTest, AnswersAsyncCallsOutOfOrder) {
+  int fd_pair[2];
+  EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fd_pair), 0);
+  std::vector<int> local_fds = {fd_pair[0]};
+  std::vector<int> remote_fds = {fd_pair[1]};
+  absl::Notification slow_call_released;
+  NativeFunctionTable function_table;
+  function_table
+      .Register("slow_function",
+                [&slow_call_released](FunctionBindingPayload<>& wrapper) {
+                  slow_call_released.WaitForNotification();
+                  wrapper.io_proto.set_output_string("slow");
+                })
+      .IgnoreError();
+  function_table
+      .Register("fast_function",
+                [](FunctionBindingPayload<>& wrapper) {
+                  wrapper.io_proto.set_output_string("fast");
+                })
+      .IgnoreError();
+  MetadataStorage<google::scp::roma::DefaultMetadata> metadata_storage;
+  NativeFunctionHandlerSapiIpc handler(&function_table, &metadata_storage,
+                                       local_fds, remote_fds,
+                                       /*skip_callback_for_cancelled=*/true,
+                                       /*callback_concurrency=*/2);
+  handler.Run();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
+
+  sandbox2::Comms comms(remote_fds.at(0));
+  proto::RpcWrapper rpc_proto;
+  rpc_proto.set_request_uuid(handle->ToString());
+  rpc_proto.set_function_name("slow_function");
+  rpc_proto.set_call_id(1);
+  EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
+  rpc_proto.set_function_name("fast_function");
+  rpc_proto.set_call_id(2);
+  EXPECT_TRUE(comms.SendProtoBuf(rpc_proto));
+
+  // The fast call is answered while the slow one is still running.
+  EXPECT_TRUE(comms.RecvProtoBuf(&rpc_proto));
+  EXPECT_EQ(rpc_proto.call_id(), 2);
+  EXPECT_THAT(rpc_proto.io_proto().output_string(), StrEq("fast"));
+
+  slow_call_released.Notify();
+  EXPECT_TRUE(comms.RecvProtoBuf(&rpc_proto));
+  EXPECT_EQ(rpc_proto.call_id(), 1);
+  EXPECT_THAT(rpc_proto.io_proto().output_string(), StrEq("slow"));
+  handler.Stop();
+}
+
+TEST(NativeFunctionHandlerSapiIpcTest, SlowCallbackDoesNotBlockOtherComms) {
+  int fd_pair_one[2];
+  int fd_pair_two[2];
+  EXPECT_EQ(
+      ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fd_pair_one), 0);
+  EXPECT_EQ(
+      ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fd_pair_two), 0);
+  std::vector<int> local_fds = {fd_pair_one[0], fd_pair_two[0]};
+  std::vector<int> remote_fds = {fd_pair_one[1], fd_pair_two[1]};
+  absl::Notification slow_call_released;
+  NativeFunctionTable function_table;
+  function_table
+      .Register("slow_function",
+                [&slow_call_released](FunctionBindingPayload<>& wrapper) {
+                  slow_call_released.WaitForNotification();
+                  wrapper.io_proto.set_output_string("slow");
+                })
+      .IgnoreError();
+  function_table
+      .Register("fast_function",
+                [](FunctionBindingPayload<>& wrapper) {
+                  wrapper.io_proto.set_output_string("fast");
+                })
+      .IgnoreError();
+  MetadataStorage<google::scp::roma::DefaultMetadata> metadata_storage;
+  NativeFunctionHandlerSapiIpc handler(&function_table, &metadata_storage,
+                                       local_fds, remote_fds);
+  handler.Run();
+  const auto handle = metadata_storage.Add({});
+  ASSERT_TRUE(handle.ok());
+
+  sandbox2::Comms comms_one(remote_fds.at(0));
+  sandbox2::Comms comms_two(remote_fds.at(1));
+  proto::RpcWrapper slow_call;
+  slow_call.set_request_uuid(handle->ToString());
+  slow_call.set_function_name("slow_function");
+  EXPECT_TRUE(comms_one.SendProtoBuf(slow_call));
+  proto::RpcWrapper fast_call;
+  fast_call.set_request_uuid(handle->ToString());
+  fast_call.set_function_name("fast_function");
+  EXPECT_TRUE(comms_two.SendProtoBuf(fast_call));
+
+  EXPECT_TRUE(comms_two.RecvProtoBuf(&fast_call));
+  EXPECT_THAT(fast_call.io_proto().output_string(), StrEq("fast"));
+  slow_call_released.Notify();
+  EXPECT_TRUE(comms_one.RecvProtoBuf(&slow_call));
+  EXPECT_THAT(slow_call.io_proto().output_string(), StrEq("slow"));
+
+  const auto histograms = handler.GetLatencyHistograms();
+  ASSERT_THAT(histograms, SizeIs(2));
+  EXPECT_EQ(histograms.at("slow_function").count, 1);
+  EXPECT_EQ(histograms.at("fast_function").count, 1);
+  handler.Stop();
+}
 }  // namespace
 }  // namespace google::scp::roma::sandbox::native_function_binding::test
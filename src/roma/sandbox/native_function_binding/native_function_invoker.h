@@ -55,6 +55,21 @@ class NativeFunctionInvoker {
   virtual absl::Status Invoke(
       google::scp::roma::proto::RpcWrapper& rpc_wrapper_proto);
 
+  /**
+   * @brief Send a call without waiting for its response. Used by asynchronous
+   * bindings, which set a call id on the call and match it to the response
+   * returned by Receive.
+   */
+  virtual absl::Status Send(
+      const google::scp::roma::proto::RpcWrapper& rpc_wrapper_proto);
+
+  /**
+   * @brief Block until the response of a call made by Send or Invoke arrives.
+   * Responses of asynchronous calls may arrive in any order.
+   */
+  virtual absl::Status Receive(
+      google::scp::roma::proto::RpcWrapper& rpc_wrapper_proto);
+
   virtual ~NativeFunctionInvoker() = default;
 
  private:
@@ -32,6 +32,13 @@ namespace google::scp::roma::sandbox::native_function_binding {
 NativeFunctionInvoker::NativeFunctionInvoker(int comms_fd) : fd_(comms_fd) {}
 
 absl::Status NativeFunctionInvoker::Invoke(RpcWrapper& rpc_wrapper_proto) {
+  if (auto status = Send(rpc_wrapper_proto); !status.ok()) {
+    return status;
+  }
+  return Receive(rpc_wrapper_proto);
+}
+
+absl::Status NativeFunctionInvoker::Send(const RpcWrapper& rpc_wrapper_proto) {
   if (!fd_.has_value()) {
     return absl::FailedPreconditionError(
         "A call to invoke was made without a file descriptor.");
@@ -53,6 +60,14 @@ absl::Status NativeFunctionInvoker::Invoke(RpcWrapper& rpc_wrapper_proto) {
     return absl::InternalError(
         "Could not send the call to the NativeFunctionHandler.");
   }
+  return absl::OkStatus();
+}
+
+absl::Status NativeFunctionInvoker::Receive(RpcWrapper& rpc_wrapper_proto) {
+  if (!fd_.has_value() || fd_ == kBadFd) {
+    return absl::FailedPreconditionError(
+        "A call to receive was made without a valid file descriptor.");
+  }
 
   // This unblocks once a call is issued from the other side
   char buffer[1024] = {0};
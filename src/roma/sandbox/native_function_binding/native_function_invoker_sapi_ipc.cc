@@ -35,6 +35,13 @@ NativeFunctionInvoker::NativeFunctionInvoker(int comms_fd) {
 }
 
 absl::Status NativeFunctionInvoker::Invoke(RpcWrapper& rpc_wrapper_proto) {
+  if (auto status = Send(rpc_wrapper_proto); !status.ok()) {
+    return status;
+  }
+  return Receive(rpc_wrapper_proto);
+}
+
+absl::Status NativeFunctionInvoker::Send(const RpcWrapper& rpc_wrapper_proto) {
   if (!ipc_comms_) {
     return absl::FailedPreconditionError(
         "A call to invoke was made with an uninitialized comms object.");
@@ -45,6 +52,14 @@ absl::Status NativeFunctionInvoker::Invoke(RpcWrapper& rpc_wrapper_proto) {
     return absl::InternalError(
         "Could not send the call to the parent process.");
   }
+  return absl::OkStatus();
+}
+
+absl::Status NativeFunctionInvoker::Receive(RpcWrapper& rpc_wrapper_proto) {
+  if (!ipc_comms_) {
+    return absl::FailedPreconditionError(
+        "A call to invoke was made with an uninitialized comms object.");
+  }
 
   auto recv = ipc_comms_->RecvProtoBuf(&rpc_wrapper_proto);
   if (!recv) {
@@ -33,8 +33,10 @@ using google::scp::roma::kWasmCodeArrayName;
 using google::scp::roma::sandbox::constants::kCodeVersion;
 using google::scp::roma::sandbox::constants::kHandlerName;
 using google::scp::roma::sandbox::constants::kRequestAction;
+using google::scp::roma::sandbox::constants::kRequestActionCollectGarbage;
 using google::scp::roma::sandbox::constants::kRequestActionExecute;
 using google::scp::roma::sandbox::constants::kRequestActionLoad;
+using google::scp::roma::sandbox::constants::kRequestActionUnload;
 using google::scp::roma::sandbox::constants::kRequestType;
 using google::scp::roma::sandbox::constants::kRequestTypeJavascript;
 using google::scp::roma::sandbox::constants::kRequestTypeJavascriptWithWasm;
@@ -88,6 +90,74 @@ TEST_F(V8EngineWorkerTest, CanRunJsCode) {
   worker.Stop();
 }
 
+TEST_F(V8EngineWorkerTest, CanCollectGarbageWithoutCodeVersion) {
+  Worker worker(CreateEngine(), /*require_preload=*/true);
+  worker.Run();
+
+  const std::string js_code =
+      R"(function hello_js() { return "Hello World!"; })";
+  std::vector<std::string_view> input;
+  absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {kRequestType, kRequestTypeJavascript},
+      {kCodeVersion, "1"},
+      {kRequestAction, kRequestActionLoad},
+  };
+  constexpr absl::Span<const uint8_t> empty_wasm;
+  ASSERT_TRUE(worker.RunCode(js_code, input, metadata, empty_wasm).ok());
+
+  metadata = {{kRequestAction, kRequestActionCollectGarbage}};
+  const auto gc_response_or =
+      worker.RunCode(/*code=*/"", input, metadata, empty_wasm);
+  ASSERT_TRUE(gc_response_or.ok());
+  EXPECT_THAT(gc_response_or->response, IsEmpty());
+
+  metadata = {
+      {kRequestType, kRequestTypeJavascript},
+      {kHandlerName, "hello_js"},
+      {kCodeVersion, "1"},
+      {kRequestAction, kRequestActionExecute},
+  };
+  const auto response_or =
+      worker.RunCode(/*code=*/"", input, metadata, empty_wasm);
+  ASSERT_TRUE(response_or.ok());
+  EXPECT_THAT(response_or->response, StrEq(R"("Hello World!")"));
+  worker.Stop();
+}
+
+TEST_F(V8EngineWorkerTest, UnloadedVersionCannotBeExecuted) {
+  Worker worker(CreateEngine(), /*require_preload=*/true);
+  worker.Run();
+
+  const std::string js_code =
+      R"(function hello_js() { return "Hello World!"; })";
+  std::vector<std::string_view> input;
+  absl::flat_hash_map<std::string_view, std::string_view> metadata = {
+      {kRequestType, kRequestTypeJavascript},
+      {kCodeVersion, "1"},
+      {kRequestAction, kRequestActionLoad},
+  };
+  constexpr absl::Span<const uint8_t> empty_wasm;
+  ASSERT_TRUE(worker.RunCode(js_code, input, metadata, empty_wasm).ok());
+
+  metadata = {
+      {kCodeVersion, "1"},
+      {kRequestAction, kRequestActionUnload},
+  };
+  ASSERT_TRUE(worker.RunCode(/*code=*/"", input, metadata, empty_wasm).ok());
+
+  metadata = {
+      {kRequestType, kRequestTypeJavascript},
+      {kHandlerName, "hello_js"},
+      {kCodeVersion, "1"},
+      {kRequestAction, kRequestActionExecute},
+  };
+  EXPECT_EQ(worker.RunCode(/*code=*/"", input, metadata, empty_wasm)
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+  worker.Stop();
+}
+
 TEST_F(V8EngineWorkerTest, CanRunMultipleVersionsOfTheCode) {
   Worker worker(CreateEngine(), /*require_preload=*/true);
   worker.Run();
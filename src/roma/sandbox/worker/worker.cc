@@ -18,21 +18,28 @@
 
 #include <unistd.h>
 
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "src/roma/logging/logging.h"
 #include "src/roma/sandbox/constants/constants.h"
 #include "src/util/status_macro/status_macros.h"
 
+using google::scp::roma::sandbox::constants::kBatchDeadline;
 using google::scp::roma::sandbox::constants::kCodeVersion;
 using google::scp::roma::sandbox::constants::kHandlerName;
 using google::scp::roma::sandbox::constants::kRequestAction;
+using google::scp::roma::sandbox::constants::kRequestActionCollectGarbage;
 using google::scp::roma::sandbox::constants::kRequestActionExecute;
 using google::scp::roma::sandbox::constants::kRequestActionLoad;
+using google::scp::roma::sandbox::constants::kRequestActionUnload;
 using google::scp::roma::sandbox::constants::kRequestType;
 using google::scp::roma::sandbox::constants::kRequestTypeJavascript;
 using google::scp::roma::sandbox::constants::kRequestTypeJavascriptWithWasm;
@@ -54,6 +61,13 @@ absl::StatusOr<js_engine::ExecutionResponse> Worker::RunCode(
     std::string_view code, const std::vector<std::string_view>& input,
     const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
     absl::Span<const uint8_t> wasm) {
+  if (const auto action_it = metadata.find(kRequestAction);
+      action_it != metadata.end() &&
+      action_it->second == kRequestActionCollectGarbage) {
+    CollectGarbage();
+    return js_engine::ExecutionResponse();
+  }
+
   auto code_version_it = metadata.find(kCodeVersion);
   if (code_version_it == metadata.end()) {
     return absl::InvalidArgumentError(absl::StrCat(
@@ -73,6 +87,13 @@ absl::StatusOr<js_engine::ExecutionResponse> Worker::RunCode(
 
   ROMA_VLOG(2) << "Worker executing request with action of " << action;
 
+  if (action == kRequestActionUnload) {
+    absl::MutexLock lock(&cache_mu_);
+    compilation_contexts_.erase(code_version);
+    ROMA_VLOG(1) << "dropped compilation context for version " << code_version;
+    return js_engine::ExecutionResponse();
+  }
+
   std::string_view handler_name = "";
   auto handler_name_it = metadata.find(kHandlerName);
 
@@ -146,4 +167,82 @@ absl::StatusOr<js_engine::ExecutionResponse> Worker::RunCode(
   return response_or->execution_response;
 }
 
+absl::StatusOr<std::vector<absl::StatusOr<js_engine::ExecutionResponse>>>
+Worker::RunCodeBatch(
+    const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+    absl::Span<const js_engine::BatchInvocation> batch) {
+  auto code_version_it = metadata.find(kCodeVersion);
+  if (code_version_it == metadata.end()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Missing expected key in request metadata: ", kCodeVersion));
+  }
+  std::string_view code_version = code_version_it->second;
+
+  auto handler_name_it = metadata.find(kHandlerName);
+  if (handler_name_it == metadata.end()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Missing expected key in request metadata: ", kHandlerName));
+  }
+  std::string_view handler_name = handler_name_it->second;
+
+  absl::Time deadline = absl::InfiniteFuture();
+  if (const auto it = metadata.find(kBatchDeadline); it != metadata.end()) {
+    int64_t deadline_ns;
+    if (!absl::SimpleAtoi(it->second, &deadline_ns)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid value for ", kBatchDeadline, ": ", it->second));
+    }
+    deadline = absl::FromUnixNanos(deadline_ns);
+  }
+
+  ROMA_VLOG(2) << "Worker executing batch of " << batch.size()
+               << " requests with code version of " << code_version;
+
+  RomaJsEngineCompilationContext context;
+  std::string request_type;
+  {
+    absl::MutexLock lock(&cache_mu_);
+    const auto it = compilation_contexts_.find(code_version);
+    if (it == compilation_contexts_.end()) {
+      return absl::NotFoundError(
+          "Could not find a stored context for the execution request.");
+    }
+    context = it->second.context;
+    request_type = it->second.request_type;
+  }
+
+  if (request_type == kRequestTypeJavascript) {
+    return js_engine_->RunJsBatch(handler_name, batch, context, deadline);
+  }
+
+  // Other request types gain nothing from sharing the engine entry, so their
+  // invocations run one by one.
+  std::vector<absl::StatusOr<js_engine::ExecutionResponse>> responses;
+  responses.reserve(batch.size());
+  for (const js_engine::BatchInvocation& invocation : batch) {
+    if (absl::Now() >= deadline) {
+      responses.push_back(absl::DeadlineExceededError(
+          "Batch deadline passed before the invocation started."));
+      continue;
+    }
+    responses.push_back(RunCode(/*code=*/"", invocation.input,
+                                invocation.metadata, /*wasm=*/{}));
+  }
+  return responses;
+}
+
+void Worker::CollectGarbage() {
+  std::vector<RomaJsEngineCompilationContext> contexts;
+  {
+    absl::MutexLock lock(&cache_mu_);
+    contexts.reserve(compilation_contexts_.size());
+    for (const auto& [_, entry] : compilation_contexts_) {
+      contexts.push_back(entry.context);
+    }
+  }
+  for (const RomaJsEngineCompilationContext& context : contexts) {
+    js_engine_->CollectGarbage(context);
+  }
+}
+
 }  // namespace google::scp::roma::sandbox::worker
@@ -54,13 +54,37 @@ class Worker {
    * @param metadata The metadata associated with the code request
    * @param wasm The wasm code module needed to run the code
    * @return absl::StatusOr<std::string>
+   *
+   * A request whose action is kRequestActionCollectGarbage runs no code, but
+   * collects the garbage of every loaded code version. One whose action is
+   * kRequestActionUnload drops the code version it names.
    */
   virtual absl::StatusOr<js_engine::ExecutionResponse> RunCode(
       std::string_view code, const std::vector<std::string_view>& input,
       const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
       absl::Span<const uint8_t> wasm) ABSL_LOCKS_EXCLUDED(cache_mu_);
 
+  /**
+   * @brief Run a batch of invocations of a previously loaded code object.
+   * JavaScript batches enter the JS engine once for the whole batch.
+   *
+   * @param metadata The metadata shared by every invocation of the batch,
+   * which names the code version and handler to run. An optional
+   * kBatchDeadline fails the invocations which would start after it.
+   * @param batch The inputs and metadata of each invocation
+   * @return The response, or the error, of each invocation in `batch` order,
+   * or an error if the batch could not run at all.
+   */
+  virtual absl::StatusOr<
+      std::vector<absl::StatusOr<js_engine::ExecutionResponse>>>
+  RunCodeBatch(
+      const absl::flat_hash_map<std::string_view, std::string_view>& metadata,
+      absl::Span<const js_engine::BatchInvocation> batch)
+      ABSL_LOCKS_EXCLUDED(cache_mu_);
+
  private:
+  void CollectGarbage() ABSL_LOCKS_EXCLUDED(cache_mu_);
+
   std::unique_ptr<js_engine::JsEngine> js_engine_;
   bool require_preload_;
   /**
@@ -49,6 +49,9 @@ absl::Status GetAbslStatus(int int_status_code) {
       return absl::InternalError(
           "Failed to create a valid sandbox2 buffer for sandbox "
           "communication");
+    case SapiStatusCode::kInvalidBufferSlot:
+      return absl::InvalidArgumentError(
+          "The request refers to a slot outside of the sandbox2 buffer");
 
       // No default. This will cause a compile error if a new enum value is
       // added without also updating this switch statement.
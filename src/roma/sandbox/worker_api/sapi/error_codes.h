@@ -42,6 +42,7 @@ enum class SapiStatusCode : int {
   kResponseLargerThanBuffer = 7,
   kUninitializedWorker = 8,
   kValidSandboxBufferRequired = 9,
+  kInvalidBufferSlot = 10,
 };
 
 // Convert the status code enum value into an absl::Status, with a message.
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shared_buffer_layout.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "google/protobuf/repeated_ptr_field.h"
+#include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
+
+namespace google::scp::roma::sandbox::worker_api {
+namespace {
+
+constexpr size_t kAlignment = sizeof(uint64_t);
+
+size_t AlignUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+size_t FrameSize(size_t control_size,
+                 absl::Span<const std::string_view> regions) {
+  size_t size = sizeof(uint64_t) + AlignUp(control_size) + sizeof(uint64_t);
+  for (std::string_view region : regions) {
+    size += sizeof(uint64_t) + AlignUp(region.size());
+  }
+  return size;
+}
+
+// Writes `control` followed by `regions` to `buffer`. Returns the number of
+// bytes written.
+absl::StatusOr<size_t> WriteFrame(const ::worker_api::WorkerParamsProto& control,
+                                  absl::Span<const std::string_view> regions,
+                                  absl::Span<uint8_t> buffer) {
+  const size_t control_size = control.ByteSizeLong();
+  const size_t frame_size = FrameSize(control_size, regions);
+  if (frame_size > buffer.size()) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Data of size ", frame_size,
+                     " bytes is larger than the Buffer capacity of ",
+                     buffer.size(), " bytes."));
+  }
+  uint8_t* pos = buffer.data();
+  auto write_size = [&pos](uint64_t size) {
+    memcpy(pos, &size, sizeof(size));
+    pos += sizeof(size);
+  };
+  write_size(control_size);
+  if (!control.SerializeToArray(pos, control_size)) {
+    return absl::InternalError("Failed to serialize the control header.");
+  }
+  pos += AlignUp(control_size);
+  write_size(regions.size());
+  for (std::string_view region : regions) {
+    write_size(region.size());
+    memcpy(pos, region.data(), region.size());
+    pos += AlignUp(region.size());
+  }
+  return frame_size;
+}
+
+struct Frame {
+  absl::Span<const uint8_t> control;
+  std::vector<std::string_view> regions;
+};
+
+absl::StatusOr<Frame> ReadFrame(absl::Span<const uint8_t> buffer) {
+  size_t offset = 0;
+  auto read_size = [&](uint64_t& size) {
+    if (buffer.size() - offset < sizeof(size)) {
+      return false;
+    }
+    memcpy(&size, buffer.data() + offset, sizeof(size));
+    offset += sizeof(size);
+    return true;
+  };
+  // Returns the region of `size` bytes at `offset` and skips past it.
+  auto read_region = [&](uint64_t size, absl::Span<const uint8_t>& region) {
+    if (buffer.size() - offset < size) {
+      return false;
+    }
+    region = buffer.subspan(offset, size);
+    offset += std::min<size_t>(AlignUp(size), buffer.size() - offset);
+    return true;
+  };
+
+  Frame frame;
+  uint64_t control_size;
+  if (!read_size(control_size) || !read_region(control_size, frame.control)) {
+    return absl::InvalidArgumentError("Buffer holds a truncated header.");
+  }
+  uint64_t region_count;
+  if (!read_size(region_count) ||
+      region_count > (buffer.size() - offset) / sizeof(uint64_t)) {
+    return absl::InvalidArgumentError("Buffer holds a truncated region count.");
+  }
+  frame.regions.reserve(region_count);
+  for (uint64_t i = 0; i < region_count; ++i) {
+    uint64_t region_size;
+    absl::Span<const uint8_t> region;
+    if (!read_size(region_size) || !read_region(region_size, region)) {
+      return absl::InvalidArgumentError("Buffer holds a truncated region.");
+    }
+    frame.regions.emplace_back(reinterpret_cast<const char*>(region.data()),
+                               region.size());
+  }
+  return frame;
+}
+
+}  // namespace
+
+absl::StatusOr<size_t> WriteRequestToBuffer(
+    ::worker_api::WorkerParamsProto& params, absl::Span<uint8_t> buffer) {
+  // Swap the inputs out of `params` so that only the control header gets
+  // serialized, and swap them back in once they are written.
+  google::protobuf::RepeatedPtrField<std::string> input_strings;
+  std::string input_bytes;
+  std::vector<std::string_view> regions;
+  switch (params.input_type_case()) {
+    case ::worker_api::WorkerParamsProto::kInputStrings:
+      input_strings.Swap(params.mutable_input_strings()->mutable_inputs());
+      regions.assign(input_strings.begin(), input_strings.end());
+      break;
+    case ::worker_api::WorkerParamsProto::kInputBytes:
+      params.mutable_input_bytes()->swap(input_bytes);
+      regions.push_back(input_bytes);
+      break;
+    default:
+      break;
+  }
+  absl::StatusOr<size_t> written = WriteFrame(params, regions, buffer);
+  switch (params.input_type_case()) {
+    case ::worker_api::WorkerParamsProto::kInputStrings:
+      input_strings.Swap(params.mutable_input_strings()->mutable_inputs());
+      break;
+    case ::worker_api::WorkerParamsProto::kInputBytes:
+      params.mutable_input_bytes()->swap(input_bytes);
+      break;
+    default:
+      break;
+  }
+  return written;
+}
+
+absl::StatusOr<BufferRequestView> ReadRequestFromBuffer(
+    absl::Span<const uint8_t> buffer) {
+  absl::StatusOr<Frame> frame = ReadFrame(buffer);
+  if (!frame.ok()) {
+    return frame.status();
+  }
+  BufferRequestView request;
+  if (!request.params.ParseFromArray(frame->control.data(),
+                                     frame->control.size())) {
+    return absl::InvalidArgumentError(
+        "Failed to deserialize the request control header.");
+  }
+  request.inputs = std::move(frame->regions);
+  return request;
+}
+
+absl::StatusOr<size_t> WriteResponseToBuffer(
+    ::worker_api::WorkerParamsProto& params, absl::Span<uint8_t> buffer) {
+  if (!params.has_response()) {
+    return WriteFrame(params, {}, buffer);
+  }
+  std::string response = std::move(*params.mutable_response());
+  params.clear_response();
+  const std::string_view region = response;
+  absl::StatusOr<size_t> written =
+      WriteFrame(params, absl::MakeConstSpan(&region, 1), buffer);
+  params.set_response(std::move(response));
+  return written;
+}
+
+absl::Status ReadResponseFromBuffer(absl::Span<const uint8_t> buffer,
+                                    ::worker_api::WorkerParamsProto& params) {
+  absl::StatusOr<Frame> frame = ReadFrame(buffer);
+  if (!frame.ok()) {
+    return frame.status();
+  }
+  if (!params.ParseFromArray(frame->control.data(), frame->control.size())) {
+    return absl::InvalidArgumentError(
+        "Failed to deserialize the response control header.");
+  }
+  if (frame->regions.size() > 1) {
+    return absl::InvalidArgumentError("Buffer holds more than one response.");
+  }
+  if (!frame->regions.empty()) {
+    const std::string_view response = frame->regions.front();
+    params.set_response(response.data(), response.size());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace google::scp::roma::sandbox::worker_api
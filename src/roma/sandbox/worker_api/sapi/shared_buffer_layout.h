@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_SANDBOX_WORKER_API_SAPI_SHARED_BUFFER_LAYOUT_H_
+#define ROMA_SANDBOX_WORKER_API_SAPI_SHARED_BUFFER_LAYOUT_H_
+
+#include <stdint.h>
+
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
+
+/**
+ * @brief Raw layout of requests and responses in the sandbox2::Buffer shared
+ * between the host process and the sandboxee.
+ *
+ * Only a small control header (the WorkerParamsProto without its inputs or
+ * response) is serialized. The inputs of a request and the response of a
+ * response are written as raw length-prefixed regions after it, so that the
+ * sandboxee can read inputs in place instead of parsing them out of a proto:
+ *
+ *   uint64 control_size | control | padding
+ *   uint64 region_count | { uint64 region_size | region | padding }...
+ *
+ * Sizes are in host byte order and every size field is 8-byte aligned.
+ */
+namespace google::scp::roma::sandbox::worker_api {
+
+/**
+ * @brief A request read from the buffer. `inputs` point into the buffer and
+ * are only valid until the buffer is written again.
+ */
+struct BufferRequestView {
+  ::worker_api::WorkerParamsProto params;
+  std::vector<std::string_view> inputs;
+};
+
+/**
+ * @brief Writes `params` to `buffer`, with its inputs as raw regions.
+ *
+ * @return The number of bytes written, or ResourceExhaustedError, with
+ * `params` left untouched, if the request does not fit into `buffer`.
+ */
+absl::StatusOr<size_t> WriteRequestToBuffer(
+    ::worker_api::WorkerParamsProto& params, absl::Span<uint8_t> buffer);
+
+/**
+ * @brief Reads a request written by WriteRequestToBuffer. `params` of the
+ * result holds no inputs, which are returned as views into `buffer` instead.
+ */
+absl::StatusOr<BufferRequestView> ReadRequestFromBuffer(
+    absl::Span<const uint8_t> buffer);
+
+/**
+ * @brief Writes `params` to `buffer`, with its response as a raw region.
+ *
+ * @return The number of bytes written, or ResourceExhaustedError, with
+ * `params` left untouched, if the response does not fit into `buffer`.
+ */
+absl::StatusOr<size_t> WriteResponseToBuffer(
+    ::worker_api::WorkerParamsProto& params, absl::Span<uint8_t> buffer);
+
+/**
+ * @brief Reads a response written by WriteResponseToBuffer into `params`.
+ */
+absl::Status ReadResponseFromBuffer(absl::Span<const uint8_t> buffer,
+                                    ::worker_api::WorkerParamsProto& params);
+
+}  // namespace google::scp::roma::sandbox::worker_api
+
+#endif  // ROMA_SANDBOX_WORKER_API_SAPI_SHARED_BUFFER_LAYOUT_H_
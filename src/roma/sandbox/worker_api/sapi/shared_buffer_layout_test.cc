@@ -0,0 +1,140 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/sandbox/worker_api/sapi/shared_buffer_layout.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::StrEq;
+
+namespace google::scp::roma::sandbox::worker_api::test {
+namespace {
+constexpr size_t kBufferSize = 1024;
+}  // namespace
+
+TEST(SharedBufferLayoutTest, RequestRoundTripsWithInputStrings) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  params.set_code("function Handler(a, b) { return a + b; }");
+  (*params.mutable_metadata())["key"] = "value";
+  params.mutable_input_strings()->add_inputs(R"("first")");
+  params.mutable_input_strings()->add_inputs("");
+  params.mutable_input_strings()->add_inputs(R"({"odd": 1})");
+
+  const auto written = WriteRequestToBuffer(params, absl::MakeSpan(buffer));
+  ASSERT_TRUE(written.ok()) << written.status();
+  // The inputs are swapped back into `params` after writing.
+  EXPECT_EQ(params.input_strings().inputs_size(), 3);
+
+  const auto request =
+      ReadRequestFromBuffer(absl::MakeConstSpan(buffer.data(), *written));
+  ASSERT_TRUE(request.ok()) << request.status();
+  EXPECT_THAT(request->inputs,
+              ElementsAre(R"("first")", "", R"({"odd": 1})"));
+  EXPECT_THAT(request->params.code(), StrEq(params.code()));
+  EXPECT_THAT(request->params.metadata().at("key"), StrEq("value"));
+  EXPECT_THAT(request->params.input_strings().inputs(), IsEmpty());
+}
+
+TEST(SharedBufferLayoutTest, RequestRoundTripsWithInputBytes) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  params.set_input_bytes(std::string("\0\1\2raw", 6));
+
+  const auto written = WriteRequestToBuffer(params, absl::MakeSpan(buffer));
+  ASSERT_TRUE(written.ok()) << written.status();
+  EXPECT_EQ(params.input_bytes().size(), 6);
+
+  const auto request =
+      ReadRequestFromBuffer(absl::MakeConstSpan(buffer.data(), *written));
+  ASSERT_TRUE(request.ok()) << request.status();
+  EXPECT_THAT(request->inputs, ElementsAre(std::string("\0\1\2raw", 6)));
+  EXPECT_TRUE(request->params.has_input_bytes());
+  EXPECT_THAT(request->params.input_bytes(), IsEmpty());
+}
+
+TEST(SharedBufferLayoutTest, RequestLargerThanBufferIsLeftUntouched) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  params.mutable_input_strings()->add_inputs(std::string(kBufferSize, 'a'));
+
+  const auto written = WriteRequestToBuffer(params, absl::MakeSpan(buffer));
+  EXPECT_EQ(written.status().code(), absl::StatusCode::kResourceExhausted);
+  ASSERT_EQ(params.input_strings().inputs_size(), 1);
+  EXPECT_EQ(params.input_strings().inputs(0).size(), kBufferSize);
+}
+
+TEST(SharedBufferLayoutTest, ResponseRoundTrips) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  params.set_response(R"("some response")");
+  params.set_profiler_output("profile");
+  (*params.mutable_metrics())["metric"].set_seconds(1);
+
+  const auto written = WriteResponseToBuffer(params, absl::MakeSpan(buffer));
+  ASSERT_TRUE(written.ok()) << written.status();
+  EXPECT_THAT(params.response(), StrEq(R"("some response")"));
+
+  ::worker_api::WorkerParamsProto response;
+  ASSERT_TRUE(
+      ReadResponseFromBuffer(absl::MakeConstSpan(buffer.data(), *written),
+                             response)
+          .ok());
+  EXPECT_THAT(response.response(), StrEq(R"("some response")"));
+  EXPECT_THAT(response.profiler_output(), StrEq("profile"));
+  EXPECT_EQ(response.metrics().at("metric").seconds(), 1);
+}
+
+TEST(SharedBufferLayoutTest, ResponseWithoutResponseFieldRoundTrips) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  params.set_error_message("some error");
+
+  const auto written = WriteResponseToBuffer(params, absl::MakeSpan(buffer));
+  ASSERT_TRUE(written.ok()) << written.status();
+
+  ::worker_api::WorkerParamsProto response;
+  ASSERT_TRUE(
+      ReadResponseFromBuffer(absl::MakeConstSpan(buffer.data(), *written),
+                             response)
+          .ok());
+  EXPECT_FALSE(response.has_response());
+  EXPECT_THAT(response.error_message(), StrEq("some error"));
+}
+
+TEST(SharedBufferLayoutTest, TruncatedBufferFailsToRead) {
+  std::vector<uint8_t> buffer(kBufferSize);
+  ::worker_api::WorkerParamsProto params;
+  // An input of 8 bytes so that the request does not end in padding.
+  params.mutable_input_strings()->add_inputs(R"("inputs")");
+
+  const auto written = WriteRequestToBuffer(params, absl::MakeSpan(buffer));
+  ASSERT_TRUE(written.ok()) << written.status();
+  for (size_t size = 0; size < *written; ++size) {
+    EXPECT_FALSE(
+        ReadRequestFromBuffer(absl::MakeConstSpan(buffer.data(), size)).ok());
+  }
+}
+
+}  // namespace google::scp::roma::sandbox::worker_api::test
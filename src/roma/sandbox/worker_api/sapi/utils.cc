@@ -59,12 +59,15 @@ std::unique_ptr<Worker> CreateWorker(const V8WorkerEngineParams& params) {
 
   auto isolate_function_binding = std::make_unique<V8IsolateFunctionBinding>(
       params.native_js_function_names, params.rpc_method_names,
-      std::move(native_function_invoker), params.server_address);
+      std::move(native_function_invoker), params.server_address,
+      params.native_js_async_function_names);
 
   auto v8_engine = std::make_unique<V8JsEngine>(
       std::move(isolate_function_binding), params.skip_v8_cleanup,
       params.enable_profilers, params.resource_constraints,
-      params.logging_function_set, params.disable_udf_stacktraces_in_response);
+      params.logging_function_set, params.disable_udf_stacktraces_in_response,
+      params.context_pool_size, params.context_max_uses,
+      params.invocation_resource_metrics);
   v8_engine->OneTimeSetup(GetEngineOneTimeSetup(params));
   return std::make_unique<Worker>(std::move(v8_engine), params.require_preload);
 }
@@ -73,6 +76,9 @@ void ClearInputFields(::worker_api::WorkerParamsProto& params) {
   params.clear_code();
   params.clear_input_strings();
   params.clear_input_bytes();
+  for (::worker_api::WorkerParamsProto& element : *params.mutable_batch()) {
+    ClearInputFields(element);
+  }
 }
 
 std::pair<absl::Status, RetryStatus> WrapResultWithNoRetry(
@@ -17,6 +17,7 @@
 #ifndef ROMA_SANDBOX_WORKER_API_SAPI_UTILS_H_
 #define ROMA_SANDBOX_WORKER_API_SAPI_UTILS_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -34,6 +35,7 @@ enum class RetryStatus { kDoNotRetry, kRetry };
 struct V8WorkerEngineParams {
   int native_js_function_comms_fd;
   std::vector<std::string> native_js_function_names;
+  std::vector<std::string> native_js_async_function_names;
   std::vector<std::string> rpc_method_names;
   std::string server_address;
   google::scp::roma::JsEngineResourceConstraints resource_constraints;
@@ -45,6 +47,9 @@ struct V8WorkerEngineParams {
   bool enable_profilers = false;
   bool logging_function_set = false;
   bool disable_udf_stacktraces_in_response = false;
+  size_t context_pool_size = 0;
+  size_t context_max_uses = 0;
+  uint32_t invocation_resource_metrics = 0;
 };
 
 absl::flat_hash_map<std::string, std::string> GetEngineOneTimeSetup(
@@ -21,12 +21,18 @@
 
 #include <linux/audit.h>
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "include/v8.h"
 #include "sandboxed_api/lenval_core.h"
 #include "sandboxed_api/sandbox2/buffer.h"
 #include "sandboxed_api/sandbox2/policy.h"
@@ -43,18 +49,25 @@ namespace google::scp::roma::sandbox::worker_api {
 WorkerSandboxApi::WorkerSandboxApi(
     bool require_preload, int native_js_function_comms_fd,
     const std::vector<std::string>& native_js_function_names,
+    const std::vector<std::string>& native_js_async_function_names,
     const std::vector<std::string>& rpc_method_names,
     const std::string& server_address, size_t max_worker_virtual_memory_mb,
     size_t js_engine_initial_heap_size_mb,
     size_t js_engine_maximum_heap_size_mb,
     size_t js_engine_max_wasm_memory_number_of_pages,
+    size_t js_engine_context_pool_size, size_t js_engine_context_max_uses,
+    uint32_t invocation_resource_metrics,
     size_t sandbox_request_response_shared_buffer_size_mb,
+    int sandbox_request_response_shared_buffer_slot_count,
     bool enable_sandbox_sharing_request_response_with_buffer_only,
+    bool enable_sandbox_sharing_request_response_with_raw_layout,
+    bool enable_spare_worker_sandbox,
     const std::vector<std::string>& v8_flags, bool enable_profilers,
     bool logging_function_set, bool disable_udf_stacktraces_in_response)
     : require_preload_(require_preload),
       native_js_function_comms_fd_(native_js_function_comms_fd),
       native_js_function_names_(native_js_function_names),
+      native_js_async_function_names_(native_js_async_function_names),
       rpc_method_names_(rpc_method_names),
       server_address_(server_address),
       max_worker_virtual_memory_mb_(max_worker_virtual_memory_mb),
@@ -62,8 +75,18 @@ WorkerSandboxApi::WorkerSandboxApi(
       js_engine_maximum_heap_size_mb_(js_engine_maximum_heap_size_mb),
       js_engine_max_wasm_memory_number_of_pages_(
           js_engine_max_wasm_memory_number_of_pages),
+      js_engine_context_pool_size_(js_engine_context_pool_size),
+      js_engine_context_max_uses_(js_engine_context_max_uses),
+      invocation_resource_metrics_(invocation_resource_metrics),
+      request_and_response_data_buffer_slot_count_(
+          sandbox_request_response_shared_buffer_slot_count > 0
+              ? sandbox_request_response_shared_buffer_slot_count
+              : 1),
       enable_sandbox_sharing_request_response_with_buffer_only_(
           enable_sandbox_sharing_request_response_with_buffer_only),
+      enable_sandbox_sharing_request_response_with_raw_layout_(
+          enable_sandbox_sharing_request_response_with_raw_layout),
+      enable_spare_worker_sandbox_(enable_spare_worker_sandbox),
       v8_flags_(v8_flags),
       enable_profilers_(enable_profilers),
       logging_function_set_(logging_function_set),
@@ -75,7 +98,8 @@ WorkerSandboxApi::WorkerSandboxApi(
           ? sandbox_request_response_shared_buffer_size_mb * kMB
           : kDefaultBufferSizeInMb * kMB;
   auto buffer = sandbox2::Buffer::CreateWithSize(
-      request_and_response_data_buffer_size_bytes_);
+      request_and_response_data_buffer_size_bytes_ *
+      request_and_response_data_buffer_slot_count_);
   CHECK_OK(buffer) << "Create Buffer with size failed with "
                    << buffer.status().message();
   sandbox_data_shared_buffer_ptr_ = std::move(buffer).value();
@@ -84,14 +108,19 @@ WorkerSandboxApi::WorkerSandboxApi(
 absl::Status WorkerSandboxApi::Init() {
   worker_wrapper_ = std::make_unique<WorkerWrapper>(
       enable_sandbox_sharing_request_response_with_buffer_only_,
+      enable_sandbox_sharing_request_response_with_raw_layout_,
       request_and_response_data_buffer_size_bytes_,
+      request_and_response_data_buffer_slot_count_,
       sandbox_data_shared_buffer_ptr_.get(), native_js_function_comms_fd_,
-      max_worker_virtual_memory_mb_);
+      max_worker_virtual_memory_mb_, enable_spare_worker_sandbox_);
 
   ::worker_api::WorkerInitParamsProto worker_init_params;
   worker_init_params.set_require_code_preload_for_execution(require_preload_);
   worker_init_params.mutable_native_js_function_names()->Assign(
       native_js_function_names_.begin(), native_js_function_names_.end());
+  worker_init_params.mutable_native_js_async_function_names()->Assign(
+      native_js_async_function_names_.begin(),
+      native_js_async_function_names_.end());
   worker_init_params.mutable_rpc_method_names()->Assign(
       rpc_method_names_.begin(), rpc_method_names_.end());
   worker_init_params.set_server_address(server_address_);
@@ -101,6 +130,12 @@ absl::Status WorkerSandboxApi::Init() {
       js_engine_maximum_heap_size_mb_);
   worker_init_params.set_js_engine_max_wasm_memory_number_of_pages(
       js_engine_max_wasm_memory_number_of_pages_);
+  worker_init_params.set_js_engine_context_pool_size(
+      js_engine_context_pool_size_);
+  worker_init_params.set_js_engine_context_max_uses(
+      js_engine_context_max_uses_);
+  worker_init_params.set_invocation_resource_metrics(
+      invocation_resource_metrics_);
   worker_init_params.set_request_and_response_data_buffer_size_bytes(
       request_and_response_data_buffer_size_bytes_);
   worker_init_params.mutable_v8_flags()->Assign(v8_flags_.begin(),
@@ -131,6 +166,10 @@ absl::Status WorkerSandboxApi::Run() {
 }
 
 absl::Status WorkerSandboxApi::Stop() {
+  if (!worker_wrapper_) {
+    // Never started.
+    return absl::OkStatus();
+  }
   const auto worker_status = worker_wrapper_->Stop();
   if (!worker_status.ok()) {
     LOG(ERROR) << "Failed to stop the worker via the wrapper with: "
@@ -145,4 +184,56 @@ std::pair<absl::Status, RetryStatus> WorkerSandboxApi::RunCode(
 }
 
 void WorkerSandboxApi::Terminate() { worker_wrapper_->Terminate(); }
+
+int WorkerSandboxApi::SlotCount() const {
+  return request_and_response_data_buffer_slot_count_;
+}
+
+std::string WorkerSandboxApi::SnapshotEnvironment() const {
+  std::string environment(v8::V8::GetVersion());
+  // Length-prefixed, so that the values cannot run into each other.
+  const auto append = [&environment](std::string_view label,
+                                     const std::vector<std::string>& values) {
+    absl::StrAppend(&environment, "\n", label, ":", values.size());
+    for (const std::string& value : values) {
+      absl::StrAppend(&environment, "\n", value.size(), ":", value);
+    }
+  };
+  append("functions", native_js_function_names_);
+  append("async_functions", native_js_async_function_names_);
+  append("rpc_methods", rpc_method_names_);
+  append("v8_flags", v8_flags_);
+  return environment;
+}
+
+absl::Status StartWorkers(absl::Span<WorkerSandboxApi> workers,
+                          int parallelism) {
+  std::atomic<size_t> next = 0;
+  absl::Mutex mu;
+  absl::Status status;
+  const auto start = [&] {
+    for (size_t i = next++; i < workers.size(); i = next++) {
+      absl::Status worker_status = workers[i].Init();
+      if (worker_status.ok()) {
+        worker_status = workers[i].Run();
+      }
+      if (!worker_status.ok()) {
+        absl::MutexLock lock(&mu);
+        status.Update(std::move(worker_status));
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  const size_t num_threads =
+      std::min(workers.size(), static_cast<size_t>(std::max(parallelism, 1)));
+  threads.reserve(num_threads);
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(start);
+  }
+  start();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return status;
+}
 }  // namespace google::scp::roma::sandbox::worker_api
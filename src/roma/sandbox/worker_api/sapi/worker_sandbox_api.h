@@ -17,12 +17,14 @@
 #ifndef ROMA_SANDBOX_WORKER_API_SAPI_WORKER_SANDBOX_API_H_
 #define ROMA_SANDBOX_WORKER_API_SAPI_WORKER_SANDBOX_API_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/buffer.h"
 #include "src/roma/sandbox/worker_api/sapi/utils.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
@@ -46,6 +48,8 @@ class WorkerSandboxApi {
    * function calls through the sandbox.
    * @param native_js_function_names The names of the functions that should be
    * registered to be available in JS.
+   * @param native_js_async_function_names The subset of
+   * native_js_function_names whose JS functions return a Promise.
    * @param rpc_method_names The names of the rpc methods for registered
    * services. Will allow clients to invoke services via gRPC in UDF
    * @param server_address The address of the gRPC server in the host process
@@ -58,9 +62,26 @@ class WorkerSandboxApi {
    * JS engine.
    * @param js_engine_max_wasm_memory_number_of_pages The maximum number of WASM
    * pages. Each page is 64KiB. Max 65536 pages (4GiB).
+   * @param js_engine_context_pool_size The number of idle JS engine contexts
+   * kept per loaded code version. Zero disables context reuse.
+   * @param js_engine_context_max_uses The number of invocations after which a
+   * pooled JS engine context is replaced. Zero means no limit.
+   * @param invocation_resource_metrics The resource usage each invocation
+   * reports, as a bitmask of InvocationResourceMetric.
    * @param sandbox_request_response_shared_buffer_size_mb The size of the
    * Buffer in megabytes (MB). If the input value is equal to or less than zero,
    * the default value of 1MB will be used.
+   * @param sandbox_request_response_shared_buffer_slot_count The number of
+   * slots of the Buffer, each of them of
+   * sandbox_request_response_shared_buffer_size_mb. Up to this many requests
+   * can be in flight to the worker at once, so that the next request is
+   * written while the worker runs the current one. If the input value is
+   * equal to or less than zero, a single slot will be used.
+   * @param enable_sandbox_sharing_request_response_with_raw_layout Whether
+   * requests and responses are shared with the Buffer as raw length-prefixed
+   * regions instead of serialized protobufs.
+   * @param enable_spare_worker_sandbox Whether a spare sandbox is kept started
+   * to replace the sandbox of the worker if it dies.
    * @param v8_flags List of flags to pass into v8. (Ex. {"--FLAG_1",
    * "--FLAG_2"})
    * @param enable_profilers Enable the V8 CPU and Heap Profilers
@@ -72,13 +93,19 @@ class WorkerSandboxApi {
   WorkerSandboxApi(
       bool require_preload, int native_js_function_comms_fd,
       const std::vector<std::string>& native_js_function_names,
+      const std::vector<std::string>& native_js_async_function_names,
       const std::vector<std::string>& rpc_method_names,
       const std::string& server_address, size_t max_worker_virtual_memory_mb,
       size_t js_engine_initial_heap_size_mb,
       size_t js_engine_maximum_heap_size_mb,
       size_t js_engine_max_wasm_memory_number_of_pages,
+      size_t js_engine_context_pool_size, size_t js_engine_context_max_uses,
+      uint32_t invocation_resource_metrics,
       size_t sandbox_request_response_shared_buffer_size_mb,
+      int sandbox_request_response_shared_buffer_slot_count,
       bool enable_sandbox_sharing_request_response_with_buffer_only,
+      bool enable_sandbox_sharing_request_response_with_raw_layout,
+      bool enable_spare_worker_sandbox,
       const std::vector<std::string>& v8_flags, bool enable_profilers,
       bool logging_function_set, bool disable_udf_stacktraces_in_response);
 
@@ -99,6 +126,21 @@ class WorkerSandboxApi {
 
   void Terminate();
 
+  /**
+   * @brief The number of RunCode calls that may be in flight at once. Callers
+   * running more than one at a time get them pipelined through the worker.
+   * Known before Init, so that workers started on demand are counted too.
+   */
+  int SlotCount() const;
+
+  /**
+   * @brief Describes what the startup snapshots created by the worker depend
+   * on besides the loaded code: the V8 version and flags, and the native
+   * function bindings, whose callbacks a snapshot refers to by their index in
+   * the external references of the worker.
+   */
+  std::string SnapshotEnvironment() const;
+
  protected:
   std::pair<absl::Status, RetryStatus> InternalRunCode(
       ::worker_api::WorkerParamsProto& params);
@@ -115,24 +157,40 @@ class WorkerSandboxApi {
   bool require_preload_;
   int native_js_function_comms_fd_;
   std::vector<std::string> native_js_function_names_;
+  std::vector<std::string> native_js_async_function_names_;
   std::vector<std::string> rpc_method_names_;
   std::string server_address_;
   size_t max_worker_virtual_memory_mb_;
   size_t js_engine_initial_heap_size_mb_;
   size_t js_engine_maximum_heap_size_mb_;
   size_t js_engine_max_wasm_memory_number_of_pages_;
+  const size_t js_engine_context_pool_size_;
+  const size_t js_engine_context_max_uses_;
+  const uint32_t invocation_resource_metrics_;
 
   // the pointer of the data shared sandbox2::Buffer which is used to share
   // input and output between the host process and the sandboxee.
   std::unique_ptr<sandbox2::Buffer> sandbox_data_shared_buffer_ptr_;
-  // The capacity size of the Buffer in bytes.
+  // The capacity size of each slot of the Buffer in bytes.
   size_t request_and_response_data_buffer_size_bytes_;
+  const int request_and_response_data_buffer_slot_count_;
   const bool enable_sandbox_sharing_request_response_with_buffer_only_;
+  const bool enable_sandbox_sharing_request_response_with_raw_layout_;
+  const bool enable_spare_worker_sandbox_;
   std::vector<std::string> v8_flags_;
   const bool enable_profilers_;
   const bool logging_function_set_;
   const bool disable_udf_stacktraces_in_response_;
 };
+
+/**
+ * @brief Inits and runs `workers`, starting up to `parallelism` of them at
+ * once, since each one launches a sandbox and boots a JS engine.
+ *
+ * @return The first error any worker failed to start with.
+ */
+absl::Status StartWorkers(absl::Span<WorkerSandboxApi> workers,
+                          int parallelism);
 }  // namespace google::scp::roma::sandbox::worker_api
 
 #endif  // ROMA_SANDBOX_WORKER_API_SAPI_WORKER_SANDBOX_API_H_
@@ -42,16 +42,63 @@ using ::testing::HasSubstr;
 using ::testing::StrEq;
 
 namespace google::scp::roma::sandbox::worker_api::test {
+namespace {
+WorkerSandboxApi WorkerWithBindings(
+    const std::vector<std::string>& function_names,
+    const std::vector<std::string>& async_function_names) {
+  return WorkerSandboxApi(
+      /*require_preload=*/false, /*native_js_function_comms_fd=*/-1,
+      function_names, async_function_names, /*rpc_method_names=*/{},
+      /*server_address=*/"", /*max_worker_virtual_memory_mb=*/0,
+      /*js_engine_initial_heap_size_mb=*/0,
+      /*js_engine_maximum_heap_size_mb=*/0,
+      /*js_engine_max_wasm_memory_number_of_pages=*/0,
+      /*js_engine_context_pool_size=*/0,
+      /*js_engine_context_max_uses=*/0,
+      /*invocation_resource_metrics=*/0,
+      /*sandbox_request_response_shared_buffer_size_mb=*/0,
+      /*sandbox_request_response_shared_buffer_slot_count=*/1,
+      /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+      /*enable_spare_worker_sandbox=*/false,
+      /*v8_flags=*/{},
+      /*enable_profilers=*/false,
+      /*logging_function_set=*/false,
+      /*disable_udf_stacktraces_in_response=*/false);
+}
+}  // namespace
+
+TEST(WorkerSandboxApiTest, SnapshotEnvironmentDependsOnBindings) {
+  const std::string environment =
+      WorkerWithBindings({"log", "fetch"}, {}).SnapshotEnvironment();
+  EXPECT_EQ(WorkerWithBindings({"log", "fetch"}, {}).SnapshotEnvironment(),
+            environment);
+  EXPECT_NE(WorkerWithBindings({"fetch", "log"}, {}).SnapshotEnvironment(),
+            environment);
+  EXPECT_NE(WorkerWithBindings({"log", "fetch"}, {"fetch"})
+                .SnapshotEnvironment(),
+            environment);
+  EXPECT_NE(WorkerWithBindings({"log"}, {}).SnapshotEnvironment(),
+            environment);
+}
+
 TEST(WorkerSandboxApiTest, WorkerWorksThroughSandbox) {
   WorkerSandboxApi sandbox_api(
       /*require_preload=*/false, /*native_js_function_comms_fd=*/-1,
-      /*native_js_function_names=*/{}, /*rpc_method_names=*/{},
+      /*native_js_function_names=*/{},
+      /*native_js_async_function_names=*/{}, /*rpc_method_names=*/{},
       /*server_address=*/"", /*max_worker_virtual_memory_mb=*/0,
       /*js_engine_initial_heap_size_mb=*/0,
       /*js_engine_maximum_heap_size_mb=*/0,
       /*js_engine_max_wasm_memory_number_of_pages=*/0,
+      /*js_engine_context_pool_size=*/0,
+      /*js_engine_context_max_uses=*/0,
+      /*invocation_resource_metrics=*/0,
       /*sandbox_request_response_shared_buffer_size_mb=*/0,
+      /*sandbox_request_response_shared_buffer_slot_count=*/1,
       /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+      /*enable_spare_worker_sandbox=*/false,
       /*v8_flags=*/{},
       /*enable_profilers=*/false,
       /*logging_function_set=*/false,
@@ -82,13 +129,20 @@ TEST(WorkerSandboxApiTest, WorkerWorksThroughSandbox) {
 TEST(WorkerSandboxApiTest, WorkerReturnsInformativeThrowMessageThroughSandbox) {
   WorkerSandboxApi sandbox_api(
       /*require_preload=*/false, /*native_js_function_comms_fd=*/-1,
-      /*native_js_function_names=*/{}, /*rpc_method_names=*/{},
+      /*native_js_function_names=*/{},
+      /*native_js_async_function_names=*/{}, /*rpc_method_names=*/{},
       /*server_address=*/"",
       /*max_worker_virtual_memory_mb=*/0, /*js_engine_initial_heap_size_mb=*/0,
       /*js_engine_maximum_heap_size_mb=*/0,
       /*js_engine_max_wasm_memory_number_of_pages=*/0,
+      /*js_engine_context_pool_size=*/0,
+      /*js_engine_context_max_uses=*/0,
+      /*invocation_resource_metrics=*/0,
       /*sandbox_request_response_shared_buffer_size_mb=*/0,
+      /*sandbox_request_response_shared_buffer_slot_count=*/1,
       /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+      /*enable_spare_worker_sandbox=*/false,
       /*v8_flags=*/{}, /*enable_profilers=*/false,
       /*logging_function_set=*/false,
       /*disable_udf_stacktraces_in_response=*/false);
@@ -117,13 +171,20 @@ TEST(WorkerSandboxApiTest, WorkerReturnsInformativeThrowMessageThroughSandbox) {
 TEST(WorkerSandboxApiTest, WorkerReturnsInformativeMessageForMissingParam) {
   WorkerSandboxApi sandbox_api(
       /*require_preload=*/false, /*native_js_function_comms_fd=*/-1,
-      /*native_js_function_names=*/{}, /*rpc_method_names=*/{},
+      /*native_js_function_names=*/{},
+      /*native_js_async_function_names=*/{}, /*rpc_method_names=*/{},
       /*server_address=*/"", /*max_worker_virtual_memory_mb=*/0,
       /*js_engine_initial_heap_size_mb=*/0,
       /*js_engine_maximum_heap_size_mb=*/0,
       /*js_engine_max_wasm_memory_number_of_pages=*/0,
+      /*js_engine_context_pool_size=*/0,
+      /*js_engine_context_max_uses=*/0,
+      /*invocation_resource_metrics=*/0,
       /*sandbox_request_response_shared_buffer_size_mb=*/0,
+      /*sandbox_request_response_shared_buffer_slot_count=*/1,
       /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+      /*enable_spare_worker_sandbox=*/false,
       /*v8_flags=*/{}, /*enable_cpu_profiler=*/false,
       /*logging_function_set=*/false,
       /*disable_udf_stacktraces_in_response=*/false);
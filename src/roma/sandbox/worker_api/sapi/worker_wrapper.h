@@ -17,11 +17,19 @@
 #ifndef ROMA_SANDBOX_WORKER_API_SAPI_WORKER_WRAPPER_H_
 #define ROMA_SANDBOX_WORKER_API_SAPI_WORKER_WRAPPER_H_
 
+#include <stdint.h>
+
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/buffer.h"
 #include "src/roma/sandbox/worker/worker.h"
 #include "src/roma/sandbox/worker_api/sapi/error_codes.h"
@@ -32,61 +40,168 @@
 
 namespace google::scp::roma::sandbox::worker_api {
 
+/**
+ * @brief Host side of the worker running in the sandbox.
+ *
+ * The Buffer is split into `request_and_response_data_buffer_slot_count`
+ * slots of `request_and_response_data_buffer_size_bytes` each. RunCode may be
+ * called concurrently: every call writes its request into a free slot and
+ * reads its response back from it without holding any lock, and only the call
+ * into the sandboxee itself is serialized. So while the sandboxee runs one
+ * request, the next one is being written into another slot.
+ *
+ * With `enable_spare_sandbox`, a second sandbox is initialized and started in
+ * the background, so that a sandbox which dies is replaced by swapping the
+ * spare in rather than by creating and initializing a new one. The spare is
+ * then replaced in the background.
+ */
 class WorkerWrapper {
  public:
   WorkerWrapper(bool enable_sandbox_sharing_request_response_with_buffer_only,
+                bool enable_sandbox_sharing_request_response_with_raw_layout,
                 size_t request_and_response_data_buffer_size_bytes,
+                int request_and_response_data_buffer_slot_count,
                 sandbox2::Buffer* sandbox_data_shared_buffer_ptr,
                 int native_js_function_comms_fd,
-                size_t max_worker_virtual_memory_mb)
+                size_t max_worker_virtual_memory_mb,
+                bool enable_spare_sandbox = false)
       : enable_sandbox_sharing_request_response_with_buffer_only_(
             enable_sandbox_sharing_request_response_with_buffer_only),
+        enable_sandbox_sharing_request_response_with_raw_layout_(
+            enable_sandbox_sharing_request_response_with_raw_layout),
         request_and_response_data_buffer_size_bytes_(
             request_and_response_data_buffer_size_bytes),
+        request_and_response_data_buffer_slot_count_(
+            request_and_response_data_buffer_slot_count),
         sandbox_data_shared_buffer_ptr_(sandbox_data_shared_buffer_ptr),
         native_js_function_comms_fd_(native_js_function_comms_fd),
-        max_worker_virtual_memory_mb_(max_worker_virtual_memory_mb) {}
+        max_worker_virtual_memory_mb_(max_worker_virtual_memory_mb),
+        enable_spare_sandbox_(enable_spare_sandbox),
+        free_slots_(request_and_response_data_buffer_slot_count) {
+    std::iota(free_slots_.rbegin(), free_slots_.rend(), 0);
+  }
+
+  ~WorkerWrapper() {
+    if (spare_sandbox_thread_.joinable()) {
+      spare_sandbox_thread_.join();
+    }
+  }
 
-  absl::Status Init(::worker_api::WorkerInitParamsProto& init_params);
+  absl::Status Init(::worker_api::WorkerInitParamsProto& init_params)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
 
-  absl::Status Run();
+  absl::Status Run() ABSL_LOCKS_EXCLUDED(sandbox_mu_, slots_mu_);
 
-  absl::Status Stop();
+  absl::Status Stop() ABSL_LOCKS_EXCLUDED(sandbox_mu_);
 
   std::pair<absl::Status, RetryStatus> RunCode(
-      ::worker_api::WorkerParamsProto& params);
+      ::worker_api::WorkerParamsProto& params)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_, slots_mu_);
 
   void Terminate();
 
+  /**
+   * @brief The number of RunCode calls which can be in flight at once.
+   */
+  int SlotCount() const;
+
  protected:
-  void WarmUpSandbox();
+  // A sandbox with an initialized worker.
+  struct Sandbox {
+    std::unique_ptr<WorkerSapiSandbox> sapi_sandbox;
+    // Must be destroyed before the sandbox it calls into.
+    std::unique_ptr<WorkerWrapperApi> api;
+  };
+
+  void WarmUpSandbox(int slot) ABSL_LOCKS_EXCLUDED(sandbox_mu_);
+
+  // Blocks until a slot of the Buffer is free and takes it.
+  int AcquireSlot() ABSL_LOCKS_EXCLUDED(slots_mu_);
+
+  void ReleaseSlot(int slot) ABSL_LOCKS_EXCLUDED(slots_mu_);
+
+  uint8_t* SlotData(int slot) const;
+
+  absl::Status InitSandbox(::worker_api::WorkerInitParamsProto& init_params)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(sandbox_mu_);
+
+  // Starts the worker inside of an initialized sandbox.
+  absl::Status StartWorker() ABSL_EXCLUSIVE_LOCKS_REQUIRED(sandbox_mu_);
+
+  // Restarts the sandbox which died while running generation
+  // `failed_generation` of it, unless a concurrent RunCode already did so.
+  absl::Status RestartSandbox(int slot, uint64_t failed_generation)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
+
+  std::pair<absl::Status, RetryStatus> RunCodeInSlot(
+      ::worker_api::WorkerParamsProto& params, int slot)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
 
   bool SandboxIsInitialized();
 
-  absl::Status CreateWorkerSapiSandbox();
+  // Creates a sandbox and initializes the worker in it, without touching the
+  // sandbox in use.
+  absl::StatusOr<Sandbox> CreateSandbox(
+      ::worker_api::WorkerInitParamsProto init_params);
+
+  // Creates, initializes and starts the spare sandbox on a separate thread.
+  void PrepareSpareSandbox() ABSL_EXCLUSIVE_LOCKS_REQUIRED(sandbox_mu_);
 
-  int TransferFdAndGetRemoteFd(std::unique_ptr<::sapi::v::Fd> local_fd);
+  // Waits for the spare sandbox and takes it, if it could be started.
+  std::optional<Sandbox> TakeSpareSandbox()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(sandbox_mu_);
 
-  absl::Status TransferFds();
+  void TerminateSandbox() ABSL_EXCLUSIVE_LOCKS_REQUIRED(sandbox_mu_);
+
+  int TransferFdAndGetRemoteFd(WorkerSapiSandbox& sandbox,
+                               std::unique_ptr<::sapi::v::Fd> local_fd);
+
+  absl::Status TransferFds(WorkerSapiSandbox& sandbox,
+                           ::worker_api::WorkerInitParamsProto& init_params);
 
   std::pair<absl::Status, RetryStatus> InternalRunCode(
-      ::worker_api::WorkerParamsProto& params);
+      ::worker_api::WorkerParamsProto& params, int slot)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
 
   std::pair<absl::Status, RetryStatus> InternalRunCodeBufferShareOnly(
-      ::worker_api::WorkerParamsProto& params);
+      ::worker_api::WorkerParamsProto& params, int slot)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
+
+  // Shares the request with the Buffer in the raw layout of
+  // shared_buffer_layout.h. Falls back to InternalRunCode if the request does
+  // not fit into the Buffer, unless sharing is restricted to the Buffer.
+  std::pair<absl::Status, RetryStatus> InternalRunCodeRawLayout(
+      ::worker_api::WorkerParamsProto& params, int slot)
+      ABSL_LOCKS_EXCLUDED(sandbox_mu_);
 
   std::unique_ptr<google::scp::roma::sandbox::worker::Worker> worker_;
   const bool enable_sandbox_sharing_request_response_with_buffer_only_;
+  const bool enable_sandbox_sharing_request_response_with_raw_layout_;
+  // The capacity of each slot of the Buffer in bytes.
   size_t request_and_response_data_buffer_size_bytes_;
+  const int request_and_response_data_buffer_slot_count_;
   sandbox2::Buffer* sandbox_data_shared_buffer_ptr_;
   // See BUILD file for named library "WorkerWrapper" in the
   // sapi_library worker_wrapper-sapi target.
   std::unique_ptr<WorkerWrapperApi> worker_wrapper_sapi_;
   int native_js_function_comms_fd_;
   size_t max_worker_virtual_memory_mb_;
+  const bool enable_spare_sandbox_;
 
   std::unique_ptr<WorkerSapiSandbox> worker_sapi_sandbox_;
   ::worker_api::WorkerInitParamsProto init_params_;
+
+  // Serializes calls into the sandboxee, which runs one request at a time, and
+  // restarts of the sandbox.
+  absl::Mutex sandbox_mu_;
+  // Incremented whenever the sandbox is (re)initialized.
+  uint64_t sandbox_generation_ ABSL_GUARDED_BY(sandbox_mu_) = 0;
+  std::thread spare_sandbox_thread_ ABSL_GUARDED_BY(sandbox_mu_);
+  absl::Mutex spare_sandbox_mu_;
+  bool preparing_spare_sandbox_ ABSL_GUARDED_BY(spare_sandbox_mu_) = false;
+  std::optional<Sandbox> spare_sandbox_ ABSL_GUARDED_BY(spare_sandbox_mu_);
+  absl::Mutex slots_mu_;
+  std::vector<int> free_slots_ ABSL_GUARDED_BY(slots_mu_);
 };
 
 }  // namespace google::scp::roma::sandbox::worker_api
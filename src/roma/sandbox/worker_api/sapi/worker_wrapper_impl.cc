@@ -35,6 +35,7 @@
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_function_binding.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_js_engine.h"
 #include "src/roma/sandbox/worker/worker.h"
+#include "src/roma/sandbox/worker_api/sapi/shared_buffer_layout.h"
 #include "src/roma/sandbox/worker_api/sapi/utils.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_init_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
@@ -47,6 +48,9 @@ using google::scp::roma::sandbox::constants::
     kExecutionMetricJsEngineCallDuration;
 using google::scp::roma::sandbox::constants::kJsEngineOneTimeSetupV8FlagsKey;
 using google::scp::roma::sandbox::constants::kJsEngineOneTimeSetupWasmPagesKey;
+using google::scp::roma::sandbox::constants::kStartupSnapshot;
+using google::scp::roma::sandbox::js_engine::BatchInvocation;
+using google::scp::roma::sandbox::js_engine::ExecutionResponse;
 using google::scp::roma::sandbox::js_engine::v8_js_engine::
     V8IsolateFunctionBinding;
 using google::scp::roma::sandbox::js_engine::v8_js_engine::V8JsEngine;
@@ -54,7 +58,9 @@ using google::scp::roma::sandbox::worker::Worker;
 using google::scp::roma::sandbox::worker_api::ClearInputFields;
 using google::scp::roma::sandbox::worker_api::CreateWorker;
 using google::scp::roma::sandbox::worker_api::GetEngineOneTimeSetup;
+using google::scp::roma::sandbox::worker_api::ReadRequestFromBuffer;
 using google::scp::roma::sandbox::worker_api::V8WorkerEngineParams;
+using google::scp::roma::sandbox::worker_api::WriteResponseToBuffer;
 using sandbox2::Buffer;
 
 namespace {
@@ -62,6 +68,7 @@ namespace {
 // the pointer of the data shared sandbox2::Buffer which is used to share
 // data between the host process and the sandboxee.
 std::unique_ptr<Buffer> sandbox_data_shared_buffer_ptr_{nullptr};
+// The capacity of each slot of the Buffer in bytes.
 size_t request_and_response_data_buffer_size_bytes_{0};
 
 std::unique_ptr<Worker> worker_{nullptr};
@@ -81,6 +88,10 @@ SapiStatusCode Init(worker_api::WorkerInitParamsProto* init_params) {
       init_params->native_js_function_names().begin(),
       init_params->native_js_function_names().end());
 
+  std::vector<std::string> native_js_async_function_names(
+      init_params->native_js_async_function_names().begin(),
+      init_params->native_js_async_function_names().end());
+
   std::vector<std::string> rpc_method_names(
       init_params->rpc_method_names().begin(),
       init_params->rpc_method_names().end());
@@ -97,6 +108,8 @@ SapiStatusCode Init(worker_api::WorkerInitParamsProto* init_params) {
   V8WorkerEngineParams v8_params = {
       .native_js_function_comms_fd = init_params->native_js_function_comms_fd(),
       .native_js_function_names = std::move(native_js_function_names),
+      .native_js_async_function_names =
+          std::move(native_js_async_function_names),
       .rpc_method_names = std::move(rpc_method_names),
       .server_address = init_params->server_address(),
       .resource_constraints = resource_constraints,
@@ -109,6 +122,11 @@ SapiStatusCode Init(worker_api::WorkerInitParamsProto* init_params) {
       .logging_function_set = init_params->logging_function_set(),
       .disable_udf_stacktraces_in_response =
           init_params->disable_udf_stacktraces_in_response(),
+      .context_pool_size =
+          static_cast<size_t>(init_params->js_engine_context_pool_size()),
+      .context_max_uses =
+          static_cast<size_t>(init_params->js_engine_context_max_uses()),
+      .invocation_resource_metrics = init_params->invocation_resource_metrics(),
   };
 
   worker_ = CreateWorker(v8_params);
@@ -131,30 +149,110 @@ SapiStatusCode Init(worker_api::WorkerInitParamsProto* init_params) {
   return SapiStatusCode::kOk;
 }
 
-SapiStatusCode RunCode(worker_api::WorkerParamsProto* params) {
-  if (!worker_) {
-    return SapiStatusCode::kUninitializedWorker;
-  }
-
-  const auto& code = params->code();
-
-  // WorkerParamsProto one of for `input_strings` or `input_bytes` or neither.
+// WorkerParamsProto one of for `input_strings` or `input_bytes` or neither.
+std::vector<std::string_view> GetInputs(
+    const worker_api::WorkerParamsProto& params) {
   std::vector<std::string_view> input;
-  auto input_type = params->metadata().find(
+  auto input_type = params.metadata().find(
       google::scp::roma::sandbox::constants::kInputType);
-  if (input_type != params->metadata().end() &&
-      input_type->second ==
-          google::scp::roma::sandbox::constants::kInputTypeBytes) {
-    input.push_back(params->input_bytes());
+  if (input_type != params.metadata().end() &&
+      (input_type->second ==
+           google::scp::roma::sandbox::constants::kInputTypeBytes ||
+       input_type->second ==
+           google::scp::roma::sandbox::constants::kInputTypeSerializedValue)) {
+    input.push_back(params.input_bytes());
   } else {
-    input.reserve(params->input_strings().inputs_size());
-    for (int i = 0; i < params->input_strings().inputs_size(); i++) {
-      input.push_back(params->input_strings().inputs().at(i));
+    input.reserve(params.input_strings().inputs_size());
+    for (int i = 0; i < params.input_strings().inputs_size(); i++) {
+      input.push_back(params.input_strings().inputs().at(i));
+    }
+  }
+  return input;
+}
+
+// Copies the response of an invocation, or its error, into `params`.
+SapiStatusCode SetResponse(absl::StatusOr<ExecutionResponse> response_or,
+                           worker_api::WorkerParamsProto* params) {
+  if (!response_or.ok()) {
+    params->set_error_message(std::string(response_or.status().message()));
+    return SapiStatusCode::kExecutionFailed;
+  }
+
+  for (const auto& pair : response_or.value().metrics) {
+    auto duration =
+        privacy_sandbox::server_common::EncodeGoogleApiProto(pair.second);
+    if (!duration.ok()) {
+      return SapiStatusCode::kInvalidDuration;
     }
+    (*params->mutable_metrics())[pair.first] = std::move(duration).value();
   }
+  params->mutable_counters()->insert(response_or.value().counters.begin(),
+                                     response_or.value().counters.end());
+
+  params->set_response(std::move(response_or.value().response));
+  params->set_profiler_output(std::move(response_or.value().profiler_output));
+  if (!response_or.value().startup_snapshot.empty()) {
+    params->set_startup_snapshot(
+        std::move(response_or.value().startup_snapshot));
+  }
+  return SapiStatusCode::kOk;
+}
 
+// Runs every element of `params->batch()` with a single call into the worker.
+// A failed element only records its error, so that the other elements of the
+// batch still get their responses.
+SapiStatusCode RunBatch(worker_api::WorkerParamsProto* params) {
+  std::vector<BatchInvocation> batch;
+  batch.reserve(params->batch_size());
+  for (const worker_api::WorkerParamsProto& element : params->batch()) {
+    batch.push_back(BatchInvocation{
+        .input = GetInputs(element),
+        .metadata = {element.metadata().begin(), element.metadata().end()},
+    });
+  }
   const absl::flat_hash_map<std::string_view, std::string_view> metadata(
       params->metadata().begin(), params->metadata().end());
+
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  auto responses_or = worker_->RunCodeBatch(metadata, batch);
+  auto js_duration = privacy_sandbox::server_common::EncodeGoogleApiProto(
+      stopwatch.GetElapsedTime());
+  if (!js_duration.ok()) {
+    return SapiStatusCode::kInvalidDuration;
+  }
+  (*params->mutable_metrics())[kExecutionMetricJsEngineCallDuration] =
+      std::move(js_duration).value();
+
+  if (!responses_or.ok()) {
+    params->set_error_message(std::string(responses_or.status().message()));
+    return SapiStatusCode::kExecutionFailed;
+  }
+  for (int i = 0; i < params->batch_size(); ++i) {
+    if (const SapiStatusCode status = SetResponse(
+            std::move((*responses_or)[i]), params->mutable_batch(i));
+        status != SapiStatusCode::kOk &&
+        status != SapiStatusCode::kExecutionFailed) {
+      return status;
+    }
+  }
+  return SapiStatusCode::kOk;
+}
+
+SapiStatusCode RunCode(worker_api::WorkerParamsProto* params,
+                       const std::vector<std::string_view>& input) {
+  if (!worker_) {
+    return SapiStatusCode::kUninitializedWorker;
+  }
+  if (params->batch_size() > 0) {
+    return RunBatch(params);
+  }
+
+  const auto& code = params->code();
+  absl::flat_hash_map<std::string_view, std::string_view> metadata(
+      params->metadata().begin(), params->metadata().end());
+  if (params->has_startup_snapshot()) {
+    metadata[kStartupSnapshot] = params->startup_snapshot();
+  }
   auto wasm_bin = reinterpret_cast<const uint8_t*>(params->wasm().c_str());
   absl::Span<const uint8_t> wasm =
       absl::MakeConstSpan(wasm_bin, params->wasm().length());
@@ -168,23 +266,55 @@ SapiStatusCode RunCode(worker_api::WorkerParamsProto* params) {
   }
   (*params->mutable_metrics())[kExecutionMetricJsEngineCallDuration] =
       std::move(js_duration).value();
+  // Don't send the snapshot of the request back.
+  params->clear_startup_snapshot();
+  return SetResponse(std::move(response_or), params);
+}
 
-  if (!response_or.ok()) {
-    params->set_error_message(std::string(response_or.status().message()));
-    return SapiStatusCode::kExecutionFailed;
+SapiStatusCode RunCode(worker_api::WorkerParamsProto* params) {
+  return RunCode(params, GetInputs(*params));
+}
+
+// Returns the start of `slot` in the Buffer, or nullptr if the Buffer does not
+// hold such a slot.
+uint8_t* GetSlotData(int slot) {
+  if (slot < 0 || (slot + 1) * request_and_response_data_buffer_size_bytes_ >
+                      sandbox_data_shared_buffer_ptr_->size()) {
+    LOG(ERROR) << "Slot " << slot << " is outside of the Buffer of size "
+               << sandbox_data_shared_buffer_ptr_->size() << " Bytes";
+    return nullptr;
   }
+  return sandbox_data_shared_buffer_ptr_->data() +
+         slot * request_and_response_data_buffer_size_bytes_;
+}
 
-  for (const auto& pair : response_or.value().metrics) {
-    auto duration =
-        privacy_sandbox::server_common::EncodeGoogleApiProto(pair.second);
-    if (!duration.ok()) {
-      return SapiStatusCode::kInvalidDuration;
-    }
-    (*params->mutable_metrics())[pair.first] = std::move(duration).value();
+// Serializes `params` into `data`, replacing its previous contents.
+SapiStatusCode ShareResponseWithLenVal(
+    const worker_api::WorkerParamsProto& params, sapi::LenValStruct* data) {
+  const size_t serialized_size = params.ByteSizeLong();
+  uint8_t* serialized_data = static_cast<uint8_t*>(malloc(serialized_size));
+  if (!serialized_data) {
+    LOG(ERROR) << "Failed to allocate uint8_t* serialized_data with size of "
+               << serialized_size;
+    return SapiStatusCode::kCouldNotSerializeResponseData;
   }
 
-  params->set_response(std::move(response_or.value().response));
-  params->set_profiler_output(std::move(response_or.value().profiler_output));
+  if (!params.SerializeToArray(serialized_data, serialized_size)) {
+    LOG(ERROR) << "Failed to serialize run_code response into uint8_t* "
+                  "serialized_data with serialized_size of "
+               << serialized_size;
+    // In this failure scenario, free the buffer.
+    // We don't free it otherwise, as it is free'd in the destructor of the
+    // LenValStruct* passed to this function, which is owned by SAPI.
+    free(serialized_data);
+    return SapiStatusCode::kCouldNotSerializeResponseData;
+  }
+
+  // Free old data
+  free(data->data);
+
+  data->data = serialized_data;
+  data->size = serialized_size;
   return SapiStatusCode::kOk;
 }
 
@@ -217,7 +347,7 @@ SapiStatusCode Stop() {
   return SapiStatusCode::kOk;
 }
 
-SapiStatusCode RunCodeFromSerializedData(sapi::LenValStruct* data,
+SapiStatusCode RunCodeFromSerializedData(int slot, sapi::LenValStruct* data,
                                          int input_serialized_size,
                                          size_t* output_serialized_size) {
   ROMA_VLOG(1)
@@ -226,14 +356,17 @@ SapiStatusCode RunCodeFromSerializedData(sapi::LenValStruct* data,
   if (!sandbox_data_shared_buffer_ptr_) {
     return SapiStatusCode::kValidSandboxBufferRequired;
   }
+  uint8_t* const slot_data = GetSlotData(slot);
+  if (slot_data == nullptr) {
+    return SapiStatusCode::kInvalidBufferSlot;
+  }
 
   worker_api::WorkerParamsProto params;
 
   // If input_serialized_size is greater than zero, then the data is shared by
   // the buffer.
   if (input_serialized_size > 0) {
-    if (!params.ParseFromArray(sandbox_data_shared_buffer_ptr_->data(),
-                               input_serialized_size)) {
+    if (!params.ParseFromArray(slot_data, input_serialized_size)) {
       LOG(ERROR) << "Could not deserialize run_code request from sandbox "
                     "buffer. The input_serialized_size in Bytes is "
                  << input_serialized_size;
@@ -259,8 +392,7 @@ SapiStatusCode RunCodeFromSerializedData(sapi::LenValStruct* data,
     ROMA_VLOG(1) << "Response data sharing with Buffer";
 
     // Write the response into Buffer.
-    if (!params.SerializeToArray(sandbox_data_shared_buffer_ptr_->data(),
-                                 serialized_size)) {
+    if (!params.SerializeToArray(slot_data, serialized_size)) {
       LOG(ERROR) << "Failed to serialize run_code response into buffer with "
                     "serialized_size in Bytes "
                  << serialized_size;
@@ -275,30 +407,11 @@ SapiStatusCode RunCodeFromSerializedData(sapi::LenValStruct* data,
                  << request_and_response_data_buffer_size_bytes_
                  << "Bytes. Data sharing with Bytes";
 
-    uint8_t* serialized_data = static_cast<uint8_t*>(malloc(serialized_size));
-    if (!serialized_data) {
-      LOG(ERROR) << "Failed to allocate uint8_t* serialized_data with size of "
-                 << serialized_size;
-      return SapiStatusCode::kCouldNotSerializeResponseData;
+    if (const SapiStatusCode status = ShareResponseWithLenVal(params, data);
+        status != SapiStatusCode::kOk) {
+      return status;
     }
 
-    if (!params.SerializeToArray(serialized_data, serialized_size)) {
-      LOG(ERROR) << "Failed to serialize run_code response into uint8_t* "
-                    "serialized_data with serialized_size of "
-                 << serialized_size;
-      // In this failure scenario, free the buffer.
-      // We don't free it otherwise, as it is free'd in the destructor of the
-      // LenValStruct* passed to this function, which is owned by SAPI.
-      free(serialized_data);
-      return SapiStatusCode::kCouldNotSerializeResponseData;
-    }
-
-    // Free old data
-    free(data->data);
-
-    data->data = serialized_data;
-    data->size = serialized_size;
-
     // output_serialized_size set to 0 to indicate the response shared by Bytes.
     *output_serialized_size = 0;
   }
@@ -307,17 +420,20 @@ SapiStatusCode RunCodeFromSerializedData(sapi::LenValStruct* data,
   return result;
 }
 
-SapiStatusCode RunCodeFromBuffer(int input_serialized_size,
+SapiStatusCode RunCodeFromBuffer(int slot, int input_serialized_size,
                                  size_t* output_serialized_size) {
   ROMA_VLOG(1) << "Worker wrapper RunCodeFromBuffer() received the request";
 
   if (!sandbox_data_shared_buffer_ptr_) {
     return SapiStatusCode::kValidSandboxBufferRequired;
   }
+  uint8_t* const slot_data = GetSlotData(slot);
+  if (slot_data == nullptr) {
+    return SapiStatusCode::kInvalidBufferSlot;
+  }
 
   worker_api::WorkerParamsProto params;
-  if (!params.ParseFromArray(sandbox_data_shared_buffer_ptr_->data(),
-                             input_serialized_size)) {
+  if (!params.ParseFromArray(slot_data, input_serialized_size)) {
     LOG(ERROR) << "Could not deserialize run_code request from sandbox";
     return SapiStatusCode::kCouldNotDeserializeRunData;
   }
@@ -339,8 +455,7 @@ SapiStatusCode RunCodeFromBuffer(int input_serialized_size,
     return SapiStatusCode::kResponseLargerThanBuffer;
   }
 
-  if (!params.SerializeToArray(sandbox_data_shared_buffer_ptr_->data(),
-                               serialized_size)) {
+  if (!params.SerializeToArray(slot_data, serialized_size)) {
     LOG(ERROR) << "Failed to serialize run_code response into buffer";
     return SapiStatusCode::kCouldNotSerializeResponseData;
   }
@@ -350,3 +465,53 @@ SapiStatusCode RunCodeFromBuffer(int input_serialized_size,
   ROMA_VLOG(1) << "Worker wrapper successfully executed the request";
   return result;
 }
+
+SapiStatusCode RunCodeFromRawBuffer(int slot, sapi::LenValStruct* data,
+                                    int input_size, size_t* output_size) {
+  ROMA_VLOG(1) << "Worker wrapper RunCodeFromRawBuffer() received the request";
+
+  if (!sandbox_data_shared_buffer_ptr_) {
+    return SapiStatusCode::kValidSandboxBufferRequired;
+  }
+  uint8_t* const slot_data = GetSlotData(slot);
+  if (slot_data == nullptr) {
+    return SapiStatusCode::kInvalidBufferSlot;
+  }
+
+  // The inputs are read in place, so the Buffer must not be written until
+  // the request has run.
+  auto request =
+      ReadRequestFromBuffer(absl::MakeConstSpan(slot_data, input_size));
+  if (!request.ok()) {
+    LOG(ERROR) << "Could not read run_code request from the Buffer: "
+               << request.status();
+    return SapiStatusCode::kCouldNotDeserializeRunData;
+  }
+
+  worker_api::WorkerParamsProto& params = request->params;
+  const auto result = RunCode(&params, request->inputs);
+  if (result != SapiStatusCode::kOk && params.error_message().empty()) {
+    return result;
+  }
+
+  // Don't return the code.
+  ClearInputFields(params);
+
+  if (auto written = WriteResponseToBuffer(
+          params, absl::MakeSpan(slot_data,
+                                 request_and_response_data_buffer_size_bytes_));
+      written.ok()) {
+    *output_size = *written;
+  } else {
+    ROMA_VLOG(1) << written.status() << " Data sharing with Bytes";
+    if (const SapiStatusCode status = ShareResponseWithLenVal(params, data);
+        status != SapiStatusCode::kOk) {
+      return status;
+    }
+    // output_size set to 0 to indicate the response shared by Bytes.
+    *output_size = 0;
+  }
+
+  ROMA_VLOG(1) << "Worker wrapper successfully executed the request";
+  return result;
+}
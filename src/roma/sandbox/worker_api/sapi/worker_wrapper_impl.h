@@ -44,6 +44,10 @@ extern "C" SapiStatusCode Stop();
 /// the second mechanism is used.
 /// <b>Sharing by SAPI variable sapi::LenValStruct<b>: This mechanism allows
 /// sharing data of any size.
+/// The Buffer is split into equally sized slots so that the host can write the
+/// next request into one slot while the sandboxee runs the request in another.
+/// @param slot The index of the Buffer slot holding the request and receiving
+/// the response.
 /// @param data The request and response data are shared with the SAPI variable
 /// sapi::LenValStruct when they are passed into or out of the sandboxee.
 /// @param input_serialized_size The input variable serialized_size is used to
@@ -52,16 +56,36 @@ extern "C" SapiStatusCode Stop();
 /// deserialize the response protobuf from the Buffer data in the host binary.
 /// @return
 extern "C" SapiStatusCode RunCodeFromSerializedData(
-    sapi::LenValStruct* data, int input_serialized_size,
+    int slot, sapi::LenValStruct* data, int input_serialized_size,
     size_t* output_serialized_size);
 
 /// @brief The sandbox API, in which the data shared with the Buffer only.
+/// @param slot The index of the Buffer slot holding the request and receiving
+/// the response.
 /// @param input_serialized_size The input variable serialized_size is used to
 /// deserialize the request protobuf from the Buffer data inside the sandboxee.
 /// @param output_serialized_size The output variable serialized_size is used to
 /// deserialize the response protobuf from the Buffer data in the host binary.
 /// @return
-extern "C" SapiStatusCode RunCodeFromBuffer(int input_serialized_size,
+extern "C" SapiStatusCode RunCodeFromBuffer(int slot,
+                                            int input_serialized_size,
                                             size_t* output_serialized_size);
 
+/// @brief The sandbox API, in which the request is shared with the Buffer in
+/// the raw layout of shared_buffer_layout.h, so that the inputs are read in
+/// place. The response is shared in the same layout if it fits into the
+/// Buffer, and as a serialized protobuf in `data` otherwise.
+/// @param slot The index of the Buffer slot holding the request and receiving
+/// the response.
+/// @param data Holds the serialized response protobuf when the response is
+/// larger than the Buffer.
+/// @param input_size The size of the request in the Buffer.
+/// @param output_size The size of the response in the Buffer, or zero if the
+/// response is shared with `data`.
+/// @return
+extern "C" SapiStatusCode RunCodeFromRawBuffer(int slot,
+                                               sapi::LenValStruct* data,
+                                               int input_size,
+                                               size_t* output_size);
+
 #endif  // ROMA_SANDBOX_WORKER_API_SAPI_WORKER_WRAPPER_H_
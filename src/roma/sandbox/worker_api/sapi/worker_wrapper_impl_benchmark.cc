@@ -23,6 +23,7 @@
 #include "sandboxed_api/sandbox2/buffer.h"
 #include "src/roma/sandbox/constants/constants.h"
 #include "src/roma/sandbox/worker_api/sapi/error_codes.h"
+#include "src/roma/sandbox/worker_api/sapi/shared_buffer_layout.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_init_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_wrapper_impl.h"
@@ -34,6 +35,8 @@ using google::scp::roma::sandbox::constants::kRequestActionExecute;
 using google::scp::roma::sandbox::constants::kRequestId;
 using google::scp::roma::sandbox::constants::kRequestType;
 using google::scp::roma::sandbox::constants::kRequestTypeJavascript;
+using google::scp::roma::sandbox::worker_api::ReadResponseFromBuffer;
+using google::scp::roma::sandbox::worker_api::WriteRequestToBuffer;
 using ::testing::StrEq;
 
 namespace {
@@ -98,7 +101,8 @@ void BM_RunCodeFromSerializedData(benchmark::State& state) {
         params_proto.SerializeToArray(buffer_ptr_->data(), serialized_size));
     size_t output_serialized_size_ptr;
     ASSERT_EQ(SapiStatusCode::kOk,
-              ::RunCodeFromSerializedData(&sapi_worker_params, serialized_size,
+              ::RunCodeFromSerializedData(/*slot=*/0, &sapi_worker_params,
+                                          serialized_size,
                                           &output_serialized_size_ptr));
 
     // The rest of the code in this block is to parse and validate the response.
@@ -141,7 +145,8 @@ void BM_RunCodeFromBuffer(benchmark::State& state) {
     size_t output_serialized_size_ptr;
     ASSERT_EQ(
         SapiStatusCode::kOk,
-        ::RunCodeFromBuffer(serialized_size, &output_serialized_size_ptr));
+        ::RunCodeFromBuffer(/*slot=*/0, serialized_size,
+                            &output_serialized_size_ptr));
 
     // The rest of the code in this block is to parse and validate the response.
     // We could ignore this and focus the benchmark on just the line above, but
@@ -156,10 +161,108 @@ void BM_RunCodeFromBuffer(benchmark::State& state) {
   EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
 }
 
+// Returns a request whose single input is a JSON string of `input_size`
+// bytes. The handler returns the length of the input.
+::worker_api::WorkerParamsProto GetWorkerParamsProtoWithInput(
+    int input_size) {
+  ::worker_api::WorkerParamsProto params_proto = GetWorkerParamsProto();
+  params_proto.set_code(
+      R"js(function cool_func(input) { return input.length; })js");
+  params_proto.mutable_input_strings()->add_inputs(
+      "\"" + std::string(input_size, 'A') + "\"");
+  return params_proto;
+}
+
+void BM_RunCodeFromBufferWithInput(benchmark::State& state) {
+  auto buffer = sandbox2::Buffer::CreateWithSize(kBufferSize);
+  ASSERT_TRUE(buffer.ok());
+  std::unique_ptr<sandbox2::Buffer> buffer_ptr_ = std::move(buffer).value();
+
+  std::string serialized_init_params;
+  ASSERT_TRUE(GetDefaultInitParams(buffer_ptr_->fd())
+                  .SerializeToString(&serialized_init_params));
+
+  sapi::LenValStruct sapi_init_params(
+      serialized_init_params.size(),
+      static_cast<void*>(serialized_init_params.data()));
+
+  ASSERT_EQ(SapiStatusCode::kOk, ::InitFromSerializedData(&sapi_init_params));
+  ASSERT_EQ(SapiStatusCode::kOk, ::Run());
+
+  const int input_size = state.range(0);
+  const ::worker_api::WorkerParamsProto params_proto =
+      GetWorkerParamsProtoWithInput(input_size);
+  const int serialized_size = params_proto.ByteSizeLong();
+
+  for (auto _ : state) {
+    ASSERT_TRUE(
+        params_proto.SerializeToArray(buffer_ptr_->data(), serialized_size));
+    size_t output_serialized_size_ptr;
+    ASSERT_EQ(
+        SapiStatusCode::kOk,
+        ::RunCodeFromBuffer(/*slot=*/0, serialized_size,
+                            &output_serialized_size_ptr));
+
+    ::worker_api::WorkerParamsProto response_proto;
+    ASSERT_TRUE(response_proto.ParseFromArray(buffer_ptr_->data(),
+                                              output_serialized_size_ptr));
+    EXPECT_THAT(response_proto.response(), StrEq(std::to_string(input_size)));
+  }
+  state.SetBytesProcessed(state.iterations() * input_size);
+  EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
+}
+
+void BM_RunCodeFromRawBuffer(benchmark::State& state) {
+  auto buffer = sandbox2::Buffer::CreateWithSize(kBufferSize);
+  ASSERT_TRUE(buffer.ok());
+  std::unique_ptr<sandbox2::Buffer> buffer_ptr_ = std::move(buffer).value();
+
+  std::string serialized_init_params;
+  ASSERT_TRUE(GetDefaultInitParams(buffer_ptr_->fd())
+                  .SerializeToString(&serialized_init_params));
+
+  sapi::LenValStruct sapi_init_params(
+      serialized_init_params.size(),
+      static_cast<void*>(serialized_init_params.data()));
+
+  ASSERT_EQ(SapiStatusCode::kOk, ::InitFromSerializedData(&sapi_init_params));
+  ASSERT_EQ(SapiStatusCode::kOk, ::Run());
+
+  const int input_size = state.range(0);
+  ::worker_api::WorkerParamsProto params_proto =
+      GetWorkerParamsProtoWithInput(input_size);
+  sapi::LenValStruct sapi_worker_params;
+
+  for (auto _ : state) {
+    // The buffer is used for both input and output to the sandbox and so we
+    // have to write the request into it for each run.
+    const auto input_size_in_buffer = WriteRequestToBuffer(
+        params_proto, absl::MakeSpan(buffer_ptr_->data(), kBufferSize));
+    ASSERT_TRUE(input_size_in_buffer.ok());
+    size_t output_size;
+    ASSERT_EQ(SapiStatusCode::kOk,
+              ::RunCodeFromRawBuffer(/*slot=*/0, &sapi_worker_params,
+                                     *input_size_in_buffer, &output_size));
+
+    ::worker_api::WorkerParamsProto response_proto;
+    ASSERT_TRUE(ReadResponseFromBuffer(
+                    absl::MakeConstSpan(buffer_ptr_->data(), output_size),
+                    response_proto)
+                    .ok());
+    EXPECT_THAT(response_proto.response(), StrEq(std::to_string(input_size)));
+  }
+  state.SetBytesProcessed(state.iterations() * input_size);
+  EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
+}
+
 }  // namespace
 
 BENCHMARK(BM_RunCodeFromSerializedData);
 BENCHMARK(BM_RunCodeFromBuffer);
+BENCHMARK(BM_RunCodeFromBufferWithInput)
+    ->RangeMultiplier(8)
+    ->Range(1 << 10, 1 << 19);
+BENCHMARK(BM_RunCodeFromRawBuffer)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
 
 // Run the benchmark
 BENCHMARK_MAIN();
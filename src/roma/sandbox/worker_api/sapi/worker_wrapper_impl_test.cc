@@ -22,6 +22,7 @@
 #include <memory>
 #include <utility>
 
+#include "absl/strings/str_cat.h"
 #include "sandboxed_api/lenval_core.h"
 #include "sandboxed_api/sandbox2/buffer.h"
 #include "src/roma/sandbox/constants/constants.h"
@@ -92,8 +93,9 @@ TEST(WorkerWrapperImplTest,
 
   size_t output_serialized_size_ptr;
   sapi::LenValStruct sapi_worker_params;
-  auto result = ::RunCodeFromSerializedData(
-      &sapi_worker_params, serialized_size, &output_serialized_size_ptr);
+  auto result =
+      ::RunCodeFromSerializedData(/*slot=*/0, &sapi_worker_params,
+                                  serialized_size, &output_serialized_size_ptr);
 
   ASSERT_EQ(SapiStatusCode::kOk, result);
 
@@ -151,8 +153,8 @@ TEST(WorkerWrapperImplTest,
   auto sapi_worker_params = CreateLenValStruct(serialized_worker_params);
 
   size_t output_serialized_size_ptr;
-  auto result = ::RunCodeFromSerializedData(&sapi_worker_params, 0,
-                                            &output_serialized_size_ptr);
+  auto result = ::RunCodeFromSerializedData(
+      /*slot=*/0, &sapi_worker_params, 0, &output_serialized_size_ptr);
   ASSERT_EQ(SapiStatusCode::kOk, result);
 
   // Take ownership of the response bytes, these will have been malloc'd by
@@ -200,8 +202,8 @@ TEST(WorkerWrapperImplTest, OverSizeResponseSharedWithLenValStruct) {
   auto sapi_worker_params = CreateLenValStruct(serialized_worker_params);
 
   size_t output_serialized_size_ptr;
-  auto result = ::RunCodeFromSerializedData(&sapi_worker_params, 0,
-                                            &output_serialized_size_ptr);
+  auto result = ::RunCodeFromSerializedData(
+      /*slot=*/0, &sapi_worker_params, 0, &output_serialized_size_ptr);
   ASSERT_EQ(SapiStatusCode::kOk, result);
 
   // Take ownership of the response bytes, these will have been malloc'd by
@@ -241,8 +243,8 @@ TEST(WorkerWrapperImplTest, CanRunCodeWithBufferShareOnly) {
       params_proto.SerializeToArray(buffer_ptr_->data(), serialized_size));
 
   size_t output_serialized_size_ptr;
-  auto result =
-      ::RunCodeFromBuffer(serialized_size, &output_serialized_size_ptr);
+  auto result = ::RunCodeFromBuffer(/*slot=*/0, serialized_size,
+                                   &output_serialized_size_ptr);
 
   ASSERT_EQ(SapiStatusCode::kOk, result);
 
@@ -254,6 +256,63 @@ TEST(WorkerWrapperImplTest, CanRunCodeWithBufferShareOnly) {
   EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
 }
 
+TEST(WorkerWrapperImplTest, CanRunCodeInBufferSlots) {
+  constexpr int kSlotCount = 4;
+  constexpr size_t kSlotSize = kBufferSize / kSlotCount;
+  auto init_params = GetDefaultInitParams();
+  init_params.set_request_and_response_data_buffer_size_bytes(kSlotSize);
+  std::string serialized_init_params;
+  ASSERT_TRUE(init_params.SerializeToString(&serialized_init_params));
+
+  sapi::LenValStruct sapi_init_params(
+      serialized_init_params.size(),
+      static_cast<void*>(serialized_init_params.data()));
+
+  EXPECT_EQ(SapiStatusCode::kOk, ::InitFromSerializedData(&sapi_init_params));
+
+  EXPECT_EQ(SapiStatusCode::kOk, ::Run());
+
+  ::worker_api::WorkerParamsProto params_proto;
+  params_proto.set_code(
+      R"js(function cool_func(slot) { return "Hi from slot " + slot; })js");
+  (*params_proto.mutable_metadata())[kRequestType] = kRequestTypeJavascript;
+  (*params_proto.mutable_metadata())[kHandlerName] = "cool_func";
+  (*params_proto.mutable_metadata())[kCodeVersion] = "1";
+  (*params_proto.mutable_metadata())[kRequestAction] = kRequestActionExecute;
+
+  // Write a distinct request into every slot before running any of them, so
+  // that running one slot must not clobber the requests in the others.
+  for (int slot = 0; slot < kSlotCount; ++slot) {
+    params_proto.mutable_input_strings()->clear_inputs();
+    params_proto.mutable_input_strings()->add_inputs(absl::StrCat(slot));
+    ASSERT_TRUE(params_proto.SerializeToArray(
+        buffer_ptr_->data() + slot * kSlotSize, kSlotSize));
+  }
+  const int serialized_size = params_proto.ByteSizeLong();
+  for (int slot = kSlotCount - 1; slot >= 0; --slot) {
+    size_t output_serialized_size_ptr;
+    ASSERT_EQ(SapiStatusCode::kOk,
+              ::RunCodeFromBuffer(slot, serialized_size,
+                                  &output_serialized_size_ptr));
+
+    ::worker_api::WorkerParamsProto response_proto;
+    ASSERT_TRUE(response_proto.ParseFromArray(
+        buffer_ptr_->data() + slot * kSlotSize, output_serialized_size_ptr));
+    EXPECT_THAT(response_proto.response(),
+                StrEq(absl::StrCat("\"Hi from slot ", slot, "\"")));
+  }
+
+  size_t output_serialized_size_ptr;
+  EXPECT_EQ(SapiStatusCode::kInvalidBufferSlot,
+            ::RunCodeFromBuffer(kSlotCount, serialized_size,
+                                &output_serialized_size_ptr));
+  EXPECT_EQ(SapiStatusCode::kInvalidBufferSlot,
+            ::RunCodeFromBuffer(-1, serialized_size,
+                                &output_serialized_size_ptr));
+
+  EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
+}
+
 TEST(WorkerWrapperImplTest,
      ShouldFailRunCodeWithBufferShareOnlyIfResponseOversize) {
   auto init_params = GetDefaultInitParams();
@@ -286,8 +345,8 @@ TEST(WorkerWrapperImplTest,
       params_proto.SerializeToArray(buffer_ptr_->data(), serialized_size));
 
   size_t output_serialized_size_ptr;
-  auto result =
-      ::RunCodeFromBuffer(serialized_size, &output_serialized_size_ptr);
+  auto result = ::RunCodeFromBuffer(/*slot=*/0, serialized_size,
+                                   &output_serialized_size_ptr);
   EXPECT_EQ(result, SapiStatusCode::kResponseLargerThanBuffer);
 
   EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
@@ -324,8 +383,9 @@ TEST(WorkerWrapperImplTest,
 
   size_t output_serialized_size_ptr;
   sapi::LenValStruct sapi_worker_params;
-  auto result = ::RunCodeFromSerializedData(
-      &sapi_worker_params, serialized_size, &output_serialized_size_ptr);
+  auto result =
+      ::RunCodeFromSerializedData(/*slot=*/0, &sapi_worker_params,
+                                  serialized_size, &output_serialized_size_ptr);
   EXPECT_NE(result, SapiStatusCode::kOk);
 
   EXPECT_EQ(SapiStatusCode::kOk, ::Stop());
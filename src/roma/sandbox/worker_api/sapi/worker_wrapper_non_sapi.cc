@@ -19,15 +19,18 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
 #include "src/roma/config/config.h"
 #include "src/roma/logging/logging.h"
 #include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/sandbox/js_engine/js_engine.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_function_binding.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_js_engine.h"
 #include "src/roma/sandbox/worker/worker.h"
@@ -40,6 +43,8 @@
 #include "worker_wrapper.h"
 
 using google::scp::roma::JsEngineResourceConstraints;
+using google::scp::roma::sandbox::js_engine::BatchInvocation;
+using google::scp::roma::sandbox::js_engine::ExecutionResponse;
 using google::scp::roma::sandbox::constants::
     kExecutionMetricJsEngineCallDuration;
 using google::scp::roma::sandbox::constants::kJsEngineOneTimeSetupV8FlagsKey;
@@ -50,6 +55,96 @@ using google::scp::roma::sandbox::js_engine::v8_js_engine::V8JsEngine;
 using google::scp::roma::sandbox::worker::Worker;
 
 namespace google::scp::roma::sandbox::worker_api {
+namespace {
+// WorkerParamsProto one of for `input_strings` or `input_bytes` or neither.
+std::vector<std::string_view> GetInputs(
+    const ::worker_api::WorkerParamsProto& params) {
+  std::vector<std::string_view> input;
+  auto input_type =
+      params.metadata().find(google::scp::roma::sandbox::constants::kInputType);
+  if (input_type != params.metadata().end() &&
+      (input_type->second ==
+           google::scp::roma::sandbox::constants::kInputTypeBytes ||
+       input_type->second ==
+           google::scp::roma::sandbox::constants::kInputTypeSerializedValue)) {
+    input.push_back(params.input_bytes());
+  } else {
+    input.reserve(params.input_strings().inputs_size());
+    for (int i = 0; i < params.input_strings().inputs_size(); i++) {
+      input.push_back(params.input_strings().inputs().at(i));
+    }
+  }
+  return input;
+}
+
+// Copies the response of a batch element, or its error, into `params`. Only
+// fails if a metric cannot be converted.
+absl::Status SetBatchResponse(absl::StatusOr<ExecutionResponse> response_or,
+                              ::worker_api::WorkerParamsProto& params) {
+  if (!response_or.ok()) {
+    params.set_error_message(std::string(response_or.status().message()));
+    return absl::OkStatus();
+  }
+  for (const auto& pair : response_or.value().metrics) {
+    auto duration =
+        privacy_sandbox::server_common::EncodeGoogleApiProto(pair.second);
+    if (!duration.ok()) {
+      return absl::InvalidArgumentError("Failed to convert a duration");
+    }
+    (*params.mutable_metrics())[pair.first] = std::move(duration).value();
+  }
+  params.mutable_counters()->insert(response_or.value().counters.begin(),
+                                    response_or.value().counters.end());
+  params.set_response(std::move(response_or.value().response));
+  params.set_profiler_output(std::move(response_or.value().profiler_output));
+  return absl::OkStatus();
+}
+
+// Runs every element of `params.batch()` with a single call into the worker.
+// A failed element only records its error, so that the other elements of the
+// batch still get their responses.
+std::pair<absl::Status, RetryStatus> RunBatch(
+    Worker& worker, ::worker_api::WorkerParamsProto& params) {
+  std::vector<BatchInvocation> batch;
+  batch.reserve(params.batch_size());
+  for (const ::worker_api::WorkerParamsProto& element : params.batch()) {
+    batch.push_back(BatchInvocation{
+        .input = GetInputs(element),
+        .metadata = {element.metadata().begin(), element.metadata().end()},
+    });
+  }
+  const absl::flat_hash_map<std::string_view, std::string_view> metadata(
+      params.metadata().begin(), params.metadata().end());
+
+  privacy_sandbox::server_common::Stopwatch stopwatch;
+  auto responses_or = worker.RunCodeBatch(metadata, batch);
+  auto js_duration = privacy_sandbox::server_common::EncodeGoogleApiProto(
+      stopwatch.GetElapsedTime());
+  if (!js_duration.ok()) {
+    return WrapResultWithNoRetry(
+        absl::InvalidArgumentError("Failed to convert a duration"));
+  }
+  (*params.mutable_metrics())[kExecutionMetricJsEngineCallDuration] =
+      std::move(js_duration).value();
+
+  if (!responses_or.ok()) {
+    params.set_error_message(std::string(responses_or.status().message()));
+    privacy_sandbox::server_common::StatusBuilder builder(
+        absl::InternalError("Execution failed"));
+    builder << params.error_message();
+    return WrapResultWithNoRetry(builder);
+  }
+  for (int i = 0; i < params.batch_size(); ++i) {
+    if (absl::Status status = SetBatchResponse(std::move((*responses_or)[i]),
+                                               *params.mutable_batch(i));
+        !status.ok()) {
+      return WrapResultWithNoRetry(std::move(status));
+    }
+  }
+  return WrapResultWithNoRetry(absl::OkStatus());
+}
+}  // namespace
+
 absl::Status WorkerWrapper::Init(
     ::worker_api::WorkerInitParamsProto& init_params) {
   if (worker_) {
@@ -65,6 +160,10 @@ absl::Status WorkerWrapper::Init(
       init_params.native_js_function_names().begin(),
       init_params.native_js_function_names().end());
 
+  std::vector<std::string> native_js_async_function_names(
+      init_params.native_js_async_function_names().begin(),
+      init_params.native_js_async_function_names().end());
+
   std::vector<std::string> rpc_method_names(
       init_params.rpc_method_names().begin(),
       init_params.rpc_method_names().end());
@@ -81,6 +180,8 @@ absl::Status WorkerWrapper::Init(
   V8WorkerEngineParams v8_params = {
       .native_js_function_comms_fd = native_js_function_comms_fd_,
       .native_js_function_names = std::move(native_js_function_names),
+      .native_js_async_function_names =
+          std::move(native_js_async_function_names),
       .rpc_method_names = std::move(rpc_method_names),
       .server_address = init_params.server_address(),
       .resource_constraints = resource_constraints,
@@ -93,6 +194,11 @@ absl::Status WorkerWrapper::Init(
       .logging_function_set = init_params.logging_function_set(),
       .disable_udf_stacktraces_in_response =
           init_params.disable_udf_stacktraces_in_response(),
+      .context_pool_size =
+          static_cast<size_t>(init_params.js_engine_context_pool_size()),
+      .context_max_uses =
+          static_cast<size_t>(init_params.js_engine_context_max_uses()),
+      .invocation_resource_metrics = init_params.invocation_resource_metrics(),
   };
 
   worker_ = CreateWorker(v8_params);
@@ -103,30 +209,28 @@ absl::Status WorkerWrapper::Init(
 
 bool WorkerWrapper::SandboxIsInitialized() { return true; }
 
+int WorkerWrapper::SlotCount() const {
+  return request_and_response_data_buffer_slot_count_;
+}
+
 std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
-    ::worker_api::WorkerParamsProto& params) {
+    ::worker_api::WorkerParamsProto& params, int /*slot*/) {
   if (!worker_) {
     return WrapResultWithNoRetry(absl::FailedPreconditionError(
         "A call to run code was issued with an uninitialized worker"));
   }
+  if (params.batch_size() > 0) {
+    return RunBatch(*worker_, params);
+  }
   const auto& code = params.code();
 
-  // WorkerParamsProto one of for `input_strings` or `input_bytes` or neither.
-  std::vector<std::string_view> input;
-  auto input_type =
-      params.metadata().find(google::scp::roma::sandbox::constants::kInputType);
-  if (input_type != params.metadata().end() &&
-      input_type->second ==
-          google::scp::roma::sandbox::constants::kInputTypeBytes) {
-    input.push_back(params.input_bytes());
-  } else {
-    input.reserve(params.input_strings().inputs_size());
-    for (int i = 0; i < params.input_strings().inputs_size(); i++) {
-      input.push_back(params.input_strings().inputs().at(i));
-    }
-  }
-  const absl::flat_hash_map<std::string_view, std::string_view> metadata(
+  const std::vector<std::string_view> input = GetInputs(params);
+  absl::flat_hash_map<std::string_view, std::string_view> metadata(
       params.metadata().begin(), params.metadata().end());
+  if (params.has_startup_snapshot()) {
+    metadata[google::scp::roma::sandbox::constants::kStartupSnapshot] =
+        params.startup_snapshot();
+  }
   auto wasm_bin = reinterpret_cast<const uint8_t*>(params.wasm().c_str());
   absl::Span<const uint8_t> wasm =
       absl::MakeConstSpan(wasm_bin, params.wasm().length());
@@ -140,6 +244,8 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
   }
   (*params.mutable_metrics())[kExecutionMetricJsEngineCallDuration] =
       std::move(js_duration).value();
+  // Don't send the snapshot of the request back.
+  params.clear_startup_snapshot();
   if (!response_or.ok()) {
     params.set_error_message(std::string(response_or.status().message()));
     privacy_sandbox::server_common::StatusBuilder builder(
@@ -158,8 +264,15 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
     (*params.mutable_metrics())[pair.first] = std::move(duration).value();
   }
 
+  params.mutable_counters()->insert(response_or.value().counters.begin(),
+                                    response_or.value().counters.end());
+
   params.set_response(std::move(response_or.value().response));
   params.set_profiler_output(std::move(response_or.value().profiler_output));
+  if (!response_or.value().startup_snapshot.empty()) {
+    params.set_startup_snapshot(
+        std::move(response_or.value().startup_snapshot));
+  }
   return WrapResultWithNoRetry(absl::OkStatus());
 }
 
@@ -187,7 +300,10 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::RunCode(
   ROMA_VLOG(1)
       << "Worker wrapper RunCodeFromSerializedData() received the request"
       << std::endl;
-  const auto result = InternalRunCode(params);
+  // The worker runs in process without a Buffer to pipeline through, so the
+  // calls sharing its slots take turns.
+  absl::MutexLock lock(&slots_mu_);
+  const auto result = InternalRunCode(params, /*slot=*/0);
 
   if (result.first != absl::OkStatus() && params.error_message().empty()) {
     return result;
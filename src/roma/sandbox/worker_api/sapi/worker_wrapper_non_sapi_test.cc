@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "src/roma/sandbox/constants/constants.h"
+#include "src/roma/sandbox/worker_api/sapi/utils.h"
+#include "src/roma/sandbox/worker_api/sapi/worker_wrapper.h"
+
+using google::scp::roma::sandbox::constants::kCodeVersion;
+using google::scp::roma::sandbox::constants::
+    kExecutionMetricJsEngineCallDuration;
+using google::scp::roma::sandbox::constants::kHandlerName;
+using google::scp::roma::sandbox::constants::kRequestAction;
+using google::scp::roma::sandbox::constants::kRequestActionExecute;
+using google::scp::roma::sandbox::constants::kRequestActionLoad;
+using google::scp::roma::sandbox::constants::kRequestType;
+using google::scp::roma::sandbox::constants::kRequestTypeJavascript;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::StrEq;
+
+namespace google::scp::roma::sandbox::worker_api::test {
+namespace {
+::worker_api::WorkerInitParamsProto GetDefaultInitParams() {
+  ::worker_api::WorkerInitParamsProto init_params;
+  init_params.set_require_code_preload_for_execution(true);
+  init_params.set_native_js_function_comms_fd(-1);
+  init_params.set_skip_v8_cleanup(true);
+  return init_params;
+}
+
+::worker_api::WorkerParamsProto BatchElement(std::string input) {
+  ::worker_api::WorkerParamsProto element;
+  (*element.mutable_metadata())[kRequestType] = kRequestTypeJavascript;
+  (*element.mutable_metadata())[kCodeVersion] = "1";
+  (*element.mutable_metadata())[kRequestAction] = kRequestActionExecute;
+  (*element.mutable_metadata())[kHandlerName] = "Handler";
+  element.mutable_input_strings()->add_inputs(std::move(input));
+  return element;
+}
+}  // namespace
+
+TEST(WorkerWrapperNonSapiTest, RunsEveryElementOfABatch) {
+  WorkerWrapper worker(
+      /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
+      /*request_and_response_data_buffer_size_bytes=*/0,
+      /*request_and_response_data_buffer_slot_count=*/1,
+      /*sandbox_data_shared_buffer_ptr=*/nullptr,
+      /*native_js_function_comms_fd=*/-1,
+      /*max_worker_virtual_memory_mb=*/0);
+  auto init_params = GetDefaultInitParams();
+  ASSERT_TRUE(worker.Init(init_params).ok());
+  ASSERT_TRUE(worker.Run().ok());
+
+  ::worker_api::WorkerParamsProto load;
+  load.set_code(R"js(function Handler(input) { return "Hi " + input; })js");
+  (*load.mutable_metadata())[kRequestType] = kRequestTypeJavascript;
+  (*load.mutable_metadata())[kCodeVersion] = "1";
+  (*load.mutable_metadata())[kRequestAction] = kRequestActionLoad;
+  ASSERT_TRUE(worker.RunCode(load).first.ok());
+
+  ::worker_api::WorkerParamsProto params;
+  (*params.mutable_metadata())[kCodeVersion] = "1";
+  (*params.mutable_metadata())[kRequestAction] = kRequestActionExecute;
+  (*params.mutable_metadata())[kHandlerName] = "Handler";
+  *params.add_batch() = BatchElement(R"("a")");
+  *params.add_batch() = BatchElement("not json");
+  *params.add_batch() = BatchElement(R"("b")");
+
+  const std::pair<absl::Status, RetryStatus> result = worker.RunCode(params);
+  ASSERT_TRUE(result.first.ok()) << result.first;
+  EXPECT_EQ(result.second, RetryStatus::kDoNotRetry);
+  EXPECT_TRUE(params.metrics().contains(kExecutionMetricJsEngineCallDuration));
+  ASSERT_EQ(params.batch_size(), 3);
+  EXPECT_THAT(params.batch(0).response(), StrEq(R"("Hi a")"));
+  EXPECT_FALSE(params.batch(0).has_error_message());
+  // A failed element only records its error.
+  EXPECT_THAT(params.batch(1).error_message(), Not(IsEmpty()));
+  EXPECT_THAT(params.batch(2).response(), StrEq(R"("Hi b")"));
+  EXPECT_FALSE(params.batch(2).has_error_message());
+
+  EXPECT_TRUE(worker.Stop().ok());
+}
+}  // namespace google::scp::roma::sandbox::worker_api::test
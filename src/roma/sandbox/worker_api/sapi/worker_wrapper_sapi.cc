@@ -18,25 +18,30 @@
 #include <unistd.h>
 
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
 #include "src/roma/config/config.h"
 #include "src/roma/logging/logging.h"
 #include "src/roma/sandbox/constants/constants.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_isolate_function_binding.h"
 #include "src/roma/sandbox/js_engine/v8_engine/v8_js_engine.h"
 #include "src/roma/sandbox/worker/worker.h"
+#include "src/roma/sandbox/worker_api/sapi/shared_buffer_layout.h"
 #include "src/roma/sandbox/worker_api/sapi/utils.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_init_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_params.pb.h"
 #include "src/roma/sandbox/worker_api/sapi/worker_wrapper-sapi.sapi.h"
 #include "src/util/duration.h"
 #include "src/util/protoutil.h"
+#include "src/util/status_macro/status_macros.h"
 
 #include "worker_wrapper.h"
 
@@ -59,29 +64,32 @@ namespace {
 constexpr std::string_view kWarmupCode = " ";
 constexpr std::string_view kWarmupRequestId = "warmup";
 constexpr std::string_view kWarmupCodeVersion = "vWarmup";
+
+absl::Status RunWorker(WorkerWrapperApi& api) {
+  const auto worker_status = api.Run();
+  if (!worker_status.ok()) {
+    return worker_status.status();
+  }
+  if (*worker_status != SapiStatusCode::kOk) {
+    return SapiStatusCodeToAbslStatus(static_cast<int>(*worker_status));
+  }
+  return absl::OkStatus();
+}
 }  // namespace
 
-absl::Status WorkerWrapper::CreateWorkerSapiSandbox() {
+void WorkerWrapper::TerminateSandbox() {
   if (worker_sapi_sandbox_) {
     worker_sapi_sandbox_->Terminate(/*attempt_graceful_exit=*/false);
     ROMA_VLOG(1) << "Successfully terminated the existing sapi sandbox";
   }
-
-  // Get the environment variable ROMA_VLOG_LEVEL value.
-  const int external_verbose_level = logging::GetVlogVerboseLevel();
-  worker_sapi_sandbox_ = std::make_unique<WorkerSapiSandbox>(
-      ROMA_CONVERT_MB_TO_BYTES(max_worker_virtual_memory_mb_),
-      external_verbose_level);
-
-  return worker_sapi_sandbox_->Init();
 }
 
 int WorkerWrapper::TransferFdAndGetRemoteFd(
-    std::unique_ptr<::sapi::v::Fd> local_fd) {
+    WorkerSapiSandbox& sandbox, std::unique_ptr<::sapi::v::Fd> local_fd) {
   // We don't want the SAPI FD object to manage the local FD or it'd close it
   // upon its deletion.
   local_fd->OwnLocalFd(false);
-  auto transferred = worker_sapi_sandbox_->TransferToSandboxee(local_fd.get());
+  auto transferred = sandbox.TransferToSandboxee(local_fd.get());
   if (!transferred.ok()) {
     return kBadFd;
   }
@@ -93,11 +101,13 @@ int WorkerWrapper::TransferFdAndGetRemoteFd(
   return local_fd->GetRemoteFd();
 }
 
-absl::Status WorkerWrapper::TransferFds() {
+absl::Status WorkerWrapper::TransferFds(
+    WorkerSapiSandbox& sandbox,
+    ::worker_api::WorkerInitParamsProto& init_params) {
   int js_hook_remote_fd = kBadFd;
   if (native_js_function_comms_fd_ != kBadFd) {
     js_hook_remote_fd = TransferFdAndGetRemoteFd(
-        std::make_unique<::sapi::v::Fd>(native_js_function_comms_fd_));
+        sandbox, std::make_unique<::sapi::v::Fd>(native_js_function_comms_fd_));
     if (js_hook_remote_fd == kBadFd) {
       return absl::InternalError(
           "Could not transfer function comms fd to sandboxee.");
@@ -110,7 +120,7 @@ absl::Status WorkerWrapper::TransferFds() {
   }
 
   int buffer_remote_fd = TransferFdAndGetRemoteFd(
-      std::make_unique<::sapi::v::Fd>(sandbox_data_shared_buffer_ptr_->fd()));
+      sandbox, std::make_unique<::sapi::v::Fd>(sandbox_data_shared_buffer_ptr_->fd()));
   if (buffer_remote_fd == kBadFd) {
     return absl::InternalError(
         "Could not transfer sandbox2::Buffer fd to sandboxee.");
@@ -119,23 +129,49 @@ absl::Status WorkerWrapper::TransferFds() {
                << " and local_fd " << sandbox_data_shared_buffer_ptr_->fd()
                << " for the buffer of the sapi sandbox";
 
-  init_params_.set_native_js_function_comms_fd(js_hook_remote_fd);
-  init_params_.set_request_and_response_data_buffer_fd(buffer_remote_fd);
+  init_params.set_native_js_function_comms_fd(js_hook_remote_fd);
+  init_params.set_request_and_response_data_buffer_fd(buffer_remote_fd);
 
   return absl::OkStatus();
 }
 
 absl::Status WorkerWrapper::Init(
     ::worker_api::WorkerInitParamsProto& init_params) {
-  PS_RETURN_IF_ERROR(CreateWorkerSapiSandbox());
+  absl::MutexLock lock(&sandbox_mu_);
+  PS_RETURN_IF_ERROR(InitSandbox(init_params));
+  if (enable_spare_sandbox_) {
+    PrepareSpareSandbox();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WorkerWrapper::InitSandbox(
+    ::worker_api::WorkerInitParamsProto& init_params) {
+  ++sandbox_generation_;
+  TerminateSandbox();
   // Save init_params for later usage in case of sandbox restart
   init_params_ = init_params;
-  PS_RETURN_IF_ERROR(TransferFds());
+  PS_ASSIGN_OR_RETURN(Sandbox sandbox, CreateSandbox(init_params_));
+  worker_wrapper_sapi_ = std::move(sandbox.api);
+  worker_sapi_sandbox_ = std::move(sandbox.sapi_sandbox);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<WorkerWrapper::Sandbox> WorkerWrapper::CreateSandbox(
+    ::worker_api::WorkerInitParamsProto init_params) {
+  Sandbox sandbox;
+  // Get the environment variable ROMA_VLOG_LEVEL value.
+  const int external_verbose_level = logging::GetVlogVerboseLevel();
+  sandbox.sapi_sandbox = std::make_unique<WorkerSapiSandbox>(
+      ROMA_CONVERT_MB_TO_BYTES(max_worker_virtual_memory_mb_),
+      external_verbose_level);
+  PS_RETURN_IF_ERROR(sandbox.sapi_sandbox->Init());
+  PS_RETURN_IF_ERROR(TransferFds(*sandbox.sapi_sandbox, init_params));
 
-  worker_wrapper_sapi_ =
-      std::make_unique<WorkerWrapperApi>(worker_sapi_sandbox_.get());
+  sandbox.api =
+      std::make_unique<WorkerWrapperApi>(sandbox.sapi_sandbox.get());
 
-  std::string serialized_data = init_params_.SerializeAsString();
+  std::string serialized_data = init_params.SerializeAsString();
   if (serialized_data.empty()) {
     LOG(ERROR) << "Failed to serialize init data.";
     return absl::InvalidArgumentError("Failed to serialize init data.");
@@ -143,21 +179,84 @@ absl::Status WorkerWrapper::Init(
   sapi::v::LenVal sapi_len_val(serialized_data.data(), serialized_data.size());
 
   const auto worker_status =
-      worker_wrapper_sapi_->InitFromSerializedData(sapi_len_val.PtrBefore());
+      sandbox.api->InitFromSerializedData(sapi_len_val.PtrBefore());
   if (!worker_status.ok()) {
     return worker_status.status();
   }
   if (*worker_status != SapiStatusCode::kOk) {
     return SapiStatusCodeToAbslStatus(static_cast<int>(*worker_status));
   }
-  return absl::OkStatus();
+  return sandbox;
+}
+
+void WorkerWrapper::PrepareSpareSandbox() {
+  if (spare_sandbox_thread_.joinable()) {
+    spare_sandbox_thread_.join();
+  }
+  {
+    absl::MutexLock lock(&spare_sandbox_mu_);
+    preparing_spare_sandbox_ = true;
+  }
+  spare_sandbox_thread_ = std::thread([this, init_params = init_params_] {
+    std::optional<Sandbox> spare;
+    if (auto sandbox = CreateSandbox(init_params); !sandbox.ok()) {
+      LOG(ERROR) << "Failed to initialize the spare sandbox: "
+                 << sandbox.status();
+    } else if (auto status = RunWorker(*sandbox->api); !status.ok()) {
+      LOG(ERROR) << "Failed to start the spare sandbox: " << status;
+    } else {
+      spare = std::move(sandbox).value();
+    }
+    absl::MutexLock lock(&spare_sandbox_mu_);
+    spare_sandbox_ = std::move(spare);
+    preparing_spare_sandbox_ = false;
+  });
+}
+
+std::optional<WorkerWrapper::Sandbox> WorkerWrapper::TakeSpareSandbox() {
+  std::optional<Sandbox> spare;
+  {
+    absl::MutexLock lock(&spare_sandbox_mu_);
+    spare_sandbox_mu_.Await(absl::Condition(
+        +[](bool* preparing) { return !*preparing; },
+        &preparing_spare_sandbox_));
+    spare.swap(spare_sandbox_);
+  }
+  if (spare_sandbox_thread_.joinable()) {
+    spare_sandbox_thread_.join();
+  }
+  return spare;
 }
 
 bool WorkerWrapper::SandboxIsInitialized() {
   return worker_wrapper_sapi_ != nullptr;
 }
 
-void WorkerWrapper::WarmUpSandbox() {
+int WorkerWrapper::SlotCount() const {
+  return request_and_response_data_buffer_slot_count_;
+}
+
+int WorkerWrapper::AcquireSlot() {
+  absl::MutexLock lock(&slots_mu_);
+  slots_mu_.Await(absl::Condition(
+      +[](std::vector<int>* free_slots) { return !free_slots->empty(); },
+      &free_slots_));
+  const int slot = free_slots_.back();
+  free_slots_.pop_back();
+  return slot;
+}
+
+void WorkerWrapper::ReleaseSlot(int slot) {
+  absl::MutexLock lock(&slots_mu_);
+  free_slots_.push_back(slot);
+}
+
+uint8_t* WorkerWrapper::SlotData(int slot) const {
+  return sandbox_data_shared_buffer_ptr_->data() +
+         slot * request_and_response_data_buffer_size_bytes_;
+}
+
+void WorkerWrapper::WarmUpSandbox(int slot) {
   using google::scp::roma::sandbox::constants::kCodeVersion;
   using google::scp::roma::sandbox::constants::kRequestAction;
   using google::scp::roma::sandbox::constants::kRequestActionLoad;
@@ -171,11 +270,11 @@ void WorkerWrapper::WarmUpSandbox() {
   (*params_proto.mutable_metadata())[kCodeVersion] = kWarmupCodeVersion;
   (*params_proto.mutable_metadata())[kRequestId] = kWarmupRequestId;
   (*params_proto.mutable_metadata())[kRequestAction] = kRequestActionLoad;
-  (void)RunCode(params_proto);
+  (void)RunCodeInSlot(params_proto, slot);
 }
 
 std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
-    ::worker_api::WorkerParamsProto& params) {
+    ::worker_api::WorkerParamsProto& params, int slot) {
   const int serialized_size = params.ByteSizeLong();
   std::unique_ptr<sapi::v::LenVal> sapi_len_val;
   std::string len_val_data;
@@ -184,8 +283,7 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
   if (serialized_size < request_and_response_data_buffer_size_bytes_) {
     ROMA_VLOG(1) << "Request data sharing with Buffer";
 
-    if (!params.SerializeToArray(sandbox_data_shared_buffer_ptr_->data(),
-                                 serialized_size)) {
+    if (!params.SerializeToArray(SlotData(slot), serialized_size)) {
       LOG(ERROR) << "Failed to serialize run_code request into buffer. The "
                     "request's ByteSizeLong is "
                  << serialized_size;
@@ -212,9 +310,13 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
   }
 
   sapi::v::IntBase<size_t> output_serialized_size_ptr;
-  auto worker_status = worker_wrapper_sapi_->RunCodeFromSerializedData(
-      sapi_len_val->PtrBoth(), input_serialized_size,
-      output_serialized_size_ptr.PtrAfter());
+  absl::StatusOr<SapiStatusCode> worker_status;
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    worker_status = worker_wrapper_sapi_->RunCodeFromSerializedData(
+        slot, sapi_len_val->PtrBoth(), input_serialized_size,
+        output_serialized_size_ptr.PtrAfter());
+  }
 
   if (!worker_status.ok()) {
     std::string err_msg = "Sandbox worker crashed during execution of request.";
@@ -229,7 +331,7 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
 
   ::worker_api::WorkerParamsProto out_params;
   if (output_serialized_size_ptr.GetValue() > 0) {
-    if (!out_params.ParseFromArray(sandbox_data_shared_buffer_ptr_->data(),
+    if (!out_params.ParseFromArray(SlotData(slot),
                                    output_serialized_size_ptr.GetValue())) {
       LOG(ERROR) << "Could not deserialize run_code response from the Buffer. "
                     "The response serialized size in Bytes is "
@@ -257,7 +359,7 @@ std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCode(
 
 std::pair<absl::Status, RetryStatus>
 WorkerWrapper::InternalRunCodeBufferShareOnly(
-    ::worker_api::WorkerParamsProto& params) {
+    ::worker_api::WorkerParamsProto& params, int slot) {
   const int serialized_size = params.ByteSizeLong();
   if (serialized_size > request_and_response_data_buffer_size_bytes_) {
     LOG(ERROR) << "Request serialized size in Bytes " << serialized_size
@@ -268,8 +370,7 @@ WorkerWrapper::InternalRunCodeBufferShareOnly(
                                      "larger than the Buffer capacity."));
   }
 
-  if (!params.SerializeToArray(sandbox_data_shared_buffer_ptr_->data(),
-                               serialized_size)) {
+  if (!params.SerializeToArray(SlotData(slot), serialized_size)) {
     LOG(ERROR) << "Failed to serialize run_code request into buffer. The "
                   "request serialized size in Bytes is "
                << serialized_size;
@@ -278,8 +379,12 @@ WorkerWrapper::InternalRunCodeBufferShareOnly(
   }
 
   sapi::v::IntBase<size_t> output_serialized_size_ptr;
-  auto worker_status = worker_wrapper_sapi_->RunCodeFromBuffer(
-      serialized_size, output_serialized_size_ptr.PtrAfter());
+  absl::StatusOr<SapiStatusCode> worker_status;
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    worker_status = worker_wrapper_sapi_->RunCodeFromBuffer(
+        slot, serialized_size, output_serialized_size_ptr.PtrAfter());
+  }
   if (!worker_status.ok()) {
     return WrapResultWithRetry(absl::InternalError(
         "Sandbox worker crashed during execution of request."));
@@ -292,7 +397,7 @@ WorkerWrapper::InternalRunCodeBufferShareOnly(
   }
 
   ::worker_api::WorkerParamsProto out_params;
-  if (!out_params.ParseFromArray(sandbox_data_shared_buffer_ptr_->data(),
+  if (!out_params.ParseFromArray(SlotData(slot),
                                  output_serialized_size_ptr.GetValue())) {
     LOG(ERROR) << "Could not deserialize run_code response from sandboxee. The "
                   "response serialized size in Bytes is "
@@ -310,24 +415,130 @@ WorkerWrapper::InternalRunCodeBufferShareOnly(
   return WrapResultWithNoRetry(absl::OkStatus());
 }
 
-absl::Status WorkerWrapper::Run() {
+std::pair<absl::Status, RetryStatus> WorkerWrapper::InternalRunCodeRawLayout(
+    ::worker_api::WorkerParamsProto& params, int slot) {
+  const absl::Span<uint8_t> buffer = absl::MakeSpan(
+      SlotData(slot), request_and_response_data_buffer_size_bytes_);
+  const absl::StatusOr<size_t> input_size =
+      WriteRequestToBuffer(params, buffer);
+  if (!input_size.ok()) {
+    if (input_size.status().code() != absl::StatusCode::kResourceExhausted) {
+      return WrapResultWithNoRetry(input_size.status());
+    }
+    if (enable_sandbox_sharing_request_response_with_buffer_only_) {
+      LOG(ERROR) << input_size.status();
+      return WrapResultWithNoRetry(
+          absl::ResourceExhaustedError("The size of request data is larger "
+                                       "than the Buffer capacity."));
+    }
+    ROMA_VLOG(1) << input_size.status()
+                 << " Data sharing with sapi::v::LenVal Bytes";
+    return InternalRunCode(params, slot);
+  }
+
+  sapi::v::LenVal sapi_len_val(nullptr, 0);
+  sapi::v::IntBase<size_t> output_size_ptr;
+  absl::StatusOr<SapiStatusCode> worker_status;
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    worker_status = worker_wrapper_sapi_->RunCodeFromRawBuffer(
+        slot, sapi_len_val.PtrBoth(), *input_size, output_size_ptr.PtrAfter());
+  }
+  if (!worker_status.ok()) {
+    return WrapResultWithRetry(absl::InternalError(
+        "Sandbox worker crashed during execution of request."));
+  } else if (*worker_status != SapiStatusCode::kOk &&
+             // If execution failed then the output may contain forwardable
+             // error message.
+             *worker_status != SapiStatusCode::kExecutionFailed) {
+    return WrapResultWithNoRetry(
+        SapiStatusCodeToAbslStatus(static_cast<int>(*worker_status)));
+  }
+
+  ::worker_api::WorkerParamsProto out_params;
+  if (output_size_ptr.GetValue() > 0) {
+    if (const absl::Status status = ReadResponseFromBuffer(
+            buffer.first(output_size_ptr.GetValue()), out_params);
+        !status.ok()) {
+      LOG(ERROR) << "Could not read run_code response from the Buffer: "
+                 << status;
+      return WrapResultWithNoRetry(
+          absl::InternalError("Failed to deserialize run_code data."));
+    }
+  } else if (!out_params.ParseFromArray(sapi_len_val.GetData(),
+                                        sapi_len_val.GetDataSize())) {
+    LOG(ERROR) << "Could not deserialize run_code response from "
+                  "sapi::v::LenVal. The sapi::v::LenVal data size in Bytes is "
+               << sapi_len_val.GetDataSize();
+    return WrapResultWithNoRetry(
+        absl::InternalError("Failed to deserialize run_code data."));
+  }
+
+  params = std::move(out_params);
+
+  if (*worker_status != SapiStatusCode::kOk) {
+    return WrapResultWithNoRetry(SapiStatusCodeToAbslStatus(
+        static_cast<int>(*worker_status), params.error_message()));
+  }
+  return WrapResultWithNoRetry(absl::OkStatus());
+}
+
+absl::Status WorkerWrapper::StartWorker() {
   if (!SandboxIsInitialized()) {
     return absl::FailedPreconditionError(
         "Attempt to call API function with an uninitialized sandbox.");
   }
+  return RunWorker(*worker_wrapper_sapi_);
+}
 
-  const auto worker_status = worker_wrapper_sapi_->Run();
-  if (!worker_status.ok()) {
-    return worker_status.status();
+absl::Status WorkerWrapper::Run() {
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    PS_RETURN_IF_ERROR(StartWorker());
   }
-  if (*worker_status != SapiStatusCode::kOk) {
-    return SapiStatusCodeToAbslStatus(static_cast<int>(*worker_status));
+  const int slot = AcquireSlot();
+  WarmUpSandbox(slot);
+  ReleaseSlot(slot);
+  return absl::OkStatus();
+}
+
+absl::Status WorkerWrapper::RestartSandbox(int slot,
+                                           uint64_t failed_generation) {
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    if (sandbox_generation_ != failed_generation) {
+      // A concurrent RunCode restarted the sandbox already.
+      return absl::OkStatus();
+    }
+    std::optional<Sandbox> spare;
+    if (enable_spare_sandbox_) {
+      spare = TakeSpareSandbox();
+    }
+    if (spare) {
+      ROMA_VLOG(1) << "Replacing the dead sandbox with the spare sandbox";
+      ++sandbox_generation_;
+      TerminateSandbox();
+      worker_wrapper_sapi_ = std::move(spare->api);
+      worker_sapi_sandbox_ = std::move(spare->sapi_sandbox);
+    } else {
+      PS_RETURN_IF_ERROR(InitSandbox(init_params_));
+      PS_RETURN_IF_ERROR(StartWorker());
+    }
+    if (enable_spare_sandbox_) {
+      PrepareSpareSandbox();
+    }
   }
-  WarmUpSandbox();
+  WarmUpSandbox(slot);
   return absl::OkStatus();
 }
 
 absl::Status WorkerWrapper::Stop() {
+  absl::MutexLock lock(&sandbox_mu_);
+  if (enable_spare_sandbox_) {
+    if (std::optional<Sandbox> spare = TakeSpareSandbox(); spare) {
+      spare->sapi_sandbox->Terminate(/*attempt_graceful_exit=*/false);
+    }
+  }
   if (!SandboxIsInitialized() ||
       (worker_sapi_sandbox_ && !worker_sapi_sandbox_->is_active())) {
     // Nothing to stop, just return
@@ -351,33 +562,44 @@ absl::Status WorkerWrapper::Stop() {
   return absl::OkStatus();
 }
 
+std::pair<absl::Status, RetryStatus> WorkerWrapper::RunCodeInSlot(
+    ::worker_api::WorkerParamsProto& params, int slot) {
+  if (enable_sandbox_sharing_request_response_with_raw_layout_) {
+    return InternalRunCodeRawLayout(params, slot);
+  } else if (enable_sandbox_sharing_request_response_with_buffer_only_) {
+    return InternalRunCodeBufferShareOnly(params, slot);
+  }
+  return InternalRunCode(params, slot);
+}
+
 std::pair<absl::Status, RetryStatus> WorkerWrapper::RunCode(
     ::worker_api::WorkerParamsProto& params) {
-  if (!SandboxIsInitialized()) {
-    return WrapResultWithNoRetry(absl::FailedPreconditionError(
-        "Attempt to call API function with an uninitialized sandbox."));
+  uint64_t generation;
+  {
+    absl::MutexLock lock(&sandbox_mu_);
+    if (!SandboxIsInitialized()) {
+      return WrapResultWithNoRetry(absl::FailedPreconditionError(
+          "Attempt to call API function with an uninitialized sandbox."));
+    }
+    generation = sandbox_generation_;
   }
 
   ROMA_VLOG(1)
       << "Worker wrapper RunCodeFromSerializedData() received the request"
       << std::endl;
-  std::pair<absl::Status, RetryStatus> run_code_result;
-  if (enable_sandbox_sharing_request_response_with_buffer_only_) {
-    run_code_result = InternalRunCodeBufferShareOnly(params);
-  } else {
-    run_code_result = InternalRunCode(params);
+  const int slot = AcquireSlot();
+  std::pair<absl::Status, RetryStatus> run_code_result =
+      RunCodeInSlot(params, slot);
+  if (!run_code_result.first.ok() &&
+      run_code_result.second == RetryStatus::kRetry) {
+    // This means that the sandbox died so we need to restart it.
+    if (auto status = RestartSandbox(slot, generation); !status.ok()) {
+      ReleaseSlot(slot);
+      return WrapResultWithNoRetry(status);
+    }
   }
-
+  ReleaseSlot(slot);
   if (!run_code_result.first.ok()) {
-    if (run_code_result.second == RetryStatus::kRetry) {
-      // This means that the sandbox died so we need to restart it.
-      if (auto status = Init(init_params_); !status.ok()) {
-        return WrapResultWithNoRetry(status);
-      }
-      if (auto status = Run(); !status.ok()) {
-        return WrapResultWithNoRetry(status);
-      }
-    }
     return run_code_result;
   }
   return WrapResultWithNoRetry(absl::OkStatus());
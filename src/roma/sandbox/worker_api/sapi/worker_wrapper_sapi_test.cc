@@ -77,7 +77,9 @@ TEST(WorkerWrapperSapiTest,
   // start. We set a limit of 100MB which causes a failure in this case.
   WorkerWrapper worker(
       /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+      /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
       /*request_and_response_data_buffer_size_bytes=*/0,
+      /*request_and_response_data_buffer_slot_count=*/1,
       /*sandbox_data_shared_buffer_ptr=*/buffer_ptr_.get(),
       /*native_js_function_comms_fd=*/-1,
       /*max_worker_virtual_memory_mb=*/100);
@@ -91,13 +93,16 @@ TEST(WorkerWrapperSapiTest,
 
 class WorkerWrapperForTests : public WorkerWrapper {
  public:
-  explicit WorkerWrapperForTests(int native_js_function_comms_fd)
+  explicit WorkerWrapperForTests(int native_js_function_comms_fd,
+                                 bool enable_spare_sandbox = false)
       : WorkerWrapper(
             /*enable_sandbox_sharing_request_response_with_buffer_only=*/false,
+            /*enable_sandbox_sharing_request_response_with_raw_layout=*/false,
             /*request_and_response_data_buffer_size_bytes=*/0,
+            /*request_and_response_data_buffer_slot_count=*/1,
             /*sandbox_data_shared_buffer_ptr=*/buffer_ptr_.get(),
             /*native_js_function_comms_fd=*/native_js_function_comms_fd,
-            /*max_worker_virtual_memory_mb=*/0) {}
+            /*max_worker_virtual_memory_mb=*/0, enable_spare_sandbox) {}
 
   ::sapi::Sandbox* GetUnderlyingSandbox() { return worker_sapi_sandbox_.get(); }
 };
@@ -145,6 +150,47 @@ TEST(WorkerWrapperSapiTest, SandboxShouldComeBackUpIfItDies) {
   EXPECT_TRUE(worker.Stop().ok());
 }
 
+TEST(WorkerWrapperSapiTest, SpareSandboxShouldReplaceTheSandboxIfItDies) {
+  auto init_params = GetDefaultInitParams();
+  WorkerWrapperForTests worker(/*native_js_function_comms_fd=*/-1,
+                               /*enable_spare_sandbox=*/true);
+
+  ASSERT_TRUE(worker.Init(init_params).ok());
+  ASSERT_TRUE(worker.Run().ok());
+
+  ::worker_api::WorkerParamsProto params_proto;
+  params_proto.set_code(R"js(function cool_func() { return "Hi"; })js");
+  (*params_proto.mutable_metadata())[kRequestType] = kRequestTypeJavascript;
+  (*params_proto.mutable_metadata())[kHandlerName] = "cool_func";
+  (*params_proto.mutable_metadata())[kCodeVersion] = "1";
+  (*params_proto.mutable_metadata())[kRequestAction] = kRequestActionExecute;
+
+  // Kill the sandbox twice, so that the second time the spare started in place
+  // of the first spare is swapped in.
+  for (int i = 0; i < 2; ++i) {
+    const int sandbox_pid = worker.GetUnderlyingSandbox()->pid();
+    EXPECT_EQ(kill(sandbox_pid, SIGKILL), 0);
+    // Wait for the sandbox to die
+    while (worker.GetUnderlyingSandbox()->is_active()) {
+    }
+    {
+      std::pair<absl::Status, RetryStatus> result_pair =
+          worker.RunCode(params_proto);
+      EXPECT_FALSE(result_pair.first.ok());
+      EXPECT_EQ(result_pair.second, RetryStatus::kRetry);
+    }
+    EXPECT_NE(worker.GetUnderlyingSandbox()->pid(), sandbox_pid);
+
+    std::pair<absl::Status, RetryStatus> result_pair =
+        worker.RunCode(params_proto);
+    ASSERT_TRUE(result_pair.first.ok());
+    EXPECT_EQ(result_pair.second, RetryStatus::kDoNotRetry);
+    EXPECT_THAT(params_proto.response(), StrEq(R"("Hi")"));
+  }
+
+  EXPECT_TRUE(worker.Stop().ok());
+}
+
 TEST(WorkerWrapperSapiTest,
      SandboxShouldComeBackUpIfItDiesAndHooksShouldContinueWorking) {
   int fds[2];
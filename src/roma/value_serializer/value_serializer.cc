@@ -0,0 +1,589 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "value_serializer.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "src/util/status_macro/status_macros.h"
+
+namespace google::scp::roma::value_serializer {
+namespace {
+// Tags of the wire format, from v8/src/objects/value-serializer.cc. Typed
+// array data is copied as is, so both ends must be little-endian.
+constexpr uint8_t kVersionTag = 0xFF;
+constexpr uint64_t kMinVersion = 13;
+// Version 14 added flags to array buffer views.
+constexpr uint64_t kViewFlagsVersion = 14;
+constexpr uint64_t kLatestVersion = 15;
+constexpr uint8_t kPadding = '\0';
+constexpr uint8_t kVerifyObjectCount = '?';
+constexpr uint8_t kTheHole = '-';
+constexpr uint8_t kUndefined = '_';
+constexpr uint8_t kNull = '0';
+constexpr uint8_t kTrue = 'T';
+constexpr uint8_t kFalse = 'F';
+constexpr uint8_t kInt32 = 'I';
+constexpr uint8_t kUint32 = 'U';
+constexpr uint8_t kDouble = 'N';
+constexpr uint8_t kUtf8String = 'S';
+constexpr uint8_t kOneByteString = '"';
+constexpr uint8_t kTwoByteString = 'c';
+constexpr uint8_t kObjectReference = '^';
+constexpr uint8_t kBeginJSObject = 'o';
+constexpr uint8_t kEndJSObject = '{';
+constexpr uint8_t kBeginSparseJSArray = 'a';
+constexpr uint8_t kEndSparseJSArray = '@';
+constexpr uint8_t kBeginDenseJSArray = 'A';
+constexpr uint8_t kEndDenseJSArray = '$';
+constexpr uint8_t kArrayBuffer = 'B';
+constexpr uint8_t kArrayBufferView = 'V';
+constexpr uint8_t kUint8ArraySubtag = 'B';
+constexpr uint8_t kFloat64ArraySubtag = 'F';
+
+// Bounds the recursion on nested input.
+constexpr int kMaxDepth = 256;
+// Bounds the memory a short sparse array can claim.
+constexpr uint64_t kMaxSparseArrayLength = 1 << 20;
+// Bounds the copies made for objects referenced more than once, as a multiple
+// of the size of the serialized value, since a chain of objects each
+// referencing the previous one twice doubles in size with every link.
+constexpr uint64_t kMaxCopyFactor = 64;
+
+template <typename... Ts>
+struct Overloaded : Ts... {
+  using Ts::operator()...;
+};
+template <typename... Ts>
+Overloaded(Ts...) -> Overloaded<Ts...>;
+
+class Writer {
+ public:
+  std::string Release() && { return std::move(out_); }
+
+  void WriteTag(uint8_t tag) { out_.push_back(static_cast<char>(tag)); }
+
+  void WriteVarint(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      if (value != 0) {
+        byte |= 0x80;
+      }
+      out_.push_back(static_cast<char>(byte));
+    } while (value != 0);
+  }
+
+  void WriteDouble(double value) {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out_.append(bytes, sizeof(bytes));
+  }
+
+  void WriteString(std::string_view str) {
+    WriteTag(kUtf8String);
+    WriteVarint(str.size());
+    out_.append(str);
+  }
+
+  void WriteArrayBuffer(const void* data, size_t size, uint8_t subtag) {
+    WriteTag(kArrayBuffer);
+    WriteVarint(size);
+    out_.append(static_cast<const char*>(data), size);
+    WriteTag(kArrayBufferView);
+    WriteTag(subtag);
+    WriteVarint(/*byte_offset=*/0);
+    WriteVarint(size);
+    WriteVarint(/*flags=*/0);
+  }
+
+  void Write(const JsValue& value) {
+    std::visit(
+        Overloaded{
+            [&](const JsValue::Undefined&) { WriteTag(kUndefined); },
+            [&](JsValue::Null) { WriteTag(kNull); },
+            [&](bool b) { WriteTag(b ? kTrue : kFalse); },
+            [&](double d) {
+              if (d >= std::numeric_limits<int32_t>::min() &&
+                  d <= std::numeric_limits<int32_t>::max() &&
+                  d == std::trunc(d) && !(d == 0 && std::signbit(d))) {
+                // Zigzag encoded.
+                const auto i = static_cast<int32_t>(d);
+                WriteTag(kInt32);
+                WriteVarint((static_cast<uint32_t>(i) << 1) ^
+                            static_cast<uint32_t>(i >> 31));
+              } else {
+                WriteTag(kDouble);
+                WriteDouble(d);
+              }
+            },
+            [&](const std::string& s) { WriteString(s); },
+            [&](const JsValue::Array& array) {
+              WriteTag(kBeginDenseJSArray);
+              WriteVarint(array.size());
+              for (const JsValue& element : array) {
+                Write(element);
+              }
+              WriteTag(kEndDenseJSArray);
+              WriteVarint(/*num_properties=*/0);
+              WriteVarint(array.size());
+            },
+            [&](const JsValue::Object& object) {
+              WriteTag(kBeginJSObject);
+              for (const auto& [key, property] : object) {
+                WriteString(key);
+                Write(property);
+              }
+              WriteTag(kEndJSObject);
+              WriteVarint(object.size());
+            },
+            [&](const JsValue::Float64Array& array) {
+              WriteArrayBuffer(array.values.data(),
+                               array.values.size() * sizeof(double),
+                               kFloat64ArraySubtag);
+            },
+            [&](const JsValue::Uint8Array& array) {
+              WriteArrayBuffer(array.bytes.data(), array.bytes.size(),
+                               kUint8ArraySubtag);
+            },
+        },
+        value.value);
+  }
+
+ private:
+  std::string out_;
+};
+
+void AppendUtf8(uint32_t code_point, std::string& out) {
+  if (code_point < 0x80) {
+    out.push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// Formats a numeric property key the way JS converts it to a string, for the
+// integers V8 writes index keys as.
+std::string NumberToKey(double number) {
+  if (number == std::trunc(number) && std::abs(number) < 1e15) {
+    return absl::StrCat(static_cast<int64_t>(number));
+  }
+  return absl::StrCat(number);
+}
+
+// The number of values in `value` plus the bytes of its strings and arrays.
+uint64_t CopySize(const JsValue& value) {
+  uint64_t size = 1;
+  std::visit(Overloaded{
+                 [&](const std::string& s) { size += s.size(); },
+                 [&](const JsValue::Array& array) {
+                   for (const JsValue& element : array) {
+                     size += CopySize(element);
+                   }
+                 },
+                 [&](const JsValue::Object& object) {
+                   for (const auto& [key, property] : object) {
+                     size += key.size() + CopySize(property);
+                   }
+                 },
+                 [&](const JsValue::Float64Array& array) {
+                   size += array.values.size() * sizeof(double);
+                 },
+                 [&](const JsValue::Uint8Array& array) {
+                   size += array.bytes.size();
+                 },
+                 [](const auto&) {},
+             },
+             value.value);
+  return size;
+}
+
+absl::Status Malformed(std::string_view reason) {
+  return absl::InvalidArgumentError(
+      absl::StrCat("Malformed serialized value: ", reason));
+}
+
+class Reader {
+ public:
+  explicit Reader(std::string_view data) : data_(data) {}
+
+  absl::StatusOr<JsValue> ReadRoot() {
+    PS_ASSIGN_OR_RETURN(std::string_view tag, ReadBytes(1));
+    if (static_cast<uint8_t>(tag[0]) != kVersionTag) {
+      return Malformed("missing header");
+    }
+    PS_ASSIGN_OR_RETURN(version_, ReadVarint());
+    if (version_ < kMinVersion || version_ > kLatestVersion) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported serialization version ", version_));
+    }
+    PS_ASSIGN_OR_RETURN(JsValue value, ReadValue(/*depth=*/0));
+    if (pos_ != data_.size()) {
+      return Malformed("trailing bytes");
+    }
+    return value;
+  }
+
+ private:
+  using Property = std::pair<JsValue, JsValue>;
+
+  absl::StatusOr<std::string_view> ReadBytes(uint64_t size) {
+    if (size > data_.size() - pos_) {
+      return Malformed("truncated");
+    }
+    std::string_view bytes = data_.substr(pos_, size);
+    pos_ += size;
+    return bytes;
+  }
+
+  absl::StatusOr<uint64_t> ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      PS_ASSIGN_OR_RETURN(std::string_view byte, ReadBytes(1));
+      const auto b = static_cast<uint8_t>(byte[0]);
+      value |= static_cast<uint64_t>(b & 0x7F) << shift;
+      if ((b & 0x80) == 0) {
+        return value;
+      }
+    }
+    return Malformed("varint too long");
+  }
+
+  absl::StatusOr<uint8_t> ReadTag() {
+    while (true) {
+      PS_ASSIGN_OR_RETURN(std::string_view byte, ReadBytes(1));
+      const auto tag = static_cast<uint8_t>(byte[0]);
+      if (tag == kPadding) {
+        continue;
+      }
+      if (tag == kVerifyObjectCount) {
+        PS_RETURN_IF_ERROR(ReadVarint().status());
+        continue;
+      }
+      return tag;
+    }
+  }
+
+  std::optional<uint8_t> PeekTag() {
+    size_t pos = pos_;
+    while (pos < data_.size() &&
+           static_cast<uint8_t>(data_[pos]) == kPadding) {
+      ++pos;
+    }
+    if (pos == data_.size()) {
+      return std::nullopt;
+    }
+    return static_cast<uint8_t>(data_[pos]);
+  }
+
+  // Reserves the id V8 assigns to the object being read, whose value is
+  // filled in by FinishObject once complete.
+  uint64_t StartObject() {
+    objects_.emplace_back();
+    return objects_.size() - 1;
+  }
+
+  JsValue FinishObject(uint64_t id, JsValue value) {
+    objects_[id] = value;
+    return value;
+  }
+
+  absl::StatusOr<JsValue> ReadValue(int depth) {
+    if (depth > kMaxDepth) {
+      return Malformed("nested too deeply");
+    }
+    PS_ASSIGN_OR_RETURN(uint8_t tag, ReadTag());
+    switch (tag) {
+      case kTheHole:
+      case kUndefined:
+        return JsValue{JsValue::Undefined{}};
+      case kNull:
+        return JsValue{nullptr};
+      case kTrue:
+        return JsValue{true};
+      case kFalse:
+        return JsValue{false};
+      case kInt32: {
+        PS_ASSIGN_OR_RETURN(uint64_t zigzag, ReadVarint());
+        const auto bits = static_cast<uint32_t>(zigzag);
+        const auto i = static_cast<int32_t>((bits >> 1) ^ -(bits & 1));
+        return JsValue{static_cast<double>(i)};
+      }
+      case kUint32: {
+        PS_ASSIGN_OR_RETURN(uint64_t u, ReadVarint());
+        return JsValue{static_cast<double>(static_cast<uint32_t>(u))};
+      }
+      case kDouble: {
+        PS_ASSIGN_OR_RETURN(std::string_view bytes, ReadBytes(sizeof(double)));
+        double d;
+        std::memcpy(&d, bytes.data(), sizeof(d));
+        return JsValue{d};
+      }
+      case kUtf8String:
+      case kOneByteString:
+      case kTwoByteString: {
+        PS_ASSIGN_OR_RETURN(std::string str, ReadString(tag));
+        return JsValue{std::move(str)};
+      }
+      case kObjectReference: {
+        PS_ASSIGN_OR_RETURN(uint64_t id, ReadVarint());
+        if (id >= objects_.size()) {
+          return Malformed("reference to an unknown object");
+        }
+        if (!objects_[id].has_value()) {
+          return absl::InvalidArgumentError(
+              "Serialized value is cyclic, which is unsupported");
+        }
+        copied_size_ += CopySize(*objects_[id]);
+        if (copied_size_ > kMaxCopyFactor * data_.size()) {
+          return absl::InvalidArgumentError(
+              "Serialized value references its objects too often to be "
+              "copied");
+        }
+        return *objects_[id];
+      }
+      case kBeginJSObject: {
+        const uint64_t id = StartObject();
+        PS_ASSIGN_OR_RETURN(std::vector<Property> properties,
+                            ReadProperties(kEndJSObject, depth));
+        PS_ASSIGN_OR_RETURN(uint64_t num_properties, ReadVarint());
+        if (num_properties != properties.size()) {
+          return Malformed("property count mismatch");
+        }
+        JsValue::Object object;
+        object.reserve(properties.size());
+        for (auto& [key, property] : properties) {
+          object.emplace_back(KeyToString(key), std::move(property));
+        }
+        return FinishObject(id, JsValue{std::move(object)});
+      }
+      case kBeginDenseJSArray: {
+        const uint64_t id = StartObject();
+        PS_ASSIGN_OR_RETURN(uint64_t length, ReadVarint());
+        // Each element takes at least one byte.
+        if (length > data_.size() - pos_) {
+          return Malformed("truncated");
+        }
+        JsValue::Array array;
+        array.reserve(length);
+        for (uint64_t i = 0; i < length; ++i) {
+          PS_ASSIGN_OR_RETURN(JsValue element, ReadValue(depth + 1));
+          array.push_back(std::move(element));
+        }
+        // Properties that are not elements have no place in a JsValue.
+        PS_ASSIGN_OR_RETURN(std::vector<Property> properties,
+                            ReadProperties(kEndDenseJSArray, depth));
+        PS_RETURN_IF_ERROR(ReadArrayEnd(properties.size(), length));
+        return FinishObject(id, JsValue{std::move(array)});
+      }
+      case kBeginSparseJSArray: {
+        const uint64_t id = StartObject();
+        PS_ASSIGN_OR_RETURN(uint64_t length, ReadVarint());
+        if (length > kMaxSparseArrayLength) {
+          return absl::InvalidArgumentError(
+              absl::StrCat("Sparse array of length ", length,
+                           " exceeds the supported maximum of ",
+                           kMaxSparseArrayLength));
+        }
+        JsValue::Array array(length);
+        PS_ASSIGN_OR_RETURN(std::vector<Property> properties,
+                            ReadProperties(kEndSparseJSArray, depth));
+        for (auto& [key, property] : properties) {
+          if (const double* index = std::get_if<double>(&key.value);
+              index != nullptr && *index >= 0 && *index < length &&
+              *index == std::trunc(*index)) {
+            array[static_cast<size_t>(*index)] = std::move(property);
+          }
+        }
+        PS_RETURN_IF_ERROR(ReadArrayEnd(properties.size(), length));
+        return FinishObject(id, JsValue{std::move(array)});
+      }
+      case kArrayBuffer:
+        return ReadArrayBuffer();
+      default:
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Serialized value has a value of unsupported type, tag '",
+            std::string(1, static_cast<char>(tag)), "'"));
+    }
+  }
+
+  absl::StatusOr<std::string> ReadString(uint8_t tag) {
+    PS_ASSIGN_OR_RETURN(uint64_t size, ReadVarint());
+    PS_ASSIGN_OR_RETURN(std::string_view bytes, ReadBytes(size));
+    if (tag == kUtf8String) {
+      return std::string(bytes);
+    }
+    std::string str;
+    if (tag == kOneByteString) {
+      // Latin-1.
+      str.reserve(bytes.size());
+      for (char c : bytes) {
+        AppendUtf8(static_cast<uint8_t>(c), str);
+      }
+      return str;
+    }
+    // UTF-16, with lone surrogates replaced.
+    if (bytes.size() % 2 != 0) {
+      return Malformed("odd two-byte string length");
+    }
+    str.reserve(bytes.size());
+    const auto unit_at = [&bytes](size_t i) {
+      return static_cast<uint32_t>(static_cast<uint8_t>(bytes[2 * i])) |
+             static_cast<uint32_t>(static_cast<uint8_t>(bytes[2 * i + 1]))
+                 << 8;
+    };
+    const size_t num_units = bytes.size() / 2;
+    for (size_t i = 0; i < num_units; ++i) {
+      uint32_t unit = unit_at(i);
+      if (unit >= 0xD800 && unit <= 0xDBFF && i + 1 < num_units &&
+          unit_at(i + 1) >= 0xDC00 && unit_at(i + 1) <= 0xDFFF) {
+        unit = 0x10000 + ((unit - 0xD800) << 10) + (unit_at(i + 1) - 0xDC00);
+        ++i;
+      } else if (unit >= 0xD800 && unit <= 0xDFFF) {
+        unit = 0xFFFD;
+      }
+      AppendUtf8(unit, str);
+    }
+    return str;
+  }
+
+  // Reads key-value pairs up to and including `end_tag`.
+  absl::StatusOr<std::vector<Property>> ReadProperties(uint8_t end_tag,
+                                                       int depth) {
+    std::vector<Property> properties;
+    while (true) {
+      const std::optional<uint8_t> tag = PeekTag();
+      if (!tag.has_value()) {
+        return Malformed("truncated");
+      }
+      if (*tag == end_tag) {
+        PS_RETURN_IF_ERROR(ReadTag().status());
+        return properties;
+      }
+      PS_ASSIGN_OR_RETURN(JsValue key, ReadValue(depth + 1));
+      if (!std::holds_alternative<std::string>(key.value) &&
+          !std::holds_alternative<double>(key.value)) {
+        return Malformed("property key is neither a string nor a number");
+      }
+      PS_ASSIGN_OR_RETURN(JsValue value, ReadValue(depth + 1));
+      properties.emplace_back(std::move(key), std::move(value));
+    }
+  }
+
+  absl::Status ReadArrayEnd(uint64_t num_properties, uint64_t length) {
+    PS_ASSIGN_OR_RETURN(uint64_t expected_num_properties, ReadVarint());
+    PS_ASSIGN_OR_RETURN(uint64_t expected_length, ReadVarint());
+    if (num_properties != expected_num_properties ||
+        length != expected_length) {
+      return Malformed("array property count or length mismatch");
+    }
+    return absl::OkStatus();
+  }
+
+  static std::string KeyToString(JsValue& key) {
+    if (std::string* str = std::get_if<std::string>(&key.value)) {
+      return std::move(*str);
+    }
+    return NumberToKey(std::get<double>(key.value));
+  }
+
+  absl::StatusOr<JsValue> ReadArrayBuffer() {
+    const uint64_t buffer_id = StartObject();
+    PS_ASSIGN_OR_RETURN(uint64_t size, ReadVarint());
+    PS_ASSIGN_OR_RETURN(std::string_view buffer, ReadBytes(size));
+    // A bare buffer reads as its bytes.
+    JsValue bytes = FinishObject(
+        buffer_id, JsValue{JsValue::Uint8Array{std::string(buffer)}});
+    if (PeekTag() != kArrayBufferView) {
+      return bytes;
+    }
+    PS_RETURN_IF_ERROR(ReadTag().status());
+    const uint64_t view_id = StartObject();
+    PS_ASSIGN_OR_RETURN(std::string_view subtag, ReadBytes(1));
+    PS_ASSIGN_OR_RETURN(uint64_t byte_offset, ReadVarint());
+    PS_ASSIGN_OR_RETURN(uint64_t byte_length, ReadVarint());
+    if (version_ >= kViewFlagsVersion) {
+      PS_RETURN_IF_ERROR(ReadVarint().status());
+    }
+    if (byte_offset > buffer.size() ||
+        byte_length > buffer.size() - byte_offset) {
+      return Malformed("array buffer view out of bounds");
+    }
+    std::string_view view = buffer.substr(byte_offset, byte_length);
+    switch (static_cast<uint8_t>(subtag[0])) {
+      case kUint8ArraySubtag:
+        return FinishObject(view_id,
+                            JsValue{JsValue::Uint8Array{std::string(view)}});
+      case kFloat64ArraySubtag: {
+        if (view.size() % sizeof(double) != 0) {
+          return Malformed("Float64Array length");
+        }
+        JsValue::Float64Array array;
+        array.values.resize(view.size() / sizeof(double));
+        std::memcpy(array.values.data(), view.data(), view.size());
+        return FinishObject(view_id, JsValue{std::move(array)});
+      }
+      default:
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Serialized value has an array buffer view of unsupported type, "
+            "subtag '",
+            subtag, "'"));
+    }
+  }
+
+  std::string_view data_;
+  size_t pos_ = 0;
+  uint64_t version_ = 0;
+  // Objects by the id V8 assigns them, empty while being read.
+  std::vector<std::optional<JsValue>> objects_;
+  // The total CopySize of the objects copied for references.
+  uint64_t copied_size_ = 0;
+};
+}  // namespace
+
+std::string SerializeValue(const JsValue& value) {
+  Writer writer;
+  writer.WriteTag(kVersionTag);
+  writer.WriteVarint(kLatestVersion);
+  writer.Write(value);
+  return std::move(writer).Release();
+}
+
+absl::StatusOr<JsValue> DeserializeValue(std::string_view data) {
+  return Reader(data).ReadRoot();
+}
+
+}  // namespace google::scp::roma::value_serializer
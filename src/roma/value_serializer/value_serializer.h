@@ -0,0 +1,84 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROMA_VALUE_SERIALIZER_VALUE_SERIALIZER_H_
+#define ROMA_VALUE_SERIALIZER_VALUE_SERIALIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+namespace google::scp::roma::value_serializer {
+
+/**
+ * @brief A JS value of one of the types that can cross between the host and
+ * the isolate in the V8 ValueSerializer wire format.
+ *
+ * Numbers are doubles, as in JS. Object properties keep their order.
+ * Float64Array and Uint8Array carry numeric data without a per-element tag.
+ */
+struct JsValue {
+  struct Undefined {
+    bool operator==(const Undefined&) const { return true; }
+  };
+  using Null = std::nullptr_t;
+  using Array = std::vector<JsValue>;
+  using Object = std::vector<std::pair<std::string, JsValue>>;
+  struct Float64Array {
+    std::vector<double> values;
+    bool operator==(const Float64Array& other) const {
+      return values == other.values;
+    }
+  };
+  struct Uint8Array {
+    std::string bytes;
+    bool operator==(const Uint8Array& other) const {
+      return bytes == other.bytes;
+    }
+  };
+
+  std::variant<Undefined, Null, bool, double, std::string, Array, Object,
+               Float64Array, Uint8Array>
+      value;
+
+  bool operator==(const JsValue& other) const { return value == other.value; }
+};
+
+/**
+ * @brief Writes `value` in the V8 ValueSerializer wire format, as read by
+ * v8::ValueDeserializer.
+ */
+std::string SerializeValue(const JsValue& value);
+
+/**
+ * @brief Reads a value written by v8::ValueSerializer.
+ *
+ * Fails with InvalidArgument if `data` is malformed, cyclic or contains a
+ * value of a type JsValue cannot hold, such as a Map or a BigInt. Objects
+ * referenced more than once are copied, and fails with InvalidArgument if the
+ * copies would be much larger than `data`.
+ */
+absl::StatusOr<JsValue> DeserializeValue(std::string_view data);
+
+}  // namespace google::scp::roma::value_serializer
+
+#endif  // ROMA_VALUE_SERIALIZER_VALUE_SERIALIZER_H_
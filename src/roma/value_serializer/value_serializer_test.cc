@@ -0,0 +1,183 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/roma/value_serializer/value_serializer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+namespace google::scp::roma::value_serializer::test {
+namespace {
+
+using ::std::string_view_literals::operator""sv;
+using ::testing::ElementsAre;
+using ::testing::SizeIs;
+
+// Written by v8::ValueSerializer for ({a: 1, b: [true, null], c: "é"}).
+constexpr std::string_view kV8Object =
+    "\xFF\x0F"
+    "o"
+    "\"\x01"
+    "a"
+    "I\x02"
+    "\"\x01"
+    "b"
+    "A\x02"
+    "T0"
+    "$\x00\x02"
+    "\"\x01"
+    "c"
+    "\"\x01\xE9"
+    "{\x03"sv;
+
+TEST(ValueSerializerTest, ReadsValueWrittenByV8) {
+  const auto value = DeserializeValue(kV8Object);
+  ASSERT_TRUE(value.ok()) << value.status();
+  EXPECT_EQ(*value, (JsValue{JsValue::Object{
+                        {"a", JsValue{1.0}},
+                        {"b", JsValue{JsValue::Array{JsValue{true},
+                                                     JsValue{nullptr}}}},
+                        {"c", JsValue{std::string("\xC3\xA9")}},
+                    }}));
+}
+
+TEST(ValueSerializerTest, WritesSmallIntegersAsInt32) {
+  EXPECT_EQ(SerializeValue(JsValue{-2.0}), "\xFF\x0FI\x03"sv);
+  EXPECT_EQ(SerializeValue(JsValue{0.5}).substr(2, 1), "N");
+  // Negative zero is not an int32.
+  EXPECT_EQ(SerializeValue(JsValue{-0.0}).substr(2, 1), "N");
+}
+
+TEST(ValueSerializerTest, RoundTripsNestedValues) {
+  const JsValue value{JsValue::Object{
+      {"undefined", JsValue{JsValue::Undefined{}}},
+      {"number", JsValue{1e100}},
+      {"string", JsValue{std::string("h\xC3\xA9llo \xF0\x9F\x98\x80")}},
+      {"nested", JsValue{JsValue::Array{
+                     JsValue{JsValue::Object{{"x", JsValue{false}}}},
+                 }}},
+      {"doubles", JsValue{JsValue::Float64Array{{1.5, -2, NAN}}}},
+      {"bytes", JsValue{JsValue::Uint8Array{std::string("\x00\x01"sv)}}},
+  }};
+  const auto read = DeserializeValue(SerializeValue(value));
+  ASSERT_TRUE(read.ok()) << read.status();
+  const auto& object = std::get<JsValue::Object>(read->value);
+  ASSERT_EQ(object.size(), 6);
+  for (int i : {0, 1, 2, 3, 5}) {
+    EXPECT_EQ(object[i], std::get<JsValue::Object>(value.value)[i]);
+  }
+  const auto& doubles =
+      std::get<JsValue::Float64Array>(object[4].second.value).values;
+  ASSERT_EQ(doubles.size(), 3);
+  EXPECT_EQ(doubles[0], 1.5);
+  EXPECT_EQ(doubles[1], -2);
+  EXPECT_TRUE(std::isnan(doubles[2]));
+}
+
+TEST(ValueSerializerTest, ReadsTwoByteStringsAndSparseArrays) {
+  // "€" as UTF-16, preceded by padding, then a sparse array of length 3 with
+  // only index 1 set.
+  constexpr std::string_view kData =
+      "\xFF\x0F"
+      "A\x02"
+      "\x00"
+      "c\x02\xAC\x20"
+      "a\x03"
+      "I\x02"
+      "I\x0E"
+      "@\x01\x03"
+      "$\x00\x02"sv;
+  const auto value = DeserializeValue(kData);
+  ASSERT_TRUE(value.ok()) << value.status();
+  const auto& array = std::get<JsValue::Array>(value->value);
+  ASSERT_EQ(array.size(), 2);
+  EXPECT_EQ(array[0], JsValue{std::string("\xE2\x82\xAC")});
+  EXPECT_THAT(std::get<JsValue::Array>(array[1].value),
+              ElementsAre(JsValue{JsValue::Undefined{}}, JsValue{7.0},
+                          JsValue{JsValue::Undefined{}}));
+}
+
+TEST(ValueSerializerTest, CopiesObjectsReferencedTwice) {
+  // [o, o] where o = {}.
+  constexpr std::string_view kData =
+      "\xFF\x0F"
+      "A\x02"
+      "o{\x00"
+      "^\x01"
+      "$\x00\x02"sv;
+  const auto value = DeserializeValue(kData);
+  ASSERT_TRUE(value.ok()) << value.status();
+  EXPECT_THAT(std::get<JsValue::Array>(value->value),
+              ElementsAre(JsValue{JsValue::Object{}},
+                          JsValue{JsValue::Object{}}));
+}
+
+// a_0 = []; a_n = [a_(n-1), a_(n-1)], with the outermost array written first,
+// so that a_n has the id `depth - n`.
+std::string DoublingChain(int depth, int id = 0) {
+  if (depth == 0) {
+    return std::string("A\x00$\x00\x00"sv);
+  }
+  std::string chain = "A\x02";
+  chain += DoublingChain(depth - 1, id + 1);
+  chain += '^';
+  chain += static_cast<char>(id + 1);
+  chain += "$\x00\x02"sv;
+  return chain;
+}
+
+TEST(ValueSerializerTest, RejectsReferencesCopiedIntoHugeValues) {
+  const auto small =
+      DeserializeValue(absl::StrCat("\xFF\x0F", DoublingChain(3)));
+  ASSERT_TRUE(small.ok()) << small.status();
+  EXPECT_THAT(std::get<JsValue::Array>(small->value), SizeIs(2));
+  // Would copy 2^40 arrays.
+  EXPECT_EQ(DeserializeValue(absl::StrCat("\xFF\x0F", DoublingChain(40)))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ValueSerializerTest, RejectsCyclicAndMalformedValues) {
+  // o = {}; o.self = o.
+  constexpr std::string_view kCyclic =
+      "\xFF\x0F"
+      "o"
+      "\"\x04self"
+      "^\x00"
+      "{\x01"sv;
+  EXPECT_EQ(DeserializeValue(kCyclic).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  // A Map.
+  EXPECT_EQ(DeserializeValue("\xFF\x0F;:\x00").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  // Truncated.
+  EXPECT_EQ(DeserializeValue("\xFF\x0F\"\x05" "ab").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  // Not serialized by V8.
+  EXPECT_EQ(DeserializeValue("{}").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace google::scp::roma::value_serializer::test
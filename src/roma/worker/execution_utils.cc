@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "absl/base/nullability.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_split.h"
 #include "src/roma/config/type_converter.h"
@@ -382,32 +383,37 @@ v8::Local<v8::Array> ExecutionUtils::ParseAsJsInput(
   auto isolate = v8::Isolate::GetCurrent();
   auto context = isolate->GetCurrentContext();
 
-  const int argc = input.size();
-
-  v8::Local<v8::Array> argv = v8::Array::New(isolate, argc);
-  for (auto i = 0; i < argc; ++i) {
-    v8::Local<v8::String> arg_str =
-        v8::String::NewFromUtf8(isolate, input[i].data(),
-                                v8::NewStringType::kNormal, input[i].size())
-            .ToLocalChecked();
+  std::vector<v8::Local<v8::Value>> argv(input.size());
+  if (!ParseAsJsArgs(isolate, context, input, is_byte_str,
+                     absl::MakeSpan(argv))) {
+    return v8::Local<v8::Array>();
+  }
+  return v8::Array::New(isolate, argv.data(), argv.size());
+}
 
+bool ExecutionUtils::ParseAsJsArgs(absl::Nonnull<v8::Isolate*> isolate,
+                                   v8::Local<v8::Context> context,
+                                   const std::vector<std::string_view>& input,
+                                   bool is_byte_str,
+                                   absl::Span<v8::Local<v8::Value>> argv) {
+  for (size_t i = 0; i < input.size(); ++i) {
+    v8::Local<v8::String> arg_str;
+    if (!v8::String::NewFromUtf8(isolate, input[i].data(),
+                                 v8::NewStringType::kNormal, input[i].size())
+             .ToLocal(&arg_str)) {
+      return false;
+    }
     if (is_byte_str) {
-      if (!argv->Set(context, i, arg_str).ToChecked()) {
-        return v8::Local<v8::Array>();
-      }
-    } else {
-      v8::Local<v8::Value> arg = v8::Undefined(isolate);
-      if (arg_str->Length() > 0 &&
-          !v8::JSON::Parse(context, arg_str).ToLocal(&arg)) {
-        return v8::Local<v8::Array>();
-      }
-      if (!argv->Set(context, i, arg).ToChecked()) {
-        return v8::Local<v8::Array>();
-      }
+      argv[i] = arg_str;
+      continue;
+    }
+    argv[i] = v8::Undefined(isolate);
+    if (arg_str->Length() > 0 &&
+        !v8::JSON::Parse(context, arg_str).ToLocal(&argv[i])) {
+      return false;
     }
   }
-
-  return argv;
+  return true;
 }
 
 v8::Local<v8::Array> ExecutionUtils::ParseAsWasmInput(
@@ -646,7 +652,8 @@ v8::Local<v8::Value> ExecutionUtils::ReadFromWasmMemory(
 }
 
 absl::Status ExecutionUtils::V8PromiseHandler(
-    absl::Nonnull<v8::Isolate*> isolate, v8::Local<v8::Value>& result) {
+    absl::Nonnull<v8::Isolate*> isolate, v8::Local<v8::Value>& result,
+    absl::AnyInvocable<absl::Status()> complete_pending_call) {
   // We don't need a callback handler for now. The default handler will wrap
   // the successful result of Promise::kFulfilled and the exception message of
   // Promise::kRejected.
@@ -655,6 +662,10 @@ absl::Status ExecutionUtils::V8PromiseHandler(
   // Wait until promise state isn't pending.
   while (promise->State() == v8::Promise::kPending) {
     isolate->PerformMicrotaskCheckpoint();
+    if (complete_pending_call != nullptr &&
+        promise->State() == v8::Promise::kPending) {
+      PS_RETURN_IF_ERROR(complete_pending_call());
+    }
   }
 
   if (promise->State() == v8::Promise::kRejected) {
@@ -25,7 +25,9 @@
 #include <vector>
 
 #include "absl/base/nullability.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "include/v8.h"
 #include "src/roma/interface/roma.h"
 
@@ -121,6 +123,24 @@ class ExecutionUtils {
   static v8::Local<v8::Array> ParseAsJsInput(
       const std::vector<std::string_view>& input, bool is_byte_str = false);
 
+  /**
+   * @brief Parse each input straight into the handler argument at the same
+   * position, without building an intermediate array.
+   *
+   * @param isolate
+   * @param context
+   * @param input
+   * @param is_byte_str Whether the input strings should be processed as byte
+   * strings.
+   * @param argv The arguments, of the same length as `input`.
+   * @return true on success or false if an input could not be parsed.
+   */
+  static bool ParseAsJsArgs(absl::Nonnull<v8::Isolate*> isolate,
+                            v8::Local<v8::Context> context,
+                            const std::vector<std::string_view>& input,
+                            bool is_byte_str,
+                            absl::Span<v8::Local<v8::Value>> argv);
+
   /**
    * @brief Parse the handler input to be provided to a WASM handler.
    * This function handles writing to the WASM memory if necessary.
@@ -188,8 +208,17 @@ class ExecutionUtils {
   static v8::Local<v8::Value> GetWasmMemoryObject(
       absl::Nonnull<v8::Isolate*> isolate, v8::Local<v8::Context>& context);
 
-  static absl::Status V8PromiseHandler(absl::Nonnull<v8::Isolate*> isolate,
-                                       v8::Local<v8::Value>& result);
+  /**
+   * @brief Wait for the promise in result to settle and replace it with its
+   * value.
+   *
+   * @param complete_pending_call If set, called whenever running the
+   * microtasks did not settle the promise, to block until an outstanding
+   * asynchronous native function call completes.
+   */
+  static absl::Status V8PromiseHandler(
+      absl::Nonnull<v8::Isolate*> isolate, v8::Local<v8::Value>& result,
+      absl::AnyInvocable<absl::Status()> complete_pending_call = nullptr);
 
   static absl::Status OverrideConsoleLog(v8::Isolate* isolate,
                                          bool logging_function_set);